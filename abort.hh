@@ -97,7 +97,7 @@ static inline void __print_values(const float a, const float b)
     do {                                                                \
         if (__builtin_expect(!(cond), 0)) {                             \
             Log_Debug(__FILE__ ":" __stringify(__LINE__) ": "           \
-                    "AbortIfNot(" #cond ")\n");                         \
+                    "AbortIfNot(%s)\n", #cond);                         \
             return __VA_ARGS__;                                         \
         }                                                               \
     } while(0);
@@ -114,7 +114,7 @@ static inline void __print_values(const float a, const float b)
     do {                                                                \
         if (__builtin_expect(!!(cond), 0)) {                            \
             Log_Debug(__FILE__ ":" __stringify(__LINE__) ": "           \
-                    "AbortIf(" #cond ")\n");                            \
+                    "AbortIf(%s)\n", #cond);                            \
             return __VA_ARGS__;                                         \
         }                                                               \
     } while(0);
@@ -132,7 +132,7 @@ static inline void __print_values(const float a, const float b)
     do {                                                                \
         if (!__builtin_expect((a) == (b), 1)) {                         \
             Log_Debug(__FILE__ ":" __stringify(__LINE__) ": "           \
-                    "AbortIfNeq(" #a ", " #b " (values: ");             \
+                    "AbortIfNeq(%s, %s (values: ", #a, #b);             \
             __print_values(a, b);                                       \
             Log_Debug("))\n");                                          \
             return __VA_ARGS__;                                         \
@@ -152,7 +152,7 @@ static inline void __print_values(const float a, const float b)
     do {                                                                \
         if (__builtin_expect((cond) < 0, 0)) {                          \
             Log_Debug(__FILE__ ":" __stringify(__LINE__) ": "           \
-                    "AbortErrno(" #cond "): %m\n");                     \
+                    "AbortErrno(%s): %m\n", #cond);                     \
             return __VA_ARGS__;                                         \
         }                                                               \
     } while(0);
@@ -170,7 +170,7 @@ static inline void __print_values(const float a, const float b)
     do {                                                                \
         if (__builtin_expect((ptr) == nullptr, 0)) {                    \
             Log_Debug(__FILE__ ":" __stringify(__LINE__) ": "           \
-                    "AbortErrno(" #ptr "): %m\n");                      \
+                    "AbortErrno(%s): %m\n", #ptr);                      \
             return __VA_ARGS__;                                         \
         }                                                               \
     } while(0);
@@ -184,7 +184,7 @@ static inline void __print_values(const float a, const float b)
     do {                                                                \
         if (__builtin_expect(!(cond), 0)) {                             \
             Log_Debug(__FILE__ ":" __stringify(__LINE__) ": "           \
-                    "Assert(" #cond ")\n");                             \
+                    "Assert(%s)\n", #cond);                             \
             exit(EXIT_FAILURE);                                         \
         }                                                               \
     } while(0);
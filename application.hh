@@ -10,11 +10,26 @@
 #include <signal.h>
 #include <stdint.h>
 #include <stdio.h>
+#include <string.h>
+#include <time.h>
 #include <unistd.h>
 
 #include <sphereplusplus/abort.hh>
+#include <sphereplusplus/checkpoint.hh>
+#include <sphereplusplus/clock.hh>
+#include <sphereplusplus/dispatch.hh>
 #include <sphereplusplus/enums.hh>
+#include <sphereplusplus/health.hh>
+#include <sphereplusplus/metrics.hh>
+#include <sphereplusplus/power.hh>
+#include <sphereplusplus/record.hh>
+#include <sphereplusplus/signal.hh>
+#include <sphereplusplus/stall.hh>
+#include <sphereplusplus/std.hh>
 #include <sphereplusplus/timer.hh>
+#include <sphereplusplus/tracer.hh>
+#include <sphereplusplus/update.hh>
+#include <sphereplusplus/watchdog.hh>
 
 #include <applibs/eventloop.h>
 #include <applibs/networking.h>
@@ -26,6 +41,8 @@
 #include <azureiot/iothub_client_options.h>
 #include <azureiot/iothub_device_client_ll.h>
 
+#include "internal.hh"
+
 namespace SpherePlusPlus {
 
 /**
@@ -33,6 +50,11 @@ namespace SpherePlusPlus {
  */
 enum class ApplicationFeatures : uint8_t
 {
+    /**
+     * No features.
+     */
+    None = 0x00,
+
     /**
      * Enable notifications for updates.
      * @note Requires the "SystemEventNotifications" application capability and
@@ -65,14 +87,68 @@ enum class ApplicationFeatures : uint8_t
      * Enable periodic keepalive to Azure IoT Central.
      */
     Keepalive = 0x10,
+
+    /**
+     * Enable the checkpoint of the application state (see checkpoint.hh).
+     * @note Requires the "MutableStorage" application capability.
+     */
+    Checkpoint = 0x20,
+
+    /**
+     * All the features.
+     */
+    All = 0x3f,
 };
 ENABLE_BITMASK_OPERATORS(ApplicationFeatures);
 
 /**
- * @brief Base application class, abstracting the event loop and basic
- *        functionality.
+ * @brief Phases of the startup of the application.
+ */
+enum class StartupPhase : uint8_t
+{
+    /**
+     * The creation of the event loop.
+     */
+    EventLoop,
+
+    /**
+     * The registration for update notifications.
+     */
+    UpdateNotification,
+
+    /**
+     * The enabling of the time synchronization.
+     */
+    TimeSync,
+
+    /**
+     * The initialization of the watchdog.
+     */
+    Watchdog,
+
+    /**
+     * The initialization of the connection to Azure IoT Central.
+     */
+    IoTCentral,
+
+    /**
+     * The loading of the checkpoint.
+     */
+    Checkpoint,
+
+    /**
+     * The first iteration of the event loop, processing the events pending
+     * when the application starts running.
+     */
+    FirstIteration,
+};
+
+/**
+ * @brief Base application class, abstracting the event loop and the
+ *        functionality that does not depend on the application features.
+ * @see BasicApplication
  */
-class Application
+class ApplicationBase
 {
 public:
     /**
@@ -98,496 +174,2296 @@ public:
     static constexpr uint32_t k_defaultKeepalivePeriod = 30;
 
     /**
-     * @brief Constructor.
+     * The period of the Azure IoT client processing while it has work, that is
+     * while connecting or while telemetry is not yet confirmed, and while it
+     * is idle, in milliseconds.
+     * @{
+     */
+    static constexpr uint32_t k_iotPumpPeriod = 100;
+    static constexpr uint32_t k_iotIdlePumpPeriod = 1000;
+    /**
+     * @}
      */
-    Application() :
-        m_eventLoop(nullptr),
-        m_running(false),
-        m_sysevent(nullptr),
-        m_iotConnectTimer(),
-        m_iotHandle(nullptr),
-        m_iotConnected(false),
-        m_iotScopeId(),
-        m_iotRetryInterval(k_initialIotRetryInterval),
-        m_iotMaxRetryInterval(k_defaultIotMaxRetryInterval),
-        m_useIot(false),
-        m_keepalivePeriod(k_defaultKeepalivePeriod),
-        m_useKeepalive(false),
-        m_watchdogPeriod(k_defaultWatchdogPeriod),
-        m_useWatchdog(false),
-        m_oldTermAction(),
-        m_oldAlrmAction()
-    {
-    }
 
     /**
-     * @brief Destructor.
+     * The period of the Azure IoT Central processing while flushing the
+     * application, in milliseconds.
      */
-    virtual ~Application()
-    {
-        destroy();
-    }
+    static constexpr uint32_t k_flushPumpPeriod = 10;
 
     /**
-     * @brief Initialize the application.
-     * @param[in] features A bitmask of features to enable.
-     * @return True on success.
+     * The maximum size of the telemetry messages built by the application, in
+     * bytes.
      */
-    virtual bool init(const ApplicationFeatures &features)
-    {
-        AbortIf(g_application, false);
-        AbortIf(m_eventLoop, false);
+    static constexpr size_t k_maxTelemetrySize = 1024;
 
-        m_eventLoop = EventLoop_Create();
-        AbortIfNot(m_eventLoop, false);
+    /**
+     * The default time allowed to flush the application before shutting down,
+     * in milliseconds. It must stay within the grace period given by the
+     * system after the termination signal.
+     */
+    static constexpr uint32_t k_defaultShutdownDeadline = 2000;
 
-        g_application = this;
+    /**
+     * The maximum size of the checkpoint of the application state, in bytes.
+     * The mutable storage holds two slots of this size.
+     */
+    static constexpr size_t k_maxCheckpointSize = 1024;
 
-        /*
-         * Register a handler for the termination signal.
+    /**
+     * The default period of the checkpoint of the application state, in
+     * seconds.
+     */
+    static constexpr uint32_t k_defaultCheckpointPeriod = 3600;
+
+    /**
+     * The number of phases of the startup.
+     */
+    static constexpr uint8_t k_startupPhases =
+        static_cast<uint8_t>(StartupPhase::FirstIteration) + 1;
+
+    /**
+     * @brief Time of a phase of the startup.
+     */
+    struct StartupPhaseTime
+    {
+        /**
+         * The start of the phase, on the monotonic clock, in nanoseconds, or 0
+         * when the phase did not run.
          */
-        struct sigaction term_action = {};
-        term_action.sa_handler = signalHandler;
-        AbortErrno(sigaction(SIGTERM, &term_action, &m_oldTermAction), false);
+        uint64_t start_ns;
 
-        /*
-         * Initialize the requested features.
+        /**
+         * The end of the phase, on the monotonic clock, in nanoseconds.
          */
+        uint64_t end_ns;
+    };
 
-        if (isSet(features, ApplicationFeatures::UpdateNotification)) {
-            m_sysevent = SysEvent_RegisterForEventNotifications(
-                m_eventLoop, SysEvent_Events_UpdateReadyForInstall,
-                syseventCallback, this);
-            AbortErrnoPtr(m_sysevent, false);
-        }
+    /*
+     * The application registers itself with the system, and cannot be copied.
+     */
+    ApplicationBase(const ApplicationBase &other) = delete;
+    ApplicationBase &operator =(const ApplicationBase &other) = delete;
 
-        if (isSet(features, ApplicationFeatures::TimeSync)) {
-            AbortErrno(Networking_TimeSync_SetEnabled(true), false);
-        }
+    /**
+     * @brief Destructor.
+     */
+    virtual ~ApplicationBase()
+    {
+    }
 
-        m_useWatchdog = isSet(features, ApplicationFeatures::Watchdog);
-        if (m_useWatchdog) {
-            struct sigaction alrm_action = {};
-            alrm_action.sa_handler = signalHandler;
-            AbortErrno(sigaction(SIGALRM, &alrm_action, &m_oldAlrmAction),
-                       false);
+    /**
+     * @brief Run the application's event loop.
+     * @return True on success.
+     * @note When stop() was invoked since the application was initialized or
+     *       since the last return from run(), returns immediately.
+     */
+    virtual bool run()
+    {
+        AbortIfNot(m_eventLoop, false);
 
-            AbortIfNot(petWatchdog(), false);
+        if (__atomic_load_n(&m_running, __ATOMIC_RELAXED) &&
+            !m_startup[static_cast<uint8_t>(StartupPhase::FirstIteration)]
+                .end_ns) {
+            AbortIfNot(runFirstIteration(), false);
         }
 
-        m_useIot = isSet(features, ApplicationFeatures::IoTCentral);
-        m_useKeepalive = isSet(features, ApplicationFeatures::Keepalive);
-        if (m_useIot) {
-            AbortIfNot(m_iotConnectTimer.init(), false);
+        while (__atomic_load_n(&m_running, __ATOMIC_RELAXED)) {
+            Tracer::begin(DispatchKind::Loop, nullptr, m_eventLoop);
 
-            m_iotConnectTimer.connect<
-                Application, &Application::retryConnectIot>(*this);
+            /*
+             * Process one event per iteration. On a virtual clock, jump to the
+             * next deadline whenever no other event is pending, and only wait
+             * for events once no timer is armed.
+             */
+            VirtualClock *const clock = VirtualClock::current();
+            EventLoop_Run_Result status = EventLoop_Run(
+                m_eventLoop, clock || m_powerScheduler ? 0 : -1, true);
+            if (status == EventLoop_Run_FinishedEmpty) {
+                /*
+                 * With a power scheduler, consider suspending the system
+                 * before waiting.
+                 */
+                if (m_powerScheduler) {
+                    AbortIfNot(suspendIfIdle(), false);
+                }
 
-            AbortIfNot(tryConnectIot(), false);
+                if (clock ? !clock->advance() : m_powerScheduler != nullptr) {
+                    status = EventLoop_Run(m_eventLoop, -1, true);
+                }
+            }
+
+            if (status == EventLoop_Run_Failed && errno != EINTR) {
+                AbortErrno(-1, false);
+            }
+
+            Tracer::end(DispatchKind::Loop, nullptr, m_eventLoop);
+            StallDetector::iterate();
         }
 
+        /*
+         * Rearm for the next run.
+         */
+        __atomic_store_n(&m_running, true, __ATOMIC_RELAXED);
+
         return true;
     }
 
     /**
-     * @brief Initialize the application.
-     * @param[in] features A bitmask of features to enable.
-     * @param[in] watchdog_period_s The watchdog period, in seconds.
+     * @brief Stop the application's event loop, returning from run().
      * @return True on success.
+     * @note On the host build, may be invoked from another thread.
      */
-    virtual bool init(const ApplicationFeatures &features,
-                      const uint32_t watchdog_period_s)
+    virtual bool stop()
     {
-        AbortIf(m_eventLoop, false);
-
-        AbortIfNot(watchdog_period_s > 0, false);
-
-        m_watchdogPeriod = watchdog_period_s;
+        AbortIfNot(m_eventLoop, false);
 
-        AbortIfNot(init(features), false);
+        __atomic_store_n(&m_running, false, __ATOMIC_RELAXED);
+        AbortErrno(EventLoop_Stop(m_eventLoop), false);
 
         return true;
     }
 
     /**
-     * @brief Initialize the application.
-     * @param[in] features A bitmask of features to enable.
-     * @param[in] azscope The Azure IoT Central scope ID.
+     * @brief Destroy the application.
      * @return True on success.
      */
-    virtual bool init(const ApplicationFeatures &features,
-                      const char *const azscope)
-    {
-        AbortIf(m_eventLoop, false);
-
-        AbortIfNot(azscope, false);
-
-        snprintf(m_iotScopeId, sizeof(m_iotScopeId), "%s", azscope);
-
-        AbortIfNot(init(features), false);
+    virtual bool destroy() = 0;
 
-        return true;
+    /**
+     * @brief Callback for notifications of a pending application update.
+     * @param[in] max_deferral_m The maximum value that the callback can pass to
+     *            blockUpdate()
+     * @return True on success.
+     * @note By default, the update policy decides when to install the update,
+     *       or the update is installed right away without a policy.
+     */
+    virtual bool notifyAppUpdatePending(const uint32_t max_deferral_m)
+    {
+        return !m_updatePolicy || m_updatePolicy->pending(max_deferral_m);
     }
 
     /**
-     * @brief Initialize the application.
-     * @param[in] features A bitmask of features to enable.
-     * @param[in] azscope The Azure IoT Central scope ID.
-     * @param[in] keepalive_period_s The Azure IoT keepalive period, in seconds.
+     * @brief Callback for notifications of a pending system update.
+     * @param[in] max_deferral_m The maximum value that the callback can pass to
+     *            blockUpdate()
      * @return True on success.
+     * @note By default, the update policy decides when to install the update,
+     *       or the update is installed right away without a policy.
      */
-    virtual bool init(const ApplicationFeatures &features,
-                      const char *const azscope,
-                      const uint32_t keepalive_period_s)
+    virtual bool notifySystemUpdatePending(const uint32_t max_deferral_m)
     {
-        AbortIf(m_eventLoop, false);
-
-        AbortIfNot(azscope, false);
-        AbortIfNot(keepalive_period_s > 0, false);
-
-        snprintf(m_iotScopeId, sizeof(m_iotScopeId), "%s", azscope);
-        m_keepalivePeriod = keepalive_period_s;
-
-        AbortIfNot(init(features), false);
-
-        return true;
+        return !m_updatePolicy || m_updatePolicy->pending(max_deferral_m);
     }
 
     /**
-     * @brief Initialize the application.
-     * @param[in] features A bitmask of features to enable.
-     * @param[in] watchdog_period_s The watchdog period, in seconds.
-     * @param[in] azscope The Azure IoT Central scope ID.
+     * @brief Set the policy deciding when to install the pending updates.
+     * @param[in] policy The policy, which must remain valid, or nullptr to
+     *            install the updates right away.
      * @return True on success.
+     * @note Requires the UpdateNotification feature to be notified of the
+     *       updates.
      */
-    virtual bool init(const ApplicationFeatures &features,
-                      const uint32_t watchdog_period_s,
-                      const char *const azscope)
+    virtual bool setUpdatePolicy(UpdatePolicy *const policy) final
     {
-        AbortIf(m_eventLoop, false);
-
-        AbortIfNot(watchdog_period_s > 0, false);
-        AbortIfNot(azscope, false);
-
-        m_watchdogPeriod = watchdog_period_s;
-        snprintf(m_iotScopeId, sizeof(m_iotScopeId), "%s", azscope);
-
-        AbortIfNot(init(features), false);
+        m_updatePolicy = policy;
 
         return true;
     }
 
     /**
-     * @brief Initialize the application.
-     * @param[in] features A bitmask of features to enable.
-     * @param[in] watchdog_period_s The watchdog period, in seconds.
-     * @param[in] azscope The Azure IoT Central scope ID.
-     * @param[in] keepalive_period_s The Azure IoT keepalive period, in seconds.
+     * @brief Set the scheduler suspending the system while the application is
+     *        idle.
+     * @param[in] scheduler The scheduler, which must remain valid, or nullptr
+     *            to keep the system awake.
      * @return True on success.
+     * @note The event loop then checks for pending events before waiting, at
+     *       the cost of one system call per event.
      */
-    virtual bool init(const ApplicationFeatures &features,
-                      const uint32_t watchdog_period_s,
-                      const char *const azscope,
-                      const uint32_t keepalive_period_s)
+    virtual bool setPowerScheduler(PowerScheduler *const scheduler) final
     {
-        AbortIf(m_eventLoop, false);
-
-        AbortIfNot(watchdog_period_s > 0, false);
-        AbortIfNot(azscope, false);
-        AbortIfNot(keepalive_period_s > 0, false);
-
-        m_watchdogPeriod = watchdog_period_s;
-        snprintf(m_iotScopeId, sizeof(m_iotScopeId), "%s", azscope);
-        m_keepalivePeriod = keepalive_period_s;
-
-        AbortIfNot(init(features), false);
+        m_powerScheduler = scheduler;
 
         return true;
     }
 
     /**
-     * @brief Run the application's event loop.
+     * @brief Set the governor switching the system power profile with the
+     *        load of the application.
+     * @param[in] governor The governor, which must remain valid, or nullptr.
+     *            The operations pending in the application, such as the
+     *            telemetry messages not yet confirmed, count as work queued.
      * @return True on success.
      */
-    virtual bool run()
+    virtual bool setPowerGovernor(PowerGovernor *const governor) final
     {
-        AbortIfNot(m_eventLoop, false);
-
-        m_running = true;
-        while (m_running) {
-            const EventLoop_Run_Result status =
-                EventLoop_Run(m_eventLoop, -1, false);
+        if (m_powerGovernor) {
+            m_powerGovernor->disconnectPending();
+        }
 
-            if (status == EventLoop_Run_Failed && errno != EINTR) {
-                AbortErrno(-1, false);
-            }
+        m_powerGovernor = governor;
+        if (m_powerGovernor) {
+            m_powerGovernor->connectPending<
+                ApplicationBase, &ApplicationBase::pendingOperations>(*this);
         }
 
         return true;
     }
 
     /**
-     * @brief Destroy the application.
+     * @brief Callback for notifications of a completed application update.
      * @return True on success.
      */
-    virtual bool destroy()
+    virtual bool notifyAppUpdateCompleted()
     {
-        AbortIfNot(m_eventLoop, false);
-
-        m_running = false;
-        AbortErrno(EventLoop_Stop(m_eventLoop), false);
-
-        if (m_useIot) {
-            AbortIfNot(m_iotConnectTimer.stop(), false);
-
-            if (m_iotConnected) {
-                IoTHubDeviceClient_LL_Destroy(m_iotHandle);
-                m_iotHandle = nullptr;
-            }
-        }
-
-        if (m_useWatchdog) {
-            alarm(0);
-            AbortErrno(sigaction(SIGALRM, &m_oldAlrmAction, nullptr), false);
-        }
-
-        if (m_sysevent) {
-            AbortErrno(SysEvent_UnregisterForEventNotifications(m_sysevent),
-                       false);
-            m_sysevent = nullptr;
-        }
-
-        EventLoop_Close(m_eventLoop);
-        m_eventLoop = nullptr;
-
-        AbortErrno(sigaction(SIGTERM, &m_oldTermAction, nullptr), false);
-
-        g_application = nullptr;
+        AbortIfNot(flush(), false);
+        AbortIfNot(systemReboot(), false);
 
         return true;
     }
 
     /**
-     * @brief Callback for notifications of a pending application update.
-     * @param[in] max_deferral_m The maximum value that the callback can pass to
-     *            blockUpdate()
+     * @brief Callback to persist the state of the application, before the
+     *        application shuts down or the system reboots.
+     * @param[in] deadline_ms The time left to persist the state, in
+     *            milliseconds.
      * @return True on success.
+     * @see flush
      */
-    virtual bool notifyAppUpdatePending(const uint32_t max_deferral_m)
+    virtual bool persistState(const uint32_t deadline_ms)
     {
         return true;
     }
 
     /**
-     * @brief Callback for notifications of a pending system update.
-     * @param[in] max_deferral_m The maximum value that the callback can pass to
-     *            blockUpdate()
+     * @brief Flush the application before shutting down: persist its state,
+     *        and send the outbound messages still queued. Invoked upon the
+     *        termination signal and before rebooting for an application
+     *        update.
      * @return True on success.
+     * @note The flush takes at most the shutdown deadline, and the messages
+     *       that could not be sent by then are reported as dropped.
+     * @see setShutdownDeadline
      */
-    virtual bool notifySystemUpdatePending(const uint32_t max_deferral_m)
+    virtual bool flush() final
     {
-        return true;
+        return flush(true);
     }
 
     /**
-     * @brief Callback for notifications of a completed application update.
+     * @brief Change the time allowed to flush the application before shutting
+     *        down.
+     * @param[in] deadline_ms The time allowed, in milliseconds.
      * @return True on success.
+     * @see flush
      */
-    virtual bool notifyAppUpdateCompleted()
+    virtual bool setShutdownDeadline(const uint32_t deadline_ms) final
     {
-        AbortIfNot(systemReboot(), false);
+        m_shutdownDeadline = deadline_ms;
 
         return true;
     }
 
     /**
-     * @brief Block system and application updates.
-     * @param[in] duration_m The duration to block updates for, in minutes.
+     * @brief Select the features to initialize lazily, on their first use or
+     *        after the first iteration of the event loop, rather than in
+     *        init(). The event handlers of the application then respond
+     *        sooner after boot.
+     * @param[in] features A bitmask of features. The Keepalive feature follows
+     *            the IoTCentral feature.
      * @return True on success.
-     * @see allowUpdate
-     * @note Requires the "SoftwareUpdateDeferral" application capability.
+     * @note Must be invoked before init().
      */
-    virtual bool blockUpdate(const uint32_t duration_m) final
+    virtual bool setLazyFeatures(const ApplicationFeatures &features) final
     {
-        AbortIfNot(m_eventLoop, false);
+        AbortIf(m_eventLoop, false);
 
-        AbortErrno(SysEvent_DeferEvent(SysEvent_Events_UpdateReadyForInstall,
-                                       duration_m),
-                   false);
+        m_lazyFeatures = features;
+
+        return true;
+    }
+
+    /**
+     * @brief Get the time of a phase of the startup.
+     * @param[in] phase The phase.
+     * @return The time of the phase. The phases of the lazy features follow
+     *         the first iteration of the event loop, unless the features were
+     *         used earlier.
+     */
+    const StartupPhaseTime &startupPhase(const StartupPhase phase) const
+    {
+        return m_startup[static_cast<uint8_t>(phase)];
+    }
+
+    /**
+     * @brief Get the name of a phase of the startup.
+     * @param[in] phase The phase.
+     * @return The name.
+     */
+    static const char *startupPhaseName(const StartupPhase phase)
+    {
+        switch (phase) {
+            case StartupPhase::EventLoop:
+                return "event_loop";
+
+            case StartupPhase::UpdateNotification:
+                return "update_notification";
+
+            case StartupPhase::TimeSync:
+                return "time_sync";
+
+            case StartupPhase::Watchdog:
+                return "watchdog";
+
+            case StartupPhase::IoTCentral:
+                return "iot_central";
+
+            case StartupPhase::Checkpoint:
+                return "checkpoint";
+
+            case StartupPhase::FirstIteration:
+                return "first_iteration";
+
+            default:
+                return "unknown";
+        }
+    }
+
+    /**
+     * @brief Block system and application updates.
+     * @param[in] duration_m The duration to block updates for, in minutes.
+     * @return True on success.
+     * @see allowUpdate
+     * @note Requires the "SoftwareUpdateDeferral" application capability.
+     */
+    virtual bool blockUpdate(const uint32_t duration_m) final
+    {
+        AbortIfNot(m_eventLoop, false);
+
+        AbortErrno(SysEvent_DeferEvent(SysEvent_Events_UpdateReadyForInstall,
+                                       duration_m),
+                   false);
+
+        return true;
+    }
+
+    /**
+     * @brief Allow system and application updates.
+     * @return True on success.
+     * @see blockUpdate
+     */
+    virtual bool allowUpdate() final
+    {
+        AbortIfNot(m_eventLoop, false);
+
+        AbortErrno(SysEvent_ResumeEvent(SysEvent_Events_UpdateReadyForInstall),
+                   false);
+
+        return true;
+    }
+
+    /**
+     * @brief Reboot the system.
+     * @return True on success.
+     * @note Requires the "PowerControls" application capability to specify
+     *       "ForceReboot".
+     */
+    virtual bool systemReboot() final
+    {
+        AbortErrno(PowerManagement_ForceSystemReboot(), false);
+
+        return true;
+    }
+
+    /**
+     * @brief Suspend the system.
+     * @param[in] duration_s The duration to suspend for, in seconds.
+     * @return True on success.
+     * @note Requires the "PowerControls" application capability to specify
+     *       "ForcePowerDown".
+     */
+    virtual bool systemSuspend(const uint32_t duration_s) final
+    {
+        AbortErrno(PowerManagement_ForceSystemPowerDown(duration_s), false);
+
+        return true;
+    }
+
+protected:
+    /**
+     * @brief Constructor.
+     */
+    ApplicationBase() :
+        m_eventLoop(nullptr),
+        m_timers(nullptr),
+        m_running(false),
+        m_termSignal(),
+        m_shutdownDeadline(k_defaultShutdownDeadline),
+        m_updatePolicy(nullptr),
+        m_powerScheduler(nullptr),
+        m_suspending(false),
+        m_powerGovernor(nullptr),
+        m_lazyFeatures(ApplicationFeatures::None),
+        m_pendingFeatures(ApplicationFeatures::None),
+        m_startup()
+    {
+    }
+
+    /**
+     * @brief Move constructor.
+     * @param[in] other The instance to move from.
+     */
+    ApplicationBase(ApplicationBase &&other) :
+        m_eventLoop(nullptr),
+        m_timers(nullptr),
+        m_running(false),
+        m_termSignal(),
+        m_shutdownDeadline(other.m_shutdownDeadline),
+        m_updatePolicy(other.m_updatePolicy),
+        m_powerScheduler(other.m_powerScheduler),
+        m_suspending(false),
+        m_powerGovernor(nullptr),
+        m_lazyFeatures(other.m_lazyFeatures),
+        m_pendingFeatures(ApplicationFeatures::None),
+        m_startup()
+    {
+        Assert(!other.m_eventLoop);
+
+        setPowerGovernor(other.m_powerGovernor);
+        other.m_powerGovernor = nullptr;
+    }
+
+    /**
+     * @brief Create the event loop and register the application as the
+     *        application of the calling thread.
+     * @return True on success.
+     */
+    bool initEventLoop()
+    {
+        AbortIf(g_current, false);
+        AbortIf(m_eventLoop, false);
+
+        m_eventLoop = EventLoop_Create();
+        AbortIfNot(m_eventLoop, false);
+
+        g_current = this;
+        m_running = true;
+
+        /*
+         * Handle the termination signal from the event loop.
+         */
+        AbortIfNot(m_termSignal.init(SIGTERM), false);
+        m_termSignal.connect<ApplicationBase, &ApplicationBase::terminate>(
+            *this);
+
+        return true;
+    }
+
+    /**
+     * @brief Run the first iteration of the event loop, processing the events
+     *        already pending without waiting, then initialize the lazy
+     *        features.
+     * @return True on success.
+     */
+    bool runFirstIteration()
+    {
+        const uint64_t start = readClock();
+
+        Tracer::begin(DispatchKind::Loop, nullptr, m_eventLoop);
+        if (EventLoop_Run(m_eventLoop, 0, false) == EventLoop_Run_Failed &&
+            errno != EINTR) {
+            AbortErrno(-1, false);
+        }
+        Tracer::end(DispatchKind::Loop, nullptr, m_eventLoop);
+        StallDetector::iterate();
+
+        recordStartupPhase(StartupPhase::FirstIteration, start);
+
+        AbortIfNot(initPendingFeatures(), false);
+
+        for (uint8_t i = 0; i < k_startupPhases; i++) {
+            const StartupPhaseTime &phase = m_startup[i];
+            if (phase.start_ns) {
+                Log_Debug("Startup phase %s: %llu us at %llu ms\n",
+                          startupPhaseName(static_cast<StartupPhase>(i)),
+                          static_cast<unsigned long long>(
+                              (phase.end_ns - phase.start_ns) / 1000),
+                          static_cast<unsigned long long>(
+                              phase.start_ns / 1000000));
+            }
+        }
+
+        return true;
+    }
+
+    /**
+     * @brief Record the time of a phase of the startup, ending now.
+     * @param[in] phase The phase.
+     * @param[in] start_ns The start of the phase, in nanoseconds.
+     */
+    void recordStartupPhase(const StartupPhase phase, const uint64_t start_ns)
+    {
+        StartupPhaseTime &time = m_startup[static_cast<uint8_t>(phase)];
+
+        time.start_ns = start_ns;
+        time.end_ns = readClock();
+    }
+
+    /**
+     * @brief Initialize the lazy features not yet used.
+     * @return True on success.
+     */
+    virtual bool initPendingFeatures() = 0;
+
+    /**
+     * @brief Close the event loop and unregister the application.
+     * @return True on success.
+     */
+    bool destroyEventLoop()
+    {
+        AbortIfNot(m_termSignal.destroy(), false);
+
+        Timer::release(m_timers);
+        EventLoop_Close(m_eventLoop);
+        m_eventLoop = nullptr;
+
+        AbortIfNot(setPowerGovernor(nullptr), false);
+
+        if (g_current == this) {
+            g_current = nullptr;
+        }
+
+        return true;
+    }
+
+    /**
+     * @brief Termination signal callback.
+     */
+    void terminate()
+    {
+        Log_Debug("Termination signal received, shutting down...\n");
+
+        /*
+         * A suspend powers the system down with the termination signal: the
+         * application was just flushed, and the checkpoint rate-limited.
+         */
+        if (!flush(!m_suspending)) {
+            Log_Debug("Flush failed, shutting down anyway\n");
+        }
+        AbortIfNot(stop());
+    }
+
+    /**
+     * @brief Flush the application.
+     * @param[in] checkpoint Whether to save the checkpoint.
+     * @return True on success.
+     * @see flush()
+     */
+    bool flush(const bool checkpoint)
+    {
+        AbortIfNot(m_eventLoop, false);
+
+        const uint64_t start = readClock();
+        const uint64_t deadline = start + m_shutdownDeadline * 1000000ull;
+
+        AbortIfNot(persistState(m_shutdownDeadline), false);
+        if (checkpoint) {
+            AbortIfNot(saveCheckpoint(), false);
+        }
+
+        /*
+         * Only report the flushes that lost messages or ran out of time.
+         */
+        const uint32_t dropped = drain(deadline);
+        const uint64_t end = readClock();
+        if (dropped || end >= deadline) {
+            Log_Debug("Flushed in %u ms, %u message(s) dropped\n",
+                      static_cast<uint32_t>((end - start) / 1000000),
+                      dropped);
+        }
+
+        return true;
+    }
+
+    /**
+     * @brief Send the outbound messages still queued.
+     * @param[in] deadline_ns The deadline, in nanoseconds.
+     * @return The number of messages that could not be sent.
+     */
+    virtual uint32_t drain(const uint64_t deadline_ns) = 0;
+
+    /**
+     * @brief Save the checkpoint of the application state, when used.
+     * @return True on success.
+     */
+    virtual bool saveCheckpoint() = 0;
+
+    /**
+     * @brief Get the time the checkpoint in storage was saved, when used.
+     * @return The time since the epoch, in seconds, or 0 when there is none.
+     */
+    virtual uint32_t checkpointTime() = 0;
+
+    /**
+     * @brief Get the number of operations pending, such as the telemetry
+     *        messages not yet confirmed.
+     * @return The number of operations.
+     */
+    virtual uint32_t pendingOperations() = 0;
+
+    /**
+     * @brief Suspend the system when the power scheduler finds it safe and
+     *        worthwhile, after flushing the application.
+     * @return True on success.
+     */
+    bool suspendIfIdle()
+    {
+        m_suspending = false;
+
+        const uint32_t duration_s =
+            m_powerScheduler->suspendDuration(m_eventLoop, pendingOperations());
+        if (!duration_s) {
+            return true;
+        }
+
+        Log_Debug("Idle, suspending for %u s\n", duration_s);
+        const bool checkpoint =
+            m_powerScheduler->suspended(duration_s, checkpointTime());
+        AbortIfNot(flush(checkpoint), false);
+        AbortIfNot(systemSuspend(duration_s), false);
+        m_suspending = true;
+
+        return true;
+    }
+
+    /**
+     * The event loop.
+     */
+    EventLoop *m_eventLoop;
+
+    /**
+     * The timers armed on the event loop (see Timer::nextExpiry()).
+     */
+    Timer *m_timers;
+
+    /**
+     *  Whether to keep the event loop running.
+     */
+    bool m_running;
+
+    /**
+     * The termination signal.
+     */
+    Signal m_termSignal;
+
+    /**
+     * The time allowed to flush the application before shutting down, in
+     * milliseconds.
+     */
+    uint32_t m_shutdownDeadline;
+
+    /**
+     * The policy deciding when to install the pending updates.
+     */
+    UpdatePolicy *m_updatePolicy;
+
+    /**
+     * The scheduler suspending the system while the application is idle.
+     */
+    PowerScheduler *m_powerScheduler;
+
+    /**
+     * Whether a suspend was requested since the event loop was last idle.
+     */
+    bool m_suspending;
+
+    /**
+     * The governor switching the system power profile.
+     */
+    PowerGovernor *m_powerGovernor;
+
+    /**
+     * The features to initialize lazily.
+     */
+    ApplicationFeatures m_lazyFeatures;
+
+    /**
+     * The lazy features not yet initialized.
+     */
+    ApplicationFeatures m_pendingFeatures;
+
+    /**
+     * The time of the phases of the startup.
+     */
+    StartupPhaseTime m_startup[k_startupPhases];
+
+    /**
+     * The application of the current thread, used to register the event
+     * handlers.
+     */
+    static __thread ApplicationBase *g_current;
+
+    friend EventLoop *getEventLoop();
+    friend Timer **getArmedTimers(const EventLoop *eventLoop);
+};
+
+/**
+ * @brief State of the update notification feature, empty when the feature is
+ *        compiled out.
+ * @tparam ENABLED Whether the feature is compiled in.
+ */
+template<bool ENABLED>
+struct ApplicationUpdateState
+{
+};
+
+template<>
+struct ApplicationUpdateState<true>
+{
+    ApplicationUpdateState() :
+        m_sysevent(nullptr)
+    {
+    }
+
+    ApplicationUpdateState(ApplicationUpdateState &&other) :
+        m_sysevent(nullptr)
+    {
+    }
+
+    /**
+     * The system event handler.
+     */
+    EventRegistration *m_sysevent;
+};
+
+/**
+ * @brief State of the watchdog feature, empty when the feature is compiled
+ *        out.
+ * @tparam ENABLED Whether the feature is compiled in.
+ */
+template<bool ENABLED>
+struct ApplicationWatchdogState
+{
+};
+
+template<>
+struct ApplicationWatchdogState<true>
+{
+    ApplicationWatchdogState() :
+        m_watchdogPeriod(ApplicationBase::k_defaultWatchdogPeriod),
+        m_useWatchdog(false),
+        m_watchdog(),
+        m_watchdogComponent("application")
+    {
+    }
+
+    ApplicationWatchdogState(ApplicationWatchdogState &&other) :
+        m_watchdogPeriod(other.m_watchdogPeriod),
+        m_useWatchdog(false),
+        m_watchdog(),
+        m_watchdogComponent("application")
+    {
+    }
+
+    /**
+     * The watchdog period, in seconds.
+     */
+    uint32_t m_watchdogPeriod;
+
+    /**
+     * Whether the watchdog is used by the application.
+     */
+    bool m_useWatchdog;
+
+    /**
+     * The watchdog.
+     */
+    Watchdog m_watchdog;
+
+    /**
+     * The component petted with petWatchdog().
+     */
+    WatchdogComponent m_watchdogComponent;
+};
+
+/**
+ * @brief State of the Azure IoT Central and keepalive features, empty when
+ *        the features are compiled out.
+ * @tparam ENABLED Whether the features are compiled in.
+ */
+template<bool ENABLED>
+struct ApplicationIotState
+{
+};
+
+template<>
+struct ApplicationIotState<true>
+{
+    ApplicationIotState() :
+        m_iotConnectTimer(),
+        m_iotPumpTimer(),
+        m_metricsTimer(),
+        m_health(),
+        m_iotPumpPeriod(0),
+        m_iotHandle(nullptr),
+        m_iotConnected(false),
+        m_iotWasConnected(false),
+        m_telemetryPending(0),
+        m_iotScopeId(),
+        m_iotRetryInterval(ApplicationBase::k_initialIotRetryInterval),
+        m_iotMaxRetryInterval(ApplicationBase::k_defaultIotMaxRetryInterval),
+        m_useIot(false),
+        m_useHealth(false),
+        m_keepalivePeriod(ApplicationBase::k_defaultKeepalivePeriod),
+        m_useKeepalive(false)
+    {
+    }
+
+    ApplicationIotState(ApplicationIotState &&other) :
+        m_iotConnectTimer(std::move(other.m_iotConnectTimer)),
+        m_iotPumpTimer(std::move(other.m_iotPumpTimer)),
+        m_metricsTimer(std::move(other.m_metricsTimer)),
+        m_health(),
+        m_iotPumpPeriod(0),
+        m_iotHandle(nullptr),
+        m_iotConnected(false),
+        m_iotWasConnected(false),
+        m_telemetryPending(0),
+        m_iotScopeId(),
+        m_iotRetryInterval(other.m_iotRetryInterval),
+        m_iotMaxRetryInterval(other.m_iotMaxRetryInterval),
+        m_useIot(false),
+        m_useHealth(false),
+        m_keepalivePeriod(other.m_keepalivePeriod),
+        m_useKeepalive(false)
+    {
+        memcpy(m_iotScopeId, other.m_iotScopeId, sizeof(m_iotScopeId));
+    }
+
+    /**
+     * The (re)connection timer to Azure IoT Central.
+     */
+    Timer m_iotConnectTimer;
+
+    /**
+     * The timer processing the Azure IoT Central connection.
+     */
+    Timer m_iotPumpTimer;
+
+    /**
+     * The timer publishing the metrics to Azure IoT Central.
+     */
+    Timer m_metricsTimer;
+
+    /**
+     * The health reporter.
+     */
+    HealthReporter m_health;
+
+    /**
+     * The period of the processing timer, in milliseconds, or 0 when stopped.
+     */
+    uint32_t m_iotPumpPeriod;
+
+    /**
+     * The Azure IoT Central connection.
+     */
+    IOTHUB_DEVICE_CLIENT_LL_HANDLE m_iotHandle;
+
+    /**
+     * Whether the application is connected to Azure IoT Central.
+     */
+    bool m_iotConnected;
+
+    /**
+     * Whether the application was ever connected to Azure IoT Central.
+     */
+    bool m_iotWasConnected;
+
+    /**
+     * The number of telemetry messages queued and not yet confirmed.
+     */
+    uint32_t m_telemetryPending;
+
+    /**
+     * The Azure IoT Central scope ID.
+     */
+    char m_iotScopeId[64];
+
+    /**
+     * The current retry interval when connecting to Azure IoT Central, in
+     * seconds.
+     */
+    uint32_t m_iotRetryInterval;
+
+    /**
+     * The maximum retry interval when connecting to Azure IoT Central, in
+     * seconds.
+     */
+    uint32_t m_iotMaxRetryInterval;
+
+    /**
+     * Whether Azure IoT Central is used by the application.
+     */
+    bool m_useIot;
+
+    /**
+     * Whether the health report is sent.
+     */
+    bool m_useHealth;
+
+    /**
+     * The Azure IoT Central keepalive period, in seconds.
+     */
+    uint32_t m_keepalivePeriod;
+
+    /**
+     * Whether to send keepalive to Azure IoT Central.
+     */
+    bool m_useKeepalive;
+};
+
+/**
+ * @brief State of the checkpoint feature, empty when the feature is compiled
+ *        out.
+ * @tparam ENABLED Whether the feature is compiled in.
+ */
+template<bool ENABLED>
+struct ApplicationCheckpointState
+{
+};
+
+template<>
+struct ApplicationCheckpointState<true>
+{
+    ApplicationCheckpointState() :
+        m_checkpoint(),
+        m_checkpointPeriod(ApplicationBase::k_defaultCheckpointPeriod),
+        m_useCheckpoint(false)
+    {
+    }
+
+    ApplicationCheckpointState(ApplicationCheckpointState &&other) :
+        m_checkpoint(),
+        m_checkpointPeriod(other.m_checkpointPeriod),
+        m_useCheckpoint(false)
+    {
+    }
+
+    /**
+     * The checkpoint.
+     */
+    Checkpoint m_checkpoint;
+
+    /**
+     * The buffer holding the checkpoint.
+     */
+    uint8_t m_checkpointBuffer[ApplicationBase::k_maxCheckpointSize];
+
+    /**
+     * The checkpoint period, in seconds.
+     */
+    uint32_t m_checkpointPeriod;
+
+    /**
+     * Whether the checkpoint is used by the application.
+     */
+    bool m_useCheckpoint;
+};
+
+/**
+ * @brief Base application class, abstracting the event loop and basic
+ *        functionality.
+ * @tparam FEATURES A bitmask of the features compiled into the application.
+ *         The features enabled at runtime with init() must be a subset of
+ *         these. The code and the state of the other features is compiled out.
+ * @see Application
+ */
+template<ApplicationFeatures FEATURES>
+class BasicApplication :
+    public ApplicationBase,
+    private ApplicationUpdateState<
+        isSet(FEATURES, ApplicationFeatures::UpdateNotification)>,
+    private ApplicationWatchdogState<
+        isSet(FEATURES, ApplicationFeatures::Watchdog)>,
+    private ApplicationIotState<
+        isSet(FEATURES, ApplicationFeatures::IoTCentral)>,
+    private ApplicationCheckpointState<
+        isSet(FEATURES, ApplicationFeatures::Checkpoint)>
+{
+public:
+    /**
+     * @brief Constructor.
+     */
+    BasicApplication()
+    {
+    }
+
+    /**
+     * @brief Move constructor.
+     * @param[in] other The instance to move from.
+     *
+     * @note Only the configuration of the application is moved, the other
+     *       application must not be initialized yet.
+     */
+    BasicApplication(BasicApplication &&other) :
+        ApplicationBase(std::move(other)),
+        UpdateState(std::move(other)),
+        WatchdogState(std::move(other)),
+        IotState(std::move(other)),
+        CheckpointState(std::move(other))
+    {
+    }
+
+    /**
+     * @brief Destructor.
+     */
+    virtual ~BasicApplication()
+    {
+        if (m_eventLoop) {
+            destroy();
+        }
+    }
+
+    /**
+     * @brief Whether a feature is compiled into the application.
+     * @param[in] feature The feature to test.
+     * @return True when the feature can be enabled with init().
+     */
+    static constexpr bool hasFeature(const ApplicationFeatures feature)
+    {
+        return (FEATURES & feature) == feature;
+    }
+
+    /**
+     * @brief Initialize the application.
+     * @param[in] features A bitmask of features to enable.
+     * @return True on success.
+     */
+    virtual bool init(const ApplicationFeatures &features)
+    {
+        AbortIfNot(hasFeature(features), false);
+
+        memset(m_startup, 0, sizeof(m_startup));
+
+        const uint64_t start = readClock();
+        AbortIfNot(initEventLoop(), false);
+        recordStartupPhase(StartupPhase::EventLoop, start);
+
+        /*
+         * Initialize the requested features, except the lazy ones.
+         */
+        m_pendingFeatures = features & m_lazyFeatures &
+            ~ApplicationFeatures::Keepalive;
+        if (isSet(m_pendingFeatures, ApplicationFeatures::IoTCentral)) {
+            m_pendingFeatures = m_pendingFeatures |
+                (features & ApplicationFeatures::Keepalive);
+        }
+
+        AbortIfNot(initFeatures(features & ~m_pendingFeatures,
+                                ApplicationFeatures::All),
+                   false);
+
+        return true;
+    }
+
+    /**
+     * @brief Initialize the application.
+     * @param[in] features A bitmask of features to enable.
+     * @param[in] watchdog_period_s The watchdog period, in seconds.
+     * @return True on success.
+     */
+    virtual bool init(const ApplicationFeatures &features,
+                      const uint32_t watchdog_period_s)
+    {
+        AbortIf(m_eventLoop, false);
+
+        AbortIfNot(configureWatchdog(watchdog_period_s,
+                                     Has<ApplicationFeatures::Watchdog>()),
+                   false);
+
+        AbortIfNot(init(features), false);
+
+        return true;
+    }
+
+    /**
+     * @brief Initialize the application.
+     * @param[in] features A bitmask of features to enable.
+     * @param[in] azscope The Azure IoT Central scope ID.
+     * @return True on success.
+     */
+    virtual bool init(const ApplicationFeatures &features,
+                      const char *const azscope)
+    {
+        AbortIf(m_eventLoop, false);
+
+        AbortIfNot(configureIot(azscope, 0,
+                                Has<ApplicationFeatures::IoTCentral>()),
+                   false);
+
+        AbortIfNot(init(features), false);
+
+        return true;
+    }
+
+    /**
+     * @brief Initialize the application.
+     * @param[in] features A bitmask of features to enable.
+     * @param[in] azscope The Azure IoT Central scope ID.
+     * @param[in] keepalive_period_s The Azure IoT keepalive period, in seconds.
+     * @return True on success.
+     */
+    virtual bool init(const ApplicationFeatures &features,
+                      const char *const azscope,
+                      const uint32_t keepalive_period_s)
+    {
+        AbortIf(m_eventLoop, false);
+
+        AbortIfNot(keepalive_period_s > 0, false);
+
+        AbortIfNot(configureIot(azscope, keepalive_period_s,
+                                Has<ApplicationFeatures::IoTCentral>()),
+                   false);
+
+        AbortIfNot(init(features), false);
+
+        return true;
+    }
+
+    /**
+     * @brief Initialize the application.
+     * @param[in] features A bitmask of features to enable.
+     * @param[in] watchdog_period_s The watchdog period, in seconds.
+     * @param[in] azscope The Azure IoT Central scope ID.
+     * @return True on success.
+     */
+    virtual bool init(const ApplicationFeatures &features,
+                      const uint32_t watchdog_period_s,
+                      const char *const azscope)
+    {
+        AbortIf(m_eventLoop, false);
+
+        AbortIfNot(configureWatchdog(watchdog_period_s,
+                                     Has<ApplicationFeatures::Watchdog>()),
+                   false);
+        AbortIfNot(configureIot(azscope, 0,
+                                Has<ApplicationFeatures::IoTCentral>()),
+                   false);
+
+        AbortIfNot(init(features), false);
+
+        return true;
+    }
+
+    /**
+     * @brief Initialize the application.
+     * @param[in] features A bitmask of features to enable.
+     * @param[in] watchdog_period_s The watchdog period, in seconds.
+     * @param[in] azscope The Azure IoT Central scope ID.
+     * @param[in] keepalive_period_s The Azure IoT keepalive period, in seconds.
+     * @return True on success.
+     */
+    virtual bool init(const ApplicationFeatures &features,
+                      const uint32_t watchdog_period_s,
+                      const char *const azscope,
+                      const uint32_t keepalive_period_s)
+    {
+        AbortIf(m_eventLoop, false);
+
+        AbortIfNot(keepalive_period_s > 0, false);
+
+        AbortIfNot(configureWatchdog(watchdog_period_s,
+                                     Has<ApplicationFeatures::Watchdog>()),
+                   false);
+        AbortIfNot(configureIot(azscope, keepalive_period_s,
+                                Has<ApplicationFeatures::IoTCentral>()),
+                   false);
+
+        AbortIfNot(init(features), false);
+
+        return true;
+    }
+
+    /**
+     * @brief Destroy the application.
+     * @return True on success.
+     */
+    virtual bool destroy() override
+    {
+        AbortIfNot(stop(), false);
+
+        AbortIfNot(destroyCheckpoint(Has<ApplicationFeatures::Checkpoint>()),
+                   false);
+        AbortIfNot(destroyIot(Has<ApplicationFeatures::IoTCentral>()), false);
+        AbortIfNot(destroyWatchdog(Has<ApplicationFeatures::Watchdog>()),
+                   false);
+        AbortIfNot(destroyUpdateNotification(
+                    Has<ApplicationFeatures::UpdateNotification>()),
+                   false);
+
+        AbortIfNot(destroyEventLoop(), false);
+        m_pendingFeatures = ApplicationFeatures::None;
+
+        return true;
+    }
+
+    /**
+     * @brief Pet the watchdog.
+     * @return True on success.
+     * @note The application must be initialized with the Watchdog feature.
+     */
+    virtual bool petWatchdog() final
+    {
+        AbortIfNot(m_eventLoop, false);
+
+        AbortIfNot(initPendingFeatures(ApplicationFeatures::Watchdog), false);
+        AbortIfNot(petWatchdog(Has<ApplicationFeatures::Watchdog>()), false);
+
+        return true;
+    }
+
+    /**
+     * @brief Change the period of the watchdog.
+     * @param[in] period_s The watchdog period, in seconds.
+     * @return True on success.
+     * @note The application must be initialized with the Watchdog feature.
+     */
+    virtual bool setWatchdogPeriod(const uint32_t period_s) final
+    {
+        AbortIfNot(m_eventLoop, false);
+
+        AbortIfNot(configureWatchdog(period_s,
+                                     Has<ApplicationFeatures::Watchdog>()),
+                   false);
+
+        /*
+         * Pet the watchdog immediately to start using the new period.
+         */
+        AbortIfNot(petWatchdog(), false);
+
+        return true;
+    }
+
+    /**
+     * @brief Get the watchdog, to supervise additional components.
+     * @return The watchdog.
+     * @note The application must be initialized with the Watchdog feature.
+     */
+    Watchdog &watchdog()
+    {
+        const bool initialized =
+            initPendingFeatures(ApplicationFeatures::Watchdog);
+        Assert(initialized);
+        Assert(this->m_useWatchdog);
+
+        return this->m_watchdog;
+    }
+
+    /**
+     * @brief Change the maximum connection retry interval when connecting to
+     *        Azure IoT Central.
+     * @param[in] max_retry_interval_s The maximum connection retry interval, in
+     *            seconds.
+     * @return True on success.
+     * @note The application must be initialized with the AzureIoT feature.
+     */
+    virtual bool setMaxRetryInterval(const uint32_t max_retry_interval_s) final
+    {
+        AbortIfNot(m_eventLoop, false);
+
+        AbortIfNot(max_retry_interval_s > 0, false);
+
+        AbortIfNot(initPendingFeatures(ApplicationFeatures::IoTCentral),
+                   false);
+        AbortIfNot(setMaxRetryInterval(max_retry_interval_s,
+                                       Has<ApplicationFeatures::IoTCentral>()),
+                   false);
+
+        return true;
+    }
+
+    /**
+     * @brief Send a telemetry message to Azure IoT Central.
+     * @param[in] message The message, usually in JSON.
+     * @return True when the message is queued for transmission.
+     * @note The application must be initialized with the IoTCentral feature.
+     */
+    virtual bool sendTelemetry(const char *const message) final
+    {
+        EnergyModel::Scope scope("telemetry");
+        AbortIfNot(m_eventLoop, false);
+
+        AbortIfNot(initPendingFeatures(ApplicationFeatures::IoTCentral),
+                   false);
+        AbortIfNot(sendTelemetry(message,
+                                 Has<ApplicationFeatures::IoTCentral>()),
+                   false);
+
+        return true;
+    }
+
+    /**
+     * @brief Periodically publish the registered metrics (see metrics.hh) as
+     *        telemetry to Azure IoT Central.
+     * @param[in] period_s The publication period, in seconds, or 0 to stop
+     *            publishing.
+     * @return True on success.
+     * @note The application must be initialized with the IoTCentral feature.
+     */
+    virtual bool setMetricsPeriod(const uint32_t period_s) final
+    {
+        AbortIfNot(m_eventLoop, false);
+
+        AbortIfNot(initPendingFeatures(ApplicationFeatures::IoTCentral),
+                   false);
+        AbortIfNot(setMetricsPeriod(period_s,
+                                    Has<ApplicationFeatures::IoTCentral>()),
+                   false);
+
+        return true;
+    }
+
+    /**
+     * @brief Periodically send a health report (see health.hh) as telemetry to
+     *        Azure IoT Central.
+     * @param[in] policy The policy deciding when to send a report. A period of
+     *            0 stops the reports.
+     * @return True on success.
+     * @note The application must be initialized with the IoTCentral feature.
+     */
+    virtual bool setHealthReport(
+        const HealthReporter::Policy &policy = HealthReporter::k_defaultPolicy)
+        final
+    {
+        AbortIfNot(m_eventLoop, false);
+
+        AbortIfNot(initPendingFeatures(ApplicationFeatures::IoTCentral),
+                   false);
+        AbortIfNot(setHealthReport(policy,
+                                   Has<ApplicationFeatures::IoTCentral>()),
+                   false);
+
+        return true;
+    }
+
+    /**
+     * @brief Change the period of the keepalive to Azure IoT.
+     * @param[in] period_s The Azure IoT keepalive period, in seconds.
+     * @return True on success.
+     * @note The application must be initialized with the Keepalive feature.
+     */
+    virtual bool setKeepalivePeriod(const uint32_t period_s) final
+    {
+        AbortIfNot(m_eventLoop, false);
+
+        AbortIfNot(period_s > 0, false);
+
+        AbortIfNot(initPendingFeatures(ApplicationFeatures::IoTCentral),
+                   false);
+        AbortIfNot(setKeepalivePeriod(period_s,
+                                      Has<ApplicationFeatures::IoTCentral>()),
+                   false);
+
+        return true;
+    }
+
+    /**
+     * @brief Get the checkpoint, to register the components saving their
+     *        state.
+     * @return The checkpoint.
+     * @note The application must be initialized with the Checkpoint feature.
+     */
+    Checkpoint &checkpoint()
+    {
+        const bool initialized =
+            initPendingFeatures(ApplicationFeatures::Checkpoint);
+        Assert(initialized);
+        Assert(this->m_useCheckpoint);
+
+        return this->m_checkpoint;
+    }
+
+    /**
+     * @brief Change the period of the checkpoint of the application state.
+     * @param[in] period_s The checkpoint period, in seconds, or 0 to only save
+     *            the checkpoint when the application is flushed.
+     * @return True on success.
+     * @note The application must be initialized with the Checkpoint feature.
+     */
+    virtual bool setCheckpointPeriod(const uint32_t period_s) final
+    {
+        AbortIfNot(m_eventLoop, false);
+
+        AbortIfNot(initPendingFeatures(ApplicationFeatures::Checkpoint),
+                   false);
+        AbortIfNot(setCheckpointPeriod(period_s,
+                                       Has<ApplicationFeatures::Checkpoint>()),
+                   false);
+
+        return true;
+    }
+
+private:
+    /**
+     * @brief Tag type selecting the implementation of a feature.
+     * @tparam FEATURE The feature.
+     */
+    template<ApplicationFeatures FEATURE>
+    using Has = std::integral_constant<bool, hasFeature(FEATURE)>;
+
+    /**
+     * Shorthands for the state of the features.
+     * @{
+     */
+    using UpdateState = ApplicationUpdateState<
+        hasFeature(ApplicationFeatures::UpdateNotification)>;
+    using WatchdogState = ApplicationWatchdogState<
+        hasFeature(ApplicationFeatures::Watchdog)>;
+    using IotState = ApplicationIotState<
+        hasFeature(ApplicationFeatures::IoTCentral)>;
+    using CheckpointState = ApplicationCheckpointState<
+        hasFeature(ApplicationFeatures::Checkpoint)>;
+    /**
+     * @}
+     */
+
+    /**
+     * @brief Send the outbound messages still queued.
+     * @param[in] deadline_ns The deadline, in nanoseconds.
+     * @return The number of messages that could not be sent.
+     */
+    virtual uint32_t drain(const uint64_t deadline_ns) override
+    {
+        return drain(deadline_ns, Has<ApplicationFeatures::IoTCentral>());
+    }
+
+    /**
+     * @brief Save the checkpoint of the application state, when used.
+     * @return True on success.
+     */
+    virtual bool saveCheckpoint() override
+    {
+        return saveCheckpoint(Has<ApplicationFeatures::Checkpoint>());
+    }
+
+    /**
+     * @brief Get the time the checkpoint in storage was saved, when used.
+     * @return The time since the epoch, in seconds, or 0 when there is none.
+     */
+    virtual uint32_t checkpointTime() override
+    {
+        return checkpointTime(Has<ApplicationFeatures::Checkpoint>());
+    }
+
+    /**
+     * @brief Get the number of operations pending.
+     * @return The number of telemetry messages not yet confirmed.
+     */
+    virtual uint32_t pendingOperations() override
+    {
+        return pendingOperations(Has<ApplicationFeatures::IoTCentral>());
+    }
+
+    /**
+     * @brief Initialize the features, and record the time of their startup
+     *        phases.
+     * @param[in] features A bitmask of features to enable.
+     * @param[in] mask A bitmask of the features to initialize. The features
+     *            not enabled are initialized as disabled.
+     * @return True on success.
+     */
+    bool initFeatures(const ApplicationFeatures &features,
+                      const ApplicationFeatures &mask)
+    {
+        uint64_t start = readClock();
+
+        if (isSet(mask, ApplicationFeatures::UpdateNotification)) {
+            AbortIfNot(initUpdateNotification(
+                        isSet(features,
+                              ApplicationFeatures::UpdateNotification),
+                        Has<ApplicationFeatures::UpdateNotification>()),
+                       false);
+            if (isSet(features, ApplicationFeatures::UpdateNotification)) {
+                recordStartupPhase(StartupPhase::UpdateNotification, start);
+                start = readClock();
+            }
+        }
+
+        if (isSet(mask, ApplicationFeatures::TimeSync)) {
+            AbortIfNot(initTimeSync(
+                        isSet(features, ApplicationFeatures::TimeSync),
+                        Has<ApplicationFeatures::TimeSync>()),
+                       false);
+            if (isSet(features, ApplicationFeatures::TimeSync)) {
+                recordStartupPhase(StartupPhase::TimeSync, start);
+                start = readClock();
+            }
+        }
+
+        if (isSet(mask, ApplicationFeatures::Watchdog)) {
+            AbortIfNot(initWatchdog(
+                        isSet(features, ApplicationFeatures::Watchdog),
+                        Has<ApplicationFeatures::Watchdog>()),
+                       false);
+            if (isSet(features, ApplicationFeatures::Watchdog)) {
+                recordStartupPhase(StartupPhase::Watchdog, start);
+                start = readClock();
+            }
+        }
+
+        if (isSet(mask, ApplicationFeatures::IoTCentral)) {
+            AbortIfNot(initIot(isSet(features, ApplicationFeatures::IoTCentral),
+                               isSet(features, ApplicationFeatures::Keepalive),
+                               Has<ApplicationFeatures::IoTCentral>()),
+                       false);
+            if (isSet(features, ApplicationFeatures::IoTCentral)) {
+                recordStartupPhase(StartupPhase::IoTCentral, start);
+                start = readClock();
+            }
+        }
+
+        if (isSet(mask, ApplicationFeatures::Checkpoint)) {
+            AbortIfNot(initCheckpoint(
+                        isSet(features, ApplicationFeatures::Checkpoint),
+                        Has<ApplicationFeatures::Checkpoint>()),
+                       false);
+            if (isSet(features, ApplicationFeatures::Checkpoint)) {
+                recordStartupPhase(StartupPhase::Checkpoint, start);
+            }
+        }
+
+        return true;
+    }
+
+    /**
+     * @brief Initialize lazy features not yet used.
+     * @param[in] features A bitmask of the features to initialize, when they
+     *            are pending.
+     * @return True on success.
+     */
+    bool initPendingFeatures(const ApplicationFeatures &features)
+    {
+        ApplicationFeatures pending = m_pendingFeatures & features;
+        if (pending == ApplicationFeatures::None) {
+            return true;
+        }
+
+        if (isSet(pending, ApplicationFeatures::IoTCentral)) {
+            pending = pending |
+                (m_pendingFeatures & ApplicationFeatures::Keepalive);
+        }
+        m_pendingFeatures = m_pendingFeatures & ~pending;
+
+        AbortIfNot(initFeatures(pending, pending), false);
+
+        return true;
+    }
+
+    /**
+     * @brief Initialize all the lazy features not yet used.
+     * @return True on success.
+     */
+    virtual bool initPendingFeatures() override
+    {
+        return initPendingFeatures(ApplicationFeatures::All);
+    }
+
+    /**
+     * @brief Initialize the update notifications.
+     * @param[in] enable Whether the feature is requested.
+     * @return True on success.
+     * @{
+     */
+    bool initUpdateNotification(const bool enable, std::true_type)
+    {
+        if (enable) {
+            this->m_sysevent = SysEvent_RegisterForEventNotifications(
+                m_eventLoop, SysEvent_Events_UpdateReadyForInstall,
+                syseventCallback, this);
+            AbortErrnoPtr(this->m_sysevent, false);
+        }
+
+        return true;
+    }
+
+    bool initUpdateNotification(const bool enable, std::false_type)
+    {
+        return !enable;
+    }
+    /**
+     * @}
+     */
+
+    /**
+     * @brief Destroy the update notifications.
+     * @return True on success.
+     * @{
+     */
+    bool destroyUpdateNotification(std::true_type)
+    {
+        if (this->m_sysevent) {
+            AbortErrno(SysEvent_UnregisterForEventNotifications(
+                        this->m_sysevent),
+                       false);
+            this->m_sysevent = nullptr;
+        }
+
+        return true;
+    }
+
+    bool destroyUpdateNotification(std::false_type)
+    {
+        return true;
+    }
+    /**
+     * @}
+     */
+
+    /**
+     * @brief Initialize the time synchronization.
+     * @param[in] enable Whether the feature is requested.
+     * @return True on success.
+     * @{
+     */
+    bool initTimeSync(const bool enable, std::true_type)
+    {
+        if (enable) {
+            AbortErrno(Networking_TimeSync_SetEnabled(true), false);
+        }
+
+        return true;
+    }
+
+    bool initTimeSync(const bool enable, std::false_type)
+    {
+        return !enable;
+    }
+    /**
+     * @}
+     */
+
+    /**
+     * @brief Configure the watchdog.
+     * @param[in] period_s The watchdog period, in seconds.
+     * @return True on success.
+     * @{
+     */
+    bool configureWatchdog(const uint32_t period_s, std::true_type)
+    {
+        AbortIfNot(period_s > 0, false);
+
+        this->m_watchdogPeriod = period_s;
+
+        if (this->m_useWatchdog) {
+            AbortIfNot(this->m_watchdog.setLoopTimeout(watchdogLoopTimeout()),
+                       false);
+            AbortIfNot(this->m_watchdogComponent.setPeriod(period_s * 1000),
+                       false);
+        }
+
+        return true;
+    }
+
+    bool configureWatchdog(const uint32_t period_s, std::false_type)
+    {
+        return false;
+    }
+    /**
+     * @}
+     */
+
+    /**
+     * @brief Initialize the watchdog.
+     * @param[in] enable Whether the feature is requested.
+     * @return True on success.
+     * @{
+     */
+    bool initWatchdog(const bool enable, std::true_type)
+    {
+        this->m_useWatchdog = enable;
+        if (this->m_useWatchdog) {
+            this->m_watchdog.template connect<
+                BasicApplication, &BasicApplication::watchdogExpired>(*this);
+            AbortIfNot(this->m_watchdog.init(watchdogLoopTimeout()), false);
+
+            AbortIfNot(this->m_watchdogComponent.init(
+                        this->m_watchdog, this->m_watchdogPeriod * 1000),
+                       false);
+        }
+
+        return true;
+    }
+
+    bool initWatchdog(const bool enable, std::false_type)
+    {
+        return !enable;
+    }
+    /**
+     * @}
+     */
+
+    /**
+     * @brief Destroy the watchdog.
+     * @return True on success.
+     * @{
+     */
+    bool destroyWatchdog(std::true_type)
+    {
+        if (this->m_useWatchdog) {
+            AbortIfNot(this->m_watchdogComponent.destroy(), false);
+            AbortIfNot(this->m_watchdog.destroy(), false);
+        }
+
+        return true;
+    }
+
+    bool destroyWatchdog(std::false_type)
+    {
+        return true;
+    }
+    /**
+     * @}
+     */
+
+    /**
+     * @brief Pet the watchdog.
+     * @return True on success.
+     * @{
+     */
+    bool petWatchdog(std::true_type)
+    {
+        AbortIfNot(this->m_useWatchdog, false);
+
+        AbortIfNot(this->m_watchdogComponent.pet(), false);
+
+        return true;
+    }
+
+    bool petWatchdog(std::false_type)
+    {
+        return false;
+    }
+    /**
+     * @}
+     */
+
+    /**
+     * @brief Get the time without checks after which the watchdog considers
+     *        the event loop hung.
+     * @return The timeout, in milliseconds.
+     *
+     * @note The components are checked once per check period, so a missed
+     *       heartbeat may be noticed up to one check period late.
+     */
+    uint32_t watchdogLoopTimeout() const
+    {
+        return this->m_watchdogPeriod * 1000 + Watchdog::k_defaultCheckPeriod;
+    }
+
+    /**
+     * @brief Watchdog expiry callback.
+     * @param[in] component The component that expired, or nullptr when the
+     *            event loop is hung.
+     * @note May be invoked from the watchdog's monitor thread.
+     */
+    void watchdogExpired(const WatchdogComponent *const component)
+    {
+        Log_Debug("Watchdog timeout (%s), rebooting...\n",
+                  component ? component->name() : "event loop");
+        systemReboot();
+    }
+
+    /**
+     * @brief Initialize the checkpoint, restoring the checkpoint saved in
+     *        storage.
+     * @param[in] enable Whether the feature is requested.
+     * @return True on success.
+     * @{
+     */
+    bool initCheckpoint(const bool enable, std::true_type)
+    {
+        this->m_useCheckpoint = enable;
+        if (this->m_useCheckpoint) {
+            AbortIfNot(this->m_checkpoint.init(this->m_checkpointBuffer,
+                                               this->m_checkpointPeriod),
+                       false);
+        }
+
+        return true;
+    }
+
+    bool initCheckpoint(const bool enable, std::false_type)
+    {
+        return !enable;
+    }
+    /**
+     * @}
+     */
+
+    /**
+     * @brief Destroy the checkpoint.
+     * @return True on success.
+     * @{
+     */
+    bool destroyCheckpoint(std::true_type)
+    {
+        if (this->m_useCheckpoint) {
+            AbortIfNot(this->m_checkpoint.destroy(), false);
+            this->m_useCheckpoint = false;
+        }
+
+        return true;
+    }
+
+    bool destroyCheckpoint(std::false_type)
+    {
+        return true;
+    }
+    /**
+     * @}
+     */
+
+    /**
+     * @brief Change the period of the checkpoint.
+     * @param[in] period_s The checkpoint period, in seconds.
+     * @return True on success.
+     * @{
+     */
+    bool setCheckpointPeriod(const uint32_t period_s, std::true_type)
+    {
+        AbortIfNot(this->m_useCheckpoint, false);
+
+        this->m_checkpointPeriod = period_s;
+        AbortIfNot(this->m_checkpoint.setPeriod(period_s), false);
+
+        return true;
+    }
+
+    bool setCheckpointPeriod(const uint32_t period_s, std::false_type)
+    {
+        return false;
+    }
+    /**
+     * @}
+     */
+
+    /**
+     * @brief Save the checkpoint.
+     * @return True on success.
+     * @{
+     */
+    bool saveCheckpoint(std::true_type)
+    {
+        if (this->m_useCheckpoint) {
+            AbortIfNot(this->m_checkpoint.save(), false);
+        }
+
+        return true;
+    }
+
+    bool saveCheckpoint(std::false_type)
+    {
+        return true;
+    }
+    /**
+     * @}
+     */
+
+    /**
+     * @brief Get the time the checkpoint in storage was saved.
+     * @return The time since the epoch, in seconds, or 0 when there is none.
+     * @{
+     */
+    uint32_t checkpointTime(std::true_type)
+    {
+        return this->m_useCheckpoint ? this->m_checkpoint.storedTime() : 0;
+    }
+
+    uint32_t checkpointTime(std::false_type)
+    {
+        return 0;
+    }
+    /**
+     * @}
+     */
+
+    /**
+     * @brief Configure the connection to Azure IoT Central.
+     * @param[in] azscope The Azure IoT Central scope ID.
+     * @param[in] keepalive_period_s The Azure IoT keepalive period, in seconds,
+     *            or 0 to keep the current period.
+     * @return True on success.
+     * @{
+     */
+    bool configureIot(const char *const azscope,
+                      const uint32_t keepalive_period_s, std::true_type)
+    {
+        AbortIfNot(azscope, false);
+
+        snprintf(this->m_iotScopeId, sizeof(this->m_iotScopeId), "%s",
+                 azscope);
+        if (keepalive_period_s > 0) {
+            this->m_keepalivePeriod = keepalive_period_s;
+        }
+
+        return true;
+    }
+
+    bool configureIot(const char *const azscope,
+                      const uint32_t keepalive_period_s, std::false_type)
+    {
+        return false;
+    }
+    /**
+     * @}
+     */
+
+    /**
+     * @brief Initialize the connection to Azure IoT Central.
+     * @param[in] enable Whether the feature is requested.
+     * @param[in] enableKeepalive Whether the keepalive feature is requested.
+     * @return True on success.
+     * @{
+     */
+    bool initIot(const bool enable, const bool enableKeepalive, std::true_type)
+    {
+        this->m_useIot = enable;
+        this->m_useKeepalive = enableKeepalive;
+        if (this->m_useIot) {
+            AbortIfNot(this->m_iotConnectTimer.init(), false);
+
+            this->m_iotConnectTimer.template connect<
+                BasicApplication, &BasicApplication::retryConnectIot>(*this);
+
+            AbortIfNot(this->m_iotPumpTimer.init(), false);
+            this->m_iotPumpTimer.setDeferrable(true);
+
+            this->m_iotPumpTimer.template connect<
+                BasicApplication, &BasicApplication::pumpIot>(*this);
+
+            AbortIfNot(this->m_metricsTimer.init(), false);
+
+            this->m_metricsTimer.template connect<
+                BasicApplication, &BasicApplication::publishMetrics>(*this);
+
+            AbortIfNot(tryConnectIot(), false);
+        }
+
+        return true;
+    }
+
+    bool initIot(const bool enable, const bool enableKeepalive,
+                 std::false_type)
+    {
+        return !enable && !enableKeepalive;
+    }
+    /**
+     * @}
+     */
+
+    /**
+     * @brief Destroy the connection to Azure IoT Central.
+     * @return True on success.
+     * @{
+     */
+    bool destroyIot(std::true_type)
+    {
+        if (this->m_useIot) {
+            AbortIfNot(this->m_iotConnectTimer.destroy(), false);
+            AbortIfNot(this->m_iotPumpTimer.destroy(), false);
+            this->m_iotPumpPeriod = 0;
+            AbortIfNot(this->m_metricsTimer.destroy(), false);
+
+            if (this->m_useHealth) {
+                AbortIfNot(this->m_health.destroy(), false);
+                this->m_useHealth = false;
+            }
+
+            if (this->m_iotHandle) {
+                /*
+                 * The client confirms the messages still queued as dropped.
+                 */
+                IoTHubDeviceClient_LL_Destroy(this->m_iotHandle);
+                this->m_iotHandle = nullptr;
+                this->m_iotConnected = false;
+                EnergyModel::keepalive(0);
+                this->m_telemetryPending = 0;
+            }
+
+            this->m_useIot = false;
+        }
+
+        return true;
+    }
+
+    bool destroyIot(std::false_type)
+    {
+        return true;
+    }
+    /**
+     * @}
+     */
+
+    /**
+     * @brief Change the maximum connection retry interval when connecting to
+     *        Azure IoT Central.
+     * @param[in] max_retry_interval_s The maximum connection retry interval, in
+     *            seconds.
+     * @return True on success.
+     * @{
+     */
+    bool setMaxRetryInterval(const uint32_t max_retry_interval_s,
+                             std::true_type)
+    {
+        AbortIfNot(this->m_useIot, false);
+
+        this->m_iotMaxRetryInterval = max_retry_interval_s;
+
+        if (this->m_iotConnected) {
+            AbortIfNeq(IoTHubDeviceClient_LL_SetRetryPolicy(
+                        this->m_iotHandle,
+                        IOTHUB_CLIENT_RETRY_EXPONENTIAL_BACKOFF,
+                        this->m_iotMaxRetryInterval),
+                       IOTHUB_CLIENT_OK, false);
+        } else {
+            /*
+             * If the application is try to reconnect but the new maximum retry
+             * interval is lower than the previous one, restart the connection
+             * timer to apply the new interval now.
+             */
+            if (this->m_iotRetryInterval > this->m_iotMaxRetryInterval) {
+                this->m_iotRetryInterval = this->m_iotMaxRetryInterval;
+
+                AbortIfNot(this->m_iotConnectTimer.startOneShot(
+                            this->m_iotRetryInterval * 1000000),
+                           false);
+            }
+        }
 
         return true;
     }
 
+    bool setMaxRetryInterval(const uint32_t max_retry_interval_s,
+                             std::false_type)
+    {
+        return false;
+    }
     /**
-     * @brief Allow system and application updates.
+     * @}
+     */
+
+    /**
+     * @brief Send a telemetry message to Azure IoT Central.
+     * @param[in] message The message.
      * @return True on success.
-     * @see blockUpdate
+     * @{
      */
-    virtual bool allowUpdate() final
+    bool sendTelemetry(const char *const message, std::true_type)
     {
-        AbortIfNot(m_eventLoop, false);
+        AbortIfNot(this->m_useIot, false);
+        AbortIfNot(this->m_iotHandle, false);
 
-        AbortErrno(SysEvent_ResumeEvent(SysEvent_Events_UpdateReadyForInstall),
-                   false);
+        /*
+         * The client keeps a copy of the message, and queues it while
+         * disconnected.
+         */
+        const IOTHUB_MESSAGE_HANDLE handle =
+            IoTHubMessage_CreateFromString(message);
+        AbortIfNot(handle, false);
+
+        const IOTHUB_CLIENT_RESULT result =
+            IoTHubDeviceClient_LL_SendEventAsync(
+                this->m_iotHandle, handle, telemetryCallback, this);
+        IoTHubMessage_Destroy(handle);
+        if (result != IOTHUB_CLIENT_OK) {
+            this->m_health.countDrop();
+        }
+        AbortIfNeq(result, IOTHUB_CLIENT_OK, false);
+        this->m_telemetryPending++;
+        EnergyModel::radio(strlen(message));
+        AbortIfNot(schedulePumpIot(), false);
 
         return true;
     }
 
+    bool sendTelemetry(const char *const message, std::false_type)
+    {
+        return false;
+    }
     /**
-     * @brief Reboot the system.
-     * @return True on success.
-     * @note Requires the "PowerControls" application capability to specify
-     *       "ForceReboot".
+     * @}
      */
-    virtual bool systemReboot() final
+
+    /**
+     * @brief Send the telemetry messages still queued for Azure IoT Central.
+     * @param[in] deadline_ns The deadline, in nanoseconds.
+     * @return The number of messages that could not be sent.
+     * @{
+     */
+    uint32_t drain(const uint64_t deadline_ns, std::true_type)
     {
-        AbortErrno(PowerManagement_ForceSystemReboot(), false);
+        if (!this->m_iotHandle) {
+            return 0;
+        }
 
-        return true;
+        /*
+         * The event loop is no longer serviced, process the connection
+         * directly until the client confirmed all the messages.
+         */
+        while (this->m_telemetryPending && readClock() < deadline_ns) {
+            pumpIot();
+            if (this->m_telemetryPending) {
+                usleep(k_flushPumpPeriod * 1000);
+            }
+        }
+
+        return this->m_telemetryPending;
     }
 
+    uint32_t drain(const uint64_t deadline_ns, std::false_type)
+    {
+        return 0;
+    }
     /**
-     * @brief Suspend the system.
-     * @param[in] duration_s The duration to suspend for, in seconds.
-     * @return True on success.
-     * @note Requires the "PowerControls" application capability to specify
-     *       "ForcePowerDown".
+     * @}
      */
-    virtual bool systemSuspend(const uint32_t duration_s) final
+
+    /**
+     * @brief Get the number of telemetry messages not yet confirmed.
+     * @return The number of messages.
+     * @{
+     */
+    uint32_t pendingOperations(std::true_type)
     {
-        AbortErrno(PowerManagement_ForceSystemPowerDown(duration_s), false);
+        return this->m_telemetryPending;
+    }
 
-        return true;
+    uint32_t pendingOperations(std::false_type)
+    {
+        return 0;
     }
+    /**
+     * @}
+     */
 
     /**
-     * @brief Pet the watchdog.
+     * @brief Change the period of the publication of the metrics.
+     * @param[in] period_s The publication period, in seconds, or 0.
      * @return True on success.
-     * @note The application must be initialized with the Watchdog feature.
+     * @{
      */
-    virtual bool petWatchdog() final
+    bool setMetricsPeriod(const uint32_t period_s, std::true_type)
     {
-        AbortIfNot(m_eventLoop, false);
-        AbortIfNot(m_useWatchdog, false);
+        AbortIfNot(this->m_useIot, false);
 
-        alarm(m_watchdogPeriod);
+        if (period_s) {
+            AbortIfNot(this->m_metricsTimer.startPeriodic(
+                        period_s * 1000000ull),
+                       false);
+        } else {
+            AbortIfNot(this->m_metricsTimer.stop(), false);
+        }
 
         return true;
     }
 
+    bool setMetricsPeriod(const uint32_t period_s, std::false_type)
+    {
+        return false;
+    }
     /**
-     * @brief Change the period of the watchdog.
-     * @param[in] period_s The watchdog period, in seconds.
+     * @}
+     */
+
+    /**
+     * @brief Change the policy of the health report.
+     * @param[in] policy The policy deciding when to send a report.
      * @return True on success.
-     * @note The application must be initialized with the Watchdog feature.
+     * @{
      */
-    virtual bool setWatchdogPeriod(const uint32_t period_s) final
+    bool setHealthReport(const HealthReporter::Policy &policy, std::true_type)
     {
-        AbortIfNot(m_eventLoop, false);
-        AbortIfNot(m_useWatchdog, false);
+        AbortIfNot(this->m_useIot, false);
 
-        AbortIfNot(period_s > 0, false);
+        if (this->m_useHealth) {
+            AbortIfNot(this->m_health.destroy(), false);
+            this->m_useHealth = false;
+        }
 
-        m_watchdogPeriod = period_s;
+        if (policy.period_s) {
+            this->m_health.template connect<
+                BasicApplication, &BasicApplication::sendHealthReport>(*this);
 
-        /*
-         * Pet the watchdog immediately to start using the new period.
-         */
-        AbortIfNot(petWatchdog(), false);
+            AbortIfNot(this->m_health.init(
+                        policy,
+                        healthWatchdog(Has<ApplicationFeatures::Watchdog>())),
+                       false);
+            this->m_useHealth = true;
+        }
 
         return true;
     }
 
+    bool setHealthReport(const HealthReporter::Policy &policy,
+                         std::false_type)
+    {
+        return false;
+    }
     /**
-     * @brief Change the maximum connection retry interval when connecting to
-     *        Azure IoT Central.
-     * @param[in] max_retry_interval_s The maximum connection retry interval, in
-     *            seconds.
-     * @return True on success.
-     * @note The application must be initialized with the AzureIoT feature.
+     * @}
      */
-    virtual bool setMaxRetryInterval(const uint32_t max_retry_interval_s) final
-    {
-        AbortIfNot(m_eventLoop, false);
-        AbortIfNot(m_useIot, false);
-
-        AbortIfNot(max_retry_interval_s > 0, false);
-
-        m_iotMaxRetryInterval = max_retry_interval_s;
-
-        if (m_iotConnected) {
-            AbortIfNeq(IoTHubDeviceClient_LL_SetRetryPolicy(
-                        m_iotHandle, IOTHUB_CLIENT_RETRY_EXPONENTIAL_BACKOFF,
-                        m_iotMaxRetryInterval),
-                       IOTHUB_CLIENT_OK, false);
-        } else {
-            /*
-             * If the application is try to reconnect but the new maximum retry
-             * interval is lower than the previous one, restart the connection
-             * timer to apply the new interval now.
-             */
-            if (m_iotRetryInterval > m_iotMaxRetryInterval) {
-                m_iotRetryInterval = m_iotMaxRetryInterval;
 
-                AbortIfNot(m_iotConnectTimer.startOneShot(
-                            m_iotRetryInterval * 1000000),
-                           false);
-            }
-        }
+    /**
+     * @brief Get the watchdog whose near misses are reported.
+     * @return The watchdog, or nullptr.
+     * @{
+     */
+    const Watchdog *healthWatchdog(std::true_type)
+    {
+        return this->m_useWatchdog ? &this->m_watchdog : nullptr;
+    }
 
-        return true;
+    const Watchdog *healthWatchdog(std::false_type)
+    {
+        return nullptr;
     }
+    /**
+     * @}
+     */
 
     /**
      * @brief Change the period of the keepalive to Azure IoT.
      * @param[in] period_s The Azure IoT keepalive period, in seconds.
      * @return True on success.
-     * @note The application must be initialized with the Keepalive feature.
+     * @{
      */
-    virtual bool setKeepalivePeriod(const uint32_t period_s) final
+    bool setKeepalivePeriod(const uint32_t period_s, std::true_type)
     {
-        AbortIfNot(m_eventLoop, false);
-        AbortIfNot(m_useKeepalive, false);
-
-        AbortIfNot(period_s > 0, false);
+        AbortIfNot(this->m_useKeepalive, false);
 
-        m_keepalivePeriod = period_s;
+        this->m_keepalivePeriod = period_s;
 
-        if (m_iotConnected) {
+        if (this->m_iotConnected) {
             const int keepalive_option = period_s;
+            EnergyModel::keepalive(period_s);
 
             AbortIfNeq(IoTHubDeviceClient_LL_SetOption(
-                        m_iotHandle, OPTION_KEEP_ALIVE, &keepalive_option),
+                        this->m_iotHandle, OPTION_KEEP_ALIVE,
+                        &keepalive_option),
                        IOTHUB_CLIENT_OK, false);
         }
 
         return true;
     }
 
-private:
-    /**
-     * @brief Process signal callback.
-     * @param[in] signo The signal number.
-     */
-    static void signalHandler(const int signo)
+    bool setKeepalivePeriod(const uint32_t period_s, std::false_type)
     {
-        Assert(g_application);
-
-        switch (signo) {
-            case SIGTERM:
-                Log_Debug("Termination signal received, shutting down...\n");
-                g_application->destroy();
-                break;
-
-            case SIGALRM:
-                Log_Debug("Watchdog timeout, rebooting...\n");
-                g_application->systemReboot();
-                break;
-
-            default:
-                break;
-        }
+        return false;
     }
+    /**
+     * @}
+     */
 
     /**
      * @brief System event callback.
@@ -603,10 +2479,18 @@ private:
     {
         Assert(event == SysEvent_Events_UpdateReadyForInstall);
 
-        Application *const application = static_cast<Application *>(context);
+        DispatchScope scope(DispatchKind::SysEvent,
+                            reinterpret_cast<const void *>(syseventCallback),
+                            context);
+
+        BasicApplication *const application =
+            static_cast<BasicApplication *>(context);
 
         SysEvent_Info_UpdateData update;
         AbortErrno(SysEvent_Info_GetUpdateData(info, &update));
+        InputRecorder::record(InputKind::SysEvent, event, state,
+                              update.max_deferral_time_in_minutes,
+                              update.update_type);
         const bool isSystemUpdate =
             update.update_type == SysEvent_UpdateType_System;
 
@@ -641,7 +2525,7 @@ private:
     {
         const AZURE_SPHERE_PROV_RETURN_VALUE status =
             IoTHubDeviceClient_LL_CreateWithAzureSphereDeviceAuthProvisioning(
-                m_iotScopeId, 10000, &m_iotHandle);
+                this->m_iotScopeId, 10000, &this->m_iotHandle);
 
         if (status.result != AZURE_SPHERE_PROV_RESULT_OK) {
             const char *stage;
@@ -683,13 +2567,13 @@ private:
             /*
              * Retry with exponential back-off.
              */
-            AbortIfNot(m_iotConnectTimer.startOneShot(
-                        m_iotRetryInterval * 1000000),
+            AbortIfNot(this->m_iotConnectTimer.startOneShot(
+                        this->m_iotRetryInterval * 1000000),
                        false);
 
-            m_iotRetryInterval *= m_iotRetryInterval;
-            if (m_iotRetryInterval > m_iotMaxRetryInterval) {
-                m_iotRetryInterval = m_iotMaxRetryInterval;
+            this->m_iotRetryInterval *= this->m_iotRetryInterval;
+            if (this->m_iotRetryInterval > this->m_iotMaxRetryInterval) {
+                this->m_iotRetryInterval = this->m_iotMaxRetryInterval;
             }
 
             return true;
@@ -698,26 +2582,34 @@ private:
         /*
          * Apply options that require the handle to be valid first.
          */
-        if (m_useKeepalive) {
-            const int keepalive_option = m_keepalivePeriod;
+        if (this->m_useKeepalive) {
+            const int keepalive_option = this->m_keepalivePeriod;
 
             AbortIfNeq(IoTHubDeviceClient_LL_SetOption(
-                        m_iotHandle, OPTION_KEEP_ALIVE, &keepalive_option),
+                        this->m_iotHandle, OPTION_KEEP_ALIVE,
+                        &keepalive_option),
                        IOTHUB_CLIENT_OK, false);
         }
 
         AbortIfNeq(IoTHubDeviceClient_LL_SetRetryPolicy(
-                    m_iotHandle, IOTHUB_CLIENT_RETRY_EXPONENTIAL_BACKOFF,
-                    m_iotMaxRetryInterval),
+                    this->m_iotHandle, IOTHUB_CLIENT_RETRY_EXPONENTIAL_BACKOFF,
+                    this->m_iotMaxRetryInterval),
                    IOTHUB_CLIENT_OK, false);
 
         /*
          * Register all required callbacks.
          */
         AbortIfNeq(IoTHubDeviceClient_LL_SetConnectionStatusCallback(
-                    m_iotHandle, iotConnectionCallback, this),
+                    this->m_iotHandle, iotConnectionCallback, this),
                    IOTHUB_CLIENT_OK, false);
 
+        /*
+         * The client only makes progress (and invokes the callbacks) when
+         * processed periodically.
+         */
+        this->m_iotPumpPeriod = 0;
+        AbortIfNot(schedulePumpIot(), false);
+
         Log_Debug("Connected to Azure IoT Central\n");
 
         return true;
@@ -732,115 +2624,135 @@ private:
     }
 
     /**
-     * @brief IoT Central connection callback.
-     * @param[in] status The status of the connection.
-     * @param[in] reason The reason for the reported status.
-     * @param[in] context The Application object.
+     * @brief IoT Central processing timer callback.
      */
-    static void iotConnectionCallback(
-        const IOTHUB_CLIENT_CONNECTION_STATUS status,
-        const IOTHUB_CLIENT_CONNECTION_STATUS_REASON reason,
-        void *const context)
+    void pumpIot()
     {
-        Application *const application = static_cast<Application *>(context);
+        DispatchScope scope(
+            DispatchKind::Iot,
+            reinterpret_cast<const void *>(IoTHubDeviceClient_LL_DoWork),
+            this->m_iotHandle);
 
-        application->m_iotConnected =
-            status == IOTHUB_CLIENT_CONNECTION_AUTHENTICATED;
-        if (!application->m_iotConnected) {
-            Log_Debug("Failed to communicate with Azure IoT Central: %s\n",
-                      IOTHUB_CLIENT_CONNECTION_STATUS_REASONStrings(reason));
-        }
+        IoTHubDeviceClient_LL_DoWork(this->m_iotHandle);
+        AbortIfNot(schedulePumpIot());
     }
 
     /**
-     * The event loop.
-     */
-    EventLoop *m_eventLoop;
-
-    /**
-     *  Whether to keep the event loop running.
-     */
-    bool m_running;
-
-    /**
-     * The system event handler.
-     */
-    EventRegistration *m_sysevent;
-
-    /**
-     * The (re)connection timer to Azure IoT Central.
-     */
-    Timer m_iotConnectTimer;
-
-    /**
-     * The Azure IoT Central connection.
-     */
-    IOTHUB_DEVICE_CLIENT_LL_HANDLE m_iotHandle;
-
-    /**
-     * Whether the application is connected to Azure IoT Central.
+     * @brief Adjust the period of the IoT Central processing to the work of
+     *        the client: short while connecting or while telemetry is not yet
+     *        confirmed, long otherwise, to avoid waking up the device for
+     *        nothing.
+     * @return True on success.
      */
-    bool m_iotConnected;
+    bool schedulePumpIot()
+    {
+        const uint32_t period =
+            this->m_telemetryPending || !this->m_iotConnected ?
+                k_iotPumpPeriod : k_iotIdlePumpPeriod;
+        if (period == this->m_iotPumpPeriod) {
+            return true;
+        }
 
-    /**
-     * The Azure IoT Central scope ID.
-     */
-    char m_iotScopeId[64];
+        AbortIfNot(this->m_iotPumpTimer.startPeriodic(period * 1000), false);
+        this->m_iotPumpPeriod = period;
 
-    /**
-     * The current retry interval when connecting to Azure IoT Central, in
-     * seconds.
-     */
-    uint32_t m_iotRetryInterval;
+        return true;
+    }
 
     /**
-     * The maximum retry interval when connecting to Azure IoT Central, in
-     * seconds.
+     * @brief Health report sending callback.
+     * @param[in] message The report.
+     * @return True if the report was queued.
      */
-    uint32_t m_iotMaxRetryInterval;
+    bool sendHealthReport(const char *const message)
+    {
+        EnergyModel::Scope scope("health");
+        return sendTelemetry(message, std::true_type());
+    }
 
     /**
-     * Whether Azure IoT Central is used by the application.
+     * @brief Metrics publication timer callback.
      */
-    bool m_useIot;
+    void publishMetrics()
+    {
+        EnergyModel::Scope scope("metrics");
+        char message[k_maxTelemetrySize];
 
-    /**
-     * The Azure IoT Central keepalive period, in seconds.
-     */
-    uint32_t m_keepalivePeriod;
+        const size_t length =
+            MetricRegistry::serializeJson(message, sizeof(message));
+        AbortIfNot(length);
 
-    /**
-     * Whether to send keepalive to Azure IoT Central.
-     */
-    bool m_useKeepalive;
+        AbortIfNot(sendTelemetry(message, std::true_type()));
+    }
 
     /**
-     * The watchdog period, in seconds.
+     * @brief IoT Central telemetry confirmation callback.
+     * @param[in] result The result of the transmission.
+     * @param[in] context The Application object.
      */
-    uint32_t m_watchdogPeriod;
+    static void telemetryCallback(
+        const IOTHUB_CLIENT_CONFIRMATION_RESULT result, void *const context)
+    {
+        DispatchScope scope(
+            DispatchKind::Iot,
+            reinterpret_cast<const void *>(telemetryCallback), context);
+        InputRecorder::record(InputKind::IotConfirmation, result);
+
+        BasicApplication *const application =
+            static_cast<BasicApplication *>(context);
+
+        Assert(application->m_telemetryPending > 0);
+        application->m_telemetryPending--;
+        if (result != IOTHUB_CLIENT_CONFIRMATION_OK) {
+            Log_Debug("Failed to send telemetry to Azure IoT Central: %s\n",
+                      IOTHUB_CLIENT_CONFIRMATION_RESULTStrings(result));
+            application->m_health.countDrop();
+        }
+    }
 
     /**
-     * Whether the watchdog is used by the application.
+     * @brief IoT Central connection callback.
+     * @param[in] status The status of the connection.
+     * @param[in] reason The reason for the reported status.
+     * @param[in] context The Application object.
      */
-    bool m_useWatchdog;
+    static void iotConnectionCallback(
+        const IOTHUB_CLIENT_CONNECTION_STATUS status,
+        const IOTHUB_CLIENT_CONNECTION_STATUS_REASON reason,
+        void *const context)
+    {
+        DispatchScope scope(
+            DispatchKind::Iot,
+            reinterpret_cast<const void *>(iotConnectionCallback), context);
+        InputRecorder::record(InputKind::IotConnection, status, reason);
 
-    /**
-     * Saved state for the signal handlers.
-     * @{
-     */
-    struct sigaction m_oldTermAction;
-    struct sigaction m_oldAlrmAction;
-    /**
-     * @}
-     */
+        BasicApplication *const application =
+            static_cast<BasicApplication *>(context);
 
-    /**
-     * A pointer to the currently running application, used to handle process
-     * signals.
-     */
-    static Application *g_application;
+        const bool connected =
+            status == IOTHUB_CLIENT_CONNECTION_AUTHENTICATED;
+        if (connected && !application->m_iotConnected) {
+            if (application->m_iotWasConnected) {
+                application->m_health.countReconnect();
+            }
+            application->m_iotWasConnected = true;
+        }
 
-    friend EventLoop *getEventLoop();
+        application->m_iotConnected = connected;
+        EnergyModel::keepalive(connected && application->m_useKeepalive ?
+                               application->m_keepalivePeriod : 0);
+        if (!application->m_iotConnected) {
+            Log_Debug("Failed to communicate with Azure IoT Central: %s\n",
+                      IOTHUB_CLIENT_CONNECTION_STATUS_REASONStrings(reason));
+        }
+    }
 };
 
+/**
+ * @brief Application with all the features compiled in, the features being
+ *        selected at runtime with init().
+ * @see BasicApplication
+ */
+using Application = BasicApplication<ApplicationFeatures::All>;
+
 } /* namespace SpherePlusPlus */
@@ -0,0 +1,145 @@
+/**
+ * @file bench.hh
+ * @author Matthieu Bucchianeri
+ * @brief Minimal benchmark harness for the host build.
+ *
+ * Each benchmark times a loop of a given number of iterations. The harness
+ * grows the number of iterations until a loop lasts at least k_minDuration,
+ * then times k_repetitions loops, and reports the median and the minimum time
+ * per iteration as JSON:
+ *
+ * {"benchmarks":[
+ *  {"name":"call.delegate","iterations":16777216,"ns_per_op":1.52,
+ *   "min_ns_per_op":1.49},
+ *  ...
+ * ]}
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+namespace SpherePlusPlus {
+namespace Bench {
+
+/**
+ * The shortest duration of a timed loop, in nanoseconds.
+ */
+static constexpr uint64_t k_minDuration = 20000000;
+
+/**
+ * The number of timed loops of each benchmark.
+ */
+static constexpr size_t k_repetitions = 7;
+
+/**
+ * @brief Benchmark, timing a loop.
+ * @param[in] iterations The number of iterations of the loop.
+ * @return The duration of the loop, in nanoseconds.
+ */
+using Function = uint64_t (*)(uint64_t iterations);
+
+/**
+ * @brief Prevent the compiler from optimizing a value out.
+ * @param[in] value The value.
+ */
+template<typename T>
+static inline void keep(const T &value)
+{
+    asm volatile("" : : "r,m"(value) : "memory");
+}
+
+/**
+ * @brief Prevent the compiler from assuming anything about the memory, such
+ *        as the target of a call being constant across iterations.
+ */
+static inline void clobber()
+{
+    asm volatile("" : : : "memory");
+}
+
+/**
+ * @brief Benchmark runner, printing the results as JSON.
+ */
+class Runner
+{
+public:
+    /**
+     * @brief Constructor.
+     * @param[in] filter Only run the benchmarks whose name contains this
+     *            string, or nullptr to run them all.
+     */
+    Runner(const char *const filter) :
+        m_filter(filter),
+        m_count(0)
+    {
+        printf("{\"benchmarks\":[");
+    }
+
+    Runner(const Runner &other) = delete;
+    Runner &operator =(const Runner &other) = delete;
+
+    /**
+     * @brief Destructor, completing the JSON document.
+     */
+    ~Runner()
+    {
+        printf("\n]}\n");
+    }
+
+    /**
+     * @brief Run a benchmark.
+     * @param[in] name The name of the benchmark.
+     * @param[in] function The benchmark.
+     */
+    void run(const char *const name, const Function function)
+    {
+        if (m_filter && !strstr(name, m_filter)) {
+            return;
+        }
+
+        uint64_t iterations = 1;
+        while (function(iterations) < k_minDuration &&
+               iterations < (1ull << 40)) {
+            iterations *= 2;
+        }
+
+        double samples[k_repetitions];
+        for (size_t i = 0; i < k_repetitions; i++) {
+            samples[i] = static_cast<double>(function(iterations)) / iterations;
+
+            /*
+             * Insertion sort, for the median.
+             */
+            for (size_t j = i; j > 0 && samples[j] < samples[j - 1]; j--) {
+                const double sample = samples[j];
+                samples[j] = samples[j - 1];
+                samples[j - 1] = sample;
+            }
+        }
+
+        printf("%s\n {\"name\":\"%s\",\"iterations\":%llu,"
+               "\"ns_per_op\":%.2f,\"min_ns_per_op\":%.2f}",
+               m_count ? "," : "", name,
+               static_cast<unsigned long long>(iterations),
+               samples[k_repetitions / 2], samples[0]);
+        fflush(stdout);
+        m_count++;
+    }
+
+private:
+    /**
+     * The filter on the names of the benchmarks.
+     */
+    const char *const m_filter;
+
+    /**
+     * The number of benchmarks run.
+     */
+    size_t m_count;
+};
+
+} /* namespace Bench */
+} /* namespace SpherePlusPlus */
@@ -0,0 +1,458 @@
+/**
+ * @file fleet.cc
+ * @author Matthieu Bucchianeri
+ * @brief Simulated fleet of devices, on the host build, to load test a
+ *        backend.
+ *
+ * Usage: sphereplusplus-fleet [devices] [period_ms] [duration_s] [output]
+ *
+ * Each device is an application running its own event loop on its own thread,
+ * under its own identity ("sim-0000", "sim-0001", ...). It sends telemetry on
+ * a jittered period, from a random phase, and a periodic health report. The
+ * messages are received by a hub stand-in, which counts them and optionally
+ * writes them to the output file as newline-delimited JSON:
+ *
+ * {"device":"sim-0000","message":{"seq":0,"temperature":21.50,...}}
+ *
+ * The fleet runs for the given duration, or until interrupted, then a summary
+ * is written to the standard output as JSON.
+ */
+
+#include <sys/resource.h>
+#include <limits.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include <sphereplusplus/abort.hh>
+#include <sphereplusplus/application.hh>
+#include <sphereplusplus/clock.hh>
+#include <sphereplusplus/timer.hh>
+
+#include <host/eventloop.h>
+#include <host/iot.h>
+
+using namespace SpherePlusPlus;
+
+namespace {
+
+/**
+ * The scope of the simulated devices.
+ */
+static constexpr const char *k_idScope = "0ne000F1EE7";
+
+/**
+ * The stack size of the threads running the devices.
+ */
+static constexpr size_t k_stackSize = 128 * 1024;
+
+/**
+ * The jitter on the telemetry period, in percents of the period.
+ */
+static constexpr uint32_t k_jitter = 10;
+
+/**
+ * @brief Hub stand-in, receiving the messages of all the devices.
+ */
+class Hub
+{
+public:
+    /**
+     * @brief Constructor.
+     * @param[in] output The file to write the messages to, or nullptr.
+     */
+    Hub(FILE *const output) :
+        m_output(output),
+        m_messages(0),
+        m_bytes(0)
+    {
+        pthread_mutex_init(&m_lock, nullptr);
+    }
+
+    Hub(const Hub &other) = delete;
+    Hub &operator =(const Hub &other) = delete;
+
+    /**
+     * @brief Destructor.
+     */
+    ~Hub()
+    {
+        pthread_mutex_destroy(&m_lock);
+    }
+
+    /**
+     * @brief Get the number of messages received.
+     * @return The number of messages.
+     */
+    uint64_t messages() const
+    {
+        return __atomic_load_n(&m_messages, __ATOMIC_RELAXED);
+    }
+
+    /**
+     * @brief Get the size of the messages received.
+     * @return The size, in bytes.
+     */
+    uint64_t bytes() const
+    {
+        return __atomic_load_n(&m_bytes, __ATOMIC_RELAXED);
+    }
+
+    /**
+     * @brief Sink of the simulated Azure IoT client (see host/iot.h).
+     */
+    static bool sink(const char *const idScope, const char *const deviceId,
+                     const unsigned char *const message, const size_t size,
+                     void *const context)
+    {
+        Hub *const hub = static_cast<Hub *>(context);
+
+        __atomic_fetch_add(&hub->m_messages, 1, __ATOMIC_RELAXED);
+        __atomic_fetch_add(&hub->m_bytes, size, __ATOMIC_RELAXED);
+
+        if (hub->m_output) {
+            pthread_mutex_lock(&hub->m_lock);
+            fprintf(hub->m_output, "{\"device\":\"%s\",\"message\":%.*s}\n",
+                    deviceId, static_cast<int>(size), message);
+            pthread_mutex_unlock(&hub->m_lock);
+        }
+
+        return true;
+    }
+
+private:
+    /**
+     * The file to write the messages to, or nullptr.
+     */
+    FILE *const m_output;
+
+    /**
+     * Serializes the writes to the output.
+     */
+    pthread_mutex_t m_lock;
+
+    /**
+     * The number of messages received.
+     */
+    uint64_t m_messages;
+
+    /**
+     * The size of the messages received, in bytes.
+     */
+    uint64_t m_bytes;
+};
+
+/**
+ * @brief Simulated device, running an application on its own thread.
+ */
+class Device
+{
+public:
+    /**
+     * @brief Constructor.
+     */
+    Device() :
+        m_application(),
+        m_telemetryTimer(),
+        m_thread(),
+        m_index(0),
+        m_period_ms(0),
+        m_seed(0),
+        m_sequence(0),
+        m_temperature(0),
+        m_humidity(0),
+        m_state(State::Starting),
+        m_failed(false)
+    {
+    }
+
+    Device(const Device &other) = delete;
+    Device &operator =(const Device &other) = delete;
+
+    /**
+     * @brief Start the device.
+     * @param[in] index The index of the device, giving its identity.
+     * @param[in] period_ms The period of the telemetry, in milliseconds.
+     * @return True on success.
+     */
+    bool start(const uint32_t index, const uint32_t period_ms)
+    {
+        m_index = index;
+        m_period_ms = period_ms;
+        m_seed = index * 2654435761u + 1;
+        m_temperature = 2000 + static_cast<int32_t>(rand_r(&m_seed) % 500);
+        m_humidity = 4000 + static_cast<int32_t>(rand_r(&m_seed) % 2000);
+
+        pthread_attr_t attr;
+        AbortIfNeq(pthread_attr_init(&attr), 0, false);
+        AbortIfNeq(pthread_attr_setstacksize(&attr, k_stackSize), 0, false);
+        const int status = pthread_create(&m_thread, &attr, main, this);
+        pthread_attr_destroy(&attr);
+        AbortIfNeq(status, 0, false);
+
+        return true;
+    }
+
+    /**
+     * @brief Stop the device, and wait for its thread to exit.
+     * @return True when the device ran without error.
+     */
+    bool stop()
+    {
+        /*
+         * A stop before the application runs makes run() return immediately,
+         * but the application must be initialized.
+         */
+        State state;
+        while ((state = __atomic_load_n(&m_state, __ATOMIC_ACQUIRE)) ==
+               State::Starting) {
+            sched_yield();
+        }
+        if (state == State::Running) {
+            AbortIfNot(m_application.stop(), false);
+        }
+
+        AbortIfNeq(pthread_join(m_thread, nullptr), 0, false);
+
+        return !m_failed;
+    }
+
+    /**
+     * @brief Get the number of telemetry messages sent.
+     * @return The number of messages.
+     * @note Only valid once stopped.
+     */
+    uint32_t sent() const
+    {
+        return m_sequence;
+    }
+
+private:
+    /**
+     * @brief State of the application of the device.
+     */
+    enum class State : uint8_t
+    {
+        Starting,
+        Running,
+        Failed,
+    };
+
+    /**
+     * @brief Thread running the device.
+     * @param[in] context The Device object.
+     * @return nullptr.
+     */
+    static void *main(void *const context)
+    {
+        Device *const device = static_cast<Device *>(context);
+
+        device->m_failed = !device->run();
+
+        return nullptr;
+    }
+
+    /**
+     * @brief Run the device, until stopped.
+     * @return True on success.
+     */
+    bool run()
+    {
+        char deviceId[16];
+        snprintf(deviceId, sizeof(deviceId), "sim-%04u", m_index);
+
+        bool success = HostIot_SetDeviceId(deviceId) == 0 &&
+            m_application.init(ApplicationFeatures::IoTCentral, k_idScope) &&
+            m_application.setHealthReport() &&
+            m_telemetryTimer.init();
+        __atomic_store_n(&m_state, success ? State::Running : State::Failed,
+                         __ATOMIC_RELEASE);
+        AbortIfNot(success, false);
+
+        m_telemetryTimer.connect<Device, &Device::sendTelemetry>(*this);
+        AbortIfNot(m_telemetryTimer.startOneShot(
+                       (rand_r(&m_seed) % m_period_ms) * 1000ull), false);
+
+        success = m_application.run();
+
+        /*
+         * Send the telemetry still queued, so that the hub receives all the
+         * messages counted as sent.
+         */
+        AbortIfNot(m_telemetryTimer.destroy(), false);
+        AbortIfNot(m_application.flush(), false);
+        AbortIfNot(m_application.destroy(), false);
+
+        return success;
+    }
+
+    /**
+     * @brief Send the telemetry, and schedule the next one.
+     */
+    void sendTelemetry()
+    {
+        /*
+         * Random walk of the readings, in hundredths.
+         */
+        m_temperature += static_cast<int32_t>(rand_r(&m_seed) % 21) - 10;
+        m_humidity += static_cast<int32_t>(rand_r(&m_seed) % 41) - 20;
+
+        char message[128];
+        snprintf(message, sizeof(message),
+                 "{\"seq\":%u,\"temperature\":%d.%02d,\"humidity\":%d.%02d}",
+                 m_sequence++, m_temperature / 100, abs(m_temperature % 100),
+                 m_humidity / 100, abs(m_humidity % 100));
+        m_application.sendTelemetry(message);
+
+        const uint32_t jitter = m_period_ms * k_jitter / 100;
+        const uint32_t delay_ms = m_period_ms - jitter +
+            (jitter ? rand_r(&m_seed) % (2 * jitter + 1) : 0);
+        AbortIfNot(m_telemetryTimer.startOneShot(delay_ms * 1000ull));
+    }
+
+    /**
+     * The application of the device.
+     */
+    BasicApplication<ApplicationFeatures::IoTCentral> m_application;
+
+    /**
+     * The timer sending the telemetry.
+     */
+    Timer m_telemetryTimer;
+
+    /**
+     * The thread running the device.
+     */
+    pthread_t m_thread;
+
+    /**
+     * The index of the device.
+     */
+    uint32_t m_index;
+
+    /**
+     * The period of the telemetry, in milliseconds.
+     */
+    uint32_t m_period_ms;
+
+    /**
+     * The state of the random generator of the device.
+     */
+    unsigned int m_seed;
+
+    /**
+     * The sequence number of the next message.
+     */
+    uint32_t m_sequence;
+
+    /**
+     * The temperature, in hundredths of degrees.
+     */
+    int32_t m_temperature;
+
+    /**
+     * The relative humidity, in hundredths of percents.
+     */
+    int32_t m_humidity;
+
+    /**
+     * The state of the application, published to the main thread.
+     */
+    State m_state;
+
+    /**
+     * Whether the device failed.
+     */
+    bool m_failed;
+};
+
+} /* namespace */
+
+int main(const int argc, const char *const argv[])
+{
+    const uint32_t devices = argc > 1 ? strtoul(argv[1], nullptr, 0) : 100;
+    const uint32_t period_ms = argc > 2 ? strtoul(argv[2], nullptr, 0) : 1000;
+    const uint32_t duration_s = argc > 3 ? strtoul(argv[3], nullptr, 0) : 10;
+    AbortIfNot(devices && period_ms, EXIT_FAILURE);
+
+    FILE *output = nullptr;
+    if (argc > 4) {
+        output = fopen(argv[4], "w");
+        AbortErrnoPtr(output, EXIT_FAILURE);
+    }
+
+    /*
+     * Each device uses about ten file descriptors.
+     */
+    struct rlimit limit;
+    AbortErrno(getrlimit(RLIMIT_NOFILE, &limit), EXIT_FAILURE);
+    limit.rlim_cur = limit.rlim_max;
+    AbortErrno(setrlimit(RLIMIT_NOFILE, &limit), EXIT_FAILURE);
+
+    /*
+     * Block the signals ending the simulation before creating the threads,
+     * so that they are only received below.
+     */
+    sigset_t mask;
+    AbortErrno(sigemptyset(&mask), EXIT_FAILURE);
+    AbortErrno(sigaddset(&mask, SIGINT), EXIT_FAILURE);
+    AbortErrno(sigaddset(&mask, SIGTERM), EXIT_FAILURE);
+    AbortIfNeq(pthread_sigmask(SIG_BLOCK, &mask, nullptr), 0, EXIT_FAILURE);
+
+    Hub hub(output);
+    HostIot_SetSink(Hub::sink, &hub);
+
+    Device *const fleet = new Device[devices];
+    const uint64_t start = readClock();
+    uint32_t started = 0;
+    while (started < devices && fleet[started].start(started, period_ms)) {
+        started++;
+    }
+
+    /*
+     * Run until the end of the simulation, or until interrupted.
+     */
+    if (started == devices) {
+        const uint64_t end = start + duration_s * 1000000000ull;
+        for (uint64_t time = readClock(); time < end; time = readClock()) {
+            const uint64_t remaining = end - time;
+            const struct timespec timeout = {
+                .tv_sec = static_cast<time_t>(remaining / 1000000000),
+                .tv_nsec = static_cast<long>(remaining % 1000000000),
+            };
+            if (sigtimedwait(&mask, nullptr, &timeout) >= 0) {
+                break;
+            }
+        }
+    }
+
+    bool success = started == devices;
+    uint64_t sent = 0;
+    for (uint32_t i = 0; i < started; i++) {
+        success = fleet[i].stop() && success;
+        sent += fleet[i].sent();
+    }
+    const double elapsed = (readClock() - start) / 1e9;
+    delete[] fleet;
+
+    HostIot_SetSink(nullptr, nullptr);
+    if (output) {
+        fclose(output);
+    }
+
+    printf("{\"devices\":%u,\"period_ms\":%u,\"duration_s\":%.3f,"
+           "\"telemetry\":%llu,\"messages\":%llu,\"bytes\":%llu,"
+           "\"messages_per_s\":%.1f,\"loop_backend\":\"%s\","
+           "\"loop_syscalls\":%llu}\n",
+           started, period_ms, elapsed,
+           static_cast<unsigned long long>(sent),
+           static_cast<unsigned long long>(hub.messages()),
+           static_cast<unsigned long long>(hub.bytes()),
+           hub.messages() / elapsed, HostEventLoop_GetBackend(),
+           static_cast<unsigned long long>(HostEventLoop_GetSyscallCount()));
+
+    return success ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,496 @@
+/**
+ * @file primitives.cc
+ * @author Matthieu Bucchianeri
+ * @brief Microbenchmarks of the library primitives, on the host build.
+ *
+ * Usage: sphereplusplus-bench [filter]
+ *
+ * The results are written to the standard output as JSON (see bench.hh).
+ */
+
+#include <sys/eventfd.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <sphereplusplus/abort.hh>
+#include <sphereplusplus/application.hh>
+#include <sphereplusplus/clock.hh>
+#include <sphereplusplus/delegate.hh>
+#include <sphereplusplus/gpio.hh>
+#include <sphereplusplus/profiler.hh>
+#include <sphereplusplus/timer.hh>
+
+#include <applibs/eventloop.h>
+
+#include "../internal.hh"
+#include "bench.hh"
+
+using namespace SpherePlusPlus;
+using namespace SpherePlusPlus::Bench;
+
+namespace {
+
+/*
+ * Callbacks
+ */
+
+/**
+ * The state updated by the callbacks.
+ */
+uint64_t g_counter = 0;
+
+__attribute__((noinline)) void increment()
+{
+    g_counter++;
+}
+
+/**
+ * @brief Interface invoked with a virtual call.
+ */
+class Callable
+{
+public:
+    virtual ~Callable()
+    {
+    }
+
+    virtual void call() = 0;
+};
+
+/**
+ * @brief Implementation invoked with a virtual call.
+ */
+class Counter : public Callable
+{
+public:
+    __attribute__((noinline)) virtual void call() override
+    {
+        g_counter++;
+    }
+
+    __attribute__((noinline)) void method()
+    {
+        g_counter++;
+    }
+};
+
+/**
+ * @brief Owning, type-erased callable, standing for std::function (which
+ *        is not available without the C++ library): the callable is copied
+ *        to the heap, and invoked through a virtual call.
+ */
+class Function
+{
+public:
+    template<typename LAMBDA>
+    Function(const LAMBDA &lambda) :
+        m_callable(new Holder<LAMBDA>(lambda))
+    {
+    }
+
+    Function(const Function &other) = delete;
+    Function &operator =(const Function &other) = delete;
+
+    ~Function()
+    {
+        delete m_callable;
+    }
+
+    void operator()() const
+    {
+        m_callable->call();
+    }
+
+private:
+    template<typename LAMBDA>
+    class Holder : public Callable
+    {
+    public:
+        Holder(const LAMBDA &lambda) :
+            m_lambda(lambda)
+        {
+        }
+
+        virtual void call() override
+        {
+            m_lambda();
+        }
+
+    private:
+        LAMBDA m_lambda;
+    };
+
+    Callable *const m_callable;
+};
+
+/*
+ * Calls
+ */
+
+uint64_t callFunctionPointer(const uint64_t iterations)
+{
+    void (*function)() = increment;
+    keep(function);
+
+    const uint64_t start = readClock();
+    for (uint64_t i = 0; i < iterations; i++) {
+        clobber();
+        function();
+    }
+
+    return readClock() - start;
+}
+
+uint64_t callVirtual(const uint64_t iterations)
+{
+    Counter counter;
+    Callable *callable = &counter;
+    keep(callable);
+
+    const uint64_t start = readClock();
+    for (uint64_t i = 0; i < iterations; i++) {
+        clobber();
+        callable->call();
+    }
+
+    return readClock() - start;
+}
+
+uint64_t callDelegateMethod(const uint64_t iterations)
+{
+    Counter counter;
+    Delegate<void()> delegate;
+    delegate.connect<Counter, &Counter::method>(counter);
+    keep(delegate);
+
+    const uint64_t start = readClock();
+    for (uint64_t i = 0; i < iterations; i++) {
+        clobber();
+        delegate();
+    }
+
+    return readClock() - start;
+}
+
+uint64_t callDelegateLambda(const uint64_t iterations)
+{
+    uint64_t counter = 0;
+    const auto lambda = [&counter]() { counter++; };
+    Delegate<void()> delegate;
+    delegate.connect(lambda);
+    keep(delegate);
+
+    const uint64_t start = readClock();
+    for (uint64_t i = 0; i < iterations; i++) {
+        clobber();
+        delegate();
+    }
+    keep(counter);
+
+    return readClock() - start;
+}
+
+uint64_t callFunction(const uint64_t iterations)
+{
+    uint64_t counter = 0;
+    const Function function([&counter]() { counter++; });
+    keep(function);
+
+    const uint64_t start = readClock();
+    for (uint64_t i = 0; i < iterations; i++) {
+        clobber();
+        function();
+    }
+    keep(counter);
+
+    return readClock() - start;
+}
+
+/*
+ * Timers
+ */
+
+uint64_t timerArmCancel(const uint64_t iterations)
+{
+    Timer timer;
+    AbortIfNot(timer.init(), 0);
+    timer.connect<increment>();
+
+    const uint64_t start = readClock();
+    for (uint64_t i = 0; i < iterations; i++) {
+        timer.startOneShot(1000000);
+        timer.stop();
+    }
+    const uint64_t duration = readClock() - start;
+
+    AbortIfNot(timer.destroy(), 0);
+
+    return duration;
+}
+
+uint64_t timerArmCancelVirtual(const uint64_t iterations)
+{
+    VirtualClock clock;
+    AbortIfNot(clock.init(), 0);
+    Timer timer;
+    AbortIfNot(timer.init(), 0);
+    timer.connect<increment>();
+
+    const uint64_t start = readClock();
+    for (uint64_t i = 0; i < iterations; i++) {
+        timer.startOneShot(1000000);
+        timer.stop();
+    }
+    const uint64_t duration = readClock() - start;
+
+    AbortIfNot(timer.destroy(), 0);
+    AbortIfNot(clock.destroy(), 0);
+
+    return duration;
+}
+
+/*
+ * Event loop
+ */
+
+void readEvent(EventLoop *const el, const int fd,
+               const EventLoop_IoEvents events, void *const context)
+{
+    uint64_t value;
+    (void)read(fd, &value, sizeof(value));
+    g_counter++;
+}
+
+uint64_t loopDispatch(const uint64_t iterations)
+{
+    EventLoop *const el = EventLoop_Create();
+    AbortErrnoPtr(el, 0);
+    const int fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    AbortErrno(fd, 0);
+    EventRegistration *const reg =
+        EventLoop_RegisterIo(el, fd, EventLoop_Input, readEvent, nullptr);
+    AbortErrnoPtr(reg, 0);
+
+    const uint64_t value = 1;
+    const uint64_t start = readClock();
+    for (uint64_t i = 0; i < iterations; i++) {
+        (void)write(fd, &value, sizeof(value));
+        EventLoop_Run(el, 0, true);
+    }
+    const uint64_t duration = readClock() - start;
+
+    EventLoop_UnregisterIo(el, reg);
+    close(fd);
+    EventLoop_Close(el);
+
+    return duration;
+}
+
+uint64_t loopDispatchBatch(const uint64_t iterations)
+{
+    /*
+     * Many events ready at once, as when simulating many devices.
+     */
+    static constexpr size_t k_batch = 64;
+
+    EventLoop *const el = EventLoop_Create();
+    AbortErrnoPtr(el, 0);
+    int fds[k_batch];
+    EventRegistration *regs[k_batch];
+    for (size_t i = 0; i < k_batch; i++) {
+        fds[i] = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        AbortErrno(fds[i], 0);
+        regs[i] = EventLoop_RegisterIo(el, fds[i], EventLoop_Input, readEvent,
+                                       nullptr);
+        AbortErrnoPtr(regs[i], 0);
+    }
+
+    const uint64_t value = 1;
+    const uint64_t start = readClock();
+    for (uint64_t i = 0; i < iterations; i += k_batch) {
+        for (size_t j = 0; j < k_batch; j++) {
+            (void)write(fds[j], &value, sizeof(value));
+        }
+        for (size_t j = 0; j < k_batch; j++) {
+            EventLoop_Run(el, 0, true);
+        }
+    }
+    const uint64_t duration = readClock() - start;
+
+    for (size_t i = 0; i < k_batch; i++) {
+        EventLoop_UnregisterIo(el, regs[i]);
+        close(fds[i]);
+    }
+    EventLoop_Close(el);
+
+    return duration;
+}
+
+uint64_t loopTimerExpiry(const uint64_t iterations)
+{
+    Timer timer;
+    AbortIfNot(timer.init(), 0);
+    timer.connect<increment>();
+
+    EventLoop *const el = getEventLoop();
+    const uint64_t start = readClock();
+    for (uint64_t i = 0; i < iterations; i++) {
+        /*
+         * The shortest delay, the timer expires while entering the loop.
+         */
+        timer.startOneShot(1);
+        while (EventLoop_Run(el, -1, true) != EventLoop_Run_Finished) {
+        }
+    }
+    const uint64_t duration = readClock() - start;
+
+    AbortIfNot(timer.destroy(), 0);
+
+    return duration;
+}
+
+uint64_t dispatchScope(const uint64_t iterations)
+{
+    const uint64_t start = readClock();
+    for (uint64_t i = 0; i < iterations; i++) {
+        DispatchScope scope(DispatchKind::Timer,
+                            reinterpret_cast<const void *>(increment),
+                            nullptr);
+        clobber();
+    }
+
+    return readClock() - start;
+}
+
+uint64_t dispatchScopeProfiled(const uint64_t iterations)
+{
+    CallbackProfiler profiler;
+    AbortIfNot(profiler.init(), 0);
+
+    const uint64_t duration = dispatchScope(iterations);
+
+    AbortIfNot(profiler.destroy(), 0);
+
+    return duration;
+}
+
+/*
+ * GPIO
+ */
+
+uint64_t gpioSet(const uint64_t iterations)
+{
+    GpioOut gpio(0, GPIO_OutputMode_PushPull);
+    AbortIfNot(gpio.init(false), 0);
+
+    const uint64_t start = readClock();
+    for (uint64_t i = 0; i < iterations; i++) {
+        gpio.set(i & 1);
+    }
+
+    return readClock() - start;
+}
+
+uint64_t gpioGet(const uint64_t iterations)
+{
+    GpioIn gpio(0);
+    AbortIfNot(gpio.init(), 0);
+
+    bool level = false;
+    const uint64_t start = readClock();
+    for (uint64_t i = 0; i < iterations; i++) {
+        gpio.get(level);
+        keep(level);
+    }
+
+    return readClock() - start;
+}
+
+/*
+ * Abort macros, on the success path
+ */
+
+__attribute__((noinline)) bool checkPlain(const int value)
+{
+    if (value < 0) {
+        return false;
+    }
+
+    return true;
+}
+
+__attribute__((noinline)) bool checkAbortIfNot(const int value)
+{
+    AbortIfNot(value >= 0, false);
+
+    return true;
+}
+
+__attribute__((noinline)) bool checkAbortIfNeq(const int value)
+{
+    AbortIfNeq(value & 0x10000, 0, false);
+
+    return true;
+}
+
+__attribute__((noinline)) bool checkAbortErrno(const int value)
+{
+    AbortErrno(value, false);
+
+    return true;
+}
+
+template<bool (*CHECK)(int)>
+uint64_t check(const uint64_t iterations)
+{
+    const uint64_t start = readClock();
+    for (uint64_t i = 0; i < iterations; i++) {
+        const bool result = CHECK(static_cast<int>(i & 0xffff));
+        keep(result);
+    }
+
+    return readClock() - start;
+}
+
+} /* namespace */
+
+int main(const int argc, const char *const argv[])
+{
+    /*
+     * The timers need an application.
+     */
+    BasicApplication<ApplicationFeatures::None> application;
+    AbortIfNot(application.init(ApplicationFeatures::None), EXIT_FAILURE);
+
+    {
+        Runner runner(argc > 1 ? argv[1] : nullptr);
+
+        runner.run("call.function_pointer", callFunctionPointer);
+        runner.run("call.virtual", callVirtual);
+        runner.run("call.delegate_method", callDelegateMethod);
+        runner.run("call.delegate_lambda", callDelegateLambda);
+        runner.run("call.function", callFunction);
+
+        runner.run("timer.arm_cancel", timerArmCancel);
+        runner.run("timer.arm_cancel_virtual", timerArmCancelVirtual);
+
+        runner.run("loop.dispatch", loopDispatch);
+        runner.run("loop.dispatch_batch", loopDispatchBatch);
+        runner.run("loop.timer_expiry", loopTimerExpiry);
+        runner.run("loop.dispatch_scope", dispatchScope);
+        runner.run("loop.dispatch_scope_profiled", dispatchScopeProfiled);
+
+        runner.run("gpio.set", gpioSet);
+        runner.run("gpio.get", gpioGet);
+
+        runner.run("abort.plain", check<checkPlain>);
+        runner.run("abort.if_not", check<checkAbortIfNot>);
+        runner.run("abort.if_neq", check<checkAbortIfNeq>);
+        runner.run("abort.errno", check<checkAbortErrno>);
+    }
+
+    AbortIfNot(application.destroy(), EXIT_FAILURE);
+
+    return EXIT_SUCCESS;
+}
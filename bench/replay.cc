@@ -0,0 +1,432 @@
+/**
+ * @file replay.cc
+ * @author Matthieu Bucchianeri
+ * @brief Record and replay of the inputs of an application, on the host
+ *        build, for performance regression tests.
+ *
+ * Usage: sphereplusplus-replay record <recording> [hours]
+ *        sphereplusplus-replay play <recording>
+ *
+ * The application sends telemetry every minute to Azure IoT Central, and
+ * handles the update notifications, on a virtual clock. It leaves out the
+ * health report, which depends on the real time measured by the event loop,
+ * and would make the replay diverge from the recording.
+ *
+ * In record mode, the application runs for the given number of hours (24 by
+ * default) through network outages and a system update notification, and its
+ * inputs are written to the recording (see record.hh). In play mode, the
+ * recording is replayed (see replay.hh), and a summary is written to the
+ * standard output as JSON: the CPU and wall time of the replay, the inputs of
+ * the replay compared with the recording, and the callback profile.
+ */
+
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <sphereplusplus/abort.hh>
+#include <sphereplusplus/application.hh>
+#include <sphereplusplus/clock.hh>
+#include <sphereplusplus/profiler.hh>
+#include <sphereplusplus/record.hh>
+#include <sphereplusplus/replay.hh>
+#include <sphereplusplus/timer.hh>
+
+#include <host/iot.h>
+#include <host/sysevent.h>
+
+using namespace SpherePlusPlus;
+
+namespace {
+
+using Input = InputRecorder::Input;
+
+/**
+ * The maximum number of inputs of a recording.
+ */
+static constexpr size_t k_maxInputs = 1 << 21;
+
+/**
+ * The period of the telemetry, in seconds.
+ */
+static constexpr uint64_t k_telemetryPeriod = 60;
+
+/**
+ * The number of types of input.
+ */
+static constexpr size_t k_inputKinds =
+    static_cast<size_t>(InputKind::IotConfirmation) + 1;
+
+/**
+ * @brief Application under test.
+ */
+class TestApplication : public Application
+{
+public:
+    /**
+     * @brief Initialize the application.
+     * @return True on success.
+     */
+    bool init()
+    {
+        AbortIfNot(Application::init(ApplicationFeatures::IoTCentral |
+                                     ApplicationFeatures::UpdateNotification,
+                                     "0ne000REPLAY"),
+                   false);
+        AbortIfNot(m_telemetryTimer.init(), false);
+        m_telemetryTimer.connect<TestApplication,
+                                 &TestApplication::sendReadings>(*this);
+        AbortIfNot(m_telemetryTimer.startPeriodic(k_telemetryPeriod *
+                                                  1000000),
+                   false);
+
+        return true;
+    }
+
+    /**
+     * @brief Destroy the application.
+     * @return True on success.
+     */
+    virtual bool destroy() override
+    {
+        AbortIfNot(m_telemetryTimer.destroy(), false);
+        AbortIfNot(Application::destroy(), false);
+
+        return true;
+    }
+
+private:
+    /**
+     * @brief Telemetry timer callback.
+     */
+    void sendReadings()
+    {
+        char message[64];
+        snprintf(message, sizeof(message), "{\"seq\":%u,\"level\":%u}",
+                 m_sequence, (m_sequence * 7919) % 1000);
+        m_sequence++;
+
+        sendTelemetry(message);
+    }
+
+    /**
+     * The timer sending the telemetry.
+     */
+    Timer m_telemetryTimer;
+
+    /**
+     * The sequence number of the next message.
+     */
+    uint32_t m_sequence = 0;
+};
+
+/**
+ * @brief Outside world of the recording: network outages and a system update
+ *        notification, scheduled on the virtual clock rather than with timers,
+ *        so that they are not recorded as timer expiries.
+ */
+class World
+{
+public:
+    /**
+     * @brief Constructor.
+     * @param[in] clock The virtual clock.
+     */
+    World(VirtualClock &clock) :
+        m_clock(clock),
+        m_outage(),
+        m_update(),
+        m_seed(1),
+        m_down(false)
+    {
+        m_outage.expire = toggleNetwork;
+        m_outage.context = this;
+        m_clock.schedule(m_outage, m_clock.time() + nextOutage());
+
+        m_update.expire = notifyUpdate;
+        m_update.context = this;
+        m_clock.schedule(m_update, m_clock.time() + 12 * 3600000000000ull);
+    }
+
+    World(const World &other) = delete;
+    World &operator =(const World &other) = delete;
+
+    /**
+     * @brief Destructor.
+     */
+    ~World()
+    {
+        m_clock.cancel(m_outage);
+        m_clock.cancel(m_update);
+        HostIot_SetNetworkAvailable(true);
+    }
+
+private:
+    /**
+     * @brief Get the delay before the next outage, 1 to 4 hours.
+     * @return The delay, in nanoseconds.
+     */
+    uint64_t nextOutage()
+    {
+        return (3600 + rand_r(&m_seed) % (3 * 3600)) * 1000000000ull;
+    }
+
+    /**
+     * @brief Outage alarm callback.
+     * @param[in] context The World object.
+     */
+    static void toggleNetwork(void *const context)
+    {
+        World *const world = static_cast<World *>(context);
+
+        world->m_down = !world->m_down;
+        HostIot_SetNetworkAvailable(!world->m_down);
+
+        /*
+         * The outages last 1 to 20 minutes.
+         */
+        const uint64_t delay = world->m_down ?
+            (60 + rand_r(&world->m_seed) % (19 * 60)) * 1000000000ull :
+            world->nextOutage();
+        world->m_clock.schedule(world->m_outage,
+                                world->m_outage.deadline_ns + delay);
+    }
+
+    /**
+     * @brief Update alarm callback.
+     * @param[in] context The World object.
+     */
+    static void notifyUpdate(void *const context)
+    {
+        SysEvent_Info_UpdateData update;
+        update.max_deferral_time_in_minutes = 10;
+        update.update_type = SysEvent_UpdateType_System;
+        AbortErrno(HostSysEvent_Post(SysEvent_Events_UpdateReadyForInstall,
+                                     SysEvent_Status_Pending, &update));
+    }
+
+    /**
+     * The virtual clock.
+     */
+    VirtualClock &m_clock;
+
+    /**
+     * The next outage, or the end of the outage.
+     */
+    VirtualClock::Alarm m_outage;
+
+    /**
+     * The update notification.
+     */
+    VirtualClock::Alarm m_update;
+
+    /**
+     * The state of the random generator.
+     */
+    unsigned int m_seed;
+
+    /**
+     * Whether the network is down.
+     */
+    bool m_down;
+};
+
+/**
+ * @brief Count the inputs of each type.
+ * @param[in] inputs The inputs.
+ * @param[in] count The number of inputs.
+ * @param[out] counts The number of inputs of each type.
+ */
+void countInputs(const Input *const inputs, const size_t count,
+                 size_t (&counts)[k_inputKinds])
+{
+    memset(counts, 0, sizeof(counts));
+    for (size_t i = 0; i < count; i++) {
+        counts[static_cast<size_t>(inputs[i].kind)]++;
+    }
+}
+
+/**
+ * @brief Print the number of inputs of each type as a JSON object.
+ * @param[in] counts The number of inputs of each type.
+ */
+void printCounts(const size_t (&counts)[k_inputKinds])
+{
+    for (size_t i = 0; i < k_inputKinds; i++) {
+        printf("%s\"%s\":%zu", i ? "," : "{",
+               InputRecorder::inputKindName(static_cast<InputKind>(i)),
+               counts[i]);
+    }
+    printf("}");
+}
+
+/**
+ * @brief Record the application.
+ * @param[in] path The path of the recording.
+ * @param[in] hours The duration of the recording, in hours.
+ * @return True on success.
+ */
+bool record(const char *const path, const uint64_t hours)
+{
+    Input *const inputs = new Input[k_maxInputs];
+
+    VirtualClock clock;
+    AbortIfNot(clock.init(), false);
+    TestApplication application;
+    AbortIfNot(application.init(), false);
+    InputRecorder recorder;
+    AbortIfNot(recorder.init(inputs, k_maxInputs, true), false);
+
+    {
+        World world(clock);
+
+        VirtualClock::Alarm end = {};
+        end.expire = [](void *const context) {
+            static_cast<TestApplication *>(context)->stop();
+        };
+        end.context = &application;
+        clock.schedule(end, clock.time() + hours * 3600000000000ull);
+
+        AbortIfNot(application.run(), false);
+    }
+
+    AbortIfNot(recorder.destroy(), false);
+    AbortIfNot(application.destroy(), false);
+    AbortIfNot(clock.destroy(), false);
+
+    const int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    AbortErrno(fd, false);
+    const bool written = recorder.write(fd);
+    close(fd);
+    AbortIfNot(written, false);
+
+    Log_Debug("Recorded %zu inputs (%u dropped) over %llu hours\n",
+              recorder.count(), recorder.dropped(),
+              static_cast<unsigned long long>(hours));
+    delete[] inputs;
+
+    return recorder.dropped() == 0;
+}
+
+/**
+ * @brief Replay a recording of the application.
+ * @param[in] path The path of the recording.
+ * @return True on success.
+ */
+bool play(const char *const path)
+{
+    Input *const recorded = new Input[k_maxInputs];
+    Input *const replayed = new Input[k_maxInputs];
+
+    FILE *const file = fopen(path, "r");
+    AbortErrnoPtr(file, false);
+    size_t count;
+    const bool loaded = InputReplayer::load(file, recorded, k_maxInputs,
+                                            count);
+    fclose(file);
+    AbortIfNot(loaded, false);
+
+    VirtualClock clock;
+    AbortIfNot(clock.init(), false);
+    TestApplication application;
+    AbortIfNot(application.init(), false);
+    InputRecorder recorder;
+    AbortIfNot(recorder.init(replayed, k_maxInputs, true), false);
+    CallbackProfiler profiler;
+    AbortIfNot(profiler.init(), false);
+
+    InputReplayer replayer;
+    const auto stop = [&application]() { application.stop(); };
+    replayer.connect(stop);
+    AbortIfNot(replayer.init(recorded, count), false);
+
+    const uint64_t wallStart = readClock(CLOCK_MONOTONIC);
+    const uint64_t cpuStart = readClock(CLOCK_PROCESS_CPUTIME_ID);
+    AbortIfNot(application.run(), false);
+    const uint64_t cpu = readClock(CLOCK_PROCESS_CPUTIME_ID) - cpuStart;
+    const uint64_t wall = readClock(CLOCK_MONOTONIC) - wallStart;
+    const uint64_t virtualTime = clock.time();
+
+    CallbackProfiler::Handler handlers[CallbackProfiler::k_maxHandlers];
+    const size_t handlerCount =
+        profiler.snapshot(handlers, CallbackProfiler::k_maxHandlers);
+
+    AbortIfNot(replayer.destroy(), false);
+    AbortIfNot(profiler.destroy(), false);
+    AbortIfNot(recorder.destroy(), false);
+    AbortIfNot(application.destroy(), false);
+    AbortIfNot(clock.destroy(), false);
+
+    /*
+     * The replay matches the recording up to the first input that differs.
+     */
+    size_t matching = 0;
+    while (matching < count && matching < recorder.count() &&
+           recorded[matching].kind == replayed[matching].kind &&
+           !memcmp(recorded[matching].values, replayed[matching].values,
+                   sizeof(recorded[matching].values))) {
+        matching++;
+    }
+
+    size_t recordedCounts[k_inputKinds];
+    size_t replayedCounts[k_inputKinds];
+    countInputs(recorded, count, recordedCounts);
+    countInputs(replayed, recorder.count(), replayedCounts);
+
+    printf("{\"virtual_s\":%.3f,\"wall_ms\":%.3f,\"cpu_ms\":%.3f,"
+           "\"inputs\":%zu,\"matching_inputs\":%zu,\"recorded\":",
+           virtualTime / 1e9, wall / 1e6, cpu / 1e6, count, matching);
+    printCounts(recordedCounts);
+    printf(",\"replayed\":");
+    printCounts(replayedCounts);
+    printf(",\"callbacks\":[");
+    for (size_t i = 0; i < handlerCount; i++) {
+        const CallbackProfiler::Handler &handler = handlers[i];
+
+        printf("%s\n {\"kind\":\"%s\",\"callback\":\"0x%lx\",\"calls\":%u,"
+               "\"wall_mean_ns\":%llu,\"wall_max_ns\":%llu,"
+               "\"wall_histogram\":[",
+               i ? "," : "", dispatchKindName(handler.kind),
+               static_cast<unsigned long>(
+                   reinterpret_cast<uintptr_t>(handler.callback) -
+                   reinterpret_cast<uintptr_t>(&__executable_start)),
+               handler.calls,
+               static_cast<unsigned long long>(
+                   handler.wallSamples ?
+                   handler.wallTotal_ns / handler.wallSamples : 0),
+               static_cast<unsigned long long>(handler.wallMax_ns));
+        for (size_t j = 0; j < CallbackProfiler::k_histogramBuckets; j++) {
+            printf("%s%u", j ? "," : "", handler.wallHistogram[j]);
+        }
+        printf("]}");
+    }
+    printf("\n]}\n");
+
+    delete[] replayed;
+    delete[] recorded;
+
+    return true;
+}
+
+} /* namespace */
+
+int main(const int argc, const char *const argv[])
+{
+    if (argc >= 3 && !strcmp(argv[1], "record")) {
+        const uint64_t hours = argc > 3 ? strtoull(argv[3], nullptr, 0) : 24;
+        return record(argv[2], hours) ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+
+    if (argc == 3 && !strcmp(argv[1], "play")) {
+        return play(argv[2]) ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+
+    fprintf(stderr, "Usage: %s record <recording> [hours]\n"
+            "       %s play <recording>\n", argv[0], argv[0]);
+
+    return EXIT_FAILURE;
+}
@@ -0,0 +1,61 @@
+/**
+ * @file budget.hh
+ * @author Matthieu Bucchianeri
+ * @brief Compile-time memory budget assertions.
+ *
+ * The budget is read from a header provided by the application, named by the
+ * SPHERE_PLUS_PLUS_BUDGET_HEADER macro, for example:
+ *
+ * $ cat budget.h
+ * #define SPHERE_PLUS_PLUS_BUDGET_TIMER        32
+ * #define SPHERE_PLUS_PLUS_BUDGET_APPLICATION  256
+ *
+ * $ g++ -DSPHERE_PLUS_PLUS_BUDGET_HEADER='"budget.h"' ...
+ *
+ * Each budget is optional, and is the maximum size of an instance of the
+ * class, in bytes. The application may also check its own classes with
+ * AssertFootprint().
+ */
+
+#pragma once
+
+#include <sphereplusplus/application.hh>
+#include <sphereplusplus/delegate.hh>
+#include <sphereplusplus/gpio.hh>
+#include <sphereplusplus/timer.hh>
+
+#ifdef SPHERE_PLUS_PLUS_BUDGET_HEADER
+#include SPHERE_PLUS_PLUS_BUDGET_HEADER
+#endif
+
+namespace SpherePlusPlus {
+
+/**
+ * Assert that a type fits in its memory budget, or fail the build.
+ *
+ * @param[in] type The type to check.
+ * @param[in] bytes The maximum size of an instance of the type, in bytes.
+ */
+#define AssertFootprint(type, bytes)                                    \
+    static_assert(sizeof(type) <= (bytes),                              \
+                  #type " exceeds its memory budget of "                \
+                  __stringify(bytes) " bytes")
+
+#ifdef SPHERE_PLUS_PLUS_BUDGET_DELEGATE
+AssertFootprint(Delegate<void()>, SPHERE_PLUS_PLUS_BUDGET_DELEGATE);
+#endif
+
+#ifdef SPHERE_PLUS_PLUS_BUDGET_TIMER
+AssertFootprint(Timer, SPHERE_PLUS_PLUS_BUDGET_TIMER);
+#endif
+
+#ifdef SPHERE_PLUS_PLUS_BUDGET_GPIO
+AssertFootprint(GpioIn, SPHERE_PLUS_PLUS_BUDGET_GPIO);
+AssertFootprint(GpioOut, SPHERE_PLUS_PLUS_BUDGET_GPIO);
+#endif
+
+#ifdef SPHERE_PLUS_PLUS_BUDGET_APPLICATION
+AssertFootprint(Application, SPHERE_PLUS_PLUS_BUDGET_APPLICATION);
+#endif
+
+} /* namespace SpherePlusPlus */
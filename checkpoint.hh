@@ -0,0 +1,798 @@
+/**
+ * @file checkpoint.hh
+ * @author Matthieu Bucchianeri
+ * @brief Checkpoint of the state of the application to mutable storage.
+ *
+ * The components of the application register with the checkpoint, and
+ * serialize a compact state (aggregation windows, counters, learned
+ * parameters...) into a single blob, written to the mutable storage of the
+ * application periodically and when the application is flushed before
+ * shutting down or rebooting (see ApplicationBase::flush()). The blob is loaded
+ * when the checkpoint is initialized, and each component restores its state
+ * when it registers, so that the application resumes warm after a reboot.
+ *
+ * The blob is made of a header, with the format version, a sequence number,
+ * the wall-clock time it was saved and a CRC-32 of the header and the records,
+ * and of one record per component, identified by the hash of its name, with
+ * the version of its state. The blobs are written alternately to two slots of
+ * the mutable storage, and the newest valid blob is loaded: a blob torn by a
+ * power loss leaves the previous one intact. A blob written by an incompatible
+ * version is discarded, and the components start cold. A blob identical to the
+ * newest one is not written again, to spare the flash.
+ */
+
+#pragma once
+
+#include <fcntl.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <applibs/storage.h>
+
+#include <sphereplusplus/abort.hh>
+#include <sphereplusplus/clock.hh>
+#include <sphereplusplus/delegate.hh>
+#include <sphereplusplus/energy.hh>
+#include <sphereplusplus/timer.hh>
+
+namespace SpherePlusPlus {
+
+class Checkpoint;
+
+/**
+ * @brief A component saving its state into the checkpoint.
+ */
+class CheckpointComponent
+{
+public:
+    /**
+     * @brief Constructor.
+     * @param[in] name The name of the component, identifying its state in the
+     *            checkpoint. It must remain valid.
+     */
+    CheckpointComponent(const char *const name) :
+        m_name(name),
+        m_id(hash(name)),
+        m_version(0),
+        m_checkpoint(nullptr),
+        m_next(nullptr),
+        m_save(),
+        m_restore(),
+        m_restored(false)
+    {
+    }
+
+    /*
+     * Components are linked into the checkpoint, and cannot be copied.
+     */
+    CheckpointComponent(const CheckpointComponent &other) = delete;
+    CheckpointComponent &operator =(const CheckpointComponent &other) = delete;
+
+    /**
+     * @brief Destructor.
+     */
+    virtual ~CheckpointComponent()
+    {
+        if (m_checkpoint) {
+            destroy();
+        }
+    }
+
+    /**
+     * @brief Register the component with the checkpoint, and restore its
+     *        state when the checkpoint loaded from storage has one.
+     * @param[in] checkpoint The checkpoint.
+     * @param[in] version The version of the state of the component. A state
+     *            saved with another version is not restored.
+     * @return True on success.
+     * @note The callbacks must be connected beforehand.
+     */
+    inline bool init(Checkpoint &checkpoint, uint16_t version = 0);
+
+    /**
+     * @brief Unregister the component from the checkpoint.
+     * @return True on success.
+     */
+    inline bool destroy();
+
+    /**
+     * @brief Connect class methods to save and restore the state.
+     * @tparam T The class type.
+     * @tparam TSave The class method saving the state into a buffer, given
+     *         with its size, and returning the size of the state, or 0 when
+     *         the state does not fit.
+     * @tparam TRestore The class method restoring the state from a buffer,
+     *         given with its size, and returning true on success.
+     * @param[in] instance The class instance.
+     */
+    template<class T, size_t (T::*TSave)(uint8_t *, size_t),
+             bool (T::*TRestore)(const uint8_t *, size_t)>
+    void connect(T &instance)
+    {
+        m_save.connect<T, TSave>(instance);
+        m_restore.connect<T, TRestore>(instance);
+    }
+
+    /**
+     * @brief Connect lambdas to save and restore the state.
+     * @tparam SAVE The lambda type saving the state.
+     * @tparam RESTORE The lambda type restoring the state.
+     * @param[in] save The closure saving the state.
+     * @param[in] restore The closure restoring the state.
+     * @see connect
+     */
+    template <typename SAVE, typename RESTORE>
+    void connect(const SAVE &save, const RESTORE &restore)
+    {
+        m_save.connect<SAVE>(save);
+        m_restore.connect<RESTORE>(restore);
+    }
+
+    /**
+     * @brief Get the name of the component.
+     * @return The name of the component.
+     */
+    const char *name() const
+    {
+        return m_name;
+    }
+
+    /**
+     * @brief Whether the state of the component was restored from storage.
+     * @return True when the component started warm.
+     */
+    bool restored() const
+    {
+        return m_restored;
+    }
+
+private:
+    /**
+     * @brief Hash the name of a component (32-bit FNV-1a).
+     * @param[in] name The name.
+     * @return The hash.
+     */
+    static uint32_t hash(const char *name)
+    {
+        uint32_t hash = 2166136261u;
+        while (*name) {
+            hash = (hash ^ static_cast<uint8_t>(*name++)) * 16777619u;
+        }
+
+        return hash;
+    }
+
+    /**
+     * The name of the component.
+     */
+    const char *const m_name;
+
+    /**
+     * The identifier of the state of the component in the checkpoint.
+     */
+    const uint32_t m_id;
+
+    /**
+     * The version of the state of the component.
+     */
+    uint16_t m_version;
+
+    /**
+     * The checkpoint of the component.
+     */
+    Checkpoint *m_checkpoint;
+
+    /**
+     * The next component registered with the checkpoint.
+     */
+    CheckpointComponent *m_next;
+
+    /**
+     * The callback saving the state.
+     */
+    Delegate<size_t(uint8_t *, size_t)> m_save;
+
+    /**
+     * The callback restoring the state.
+     */
+    Delegate<bool(const uint8_t *, size_t)> m_restore;
+
+    /**
+     * Whether the state was restored from storage.
+     */
+    bool m_restored;
+
+    friend class Checkpoint;
+};
+
+/**
+ * @brief Checkpoint of the state of the application to mutable storage.
+ * @note Requires the "MutableStorage" application capability, with a size of
+ *       at least twice the capacity of the checkpoint.
+ */
+class Checkpoint
+{
+public:
+    /**
+     * The version of the format of the checkpoint.
+     */
+    static constexpr uint16_t k_formatVersion = 3;
+
+    /**
+     * The number of slots written alternately.
+     */
+    static constexpr unsigned k_slots = 2;
+
+    /**
+     * @brief Constructor.
+     */
+    Checkpoint() :
+        m_fd(-1),
+        m_buffer(nullptr),
+        m_capacity(0),
+        m_size(0),
+        m_loaded(false),
+        m_sequence(0),
+        m_slot(0),
+        m_storedSize(0),
+        m_recordsCrc(0),
+        m_storedTime_s(0),
+        m_components(nullptr),
+        m_timer(),
+        m_saves(0)
+    {
+    }
+
+    /*
+     * Components are linked into the checkpoint, and cannot be copied.
+     */
+    Checkpoint(const Checkpoint &other) = delete;
+    Checkpoint &operator =(const Checkpoint &other) = delete;
+
+    /**
+     * @brief Destructor.
+     */
+    virtual ~Checkpoint()
+    {
+        if (m_fd >= 0) {
+            destroy();
+        }
+    }
+
+    /**
+     * @brief Initialize the checkpoint, and load the checkpoint saved in
+     *        storage.
+     * @param[in] buffer The buffer holding the checkpoint. It must remain
+     *            valid until the checkpoint is destroyed.
+     * @param[in] capacity The size of the buffer, in bytes, which is the
+     *            maximum size of the checkpoint, and the size of each slot in
+     *            storage.
+     * @param[in] period_s The period of the checkpoint, in seconds, or 0 to
+     *            only save it with save().
+     * @return True on success.
+     * @note Must be invoked from the thread running the event loop.
+     */
+    virtual bool init(uint8_t *const buffer, const size_t capacity,
+                      const uint32_t period_s = 0)
+    {
+        AbortIf(m_fd >= 0, false);
+        AbortIfNot(buffer, false);
+        AbortIfNot(capacity > sizeof(Header), false);
+
+        m_fd = Storage_OpenMutableFile();
+        AbortErrno(m_fd, false);
+
+        m_buffer = buffer;
+        m_capacity = capacity;
+        m_saves = 0;
+        load();
+
+        bool started = m_timer.init();
+        if (started) {
+            m_timer.setDeferrable(true);
+            m_timer.connect<Checkpoint, &Checkpoint::expired>(*this);
+            started = setPeriod(period_s);
+            if (!started) {
+                m_timer.destroy();
+            }
+        }
+
+        if (!started) {
+            close(m_fd);
+            m_fd = -1;
+            m_buffer = nullptr;
+            m_capacity = 0;
+            m_size = 0;
+            m_loaded = false;
+        }
+        AbortIfNot(started, false);
+
+        return true;
+    }
+
+    /**
+     * @brief Initialize the checkpoint.
+     * @tparam CAPACITY The size of the buffer, in bytes.
+     * @param[in] buffer The buffer holding the checkpoint.
+     * @param[in] period_s The period of the checkpoint, in seconds.
+     * @return True on success.
+     * @see init
+     */
+    template<size_t CAPACITY>
+    bool init(uint8_t (&buffer)[CAPACITY], const uint32_t period_s = 0)
+    {
+        return init(buffer, CAPACITY, period_s);
+    }
+
+    /**
+     * @brief Destroy the checkpoint.
+     * @return True on success.
+     * @note The checkpoint is not saved.
+     */
+    virtual bool destroy()
+    {
+        AbortIfNot(m_fd >= 0, false);
+
+        AbortIfNot(m_timer.destroy(), false);
+        close(m_fd);
+        m_fd = -1;
+
+        while (m_components) {
+            AbortIfNot(m_components->destroy(), false);
+        }
+
+        return true;
+    }
+
+    /**
+     * @brief Change the period of the checkpoint.
+     * @param[in] period_s The period, in seconds, or 0 to only save the
+     *            checkpoint with save().
+     * @return True on success.
+     * @note Each checkpoint is a write to flash memory, which wears out: the
+     *       period is usually in the order of hours.
+     */
+    bool setPeriod(const uint32_t period_s)
+    {
+        AbortIfNot(m_fd >= 0, false);
+
+        if (period_s) {
+            AbortIfNot(m_timer.startPeriodic(period_s * 1000000ull), false);
+        } else {
+            AbortIfNot(m_timer.stop(), false);
+        }
+
+        return true;
+    }
+
+    /**
+     * @brief Save the state of the registered components to storage.
+     * @return True on success.
+     * @note Nothing is written when the state did not change since the newest
+     *       checkpoint in storage.
+     */
+    bool save()
+    {
+        AbortIfNot(m_fd >= 0, false);
+
+        /*
+         * The loaded checkpoint is overwritten, the components registering
+         * from now on start cold.
+         */
+        m_loaded = false;
+
+        Header header;
+        header.magic = k_magic;
+        header.version = k_formatVersion;
+        header.records = 0;
+        header.sequence = m_sequence + 1;
+        header.time_s =
+            static_cast<uint32_t>(VirtualClock::wallTime() / 1000000000);
+        m_size = sizeof(Header);
+
+        for (CheckpointComponent *component = m_components; component;
+             component = component->m_next) {
+            Record record;
+            AbortIf(m_size + sizeof(Record) > m_capacity, false);
+
+            const size_t size = component->m_save(
+                m_buffer + m_size + sizeof(Record),
+                m_capacity - m_size - sizeof(Record));
+            if (!size) {
+                Log_Debug("Checkpoint: component %s does not fit\n",
+                          component->name());
+                m_size = 0;
+                return false;
+            }
+            AbortIf(size > UINT16_MAX || size > m_capacity - m_size -
+                    sizeof(Record), false);
+
+            record.id = component->m_id;
+            record.version = component->m_version;
+            record.size = static_cast<uint16_t>(size);
+            memcpy(m_buffer + m_size, &record, sizeof(record));
+
+            m_size += sizeof(Record) + size;
+            header.records++;
+        }
+
+        header.size = m_size - sizeof(Header);
+
+        /*
+         * Spare the flash when the state did not change.
+         */
+        const uint32_t recordsCrc = crc32(m_buffer + sizeof(Header),
+                                          header.size);
+        if (m_sequence && m_size == m_storedSize &&
+            recordsCrc == m_recordsCrc) {
+            return true;
+        }
+
+        header.crc = crc(header, m_buffer);
+        memcpy(m_buffer, &header, sizeof(header));
+
+        /*
+         * Overwrite the older slot, the newer one stays valid until the write
+         * completed.
+         */
+        const ssize_t written =
+            pwrite(m_fd, m_buffer, m_size, m_slot * m_capacity);
+        AbortErrno(written, false);
+        AbortIfNot(static_cast<size_t>(written) == m_size, false);
+        AbortErrno(fsync(m_fd), false);
+
+        m_sequence = header.sequence;
+        m_slot = (m_slot + 1) % k_slots;
+        m_storedSize = m_size;
+        m_recordsCrc = recordsCrc;
+        m_storedTime_s = header.time_s;
+        m_saves++;
+
+        return true;
+    }
+
+    /**
+     * @brief Discard the checkpoint saved in storage.
+     * @return True on success.
+     */
+    bool discard()
+    {
+        AbortIfNot(m_fd >= 0, false);
+
+        m_loaded = false;
+        m_size = 0;
+        m_sequence = 0;
+        m_slot = 0;
+        m_storedTime_s = 0;
+        AbortErrno(ftruncate(m_fd, 0), false);
+
+        return true;
+    }
+
+    /**
+     * @brief Get the size of the checkpoint last loaded or saved.
+     * @return The size, in bytes.
+     */
+    size_t size() const
+    {
+        return m_size;
+    }
+
+    /**
+     * @brief Get the number of checkpoints written to storage since the
+     *        initialization.
+     * @return The number of checkpoints.
+     */
+    uint32_t saves() const
+    {
+        return m_saves;
+    }
+
+    /**
+     * @brief Get the time the newest checkpoint in storage was saved, which
+     *        survives a restart (see VirtualClock::wallTime()).
+     * @return The time since the epoch, in seconds, or 0 when there is no
+     *         checkpoint in storage.
+     */
+    uint32_t storedTime() const
+    {
+        return m_storedTime_s;
+    }
+
+private:
+    /**
+     * The magic number of the checkpoint ("SPCK").
+     */
+    static constexpr uint32_t k_magic = 0x4b435053;
+
+    /**
+     * @brief Header of the checkpoint.
+     */
+    struct Header
+    {
+        uint32_t magic;
+        uint16_t version;
+        uint16_t records;
+        uint32_t size;
+        uint32_t sequence;
+        uint32_t time_s;
+        uint32_t crc;
+    };
+
+    /**
+     * @brief Header of the state of a component.
+     */
+    struct Record
+    {
+        uint32_t id;
+        uint16_t version;
+        uint16_t size;
+    };
+
+    /**
+     * @brief Load the newest valid checkpoint saved in storage.
+     */
+    void load()
+    {
+        m_loaded = false;
+        m_size = 0;
+        m_sequence = 0;
+        m_slot = 0;
+        m_storedTime_s = 0;
+
+        Header header[k_slots];
+        bool found = false;
+        unsigned newest = 0;
+        for (unsigned slot = 0; slot < k_slots; slot++) {
+            if (read(slot, header[slot]) &&
+                (!found || static_cast<int32_t>(
+                     header[slot].sequence - header[newest].sequence) > 0)) {
+                newest = slot;
+                found = true;
+            }
+        }
+
+        if (!found) {
+            return;
+        }
+
+        /*
+         * The buffer holds the last slot read.
+         */
+        if (newest != k_slots - 1 && !read(newest, header[newest])) {
+            return;
+        }
+
+        m_sequence = header[newest].sequence;
+        m_storedTime_s = header[newest].time_s;
+        m_slot = (newest + 1) % k_slots;
+        m_storedSize = m_size;
+        m_recordsCrc =
+            crc32(m_buffer + sizeof(Header), m_size - sizeof(Header));
+        m_loaded = true;
+    }
+
+    /**
+     * @brief Read a slot of the storage into the buffer, and validate it.
+     * @param[in] slot The slot.
+     * @param[out] header The header of the checkpoint.
+     * @return True when the slot holds a valid checkpoint.
+     */
+    bool read(const unsigned slot, Header &header)
+    {
+        m_size = 0;
+
+        const ssize_t size =
+            pread(m_fd, m_buffer, m_capacity, slot * m_capacity);
+        if (size <= 0) {
+            return false;
+        }
+
+        memset(&header, 0, sizeof(header));
+        if (static_cast<size_t>(size) >= sizeof(Header)) {
+            memcpy(&header, m_buffer, sizeof(header));
+        }
+
+        if (header.magic != k_magic || header.version != k_formatVersion ||
+            header.size > static_cast<size_t>(size) - sizeof(Header) ||
+            header.crc != crc(header, m_buffer)) {
+            Log_Debug("Checkpoint: discarding invalid checkpoint in slot %u\n",
+                      slot);
+            return false;
+        }
+
+        m_size = sizeof(Header) + header.size;
+
+        return true;
+    }
+
+    /**
+     * @brief Restore the state of a component from the loaded checkpoint.
+     * @param[in] component The component.
+     * @return True on success, including when no state was found.
+     */
+    bool restore(CheckpointComponent &component)
+    {
+        component.m_restored = false;
+        if (!m_loaded) {
+            return true;
+        }
+
+        size_t offset = sizeof(Header);
+        while (offset + sizeof(Record) <= m_size) {
+            Record record;
+            memcpy(&record, m_buffer + offset, sizeof(record));
+            offset += sizeof(Record);
+            AbortIf(record.size > m_size - offset, false);
+
+            if (record.id == component.m_id) {
+                if (record.version != component.m_version) {
+                    Log_Debug("Checkpoint: component %s state version %u, "
+                              "expected %u\n", component.name(),
+                              record.version, component.m_version);
+                    return true;
+                }
+
+                AbortIfNot(component.m_restore(m_buffer + offset, record.size),
+                           false);
+                component.m_restored = true;
+                return true;
+            }
+
+            offset += record.size;
+        }
+
+        return true;
+    }
+
+    /**
+     * @brief Periodic timer callback.
+     */
+    void expired()
+    {
+        EnergyModel::Scope scope("checkpoint");
+        AbortIfNot(save());
+    }
+
+    /**
+     * @brief Compute the CRC of a checkpoint, covering the header (up to the
+     *        CRC) and the records.
+     * @param[in] header The header.
+     * @param[in] blob The checkpoint.
+     * @return The CRC.
+     */
+    static uint32_t crc(const Header &header, const uint8_t *const blob)
+    {
+        const uint32_t crc = crc32(reinterpret_cast<const uint8_t *>(&header),
+                                   offsetof(Header, crc));
+
+        return crc32(blob + sizeof(Header), header.size, crc);
+    }
+
+    /**
+     * @brief Compute the CRC-32 (IEEE 802.3) of a buffer.
+     * @param[in] data The buffer.
+     * @param[in] size The size of the buffer, in bytes.
+     * @param[in] crc The CRC of the preceding data, to chain the computation.
+     * @return The CRC.
+     */
+    static uint32_t crc32(const uint8_t *const data, const size_t size,
+                          uint32_t crc = 0)
+    {
+        crc = ~crc;
+        for (size_t i = 0; i < size; i++) {
+            crc ^= data[i];
+            for (unsigned int bit = 0; bit < 8; bit++) {
+                crc = (crc >> 1) ^ (0xedb88320 & -(crc & 1));
+            }
+        }
+
+        return ~crc;
+    }
+
+    /**
+     * The mutable storage file.
+     */
+    int m_fd;
+
+    /**
+     * The buffer holding the checkpoint.
+     */
+    uint8_t *m_buffer;
+
+    /**
+     * The size of the buffer, in bytes.
+     */
+    size_t m_capacity;
+
+    /**
+     * The size of the checkpoint last loaded or saved, in bytes.
+     */
+    size_t m_size;
+
+    /**
+     * Whether the buffer holds the checkpoint loaded from storage.
+     */
+    bool m_loaded;
+
+    /**
+     * The sequence number of the newest checkpoint in storage.
+     */
+    uint32_t m_sequence;
+
+    /**
+     * The slot to write the next checkpoint to.
+     */
+    unsigned m_slot;
+
+    /**
+     * The size of the newest checkpoint in storage, in bytes.
+     */
+    size_t m_storedSize;
+
+    /**
+     * The CRC-32 of the records of the newest checkpoint in storage.
+     */
+    uint32_t m_recordsCrc;
+
+    /**
+     * The time the newest checkpoint in storage was saved, in seconds since
+     * the epoch.
+     */
+    uint32_t m_storedTime_s;
+
+    /**
+     * The registered components.
+     */
+    CheckpointComponent *m_components;
+
+    /**
+     * The periodic timer.
+     */
+    Timer m_timer;
+
+    /**
+     * The number of checkpoints saved since the initialization.
+     */
+    uint32_t m_saves;
+
+    friend class CheckpointComponent;
+};
+
+bool CheckpointComponent::init(Checkpoint &checkpoint, const uint16_t version)
+{
+    AbortIf(m_checkpoint, false);
+    AbortIfNot(m_save, false);
+    AbortIfNot(m_restore, false);
+
+    m_version = version;
+    AbortIfNot(checkpoint.restore(*this), false);
+
+    m_checkpoint = &checkpoint;
+    m_next = checkpoint.m_components;
+    checkpoint.m_components = this;
+
+    return true;
+}
+
+bool CheckpointComponent::destroy()
+{
+    AbortIfNot(m_checkpoint, false);
+
+    for (CheckpointComponent **component = &m_checkpoint->m_components;
+         *component; component = &(*component)->m_next) {
+        if (*component == this) {
+            *component = m_next;
+            break;
+        }
+    }
+
+    m_checkpoint = nullptr;
+    m_next = nullptr;
+
+    return true;
+}
+
+} /* namespace SpherePlusPlus */
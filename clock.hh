@@ -0,0 +1,281 @@
+/**
+ * @file clock.hh
+ * @author Matthieu Bucchianeri
+ * @brief Virtual clock for accelerated simulation.
+ *
+ * When a virtual clock is attached to the thread running the event loop, the
+ * timers initialized afterwards from that thread no longer arm their file
+ * descriptor. Their deadlines are kept by the clock instead, and the event
+ * loop (see ApplicationBase::run()) jumps straight to the next deadline
+ * whenever no other event is pending. Hours of retries, keepalives and
+ * reporting periods then run in milliseconds on a host.
+ *
+ * The code measuring durations in the application's own terms (such as the
+ * health report) reads the time with VirtualClock::now(), which falls back to
+ * the monotonic clock when no virtual clock is attached, and the time persisted
+ * across restarts with VirtualClock::wallTime(), which falls back to the
+ * real-time clock. The instrumentation (stall detector, profiler, tracer, load
+ * monitor), the power governor and the watchdog keep measuring real time, with
+ * readClock().
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <time.h>
+
+#include <sphereplusplus/abort.hh>
+
+namespace SpherePlusPlus {
+
+/**
+ * @brief Read a system clock.
+ * @param[in] clock The clock to read.
+ * @return The time, in nanoseconds.
+ */
+static inline uint64_t readClock(const clockid_t clock = CLOCK_MONOTONIC)
+{
+    struct timespec ts;
+    clock_gettime(clock, &ts);
+
+    return ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+/**
+ * @brief Virtual clock for accelerated simulation.
+ */
+class VirtualClock
+{
+public:
+    /**
+     * @brief Deadline kept by the clock.
+     */
+    struct Alarm
+    {
+        /**
+         * The deadline, in nanoseconds.
+         */
+        uint64_t deadline_ns;
+
+        /**
+         * The function invoked when the deadline is reached.
+         */
+        void (*expire)(void *context);
+
+        /**
+         * The context passed to the function.
+         */
+        void *context;
+
+        /**
+         * The next alarm, by increasing deadline.
+         */
+        Alarm *next;
+
+        /**
+         * Whether the alarm is scheduled.
+         */
+        bool scheduled;
+    };
+
+    /**
+     * @brief Constructor.
+     */
+    VirtualClock() :
+        m_now_ns(0),
+        m_epoch_ns(0),
+        m_alarms(nullptr)
+    {
+    }
+
+    /*
+     * The clock is attached to a thread, and cannot be copied.
+     */
+    VirtualClock(const VirtualClock &other) = delete;
+    VirtualClock &operator =(const VirtualClock &other) = delete;
+
+    /**
+     * @brief Destructor.
+     */
+    virtual ~VirtualClock()
+    {
+        if (g_current == this) {
+            destroy();
+        }
+    }
+
+    /**
+     * @brief Initialize the clock, and attach it to the calling thread, which
+     *        must be the thread running the event loop.
+     * @param[in] start_ns The initial time, in nanoseconds.
+     * @return True on success.
+     * @note Must be invoked before initializing the timers, including the
+     *       ones of the application.
+     */
+    virtual bool init(const uint64_t start_ns = 0)
+    {
+        AbortIf(g_current, false);
+
+        m_now_ns = start_ns;
+        m_epoch_ns = readClock(CLOCK_REALTIME) - start_ns;
+        m_alarms = nullptr;
+        g_current = this;
+
+        return true;
+    }
+
+    /**
+     * @brief Destroy the clock.
+     * @return True on success.
+     * @note Must be invoked from the thread running the event loop, after
+     *       destroying the timers.
+     */
+    virtual bool destroy()
+    {
+        AbortIfNot(g_current == this, false);
+        AbortIf(m_alarms, false);
+
+        g_current = nullptr;
+
+        return true;
+    }
+
+    /**
+     * @brief Get the time of the clock.
+     * @return The time, in nanoseconds.
+     */
+    uint64_t time() const
+    {
+        return m_now_ns;
+    }
+
+    /**
+     * @brief Schedule an alarm, replacing its previous deadline.
+     * @param[in] alarm The alarm.
+     * @param[in] deadline_ns The deadline, in nanoseconds.
+     */
+    void schedule(Alarm &alarm, const uint64_t deadline_ns)
+    {
+        cancel(alarm);
+
+        /*
+         * The alarms with the same deadline expire in the order they were
+         * scheduled.
+         */
+        Alarm **link = &m_alarms;
+        while (*link && (*link)->deadline_ns <= deadline_ns) {
+            link = &(*link)->next;
+        }
+
+        alarm.deadline_ns = deadline_ns;
+        alarm.next = *link;
+        alarm.scheduled = true;
+        *link = &alarm;
+    }
+
+    /**
+     * @brief Cancel an alarm.
+     * @param[in] alarm The alarm.
+     */
+    void cancel(Alarm &alarm)
+    {
+        if (!alarm.scheduled) {
+            return;
+        }
+
+        Alarm **link = &m_alarms;
+        while (*link != &alarm) {
+            link = &(*link)->next;
+        }
+
+        *link = alarm.next;
+        alarm.next = nullptr;
+        alarm.scheduled = false;
+    }
+
+    /**
+     * @brief Jump to the next deadline, and expire its alarm.
+     * @return True if an alarm expired, false if none is scheduled.
+     */
+    bool advance()
+    {
+        Alarm *const alarm = m_alarms;
+        if (!alarm) {
+            return false;
+        }
+
+        m_alarms = alarm->next;
+        alarm->next = nullptr;
+        alarm->scheduled = false;
+
+        if (alarm->deadline_ns > m_now_ns) {
+            m_now_ns = alarm->deadline_ns;
+        }
+        alarm->expire(alarm->context);
+
+        return true;
+    }
+
+    /**
+     * @brief Get the clock attached to the calling thread.
+     * @return The clock, or nullptr if the thread runs in real time.
+     */
+    static VirtualClock *current()
+    {
+        return g_current;
+    }
+
+    /**
+     * @brief Get the current time on the calling thread.
+     * @return The time of the attached clock, or the monotonic time, in
+     *         nanoseconds.
+     */
+    static uint64_t now()
+    {
+        const VirtualClock *const clock = g_current;
+        if (clock) {
+            return clock->m_now_ns;
+        }
+
+        return readClock();
+    }
+
+    /**
+     * @brief Get the wall-clock time on the calling thread.
+     * @return The time since the epoch, in nanoseconds. The time of an
+     *         attached clock advances from the real time at its
+     *         initialization.
+     */
+    static uint64_t wallTime()
+    {
+        const VirtualClock *const clock = g_current;
+        if (clock) {
+            return clock->m_epoch_ns + clock->m_now_ns;
+        }
+
+        return readClock(CLOCK_REALTIME);
+    }
+
+private:
+    /**
+     * The time of the clock, in nanoseconds.
+     */
+    uint64_t m_now_ns;
+
+    /**
+     * The wall-clock time at which the clock read 0, in nanoseconds.
+     */
+    uint64_t m_epoch_ns;
+
+    /**
+     * The alarms scheduled, by increasing deadline.
+     */
+    Alarm *m_alarms;
+
+    /**
+     * The clock attached to the current thread.
+     */
+    static __thread VirtualClock *g_current;
+};
+
+} /* namespace SpherePlusPlus */
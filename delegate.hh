@@ -10,6 +10,7 @@
 #pragma once
 
 #include <sphereplusplus/abort.hh>
+#include <sphereplusplus/std.hh>
 
 namespace SpherePlusPlus {
 
@@ -44,6 +45,18 @@ public:
     {
     }
 
+    /**
+     * @brief Move constructor.
+     * @param[in] other The instance to move from. It is left disconnected.
+     */
+    Delegate(Delegate &&other) noexcept :
+        m_object(other.m_object),
+        m_stub(other.m_stub)
+    {
+        other.m_object = nullptr;
+        other.m_stub = nullptr;
+    }
+
     /**
      * @brief Assignment operator.
      * @param[in] other The instance to copy.
@@ -57,6 +70,22 @@ public:
         return *this;
     }
 
+    /**
+     * @brief Move assignment operator.
+     * @param[in] other The instance to move from. It is left disconnected.
+     * @return This instance.
+     */
+    Delegate &operator =(Delegate &&other) noexcept
+    {
+        m_object = other.m_object;
+        m_stub = other.m_stub;
+
+        other.m_object = nullptr;
+        other.m_stub = nullptr;
+
+        return *this;
+    }
+
     /**
      * @brief Connect a class method to the delegate.
      * @tparam T The class type.
@@ -106,6 +135,34 @@ public:
         m_stub = lambda_stub<LAMBDA>;
     }
 
+    /**
+     * @brief Whether a callback is connected to the delegate.
+     * @return True when a callback is connected.
+     */
+    explicit operator bool() const
+    {
+        return m_stub != nullptr;
+    }
+
+    /**
+     * @brief Get the callback, for diagnostics.
+     * @return The address of the internal callback stub, which is specific to
+     *         the connected method, function or lambda.
+     */
+    const void *callback() const
+    {
+        return reinterpret_cast<const void *>(m_stub);
+    }
+
+    /**
+     * @brief Get the instance/closure of the callback, for diagnostics.
+     * @return The instance/closure, or nullptr for a static method.
+     */
+    const void *object() const
+    {
+        return m_object;
+    }
+
     /**
      * @brief Invoke the callback.
      * @param arg User-specified arguments.
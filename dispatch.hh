@@ -0,0 +1,80 @@
+/**
+ * @file dispatch.hh
+ * @author Matthieu Bucchianeri
+ * @brief Callbacks dispatched from the event loop.
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+namespace SpherePlusPlus {
+
+/**
+ * @brief Type of the callbacks dispatched from the event loop.
+ */
+enum class DispatchKind : uint8_t
+{
+    /**
+     * A timer expiry.
+     */
+    Timer,
+
+    /**
+     * An I/O readiness notification.
+     */
+    Io,
+
+    /**
+     * A system event notification.
+     */
+    SysEvent,
+
+    /**
+     * An Azure IoT callback or pump.
+     */
+    Iot,
+
+    /**
+     * A process signal.
+     */
+    Signal,
+
+    /**
+     * An iteration of the event loop, only used by the tracer.
+     */
+    Loop,
+};
+
+/**
+ * @brief Get the name of a type of callback.
+ * @param[in] kind The type of callback.
+ * @return The name.
+ */
+static inline const char *dispatchKindName(const DispatchKind kind)
+{
+    switch (kind) {
+        case DispatchKind::Timer:
+            return "timer";
+
+        case DispatchKind::Io:
+            return "io";
+
+        case DispatchKind::SysEvent:
+            return "sysevent";
+
+        case DispatchKind::Iot:
+            return "iot";
+
+        case DispatchKind::Signal:
+            return "signal";
+
+        case DispatchKind::Loop:
+            return "loop";
+
+        default:
+            return "unknown";
+    }
+}
+
+} /* namespace SpherePlusPlus */
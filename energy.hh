@@ -0,0 +1,662 @@
+/**
+ * @file energy.hh
+ * @author Matthieu Bucchianeri
+ * @brief Per-feature energy accounting.
+ *
+ * When an energy model is attached to the thread running the event loop, the
+ * activity of the application is attributed to features, and converted to
+ * energy with configurable coefficients:
+ * - each wakeup of the event loop, that is each callback dispatched from the
+ *   event loop (see internal.hh), costs a fixed energy;
+ * - the time spent in the callbacks costs the active power of the CPU;
+ * - each telemetry message sent costs a fixed energy for the radio, plus an
+ *   energy per byte;
+ * - the keepalive to Azure IoT Central, while connected, costs one message
+ *   per period;
+ * - each write to a GPIO costs a fixed energy.
+ *
+ * A callback is attributed to the type of the callback ("timer", "iot"...),
+ * unless it opens a Scope naming a feature:
+ *
+ * void Sampler::sample()
+ * {
+ *     EnergyModel::Scope scope("sampling");
+ *     ...
+ * }
+ *
+ * The wakeup is then attributed to the first feature named in the callback,
+ * and the time to each feature for as long as its scope is open. The library
+ * names its own features: "telemetry", "health", "metrics", "watchdog",
+ * "checkpoint" and "keepalive".
+ *
+ * The coefficients are estimates to be calibrated against measurements of the
+ * device. The keepalive is an upper bound, as the client does not send it when
+ * other messages were sent within the period. The retransmissions are not
+ * accounted.
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+
+#include <sphereplusplus/abort.hh>
+#include <sphereplusplus/clock.hh>
+#include <sphereplusplus/dispatch.hh>
+#include <sphereplusplus/ranking.hh>
+
+namespace SpherePlusPlus {
+
+/**
+ * @brief Per-feature energy accounting.
+ */
+class EnergyModel
+{
+public:
+    /**
+     * The number of features accounted. The activity of the features that do
+     * not fit, and outside of any feature, is accounted to the "other"
+     * feature.
+     */
+    static constexpr size_t k_maxFeatures = 16;
+
+    /**
+     * @brief Energy coefficients.
+     */
+    struct Coefficients
+    {
+        /**
+         * The energy of a wakeup of the event loop, in nanojoules.
+         */
+        uint32_t wakeup_nJ;
+
+        /**
+         * The power of the CPU while running a callback, in microwatts.
+         */
+        uint32_t active_uW;
+
+        /**
+         * The energy of a radio transmission, and of each byte transmitted, in
+         * nanojoules.
+         * @{
+         */
+        uint32_t radioMessage_nJ;
+        uint32_t radioByte_nJ;
+        /**
+         * @}
+         */
+
+        /**
+         * The size of a keepalive, including the protocol overhead, in bytes.
+         */
+        uint32_t keepaliveBytes;
+
+        /**
+         * The energy of a write to a GPIO, in nanojoules.
+         */
+        uint32_t gpioWrite_nJ;
+    };
+
+    /**
+     * The default coefficients: 20 uJ per wakeup, 150 mW while running, 2 mJ
+     * per radio transmission plus 2 uJ per byte, 64-byte keepalives and 100 nJ
+     * per GPIO write.
+     */
+    static constexpr Coefficients k_defaultCoefficients =
+        {20000, 150000, 2000000, 2000, 64, 100};
+
+    /**
+     * @brief Activity of a feature.
+     */
+    struct Feature
+    {
+        /**
+         * The name of the feature, or nullptr for an unused slot.
+         */
+        const char *name;
+
+        /**
+         * The number of wakeups.
+         */
+        uint64_t wakeups;
+
+        /**
+         * The time spent in callbacks, in nanoseconds.
+         */
+        uint64_t busy_ns;
+
+        /**
+         * The number of radio transmissions, and the number of bytes
+         * transmitted.
+         * @{
+         */
+        uint64_t radioMessages;
+        uint64_t radioBytes;
+        /**
+         * @}
+         */
+
+        /**
+         * The number of writes to GPIOs.
+         */
+        uint64_t gpioWrites;
+
+        /**
+         * The energy budget, as an average power in microwatts, or 0 for no
+         * budget.
+         */
+        uint32_t budget_uW;
+    };
+
+    /**
+     * @brief Scope attributing the activity of the calling thread to a
+     *        feature.
+     */
+    class Scope
+    {
+    public:
+        /**
+         * @brief Constructor, entering the feature.
+         * @param[in] name The name of the feature. It must remain valid while
+         *            the model is attached, such as a string literal.
+         */
+        explicit Scope(const char *const name) :
+            m_previous(push(name))
+        {
+        }
+
+        /**
+         * @brief Destructor, returning to the enclosing feature.
+         */
+        ~Scope()
+        {
+            pop(m_previous);
+        }
+
+        Scope(const Scope &other) = delete;
+        Scope &operator =(const Scope &other) = delete;
+
+    private:
+        /**
+         * The enclosing feature.
+         */
+        Feature *const m_previous;
+    };
+
+    /**
+     * @brief Constructor.
+     */
+    EnergyModel() :
+        m_coefficients(k_defaultCoefficients),
+        m_features(),
+        m_current(nullptr),
+        m_depth(0),
+        m_mark_ns(0),
+        m_wakeupPending(false),
+        m_start_ns(0),
+        m_keepalivePeriod_s(0),
+        m_keepaliveSince_ns(0)
+    {
+    }
+
+    /*
+     * The model is attached to a thread, and cannot be copied.
+     */
+    EnergyModel(const EnergyModel &other) = delete;
+    EnergyModel &operator =(const EnergyModel &other) = delete;
+
+    /**
+     * @brief Destructor.
+     */
+    virtual ~EnergyModel()
+    {
+        if (g_current == this) {
+            destroy();
+        }
+    }
+
+    /**
+     * @brief Initialize the model, and attach it to the calling thread, which
+     *        must be the thread running the event loop.
+     * @param[in] coefficients The energy coefficients.
+     * @return True on success.
+     * @note The keepalive is only accounted when the model is initialized
+     *       before the connection to Azure IoT Central.
+     */
+    virtual bool init(const Coefficients &coefficients = k_defaultCoefficients)
+    {
+        AbortIf(g_current, false);
+
+        m_coefficients = coefficients;
+        m_keepalivePeriod_s = 0;
+        reset();
+        g_current = this;
+
+        return true;
+    }
+
+    /**
+     * @brief Destroy the model.
+     * @return True on success.
+     * @note Must be invoked from the thread running the event loop, outside
+     *       of any callback and any scope.
+     */
+    virtual bool destroy()
+    {
+        AbortIfNot(g_current == this, false);
+
+        g_current = nullptr;
+
+        return true;
+    }
+
+    /**
+     * @brief Clear the accounting, keeping the budgets.
+     * @note Must not be invoked from a callback, nor within a scope.
+     */
+    void reset()
+    {
+        for (size_t i = 0; i < k_maxFeatures; i++) {
+            const char *const name = m_features[i].name;
+            const uint32_t budget = m_features[i].budget_uW;
+
+            memset(&m_features[i], 0, sizeof(m_features[i]));
+            m_features[i].name = name;
+            m_features[i].budget_uW = budget;
+        }
+        m_features[0].name = "other";
+
+        m_current = nullptr;
+        m_depth = 0;
+        m_wakeupPending = false;
+        m_start_ns = VirtualClock::now();
+        m_keepaliveSince_ns = m_start_ns;
+    }
+
+    /**
+     * @brief Set the energy budget of a feature.
+     * @param[in] name The name of the feature, which must remain valid while
+     *            the model is attached.
+     * @param[in] budget_uW The budget, as an average power in microwatts, or
+     *            0 for no budget.
+     * @return True on success, false when the feature does not fit.
+     */
+    bool setBudget(const char *const name, const uint32_t budget_uW)
+    {
+        Feature *const feature = lookup(name);
+        AbortIf(feature == &m_features[0] && strcmp(name, "other"), false);
+
+        feature->budget_uW = budget_uW;
+
+        return true;
+    }
+
+    /**
+     * @brief Get the energy coefficients.
+     * @return The coefficients.
+     */
+    const Coefficients &coefficients() const
+    {
+        return m_coefficients;
+    }
+
+    /**
+     * @brief Estimate the energy used by a feature.
+     * @param[in] feature The feature.
+     * @return The energy, in microjoules.
+     */
+    uint64_t energy(const Feature &feature) const
+    {
+        /*
+         * The busy time is scaled to microseconds before the multiplication,
+         * which would overflow after about 5 hours at 1 W in nanoseconds.
+         */
+        const uint64_t energy_nJ =
+            feature.wakeups * m_coefficients.wakeup_nJ +
+            feature.busy_ns / 1000 * m_coefficients.active_uW / 1000 +
+            feature.radioMessages * m_coefficients.radioMessage_nJ +
+            feature.radioBytes * m_coefficients.radioByte_nJ +
+            feature.gpioWrites * m_coefficients.gpioWrite_nJ;
+
+        return energy_nJ / 1000;
+    }
+
+    /**
+     * @brief Estimate the average power used by a feature since the
+     *        initialization, or the last reset.
+     * @param[in] feature The feature.
+     * @return The power, in microwatts.
+     */
+    uint64_t power(const Feature &feature) const
+    {
+        const uint64_t elapsed_ms =
+            (VirtualClock::now() - m_start_ns) / 1000000;
+
+        return elapsed_ms ? energy(feature) * 1000 / elapsed_ms : 0;
+    }
+
+    /**
+     * @brief Take a snapshot of the accounting.
+     * @param[out] features The features, by decreasing energy.
+     * @param[in] max The maximum number of features to return.
+     * @return The number of features returned.
+     * @note Must be invoked from the thread running the event loop.
+     */
+    size_t snapshot(Feature *const features, const size_t max)
+    {
+        accrueKeepalive();
+
+        size_t count = 0;
+        for (size_t i = 0; i < k_maxFeatures; i++) {
+            const Feature &feature = m_features[i];
+            if (!feature.name ||
+                (!feature.wakeups && !feature.busy_ns &&
+                 !feature.radioMessages && !feature.gpioWrites &&
+                 !feature.budget_uW)) {
+                continue;
+            }
+
+            insertRanked(features, count, max, feature,
+                         [this](const Feature &entry) {
+                             return energy(entry);
+                         });
+        }
+
+        return count;
+    }
+
+    /**
+     * @brief Log the features, by decreasing energy, flagging the features
+     *        over budget.
+     * @param[in] max The maximum number of features to log.
+     * @note Must be invoked from the thread running the event loop.
+     */
+    void dump(const size_t max = k_maxFeatures)
+    {
+        Feature features[k_maxFeatures];
+        const size_t count =
+            snapshot(features, max < k_maxFeatures ? max : k_maxFeatures);
+
+        Log_Debug("Energy profile (energy uJ, power uW, budget uW):\n");
+        for (size_t i = 0; i < count; i++) {
+            const Feature &feature = features[i];
+            typedef unsigned long long ull;
+
+            const uint64_t power = this->power(feature);
+            Log_Debug("  %-12s %10llu %8llu %8u%s  wakeups %llu, busy %llu us, "
+                      "radio %llu msg/%llu B, gpio %llu\n",
+                      feature.name, static_cast<ull>(energy(feature)),
+                      static_cast<ull>(power), feature.budget_uW,
+                      feature.budget_uW && power > feature.budget_uW ?
+                          " OVER" : "",
+                      static_cast<ull>(feature.wakeups),
+                      static_cast<ull>(feature.busy_ns / 1000),
+                      static_cast<ull>(feature.radioMessages),
+                      static_cast<ull>(feature.radioBytes),
+                      static_cast<ull>(feature.gpioWrites));
+        }
+    }
+
+    /**
+     * @brief Mark the start of a callback on the calling thread.
+     * @param[in] kind The type of the callback.
+     * @return The enclosing feature, to pass to leave().
+     */
+    static Feature *enter(const DispatchKind kind)
+    {
+        EnergyModel *const model = g_current;
+        if (__builtin_expect(!model, 1)) {
+            return nullptr;
+        }
+
+        if (model->m_depth++ == 0) {
+            model->m_mark_ns = readClock();
+            model->m_current = model->lookup(dispatchKindName(kind));
+            model->m_wakeupPending = true;
+
+            return nullptr;
+        }
+
+        /*
+         * A callback dispatched from within another callback is a feature of
+         * its own.
+         */
+        return model->switchTo(dispatchKindName(kind));
+    }
+
+    /**
+     * @brief Mark the end of a callback on the calling thread.
+     * @param[in] previous The enclosing feature, returned by enter().
+     */
+    static void leave(Feature *const previous)
+    {
+        EnergyModel *const model = g_current;
+        if (__builtin_expect(!model, 1) || !model->m_depth) {
+            return;
+        }
+
+        model->charge();
+        if (--model->m_depth == 0 && model->m_wakeupPending) {
+            model->m_current->wakeups++;
+            model->m_wakeupPending = false;
+        }
+        model->m_current = previous;
+    }
+
+    /**
+     * @brief Account a radio transmission to the current feature.
+     * @param[in] bytes The number of bytes transmitted.
+     */
+    static void radio(const size_t bytes)
+    {
+        EnergyModel *const model = g_current;
+        if (__builtin_expect(!model, 1)) {
+            return;
+        }
+
+        Feature *const feature =
+            model->m_current ? model->m_current : &model->m_features[0];
+        feature->radioMessages++;
+        feature->radioBytes += bytes;
+    }
+
+    /**
+     * @brief Account a write to a GPIO to the current feature.
+     */
+    static void gpio()
+    {
+        EnergyModel *const model = g_current;
+        if (__builtin_expect(!model, 1)) {
+            return;
+        }
+
+        Feature *const feature =
+            model->m_current ? model->m_current : &model->m_features[0];
+        feature->gpioWrites++;
+    }
+
+    /**
+     * @brief Set the period of the keepalive sent by the client.
+     * @param[in] period_s The period, in seconds, or 0 while no keepalive is
+     *            sent.
+     */
+    static void keepalive(const uint32_t period_s)
+    {
+        EnergyModel *const model = g_current;
+        if (__builtin_expect(!model, 1)) {
+            return;
+        }
+
+        model->accrueKeepalive();
+        model->m_keepalivePeriod_s = period_s;
+        model->m_keepaliveSince_ns = VirtualClock::now();
+    }
+
+private:
+    /**
+     * @brief Enter a feature on the calling thread.
+     * @param[in] name The name of the feature.
+     * @return The enclosing feature.
+     */
+    static Feature *push(const char *const name)
+    {
+        EnergyModel *const model = g_current;
+        if (__builtin_expect(!model, 1)) {
+            return nullptr;
+        }
+
+        return model->switchTo(name);
+    }
+
+    /**
+     * @brief Return to the enclosing feature on the calling thread.
+     * @param[in] previous The enclosing feature.
+     */
+    static void pop(Feature *const previous)
+    {
+        EnergyModel *const model = g_current;
+        if (__builtin_expect(!model, 1)) {
+            return;
+        }
+
+        if (model->m_depth) {
+            model->charge();
+        }
+        model->m_current = previous;
+    }
+
+    /**
+     * @brief Switch to a feature, charging the time so far to the current
+     *        feature.
+     * @param[in] name The name of the feature.
+     * @return The previous feature.
+     */
+    Feature *switchTo(const char *const name)
+    {
+        Feature *const previous = m_current;
+
+        if (m_depth) {
+            charge();
+        }
+        m_current = lookup(name);
+
+        /*
+         * The wakeup belongs to the first feature named in the callback.
+         */
+        if (m_wakeupPending) {
+            m_current->wakeups++;
+            m_wakeupPending = false;
+        }
+
+        return previous;
+    }
+
+    /**
+     * @brief Charge the time since the last mark to the current feature.
+     */
+    void charge()
+    {
+        const uint64_t time = readClock();
+
+        m_current->busy_ns += time - m_mark_ns;
+        m_mark_ns = time;
+    }
+
+    /**
+     * @brief Account the keepalives sent since the last accrual.
+     */
+    void accrueKeepalive()
+    {
+        if (!m_keepalivePeriod_s) {
+            return;
+        }
+
+        const uint64_t period_ns = m_keepalivePeriod_s * 1000000000ull;
+        const uint64_t keepalives =
+            (VirtualClock::now() - m_keepaliveSince_ns) / period_ns;
+        if (!keepalives) {
+            return;
+        }
+
+        Feature *const feature = lookup("keepalive");
+        feature->radioMessages += keepalives;
+        feature->radioBytes += keepalives * m_coefficients.keepaliveBytes;
+        m_keepaliveSince_ns += keepalives * period_ns;
+    }
+
+    /**
+     * @brief Find or insert a feature.
+     * @param[in] name The name of the feature.
+     * @return The feature, or the "other" feature when it does not fit.
+     */
+    Feature *lookup(const char *const name)
+    {
+        for (size_t i = 1; i < k_maxFeatures; i++) {
+            Feature *const feature = &m_features[i];
+
+            if (!feature->name) {
+                feature->name = name;
+                return feature;
+            }
+            if (feature->name == name || !strcmp(feature->name, name)) {
+                return feature;
+            }
+        }
+
+        return &m_features[0];
+    }
+
+    /**
+     * The energy coefficients.
+     */
+    Coefficients m_coefficients;
+
+    /**
+     * The features, the first one being the "other" feature.
+     */
+    Feature m_features[k_maxFeatures];
+
+    /**
+     * The current feature, or nullptr outside of any callback and any scope.
+     */
+    Feature *m_current;
+
+    /**
+     * The nesting of the callbacks running.
+     */
+    uint32_t m_depth;
+
+    /**
+     * The time up to which the callback running is accounted, in nanoseconds.
+     */
+    uint64_t m_mark_ns;
+
+    /**
+     * Whether the wakeup of the callback running is not accounted yet.
+     */
+    bool m_wakeupPending;
+
+    /**
+     * The start of the accounting, in nanoseconds.
+     */
+    uint64_t m_start_ns;
+
+    /**
+     * The period of the keepalive, in seconds, or 0 while none is sent.
+     */
+    uint32_t m_keepalivePeriod_s;
+
+    /**
+     * The time up to which the keepalives are accounted, in nanoseconds.
+     */
+    uint64_t m_keepaliveSince_ns;
+
+    /**
+     * The model attached to the current thread.
+     */
+    static __thread EnergyModel *g_current;
+};
+
+} /* namespace SpherePlusPlus */
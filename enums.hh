@@ -46,7 +46,7 @@ struct EnableBitMaskOperators<T>     \
  * @return The OR'ed value.
  */
 template<typename T>
-typename std::enable_if<EnableBitMaskOperators<T>::enable, T>::type
+constexpr typename std::enable_if<EnableBitMaskOperators<T>::enable, T>::type
 operator |(T lhs, T rhs)
 {
     return static_cast<T>(static_cast<__underlying_type(T)>(lhs) |
@@ -61,7 +61,7 @@ operator |(T lhs, T rhs)
  * @return The AND'ed value.
  */
 template<typename T>
-typename std::enable_if<EnableBitMaskOperators<T>::enable, T>::type
+constexpr typename std::enable_if<EnableBitMaskOperators<T>::enable, T>::type
 operator &(T lhs, T rhs)
 {
     return static_cast<T>(static_cast<__underlying_type(T)>(lhs) &
@@ -76,7 +76,7 @@ operator &(T lhs, T rhs)
  * @return The XOR'ed value.
  */
 template<typename T>
-typename std::enable_if<EnableBitMaskOperators<T>::enable, T>::type
+constexpr typename std::enable_if<EnableBitMaskOperators<T>::enable, T>::type
 operator ^(T lhs, T rhs)
 {
     return static_cast<T>(static_cast<__underlying_type(T)>(lhs) ^
@@ -90,7 +90,7 @@ operator ^(T lhs, T rhs)
  * @return The bitwise negated (NOT) value.
  */
 template<typename T>
-typename std::enable_if<EnableBitMaskOperators<T>::enable, T>::type
+constexpr typename std::enable_if<EnableBitMaskOperators<T>::enable, T>::type
 operator ~(T rhs)
 {
     return static_cast<T>(~static_cast<__underlying_type(T)>(rhs));
@@ -106,7 +106,7 @@ operator ~(T rhs)
 template<typename T,
          typename std::enable_if_t<EnableBitMaskOperators<T>::enable, T>* =
             nullptr>
-bool
+constexpr bool
 isSet(T lhs, T rhs)
 {
     return !!(static_cast<__underlying_type(T)>(lhs) &
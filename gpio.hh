@@ -9,6 +9,8 @@
 #include <unistd.h>
 
 #include <sphereplusplus/abort.hh>
+#include <sphereplusplus/energy.hh>
+#include <sphereplusplus/std.hh>
 
 #include <applibs/gpio.h>
 
@@ -21,12 +23,20 @@ namespace SpherePlusPlus {
 class Gpio
 {
 public:
+    /*
+     * GPIOs own a file descriptor and cannot be copied.
+     */
+    Gpio(const Gpio &other) = delete;
+    Gpio &operator =(const Gpio &other) = delete;
+
     /**
      * @brief Destructor.
      */
     virtual ~Gpio()
     {
-        destroy();
+        if (m_gpioFd >= 0) {
+            destroy();
+        }
     }
 
     /**
@@ -54,6 +64,7 @@ public:
 
         const GPIO_Value_Type value = level ? GPIO_Value_High : GPIO_Value_Low;
         AbortErrno(GPIO_SetValue(m_gpioFd, value), false);
+        EnergyModel::gpio();
 
         return true;
     }
@@ -101,6 +112,18 @@ protected:
     {
     }
 
+    /**
+     * @brief Move constructor.
+     * @param[in] other The instance to move from. It is left uninitialized.
+     */
+    Gpio(Gpio &&other) :
+        m_gpioId(other.m_gpioId),
+        m_gpioFd(other.m_gpioFd),
+        m_isOutput(other.m_isOutput)
+    {
+        other.m_gpioFd = -1;
+    }
+
     /**
      *  The GPIO unique identifier.
      */
@@ -0,0 +1,419 @@
+/**
+ * @file health.hh
+ * @author Matthieu Bucchianeri
+ * @brief Periodic device health report.
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include <applibs/applications.h>
+
+#include <sphereplusplus/abort.hh>
+#include <sphereplusplus/clock.hh>
+#include <sphereplusplus/delegate.hh>
+#include <sphereplusplus/energy.hh>
+#include <sphereplusplus/metrics.hh>
+#include <sphereplusplus/timer.hh>
+#include <sphereplusplus/watchdog.hh>
+
+namespace SpherePlusPlus {
+
+/**
+ * @brief Periodic device health report.
+ *
+ * The reporter measures the latency of the event loop with a probe timer, and
+ * periodically builds a report with the latency percentiles, the peak memory
+ * usage, and the reconnections, dropped messages and watchdog near misses
+ * counted since the start. The report is only sent when it changed
+ * significantly since the last report sent, or when no report was sent for too
+ * long.
+ *
+ * The format is compact JSON:
+ *
+ * {"uptime":3600,"lat50":12,"lat90":47,"lat99":383,"latmax":412,"mem":148,
+ *  "reconnects":1,"dropped":0,"wdnear":0}
+ *
+ * where the latencies are in microseconds, the peak memory usage in KiB, and
+ * the uptime in seconds, since the reporter was created.
+ */
+class HealthReporter
+{
+public:
+    /**
+     * The period of the latency probe, in milliseconds.
+     */
+    static constexpr uint32_t k_probePeriod = 250;
+
+    /**
+     * @brief Policy deciding when to send a report.
+     */
+    struct Policy
+    {
+        /**
+         * The period of the reports, in seconds.
+         */
+        uint32_t period_s;
+
+        /**
+         * The longest time without sending a report, in seconds.
+         */
+        uint32_t maxSilence_s;
+
+        /**
+         * The smallest change of the 99th percentile of the latency worth
+         * a report, in microseconds.
+         */
+        uint32_t latencyDeadband_us;
+
+        /**
+         * The smallest change of the peak memory usage worth a report, in KiB.
+         */
+        uint32_t memoryDeadband_kB;
+    };
+
+    /**
+     * The default policy: check every 5 minutes, and report at least hourly.
+     */
+    static constexpr Policy k_defaultPolicy = {300, 3600, 1000, 8};
+
+    /**
+     * @brief Health report.
+     */
+    struct Report
+    {
+        /**
+         * The time since the reporter was created, in seconds.
+         */
+        uint32_t uptime_s;
+
+        /**
+         * The percentiles of the latency of the event loop, since the last
+         * report sent, in microseconds.
+         * @{
+         */
+        uint32_t latencyP50_us;
+        uint32_t latencyP90_us;
+        uint32_t latencyP99_us;
+        uint32_t latencyMax_us;
+        /**
+         * @}
+         */
+
+        /**
+         * The peak memory usage, in KiB.
+         */
+        uint32_t memoryPeak_kB;
+
+        /**
+         * The number of reconnections.
+         */
+        uint32_t reconnects;
+
+        /**
+         * The number of messages dropped.
+         */
+        uint32_t dropped;
+
+        /**
+         * The number of watchdog near misses.
+         */
+        uint32_t watchdogNearMisses;
+    };
+
+    /**
+     * @brief Constructor.
+     */
+    HealthReporter() :
+        m_probeTimer(),
+        m_reportTimer(),
+        m_latency(),
+        m_policy(k_defaultPolicy),
+        m_watchdog(nullptr),
+        m_send(),
+        m_start_ns(now()),
+        m_probe_ns(0),
+        m_lastSent_ns(0),
+        m_lastSent(),
+        m_reconnects(0),
+        m_dropped(0)
+    {
+    }
+
+    /*
+     * The reporter registers its timers, and cannot be copied.
+     */
+    HealthReporter(const HealthReporter &other) = delete;
+    HealthReporter &operator =(const HealthReporter &other) = delete;
+
+    /**
+     * @brief Destructor.
+     */
+    virtual ~HealthReporter()
+    {
+    }
+
+    /**
+     * @brief Initialize the reporter.
+     * @param[in] policy The policy deciding when to send a report.
+     * @param[in] watchdog The watchdog whose near misses are reported, or
+     *            nullptr.
+     * @return True on success.
+     * @note Must be connected to a sending callback first.
+     */
+    virtual bool init(const Policy &policy, const Watchdog *const watchdog)
+    {
+        AbortIfNot(m_send, false);
+        AbortIfNot(policy.period_s > 0, false);
+
+        m_policy = policy;
+        m_watchdog = watchdog;
+        m_lastSent_ns = now();
+        m_lastSent = Report();
+        m_latency.reset();
+
+        AbortIfNot(m_probeTimer.init(), false);
+        m_probeTimer.setDeferrable(true);
+        m_probeTimer.connect<HealthReporter, &HealthReporter::probe>(*this);
+        AbortIfNot(m_reportTimer.init(), false);
+        m_reportTimer.connect<HealthReporter, &HealthReporter::evaluate>(
+            *this);
+
+        m_probe_ns = now();
+        AbortIfNot(m_probeTimer.startOneShot(k_probePeriod * 1000ull), false);
+        AbortIfNot(m_reportTimer.startPeriodic(m_policy.period_s * 1000000ull),
+                   false);
+
+        return true;
+    }
+
+    /**
+     * @brief Destroy the reporter.
+     * @return True on success.
+     */
+    virtual bool destroy()
+    {
+        AbortIfNot(m_probeTimer.destroy(), false);
+        AbortIfNot(m_reportTimer.destroy(), false);
+
+        return true;
+    }
+
+    /**
+     * @brief Connect a class method to send the reports.
+     * @tparam T The class type.
+     * @tparam TMethod The class method, returning true when the report was
+     *         sent.
+     * @param[in] instance The class instance.
+     */
+    template<class T, bool (T::*TMethod)(const char *)>
+    void connect(T &instance)
+    {
+        m_send.connect<T, TMethod>(instance);
+    }
+
+    /**
+     * @brief Count a reconnection.
+     */
+    void countReconnect()
+    {
+        m_reconnects++;
+    }
+
+    /**
+     * @brief Count a dropped message.
+     */
+    void countDrop()
+    {
+        m_dropped++;
+    }
+
+    /**
+     * @brief Build a report.
+     * @param[out] report The report.
+     */
+    void snapshot(Report &report) const
+    {
+        report.uptime_s =
+            static_cast<uint32_t>((now() - m_start_ns) / 1000000000);
+        report.latencyP50_us = m_latency.percentile(50);
+        report.latencyP90_us = m_latency.percentile(90);
+        report.latencyP99_us = m_latency.percentile(99);
+        report.latencyMax_us = m_latency.max();
+        report.memoryPeak_kB = static_cast<uint32_t>(
+            Applications_GetPeakUserModeMemoryUsageInKB());
+        report.reconnects = m_reconnects;
+        report.dropped = m_dropped;
+        report.watchdogNearMisses =
+            m_watchdog ? m_watchdog->nearMisses() : 0;
+    }
+
+    /**
+     * @brief Serialize a report.
+     * @param[in] report The report.
+     * @param[out] buffer The buffer to write to.
+     * @param[in] size The size of the buffer.
+     * @return The length of the serialized report, or 0 if it does not fit.
+     */
+    static size_t serialize(const Report &report, char *const buffer,
+                            const size_t size)
+    {
+        const int written =
+            snprintf(buffer, size,
+                     "{\"uptime\":%u,\"lat50\":%u,\"lat90\":%u,\"lat99\":%u,"
+                     "\"latmax\":%u,\"mem\":%u,\"reconnects\":%u,"
+                     "\"dropped\":%u,\"wdnear\":%u}",
+                     report.uptime_s, report.latencyP50_us,
+                     report.latencyP90_us, report.latencyP99_us,
+                     report.latencyMax_us, report.memoryPeak_kB,
+                     report.reconnects, report.dropped,
+                     report.watchdogNearMisses);
+        AbortErrno(written, 0);
+        AbortIfNot(static_cast<size_t>(written) < size, 0);
+
+        return written;
+    }
+
+private:
+    /**
+     * @brief Get the current time.
+     * @return The time, in nanoseconds.
+     * @see VirtualClock::now
+     */
+    static uint64_t now()
+    {
+        return VirtualClock::now();
+    }
+
+    /**
+     * @brief Latency probe timer callback, measuring how late the timer is
+     *        serviced by the event loop.
+     */
+    void probe()
+    {
+        EnergyModel::Scope scope("health");
+        const uint64_t expected = m_probe_ns + k_probePeriod * 1000000ull;
+
+        m_probe_ns = now();
+        const uint64_t late_us =
+            m_probe_ns > expected ? (m_probe_ns - expected) / 1000 : 0;
+        m_latency.record(late_us < UINT32_MAX ?
+                         static_cast<uint32_t>(late_us) : UINT32_MAX);
+
+        AbortIfNot(m_probeTimer.startOneShot(k_probePeriod * 1000ull));
+    }
+
+    /**
+     * @brief Report timer callback, sending the report when worth it.
+     */
+    void evaluate()
+    {
+        Report report;
+        snapshot(report);
+
+        const bool changed =
+            report.reconnects != m_lastSent.reconnects ||
+            report.dropped != m_lastSent.dropped ||
+            report.watchdogNearMisses != m_lastSent.watchdogNearMisses ||
+            distance(report.latencyP99_us, m_lastSent.latencyP99_us) >=
+                m_policy.latencyDeadband_us ||
+            distance(report.memoryPeak_kB, m_lastSent.memoryPeak_kB) >=
+                m_policy.memoryDeadband_kB;
+        const bool silent =
+            now() - m_lastSent_ns >= m_policy.maxSilence_s * 1000000000ull;
+
+        if (!changed && !silent) {
+            return;
+        }
+
+        char message[160];
+        const size_t length = serialize(report, message, sizeof(message));
+        AbortIfNot(length);
+
+        if (m_send(message)) {
+            m_lastSent = report;
+            m_lastSent_ns = now();
+
+            /*
+             * Start a new window for the latency percentiles.
+             */
+            m_latency.reset();
+        }
+    }
+
+    /**
+     * @brief Get the distance between two values.
+     * @param[in] a The first value.
+     * @param[in] b The second value.
+     * @return The absolute difference.
+     */
+    static uint32_t distance(const uint32_t a, const uint32_t b)
+    {
+        return a > b ? a - b : b - a;
+    }
+
+    /**
+     * The latency probe timer.
+     */
+    Timer m_probeTimer;
+
+    /**
+     * The report timer.
+     */
+    Timer m_reportTimer;
+
+    /**
+     * The latency of the event loop, in microseconds. It is not registered,
+     * as each application has its own reporter.
+     */
+    Histogram m_latency;
+
+    /**
+     * The policy deciding when to send a report.
+     */
+    Policy m_policy;
+
+    /**
+     * The watchdog whose near misses are reported.
+     */
+    const Watchdog *m_watchdog;
+
+    /**
+     * The sending callback.
+     */
+    Delegate<bool(const char *)> m_send;
+
+    /**
+     * When the reporter was created, in nanoseconds.
+     */
+    uint64_t m_start_ns;
+
+    /**
+     * When the latency probe was started, in nanoseconds.
+     */
+    uint64_t m_probe_ns;
+
+    /**
+     * When the last report was sent, in nanoseconds.
+     */
+    uint64_t m_lastSent_ns;
+
+    /**
+     * The last report sent.
+     */
+    Report m_lastSent;
+
+    /**
+     * The number of reconnections.
+     */
+    uint32_t m_reconnects;
+
+    /**
+     * The number of messages dropped.
+     */
+    uint32_t m_dropped;
+};
+
+} /* namespace SpherePlusPlus */
@@ -0,0 +1,465 @@
+/**
+ * @file heap.hh
+ * @author Matthieu Bucchianeri
+ * @brief Heap profiler, attributing heap usage to call sites.
+ *
+ * The profiler is opt-in: it requires building the library with the
+ * SPHERE_PLUS_PLUS_HEAP_PROFILER macro, and linking the application with:
+ *
+ * -Wl,--wrap=malloc,--wrap=free,--wrap=calloc,--wrap=realloc
+ *
+ * (see sphereplusplus_heap_profiler() in sphereplusplus.cmake). Every
+ * allocation made by the application's code, with malloc() and friends or with
+ * operator new, is then recorded against the address of its caller. Without the
+ * macro, the snapshot is always empty.
+ *
+ * The live allocations are kept in a table keyed by address, and the blocks
+ * are handed to the caller unchanged: memory from the C library or from
+ * mmap() can be freed through the wrapped functions, and memory from the
+ * wrapped functions can be freed by code that is not wrapped.
+ *
+ * @note Allocations made from within shared libraries (such as the Azure IoT
+ *       library) are not wrapped by the linker, and are not recorded.
+ *
+ * @note A block freed by code that is not wrapped stays recorded as live,
+ *       until its address is allocated again through the profiler.
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <sphereplusplus/abort.hh>
+#include <sphereplusplus/ranking.hh>
+#include <sphereplusplus/spinlock.hh>
+
+#ifdef SPHERE_PLUS_PLUS_HEAP_PROFILER
+extern "C" {
+/*
+ * The original allocator, renamed by the linker.
+ */
+void *__real_malloc(size_t size);
+void *__real_realloc(void *ptr, size_t size);
+void __real_free(void *ptr);
+
+/*
+ * Start of the executable, provided by the default linker script. Call sites
+ * are reported relative to it, so they can be symbolized with addr2line.
+ */
+extern const char __executable_start;
+}
+#endif
+
+namespace SpherePlusPlus {
+
+/**
+ * @brief Heap profiler.
+ */
+class HeapProfiler
+{
+public:
+    /**
+     * The number of call sites recorded. The allocations from the call sites
+     * that do not fit are recorded against the null call site.
+     */
+    static constexpr size_t k_maxSites = 64;
+
+    /**
+     * The number of live allocations recorded. The allocations made while the
+     * table is full are not recorded.
+     */
+    static constexpr size_t k_maxBlocks = 512;
+
+    /**
+     * @brief Heap usage of a call site.
+     */
+    struct Site
+    {
+        /**
+         * The address of the caller, relative to the start of the executable.
+         */
+        uintptr_t caller;
+
+        /**
+         * The number of allocations.
+         */
+        uint32_t allocations;
+
+        /**
+         * The number of allocations that were freed.
+         */
+        uint32_t frees;
+
+        /**
+         * The total number of bytes allocated.
+         */
+        uint64_t allocatedBytes;
+
+        /**
+         * The number of bytes currently allocated.
+         */
+        size_t liveBytes;
+
+        /**
+         * The highest number of bytes allocated at once.
+         */
+        size_t peakLiveBytes;
+    };
+
+    /**
+     * @brief Whether the profiler is built in.
+     * @return True when allocations are recorded.
+     */
+    static constexpr bool isEnabled()
+    {
+#ifdef SPHERE_PLUS_PLUS_HEAP_PROFILER
+        return true;
+#else
+        return false;
+#endif
+    }
+
+    /**
+     * @brief Take a snapshot of the heap usage.
+     * @param[out] sites The call sites, by decreasing number of live bytes.
+     * @param[in] max The maximum number of call sites to return.
+     * @return The number of call sites returned.
+     */
+    static size_t snapshot(Site *const sites, const size_t max)
+    {
+#ifdef SPHERE_PLUS_PLUS_HEAP_PROFILER
+        size_t count = 0;
+
+        g_lock.lock();
+        for (size_t i = 0; i < k_maxSites; i++) {
+            if (g_sites[i].allocations == 0) {
+                continue;
+            }
+
+            insertRanked(sites, count, max, g_sites[i],
+                         [](const Site &site) { return site.liveBytes; });
+        }
+        g_lock.unlock();
+
+        return count;
+#else
+        return 0;
+#endif
+    }
+
+    /**
+     * @brief Serialize a snapshot of the heap usage for upload.
+     * @param[out] buffer The buffer to write to.
+     * @param[in] size The size of the buffer.
+     * @return The length of the serialized snapshot, or 0 if it does not fit.
+     *
+     * The format is compact JSON, listing the call sites by decreasing number
+     * of live bytes:
+     *
+     * {"heap":[{"pc":"0x1a2c","n":12,"f":10,"b":4096,"l":512,"p":1024},...]}
+     *
+     * where pc is the caller, n the number of allocations, f the number of
+     * frees, b the total bytes allocated, l the live bytes, and p the peak of
+     * live bytes.
+     */
+    static size_t serialize(char *const buffer, const size_t size)
+    {
+        Site sites[k_maxSites];
+        const size_t count = snapshot(sites, k_maxSites);
+
+        size_t length = 0;
+        int written = snprintf(buffer, size, "{\"heap\":[");
+        for (size_t i = 0; written >= 0 && i < count; i++) {
+            length += written;
+            AbortIfNot(length < size, 0);
+
+            written = snprintf(buffer + length, size - length,
+                               "%s{\"pc\":\"0x%lx\",\"n\":%u,\"f\":%u,"
+                               "\"b\":%llu,\"l\":%lu,\"p\":%lu}",
+                               i ? "," : "",
+                               static_cast<unsigned long>(sites[i].caller),
+                               sites[i].allocations, sites[i].frees,
+                               static_cast<unsigned long long>(
+                                   sites[i].allocatedBytes),
+                               static_cast<unsigned long>(sites[i].liveBytes),
+                               static_cast<unsigned long>(
+                                   sites[i].peakLiveBytes));
+        }
+        AbortErrno(written, 0);
+        length += written;
+        AbortIfNot(length < size, 0);
+
+        written = snprintf(buffer + length, size - length, "]}");
+        AbortErrno(written, 0);
+        length += written;
+        AbortIfNot(length < size, 0);
+
+        return length;
+    }
+
+#ifdef SPHERE_PLUS_PLUS_HEAP_PROFILER
+    /**
+     * @brief Allocate memory and record the allocation.
+     * @param[in] size The size to allocate.
+     * @param[in] caller The address of the caller.
+     * @return The allocated memory, or nullptr.
+     */
+    static void *allocate(const size_t size, const void *const caller)
+    {
+        void *const ptr = __real_malloc(size);
+        if (ptr) {
+            track(ptr, size, caller);
+        }
+
+        return ptr;
+    }
+
+    /**
+     * @brief Reallocate memory and record the allocation.
+     * @param[in] ptr The memory to reallocate.
+     * @param[in] size The new size.
+     * @param[in] caller The address of the caller.
+     * @return The reallocated memory, or nullptr.
+     */
+    static void *reallocate(void *const ptr, const size_t size,
+                            const void *const caller)
+    {
+        if (!ptr) {
+            return allocate(size, caller);
+        }
+
+        /*
+         * The block is accounted as freed then reallocated by the caller. It
+         * is forgotten before it is handed back to the allocator, so that
+         * another thread reusing its address does not find a stale record.
+         */
+        size_t oldSize;
+        const bool tracked = untrack(ptr, oldSize);
+        void *const moved = __real_realloc(ptr, size);
+        if (tracked) {
+            if (moved) {
+                track(moved, size, caller);
+            } else {
+                track(ptr, oldSize, caller);
+            }
+        }
+
+        return moved;
+    }
+
+    /**
+     * @brief Free memory and record the release.
+     * @param[in] ptr The memory to free.
+     */
+    static void release(void *const ptr)
+    {
+        if (!ptr) {
+            return;
+        }
+
+        size_t size;
+        untrack(ptr, size);
+        __real_free(ptr);
+    }
+
+private:
+    /**
+     * The size of the table of live allocations. At most half of it is used,
+     * to keep the probe sequences short.
+     */
+    static constexpr size_t k_tableSize = 2 * k_maxBlocks;
+
+    /**
+     * @brief A live allocation.
+     */
+    struct Block
+    {
+        /**
+         * The address of the allocation, or 0 for an empty slot.
+         */
+        uintptr_t address;
+
+        /**
+         * The index of the call site.
+         */
+        uint32_t site;
+
+        /**
+         * The size of the allocation.
+         */
+        size_t size;
+    };
+
+    /**
+     * @brief Get the home slot of an allocation in the table.
+     * @param[in] address The address of the allocation.
+     * @return The index of the slot.
+     */
+    static size_t home(const uintptr_t address)
+    {
+        return ((address >> 3) * 2654435761u) % k_tableSize;
+    }
+
+    /**
+     * @brief Find an allocation in the table. Must be called with the lock
+     *        held.
+     * @param[in] address The address of the allocation.
+     * @return The index of its slot, or of the empty slot ending its probe
+     *         sequence.
+     */
+    static size_t find(const uintptr_t address)
+    {
+        size_t index = home(address);
+        while (g_blocks[index].address &&
+               g_blocks[index].address != address) {
+            index = (index + 1) % k_tableSize;
+        }
+
+        return index;
+    }
+
+    /**
+     * @brief Remove an allocation from the table. Must be called with the
+     *        lock held.
+     * @param[in] index The index of its slot.
+     *
+     * The following entries of the probe sequence are shifted back into the
+     * hole, so that no tombstones are needed.
+     */
+    static void remove(size_t index)
+    {
+        for (size_t next = (index + 1) % k_tableSize; g_blocks[next].address;
+             next = (next + 1) % k_tableSize) {
+            const size_t distance =
+                (next + k_tableSize - home(g_blocks[next].address)) %
+                k_tableSize;
+            if (distance >= (next + k_tableSize - index) % k_tableSize) {
+                g_blocks[index] = g_blocks[next];
+                index = next;
+            }
+        }
+
+        g_blocks[index].address = 0;
+        g_blockCount--;
+    }
+
+    /**
+     * @brief Record an allocation.
+     * @param[in] ptr The allocation.
+     * @param[in] size The size of the allocation.
+     * @param[in] caller The address of the caller.
+     */
+    static void track(void *const ptr, const size_t size,
+                      const void *const caller)
+    {
+        const uintptr_t address = reinterpret_cast<uintptr_t>(ptr);
+        const uintptr_t pc = reinterpret_cast<uintptr_t>(caller) -
+            reinterpret_cast<uintptr_t>(&__executable_start);
+
+        g_lock.lock();
+        const size_t index = find(address);
+        if (g_blocks[index].address) {
+            /*
+             * The previous block at this address was freed without going
+             * through the profiler.
+             */
+            g_sites[g_blocks[index].site].frees++;
+            g_sites[g_blocks[index].site].liveBytes -= g_blocks[index].size;
+        } else if (g_blockCount == k_maxBlocks) {
+            g_lock.unlock();
+            return;
+        } else {
+            g_blockCount++;
+        }
+
+        Block &block = g_blocks[index];
+        block.address = address;
+        block.site = lookup(pc);
+        block.size = size;
+
+        Site &site = g_sites[block.site];
+        site.allocations++;
+        site.allocatedBytes += size;
+        site.liveBytes += size;
+        if (site.liveBytes > site.peakLiveBytes) {
+            site.peakLiveBytes = site.liveBytes;
+        }
+        g_lock.unlock();
+    }
+
+    /**
+     * @brief Record a release.
+     * @param[in] ptr The allocation.
+     * @param[out] size The size of the allocation.
+     * @return True if the allocation was recorded.
+     */
+    static bool untrack(void *const ptr, size_t &size)
+    {
+        g_lock.lock();
+        const size_t index = find(reinterpret_cast<uintptr_t>(ptr));
+        const Block block = g_blocks[index];
+        if (block.address) {
+            Site &site = g_sites[block.site];
+            site.frees++;
+            site.liveBytes -= block.size;
+            remove(index);
+        }
+        g_lock.unlock();
+
+        size = block.size;
+        return block.address != 0;
+    }
+
+    /**
+     * @brief Find or insert a call site. Must be called with the lock held.
+     * @param[in] pc The caller.
+     * @return The index of the call site.
+     */
+    static uint32_t lookup(const uintptr_t pc)
+    {
+        /*
+         * Open addressing, with the null call site (index 0) collecting the
+         * overflow.
+         */
+        const size_t hash = (pc >> 2) * 2654435761u;
+        for (size_t i = 0; i < k_maxSites - 1; i++) {
+            const uint32_t index = 1 + (hash + i) % (k_maxSites - 1);
+
+            if (g_sites[index].caller == pc) {
+                return index;
+            }
+            if (g_sites[index].allocations == 0) {
+                g_sites[index].caller = pc;
+                return index;
+            }
+        }
+
+        return 0;
+    }
+
+    /**
+     * The call sites.
+     */
+    static Site g_sites[k_maxSites];
+
+    /**
+     * The live allocations, by address.
+     */
+    static Block g_blocks[k_tableSize];
+
+    /**
+     * The number of live allocations in the table.
+     */
+    static size_t g_blockCount;
+
+    /**
+     * The lock protecting the call sites and the live allocations.
+     */
+    static SpinLock g_lock;
+#endif
+};
+
+} /* namespace SpherePlusPlus */
@@ -0,0 +1,261 @@
+/**
+ * @file eventloop.c
+ * @author Matthieu Bucchianeri
+ * @brief Host stand-in for the Azure Sphere event loop, on top of epoll.
+ */
+
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <errno.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <applibs/eventloop.h>
+#include <host/eventloop.h>
+
+struct EventLoop {
+    /*
+     * The epoll instance.
+     */
+    int epollFd;
+
+    /*
+     * The event waking the loop up when stopped.
+     */
+    int stopFd;
+
+    /*
+     * Whether the loop was stopped, possibly from another thread.
+     */
+    bool stopped;
+};
+
+struct EventRegistration {
+    int fd;
+    EventLoopIoCallback *callback;
+    void *context;
+};
+
+/*
+ * The number of system calls made by the event loops.
+ */
+static uint64_t g_syscalls;
+
+static void count_syscall(void)
+{
+    __atomic_fetch_add(&g_syscalls, 1, __ATOMIC_RELAXED);
+}
+
+static uint64_t now_ms(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return ts.tv_sec * 1000ull + ts.tv_nsec / 1000000;
+}
+
+EventLoop *EventLoop_Create(void)
+{
+    EventLoop *const el = calloc(1, sizeof(*el));
+    if (!el) {
+        return NULL;
+    }
+
+    el->epollFd = epoll_create1(EPOLL_CLOEXEC);
+    el->stopFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (el->epollFd < 0 || el->stopFd < 0) {
+        goto fail;
+    }
+
+    /*
+     * The stop event is the only one registered without a registration.
+     */
+    struct epoll_event event = {
+        .events = EPOLLIN,
+        .data.ptr = NULL,
+    };
+    if (epoll_ctl(el->epollFd, EPOLL_CTL_ADD, el->stopFd, &event) < 0) {
+        goto fail;
+    }
+
+    return el;
+
+fail:
+    EventLoop_Close(el);
+    return NULL;
+}
+
+void EventLoop_Close(EventLoop *el)
+{
+    if (!el) {
+        return;
+    }
+
+    if (el->stopFd >= 0) {
+        close(el->stopFd);
+    }
+    if (el->epollFd >= 0) {
+        close(el->epollFd);
+    }
+    free(el);
+}
+
+EventLoop_Run_Result EventLoop_Run(EventLoop *el, int duration_in_milliseconds,
+                                   bool process_one_event)
+{
+    if (!el) {
+        errno = EINVAL;
+        return EventLoop_Run_Failed;
+    }
+
+    const uint64_t deadline = now_ms() + duration_in_milliseconds;
+    bool processed = false;
+
+    for (;;) {
+        int timeout = -1;
+        if (duration_in_milliseconds >= 0) {
+            const uint64_t now = now_ms();
+            timeout = now < deadline ? (int)(deadline - now) : 0;
+        }
+
+        /*
+         * Dispatch one event at a time, a callback may unregister the other
+         * events ready.
+         */
+        struct epoll_event event;
+        count_syscall();
+        const int count = epoll_wait(el->epollFd, &event, 1, timeout);
+        if (count < 0) {
+            return EventLoop_Run_Failed;
+        }
+
+        if (count == 1) {
+            EventRegistration *const reg = event.data.ptr;
+
+            if (reg) {
+                reg->callback(el, reg->fd, event.events, reg->context);
+                processed = true;
+            } else {
+                uint64_t value;
+                (void)read(el->stopFd, &value, sizeof(value));
+            }
+        }
+
+        if (__atomic_exchange_n(&el->stopped, false, __ATOMIC_ACQUIRE)) {
+            return EventLoop_Run_Finished;
+        }
+        if (processed && process_one_event) {
+            return EventLoop_Run_Finished;
+        }
+        if (count == 0) {
+            return processed ? EventLoop_Run_Finished :
+                EventLoop_Run_FinishedEmpty;
+        }
+    }
+}
+
+int EventLoop_Stop(EventLoop *el)
+{
+    if (!el) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    __atomic_store_n(&el->stopped, true, __ATOMIC_RELEASE);
+
+    const uint64_t value = 1;
+    if (write(el->stopFd, &value, sizeof(value)) < 0 && errno != EAGAIN) {
+        return -1;
+    }
+
+    return 0;
+}
+
+int EventLoop_GetWaitDescriptor(EventLoop *el)
+{
+    if (!el) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    return el->epollFd;
+}
+
+EventRegistration *EventLoop_RegisterIo(EventLoop *el, int fd,
+                                        EventLoop_IoEvents eventBitmask,
+                                        EventLoopIoCallback *callback,
+                                        void *context)
+{
+    if (!el || !callback) {
+        errno = EINVAL;
+        return NULL;
+    }
+
+    EventRegistration *const reg = malloc(sizeof(*reg));
+    if (!reg) {
+        errno = ENOMEM;
+        return NULL;
+    }
+
+    reg->fd = fd;
+    reg->callback = callback;
+    reg->context = context;
+
+    /*
+     * The event bits are the same as epoll's.
+     */
+    struct epoll_event event = {
+        .events = eventBitmask,
+        .data.ptr = reg,
+    };
+    count_syscall();
+    if (epoll_ctl(el->epollFd, EPOLL_CTL_ADD, fd, &event) < 0) {
+        free(reg);
+        return NULL;
+    }
+
+    return reg;
+}
+
+int EventLoop_ModifyIoEvents(EventLoop *el, EventRegistration *reg,
+                             EventLoop_IoEvents eventBitmask)
+{
+    if (!el || !reg) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    struct epoll_event event = {
+        .events = eventBitmask,
+        .data.ptr = reg,
+    };
+
+    count_syscall();
+    return epoll_ctl(el->epollFd, EPOLL_CTL_MOD, reg->fd, &event);
+}
+
+int EventLoop_UnregisterIo(EventLoop *el, EventRegistration *reg)
+{
+    if (!el || !reg) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    count_syscall();
+    const int result = epoll_ctl(el->epollFd, EPOLL_CTL_DEL, reg->fd, NULL);
+    free(reg);
+
+    return result;
+}
+
+const char *HostEventLoop_GetBackend(void)
+{
+    return "epoll";
+}
+
+uint64_t HostEventLoop_GetSyscallCount(void)
+{
+    return __atomic_load_n(&g_syscalls, __ATOMIC_RELAXED);
+}
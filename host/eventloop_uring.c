@@ -0,0 +1,600 @@
+/**
+ * @file eventloop_uring.c
+ * @author Matthieu Bucchianeri
+ * @brief Host stand-in for the Azure Sphere event loop, on top of io_uring.
+ *
+ * Each registration is a one-shot poll, armed again after its callback, which
+ * keeps the level-triggered semantics of the device's event loop. The polls
+ * armed and removed are queued in the submission ring, and submitted along
+ * with the wait for events, in a single system call. The events completed
+ * together are then dispatched one at a time from the completion ring,
+ * without further system calls.
+ */
+
+#include <linux/io_uring.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <applibs/eventloop.h>
+#include <host/eventloop.h>
+
+/*
+ * The size of the submission ring.
+ */
+#define RING_ENTRIES 256
+
+/*
+ * The user data of the completions not tied to a registration.
+ */
+#define USER_DATA_IGNORE 0
+#define USER_DATA_STOP 1
+
+struct EventRegistration {
+    int fd;
+    EventLoopIoCallback *callback;
+    void *context;
+    EventLoop_IoEvents events;
+
+    /*
+     * Whether a poll is in flight.
+     */
+    bool armed;
+
+    /*
+     * Whether the poll in flight is being cancelled, to change its events.
+     */
+    bool cancelling;
+
+    /*
+     * Whether the registration was unregistered, and must be freed once no
+     * poll is in flight.
+     */
+    bool removed;
+
+    struct EventRegistration *prev;
+    struct EventRegistration *next;
+};
+
+struct EventLoop {
+    /*
+     * The io_uring instance, and its rings shared with the kernel.
+     */
+    int ringFd;
+    void *rings;
+    size_t ringsSize;
+    struct io_uring_sqe *sqes;
+    size_t sqesSize;
+
+    unsigned *sqHead;
+    unsigned *sqTail;
+    unsigned *sqArray;
+    unsigned sqMask;
+    unsigned sqEntries;
+
+    /*
+     * The tail of the submission ring, including the entries not submitted
+     * yet.
+     */
+    unsigned sqQueued;
+
+    unsigned *cqHead;
+    unsigned *cqTail;
+    unsigned cqMask;
+    struct io_uring_cqe *cqes;
+
+    /*
+     * The event waking the loop up when stopped.
+     */
+    int stopFd;
+
+    /*
+     * Whether the loop was stopped, possibly from another thread.
+     */
+    bool stopped;
+
+    /*
+     * The registrations, freed when closing the loop.
+     */
+    EventRegistration *registrations;
+
+    /*
+     * The registration whose callback is running.
+     */
+    EventRegistration *dispatching;
+};
+
+/*
+ * The number of system calls made by the event loops.
+ */
+static uint64_t g_syscalls;
+
+static void count_syscall(void)
+{
+    __atomic_fetch_add(&g_syscalls, 1, __ATOMIC_RELAXED);
+}
+
+static uint64_t now_ms(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return ts.tv_sec * 1000ull + ts.tv_nsec / 1000000;
+}
+
+/*
+ * Submit the queued entries, and wait for a completion for at most the given
+ * duration (-1 for no limit, 0 to not wait).
+ */
+static int enter(EventLoop *el, int timeout_ms)
+{
+    __atomic_store_n(el->sqTail, el->sqQueued, __ATOMIC_RELEASE);
+    const unsigned submit =
+        el->sqQueued - __atomic_load_n(el->sqHead, __ATOMIC_ACQUIRE);
+
+    unsigned flags = IORING_ENTER_GETEVENTS;
+    struct __kernel_timespec ts;
+    struct io_uring_getevents_arg arg;
+    void *argp = NULL;
+    size_t argsz = 0;
+    if (timeout_ms > 0) {
+        ts.tv_sec = timeout_ms / 1000;
+        ts.tv_nsec = (timeout_ms % 1000) * 1000000ll;
+        memset(&arg, 0, sizeof(arg));
+        arg.ts = (uintptr_t)&ts;
+        flags |= IORING_ENTER_EXT_ARG;
+        argp = &arg;
+        argsz = sizeof(arg);
+    }
+
+    count_syscall();
+    const int result = syscall(__NR_io_uring_enter, el->ringFd, submit,
+                               timeout_ms ? 1 : 0, flags, argp, argsz);
+    if (result < 0 && errno == ETIME) {
+        return 0;
+    }
+
+    return result;
+}
+
+static struct io_uring_sqe *get_sqe(EventLoop *el)
+{
+    /*
+     * Submit the queued entries when the ring is full.
+     */
+    if (el->sqQueued - __atomic_load_n(el->sqHead, __ATOMIC_ACQUIRE) >=
+        el->sqEntries) {
+        if (enter(el, 0) < 0) {
+            return NULL;
+        }
+    }
+
+    const unsigned index = el->sqQueued & el->sqMask;
+    struct io_uring_sqe *const sqe = &el->sqes[index];
+    memset(sqe, 0, sizeof(*sqe));
+    el->sqArray[index] = index;
+    el->sqQueued++;
+
+    return sqe;
+}
+
+static int queue_poll(EventLoop *el, int fd, EventLoop_IoEvents events,
+                      uint64_t userData)
+{
+    struct io_uring_sqe *const sqe = get_sqe(el);
+    if (!sqe) {
+        return -1;
+    }
+
+    /*
+     * The event bits are the same as poll's.
+     */
+    sqe->opcode = IORING_OP_POLL_ADD;
+    sqe->fd = fd;
+    sqe->poll32_events = events;
+    sqe->user_data = userData;
+
+    return 0;
+}
+
+static int arm(EventLoop *el, EventRegistration *reg)
+{
+    if (reg->events == EventLoop_None) {
+        return 0;
+    }
+
+    if (queue_poll(el, reg->fd, reg->events, (uintptr_t)reg) < 0) {
+        return -1;
+    }
+    reg->armed = true;
+
+    return 0;
+}
+
+static int cancel(EventLoop *el, EventRegistration *reg)
+{
+    if (reg->cancelling) {
+        return 0;
+    }
+
+    struct io_uring_sqe *const sqe = get_sqe(el);
+    if (!sqe) {
+        return -1;
+    }
+
+    sqe->opcode = IORING_OP_POLL_REMOVE;
+    sqe->addr = (uintptr_t)reg;
+    sqe->user_data = USER_DATA_IGNORE;
+    reg->cancelling = true;
+
+    return 0;
+}
+
+static void release(EventLoop *el, EventRegistration *reg)
+{
+    if (reg->prev) {
+        reg->prev->next = reg->next;
+    } else {
+        el->registrations = reg->next;
+    }
+    if (reg->next) {
+        reg->next->prev = reg->prev;
+    }
+
+    free(reg);
+}
+
+/*
+ * Take the next completion from the ring, if any.
+ */
+static bool reap(EventLoop *el, struct io_uring_cqe *cqe)
+{
+    const unsigned head = *el->cqHead;
+    if (head == __atomic_load_n(el->cqTail, __ATOMIC_ACQUIRE)) {
+        return false;
+    }
+
+    *cqe = el->cqes[head & el->cqMask];
+    __atomic_store_n(el->cqHead, head + 1, __ATOMIC_RELEASE);
+
+    return true;
+}
+
+/*
+ * Handle a completion, returning whether a callback was invoked.
+ */
+static bool complete(EventLoop *el, const struct io_uring_cqe *cqe)
+{
+    if (cqe->user_data == USER_DATA_IGNORE) {
+        return false;
+    }
+
+    if (cqe->user_data == USER_DATA_STOP) {
+        uint64_t value;
+        (void)read(el->stopFd, &value, sizeof(value));
+        (void)queue_poll(el, el->stopFd, EventLoop_Input, USER_DATA_STOP);
+        return false;
+    }
+
+    EventRegistration *const reg = (EventRegistration *)(uintptr_t)
+        cqe->user_data;
+    reg->armed = false;
+    reg->cancelling = false;
+
+    if (reg->removed) {
+        release(el, reg);
+        return false;
+    }
+
+    /*
+     * A poll cancelled to change its events is armed again with the new
+     * events, as is a poll completed with events no longer requested. A poll
+     * failing (such as on a closed file descriptor) reports an error once.
+     */
+    if (cqe->res == -ECANCELED) {
+        (void)arm(el, reg);
+        return false;
+    }
+    const EventLoop_IoEvents events = cqe->res < 0 ? EventLoop_Error :
+        (EventLoop_IoEvents)cqe->res & (reg->events | EventLoop_Error |
+                                        POLLHUP);
+    if (!events) {
+        (void)arm(el, reg);
+        return false;
+    }
+
+    el->dispatching = reg;
+    reg->callback(el, reg->fd, events, reg->context);
+    el->dispatching = NULL;
+
+    if (reg->removed) {
+        release(el, reg);
+    } else if (!reg->armed && cqe->res >= 0) {
+        (void)arm(el, reg);
+    }
+
+    return true;
+}
+
+EventLoop *EventLoop_Create(void)
+{
+    EventLoop *const el = calloc(1, sizeof(*el));
+    if (!el) {
+        return NULL;
+    }
+    el->ringFd = -1;
+    el->stopFd = -1;
+
+    /*
+     * Defer the completion work to the next wait, rather than interrupting
+     * the loop, when supported.
+     */
+    struct io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    params.flags = IORING_SETUP_COOP_TASKRUN;
+    el->ringFd = syscall(__NR_io_uring_setup, RING_ENTRIES, &params);
+    if (el->ringFd < 0 && errno == EINVAL) {
+        memset(&params, 0, sizeof(params));
+        el->ringFd = syscall(__NR_io_uring_setup, RING_ENTRIES, &params);
+    }
+    if (el->ringFd < 0) {
+        goto fail;
+    }
+
+    /*
+     * The wait with a timeout requires Linux 5.11.
+     */
+    if (!(params.features & IORING_FEAT_SINGLE_MMAP) ||
+        !(params.features & IORING_FEAT_EXT_ARG)) {
+        errno = ENOSYS;
+        goto fail;
+    }
+
+    const size_t sqSize = params.sq_off.array +
+        params.sq_entries * sizeof(unsigned);
+    const size_t cqSize = params.cq_off.cqes +
+        params.cq_entries * sizeof(struct io_uring_cqe);
+    el->ringsSize = sqSize > cqSize ? sqSize : cqSize;
+    el->rings = mmap(NULL, el->ringsSize, PROT_READ | PROT_WRITE,
+                     MAP_SHARED | MAP_POPULATE, el->ringFd,
+                     IORING_OFF_SQ_RING);
+    if (el->rings == MAP_FAILED) {
+        el->rings = NULL;
+        goto fail;
+    }
+
+    el->sqesSize = params.sq_entries * sizeof(struct io_uring_sqe);
+    el->sqes = mmap(NULL, el->sqesSize, PROT_READ | PROT_WRITE,
+                    MAP_SHARED | MAP_POPULATE, el->ringFd, IORING_OFF_SQES);
+    if (el->sqes == MAP_FAILED) {
+        el->sqes = NULL;
+        goto fail;
+    }
+
+    char *const rings = el->rings;
+    el->sqHead = (unsigned *)(rings + params.sq_off.head);
+    el->sqTail = (unsigned *)(rings + params.sq_off.tail);
+    el->sqArray = (unsigned *)(rings + params.sq_off.array);
+    el->sqMask = *(unsigned *)(rings + params.sq_off.ring_mask);
+    el->sqEntries = params.sq_entries;
+    el->sqQueued = *el->sqTail;
+    el->cqHead = (unsigned *)(rings + params.cq_off.head);
+    el->cqTail = (unsigned *)(rings + params.cq_off.tail);
+    el->cqMask = *(unsigned *)(rings + params.cq_off.ring_mask);
+    el->cqes = (struct io_uring_cqe *)(rings + params.cq_off.cqes);
+
+    el->stopFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (el->stopFd < 0 ||
+        queue_poll(el, el->stopFd, EventLoop_Input, USER_DATA_STOP) < 0) {
+        goto fail;
+    }
+
+    return el;
+
+fail:
+    EventLoop_Close(el);
+    return NULL;
+}
+
+void EventLoop_Close(EventLoop *el)
+{
+    if (!el) {
+        return;
+    }
+
+    /*
+     * Closing the ring cancels the polls in flight.
+     */
+    while (el->registrations) {
+        release(el, el->registrations);
+    }
+
+    if (el->stopFd >= 0) {
+        close(el->stopFd);
+    }
+    if (el->sqes) {
+        munmap(el->sqes, el->sqesSize);
+    }
+    if (el->rings) {
+        munmap(el->rings, el->ringsSize);
+    }
+    if (el->ringFd >= 0) {
+        close(el->ringFd);
+    }
+    free(el);
+}
+
+EventLoop_Run_Result EventLoop_Run(EventLoop *el, int duration_in_milliseconds,
+                                   bool process_one_event)
+{
+    if (!el) {
+        errno = EINVAL;
+        return EventLoop_Run_Failed;
+    }
+
+    const uint64_t deadline = now_ms() + duration_in_milliseconds;
+    bool processed = false;
+
+    for (;;) {
+        int timeout = -1;
+        if (duration_in_milliseconds >= 0) {
+            const uint64_t now = now_ms();
+            timeout = now < deadline ? (int)(deadline - now) : 0;
+        }
+
+        /*
+         * Dispatch one completion at a time, a callback may unregister the
+         * other events ready. Only enter the kernel once the completions
+         * already reaped are dispatched.
+         */
+        struct io_uring_cqe cqe;
+        bool ready = reap(el, &cqe);
+        if (!ready) {
+            if (enter(el, timeout) < 0) {
+                return EventLoop_Run_Failed;
+            }
+            ready = reap(el, &cqe);
+        }
+
+        if (ready && complete(el, &cqe)) {
+            processed = true;
+        }
+
+        if (__atomic_exchange_n(&el->stopped, false, __ATOMIC_ACQUIRE)) {
+            return EventLoop_Run_Finished;
+        }
+        if (processed && process_one_event) {
+            return EventLoop_Run_Finished;
+        }
+        if (!ready) {
+            return processed ? EventLoop_Run_Finished :
+                EventLoop_Run_FinishedEmpty;
+        }
+    }
+}
+
+int EventLoop_Stop(EventLoop *el)
+{
+    if (!el) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    __atomic_store_n(&el->stopped, true, __ATOMIC_RELEASE);
+
+    const uint64_t value = 1;
+    if (write(el->stopFd, &value, sizeof(value)) < 0 && errno != EAGAIN) {
+        return -1;
+    }
+
+    return 0;
+}
+
+int EventLoop_GetWaitDescriptor(EventLoop *el)
+{
+    if (!el) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    return el->ringFd;
+}
+
+EventRegistration *EventLoop_RegisterIo(EventLoop *el, int fd,
+                                        EventLoop_IoEvents eventBitmask,
+                                        EventLoopIoCallback *callback,
+                                        void *context)
+{
+    if (!el || !callback) {
+        errno = EINVAL;
+        return NULL;
+    }
+
+    /*
+     * The poll only fails once submitted, check the file descriptor now, as
+     * epoll does.
+     */
+    if (fcntl(fd, F_GETFD) < 0) {
+        return NULL;
+    }
+
+    EventRegistration *const reg = calloc(1, sizeof(*reg));
+    if (!reg) {
+        errno = ENOMEM;
+        return NULL;
+    }
+
+    reg->fd = fd;
+    reg->callback = callback;
+    reg->context = context;
+    reg->events = eventBitmask;
+    if (arm(el, reg) < 0) {
+        free(reg);
+        return NULL;
+    }
+
+    reg->next = el->registrations;
+    if (reg->next) {
+        reg->next->prev = reg;
+    }
+    el->registrations = reg;
+
+    return reg;
+}
+
+int EventLoop_ModifyIoEvents(EventLoop *el, EventRegistration *reg,
+                             EventLoop_IoEvents eventBitmask)
+{
+    if (!el || !reg || reg->removed) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    if (eventBitmask == reg->events) {
+        return 0;
+    }
+    reg->events = eventBitmask;
+
+    /*
+     * The poll in flight is armed again with the new events once cancelled.
+     */
+    return reg->armed ? cancel(el, reg) : arm(el, reg);
+}
+
+int EventLoop_UnregisterIo(EventLoop *el, EventRegistration *reg)
+{
+    if (!el || !reg || reg->removed) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    reg->removed = true;
+    if (reg->armed) {
+        return cancel(el, reg);
+    }
+
+    if (reg != el->dispatching) {
+        release(el, reg);
+    }
+
+    return 0;
+}
+
+const char *HostEventLoop_GetBackend(void)
+{
+    return "io_uring";
+}
+
+uint64_t HostEventLoop_GetSyscallCount(void)
+{
+    return __atomic_load_n(&g_syscalls, __ATOMIC_RELAXED);
+}
@@ -0,0 +1,142 @@
+/**
+ * @file gpio.c
+ * @author Matthieu Bucchianeri
+ * @brief Host stand-in for the Azure Sphere GPIO API, with simulated GPIOs.
+ */
+
+#include <sys/eventfd.h>
+#include <errno.h>
+#include <unistd.h>
+
+#include <applibs/gpio.h>
+#include <host/gpio.h>
+
+/*
+ * The largest file descriptor of a GPIO.
+ */
+#define HOST_GPIO_MAX_FD 4096
+
+/*
+ * The level of each GPIO.
+ */
+static GPIO_Value_Type g_values[HOST_GPIO_COUNT];
+
+/*
+ * The GPIO opened with each file descriptor, plus one (0 when the file
+ * descriptor is not a GPIO). The entries are not cleared when the file
+ * descriptors are closed, but overwritten when they are reused.
+ */
+static int g_gpioOfFd[HOST_GPIO_MAX_FD];
+
+static int open_gpio(GPIO_Id gpioId, int isOutput)
+{
+    if (gpioId < 0 || gpioId >= HOST_GPIO_COUNT) {
+        errno = ENODEV;
+        return -1;
+    }
+
+    /*
+     * The file descriptor is only a handle, backed by an event so that it can
+     * be closed like a real one.
+     */
+    const int fd = eventfd(0, EFD_CLOEXEC);
+    if (fd < 0) {
+        return -1;
+    }
+    if (fd >= HOST_GPIO_MAX_FD) {
+        close(fd);
+        errno = EMFILE;
+        return -1;
+    }
+
+    __atomic_store_n(&g_gpioOfFd[fd], (gpioId + 1) * (isOutput ? -1 : 1),
+                     __ATOMIC_RELEASE);
+
+    return fd;
+}
+
+static int gpio_of_fd(int fd, int *isOutput)
+{
+    const int gpio = fd >= 0 && fd < HOST_GPIO_MAX_FD ?
+        __atomic_load_n(&g_gpioOfFd[fd], __ATOMIC_ACQUIRE) : 0;
+    if (!gpio) {
+        errno = EBADF;
+        return -1;
+    }
+
+    *isOutput = gpio < 0;
+    return (gpio < 0 ? -gpio : gpio) - 1;
+}
+
+int GPIO_OpenAsInput(GPIO_Id gpioId)
+{
+    return open_gpio(gpioId, 0);
+}
+
+int GPIO_OpenAsOutput(GPIO_Id gpioId, GPIO_OutputMode_Type outputMode,
+                      GPIO_Value_Type initialValue)
+{
+    if (outputMode > GPIO_OutputMode_OpenSource) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    const int fd = open_gpio(gpioId, 1);
+    if (fd >= 0) {
+        HostGpio_SetValue(gpioId, initialValue);
+    }
+
+    return fd;
+}
+
+int GPIO_GetValue(int gpioFd, GPIO_Value_Type *outValue)
+{
+    int isOutput;
+    const int gpioId = gpio_of_fd(gpioFd, &isOutput);
+    if (gpioId < 0) {
+        return -1;
+    }
+
+    return HostGpio_GetValue(gpioId, outValue);
+}
+
+int GPIO_SetValue(int gpioFd, GPIO_Value_Type value)
+{
+    int isOutput;
+    const int gpioId = gpio_of_fd(gpioFd, &isOutput);
+    if (gpioId < 0) {
+        return -1;
+    }
+    if (!isOutput) {
+        errno = EPERM;
+        return -1;
+    }
+
+    return HostGpio_SetValue(gpioId, value);
+}
+
+int HostGpio_SetValue(GPIO_Id gpioId, GPIO_Value_Type value)
+{
+    if (gpioId < 0 || gpioId >= HOST_GPIO_COUNT) {
+        errno = ENODEV;
+        return -1;
+    }
+
+    __atomic_store_n(&g_values[gpioId],
+                     value ? GPIO_Value_High : GPIO_Value_Low,
+                     __ATOMIC_RELAXED);
+
+    return 0;
+}
+
+int HostGpio_GetValue(GPIO_Id gpioId, GPIO_Value_Type *outValue)
+{
+    if (gpioId < 0 || gpioId >= HOST_GPIO_COUNT || !outValue) {
+        errno = gpioId < 0 || gpioId >= HOST_GPIO_COUNT ? ENODEV : EINVAL;
+        return -1;
+    }
+
+    *outValue = __atomic_load_n(&g_values[gpioId], __ATOMIC_RELAXED);
+
+    return 0;
+}
@@ -0,0 +1,21 @@
+/**
+ * @file applications.h
+ * @author Matthieu Bucchianeri
+ * @brief Host stand-in for the Azure Sphere applications API.
+ */
+
+#pragma once
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+size_t Applications_GetTotalMemoryUsageInKB(void);
+size_t Applications_GetUserModeMemoryUsageInKB(void);
+size_t Applications_GetPeakUserModeMemoryUsageInKB(void);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,19 @@
+/**
+ * @file log.h
+ * @author Matthieu Bucchianeri
+ * @brief Host stand-in for the Azure Sphere logging API.
+ *
+ * The messages are written to the standard error.
+ */
+
+#pragma once
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+int Log_Debug(const char *fmt, ...) __attribute__((format(printf, 1, 2)));
+
+#ifdef __cplusplus
+}
+#endif
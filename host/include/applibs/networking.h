@@ -0,0 +1,19 @@
+/**
+ * @file networking.h
+ * @author Matthieu Bucchianeri
+ * @brief Host stand-in for the Azure Sphere networking API.
+ */
+
+#pragma once
+
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+int Networking_TimeSync_SetEnabled(bool enabled);
+
+#ifdef __cplusplus
+}
+#endif
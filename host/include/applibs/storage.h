@@ -0,0 +1,20 @@
+/**
+ * @file storage.h
+ * @author Matthieu Bucchianeri
+ * @brief Host stand-in for the Azure Sphere storage API.
+ *
+ * The mutable storage is a file on the host (see host/storage.h).
+ */
+
+#pragma once
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+int Storage_OpenMutableFile(void);
+int Storage_DeleteMutableFile(void);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,100 @@
+/**
+ * @file iothub_client_core_common.h
+ * @author Matthieu Bucchianeri
+ * @brief Host stand-in for the Azure IoT client common definitions.
+ */
+
+#pragma once
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef enum {
+    IOTHUB_CLIENT_OK,
+    IOTHUB_CLIENT_INVALID_ARG,
+    IOTHUB_CLIENT_ERROR,
+    IOTHUB_CLIENT_INVALID_SIZE,
+    IOTHUB_CLIENT_INDEFINITE_TIME,
+} IOTHUB_CLIENT_RESULT;
+
+typedef enum {
+    IOTHUB_CLIENT_CONNECTION_AUTHENTICATED,
+    IOTHUB_CLIENT_CONNECTION_UNAUTHENTICATED,
+} IOTHUB_CLIENT_CONNECTION_STATUS;
+
+typedef enum {
+    IOTHUB_CLIENT_CONNECTION_EXPIRED_SAS_TOKEN,
+    IOTHUB_CLIENT_CONNECTION_DEVICE_DISABLED,
+    IOTHUB_CLIENT_CONNECTION_BAD_CREDENTIAL,
+    IOTHUB_CLIENT_CONNECTION_RETRY_EXPIRED,
+    IOTHUB_CLIENT_CONNECTION_NO_NETWORK,
+    IOTHUB_CLIENT_CONNECTION_COMMUNICATION_ERROR,
+    IOTHUB_CLIENT_CONNECTION_OK,
+    IOTHUB_CLIENT_CONNECTION_NO_PING_RESPONSE,
+} IOTHUB_CLIENT_CONNECTION_STATUS_REASON;
+
+typedef enum {
+    IOTHUB_CLIENT_RETRY_NONE,
+    IOTHUB_CLIENT_RETRY_IMMEDIATE,
+    IOTHUB_CLIENT_RETRY_INTERVAL,
+    IOTHUB_CLIENT_RETRY_LINEAR_BACKOFF,
+    IOTHUB_CLIENT_RETRY_EXPONENTIAL_BACKOFF,
+    IOTHUB_CLIENT_RETRY_EXPONENTIAL_BACKOFF_WITH_JITTER,
+    IOTHUB_CLIENT_RETRY_RANDOM,
+} IOTHUB_CLIENT_RETRY_POLICY;
+
+typedef enum {
+    IOTHUB_CLIENT_CONFIRMATION_OK,
+    IOTHUB_CLIENT_CONFIRMATION_BECAUSE_DESTROY,
+    IOTHUB_CLIENT_CONFIRMATION_MESSAGE_TIMEOUT,
+    IOTHUB_CLIENT_CONFIRMATION_ERROR,
+} IOTHUB_CLIENT_CONFIRMATION_RESULT;
+
+typedef enum {
+    PROV_DEVICE_RESULT_OK,
+    PROV_DEVICE_RESULT_INVALID_ARG,
+    PROV_DEVICE_RESULT_SUCCESS,
+    PROV_DEVICE_RESULT_MEMORY,
+    PROV_DEVICE_RESULT_PARSING,
+    PROV_DEVICE_RESULT_TRANSPORT,
+    PROV_DEVICE_RESULT_INVALID_STATE,
+    PROV_DEVICE_RESULT_DEV_AUTH_ERROR,
+    PROV_DEVICE_RESULT_TIMEOUT,
+    PROV_DEVICE_RESULT_KEY_ERROR,
+    PROV_DEVICE_RESULT_ERROR,
+    PROV_DEVICE_RESULT_HUB_NOT_SPECIFIED,
+    PROV_DEVICE_RESULT_UNAUTHORIZED,
+    PROV_DEVICE_RESULT_DISABLED,
+} PROV_DEVICE_RESULT;
+
+typedef void (*IOTHUB_CLIENT_CONNECTION_STATUS_CALLBACK)(
+    IOTHUB_CLIENT_CONNECTION_STATUS result,
+    IOTHUB_CLIENT_CONNECTION_STATUS_REASON reason, void *userContextCallback);
+typedef void (*IOTHUB_CLIENT_EVENT_CONFIRMATION_CALLBACK)(
+    IOTHUB_CLIENT_CONFIRMATION_RESULT result, void *userContextCallback);
+
+typedef struct IOTHUB_MESSAGE_HANDLE_DATA_TAG *IOTHUB_MESSAGE_HANDLE;
+
+IOTHUB_MESSAGE_HANDLE IoTHubMessage_CreateFromByteArray(
+    const unsigned char *byteArray, size_t size);
+IOTHUB_MESSAGE_HANDLE IoTHubMessage_CreateFromString(const char *source);
+void IoTHubMessage_Destroy(IOTHUB_MESSAGE_HANDLE iotHubMessageHandle);
+
+const char *IOTHUB_CLIENT_CONFIRMATION_RESULTStrings(
+    IOTHUB_CLIENT_CONFIRMATION_RESULT value);
+
+/*
+ * These definitions are missing from the library on the device, and are
+ * provided by sphereplusplus.cc.
+ */
+const char *IOTHUB_CLIENT_RESULTStrings(IOTHUB_CLIENT_RESULT value);
+const char *IOTHUB_CLIENT_CONNECTION_STATUS_REASONStrings(
+    IOTHUB_CLIENT_CONNECTION_STATUS_REASON value);
+const char *PROV_DEVICE_RESULTStrings(PROV_DEVICE_RESULT value);
+
+#ifdef __cplusplus
+}
+#endif
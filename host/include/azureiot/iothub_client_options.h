@@ -0,0 +1,9 @@
+/**
+ * @file iothub_client_options.h
+ * @author Matthieu Bucchianeri
+ * @brief Host stand-in for the Azure IoT client options.
+ */
+
+#pragma once
+
+#define OPTION_KEEP_ALIVE "keepalive"
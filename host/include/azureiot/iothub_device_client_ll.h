@@ -0,0 +1,38 @@
+/**
+ * @file iothub_device_client_ll.h
+ * @author Matthieu Bucchianeri
+ * @brief Host stand-in for the Azure IoT device client.
+ *
+ * The client is simulated, see host/iot.h.
+ */
+
+#pragma once
+
+#include <azureiot/iothub_client_core_common.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct IOTHUB_DEVICE_CLIENT_LL_TAG *IOTHUB_DEVICE_CLIENT_LL_HANDLE;
+
+void IoTHubDeviceClient_LL_Destroy(IOTHUB_DEVICE_CLIENT_LL_HANDLE handle);
+IOTHUB_CLIENT_RESULT IoTHubDeviceClient_LL_SetRetryPolicy(
+    IOTHUB_DEVICE_CLIENT_LL_HANDLE handle,
+    IOTHUB_CLIENT_RETRY_POLICY retryPolicy, size_t retryTimeoutLimitInSeconds);
+IOTHUB_CLIENT_RESULT IoTHubDeviceClient_LL_SetOption(
+    IOTHUB_DEVICE_CLIENT_LL_HANDLE handle, const char *optionName,
+    const void *value);
+IOTHUB_CLIENT_RESULT IoTHubDeviceClient_LL_SetConnectionStatusCallback(
+    IOTHUB_DEVICE_CLIENT_LL_HANDLE handle,
+    IOTHUB_CLIENT_CONNECTION_STATUS_CALLBACK connectionStatusCallback,
+    void *userContextCallback);
+IOTHUB_CLIENT_RESULT IoTHubDeviceClient_LL_SendEventAsync(
+    IOTHUB_DEVICE_CLIENT_LL_HANDLE handle, IOTHUB_MESSAGE_HANDLE eventMessage,
+    IOTHUB_CLIENT_EVENT_CONFIRMATION_CALLBACK eventConfirmationCallback,
+    void *userContextCallback);
+void IoTHubDeviceClient_LL_DoWork(IOTHUB_DEVICE_CLIENT_LL_HANDLE handle);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,39 @@
+/**
+ * @file eventloop.h
+ * @author Matthieu Bucchianeri
+ * @brief Statistics of the event loop stand-in.
+ *
+ * The event loop is implemented on top of epoll or io_uring, selected with
+ * the SPHERE_PLUS_PLUS_HOST_LOOP CMake option. The epoll backend makes one
+ * system call per event dispatched, and one per change of registration. The
+ * io_uring backend queues the changes of registration, submits them along
+ * with the wait for events, and reaps the events completed together without
+ * further system calls.
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Get the name of the event loop backend.
+ * @return "epoll" or "io_uring".
+ */
+const char *HostEventLoop_GetBackend(void);
+
+/**
+ * @brief Get the number of system calls made by the event loops, to wait for
+ *        events and to change the registrations.
+ * @return The number of system calls, since the start of the process.
+ * @note The system calls made by the callbacks, such as reading a timer, are
+ *       not counted.
+ */
+uint64_t HostEventLoop_GetSyscallCount(void);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,42 @@
+/**
+ * @file gpio.h
+ * @author Matthieu Bucchianeri
+ * @brief Control of the simulated GPIOs.
+ *
+ * Each GPIO holds a level, driven by the application through the outputs, and
+ * by the simulation through the inputs. The GPIO file descriptors are real
+ * file descriptors, which can be closed with close().
+ */
+
+#pragma once
+
+#include <applibs/gpio.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * The number of GPIOs simulated.
+ */
+#define HOST_GPIO_COUNT 128
+
+/**
+ * @brief Drive the level of a GPIO.
+ * @param[in] gpioId The GPIO.
+ * @param[in] value The level.
+ * @return 0 on success, -1 with errno set otherwise.
+ */
+int HostGpio_SetValue(GPIO_Id gpioId, GPIO_Value_Type value);
+
+/**
+ * @brief Read the level of a GPIO.
+ * @param[in] gpioId The GPIO.
+ * @param[out] outValue The level.
+ * @return 0 on success, -1 with errno set otherwise.
+ */
+int HostGpio_GetValue(GPIO_Id gpioId, GPIO_Value_Type *outValue);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,64 @@
+/**
+ * @file iot.h
+ * @author Matthieu Bucchianeri
+ * @brief Control of the simulated Azure IoT client.
+ *
+ * The simulated client connects as soon as it is processed while the network
+ * is available, and delivers the messages sent to a sink standing in for the
+ * hub, confirming them. When the network goes down, the connection is lost,
+ * and the messages are queued until it comes back.
+ *
+ * Each thread may simulate a different device, whose identity is given to the
+ * clients it creates, so that several applications can run in one process.
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include <azureiot/iothub_device_client_ll.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Hub stand-in receiving the messages.
+ * @param[in] idScope The scope of the client sending the message.
+ * @param[in] deviceId The identity of the device sending the message.
+ * @param[in] message The message.
+ * @param[in] size The size of the message.
+ * @param[in] context The context given with the sink.
+ * @return True to confirm the message, false to fail it.
+ */
+typedef bool HostIot_Sink(const char *idScope, const char *deviceId,
+                          const unsigned char *message, size_t size,
+                          void *context);
+
+/**
+ * @brief Set the hub stand-in receiving the messages.
+ * @param[in] sink The sink, or NULL to discard the messages.
+ * @param[in] context The context passed to the sink.
+ * @note The sink is invoked from the threads processing the clients.
+ */
+void HostIot_SetSink(HostIot_Sink *sink, void *context);
+
+/**
+ * @brief Set the identity of the device simulated by the calling thread.
+ * @param[in] deviceId The identity, or NULL for the default ("host").
+ * @return 0 on success, -1 if the identity is too long.
+ * @note Only applies to the clients created afterwards by the calling thread.
+ */
+int HostIot_SetDeviceId(const char *deviceId);
+
+/**
+ * @brief Make the network available or not.
+ * @param[in] available Whether the network is available.
+ * @note May be invoked from any thread.
+ */
+void HostIot_SetNetworkAvailable(bool available);
+
+#ifdef __cplusplus
+}
+#endif
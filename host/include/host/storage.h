@@ -0,0 +1,24 @@
+/**
+ * @file storage.h
+ * @author Matthieu Bucchianeri
+ * @brief Control of the simulated mutable storage.
+ */
+
+#pragma once
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Set the file holding the mutable storage of the application
+ *        simulated by the calling thread.
+ * @param[in] path The path of the file, or NULL for the default
+ *            ("mutable_storage", in the current directory).
+ * @return 0 on success, -1 if the path is too long.
+ */
+int HostStorage_SetPath(const char *path);
+
+#ifdef __cplusplus
+}
+#endif
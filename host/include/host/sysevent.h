@@ -0,0 +1,37 @@
+/**
+ * @file sysevent.h
+ * @author Matthieu Bucchianeri
+ * @brief Control of the simulated system events.
+ */
+
+#pragma once
+
+#include <applibs/sysevent.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Post a system event to the applications registered for it. The
+ *        event is delivered from their event loop.
+ * @param[in] event The event.
+ * @param[in] status The status of the event.
+ * @param[in] updateData The update information passed with the event.
+ * @return 0 on success, -1 with errno set otherwise.
+ * @note May be invoked from any thread.
+ */
+int HostSysEvent_Post(SysEvent_Events event, SysEvent_Status status,
+                      const SysEvent_Info_UpdateData *updateData);
+
+/**
+ * @brief Get the deferral last requested for a system event.
+ * @param[in] event The event.
+ * @return The deferral, in minutes, or 0 when the event was resumed or never
+ *         deferred.
+ */
+uint32_t HostSysEvent_GetDeferral(SysEvent_Events event);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,323 @@
+/**
+ * @file iot.c
+ * @author Matthieu Bucchianeri
+ * @brief Host stand-in for the Azure IoT device client, with a simulated
+ *        connection.
+ */
+
+#include <errno.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <azureiot/azure_sphere_provisioning.h>
+#include <azureiot/iothub_client_core_common.h>
+#include <azureiot/iothub_device_client_ll.h>
+#include <host/iot.h>
+
+struct IOTHUB_MESSAGE_HANDLE_DATA_TAG {
+    size_t size;
+    unsigned char data[];
+};
+
+/*
+ * A message queued by a client, until the client is processed while
+ * connected.
+ */
+struct Event {
+    IOTHUB_MESSAGE_HANDLE message;
+    IOTHUB_CLIENT_EVENT_CONFIRMATION_CALLBACK callback;
+    void *context;
+    struct Event *next;
+};
+
+#define DEVICE_ID_SIZE 64
+
+struct IOTHUB_DEVICE_CLIENT_LL_TAG {
+    char idScope[64];
+    char deviceId[DEVICE_ID_SIZE];
+    bool connected;
+    IOTHUB_CLIENT_CONNECTION_STATUS_CALLBACK connectionCallback;
+    void *connectionContext;
+    struct Event *head;
+    struct Event **tail;
+};
+
+/*
+ * The hub stand-in.
+ */
+static struct {
+    HostIot_Sink *sink;
+    void *context;
+} g_sink;
+
+static bool g_networkAvailable = true;
+
+/*
+ * The identity of the device simulated by each thread.
+ */
+static __thread char g_deviceId[DEVICE_ID_SIZE] = "host";
+
+static IOTHUB_MESSAGE_HANDLE create_message(const unsigned char *data,
+                                            size_t size)
+{
+    IOTHUB_MESSAGE_HANDLE const message = malloc(sizeof(*message) + size);
+    if (!message) {
+        return NULL;
+    }
+
+    message->size = size;
+    memcpy(message->data, data, size);
+
+    return message;
+}
+
+IOTHUB_MESSAGE_HANDLE IoTHubMessage_CreateFromByteArray(
+    const unsigned char *byteArray, size_t size)
+{
+    if (!byteArray && size) {
+        return NULL;
+    }
+
+    return create_message(byteArray, size);
+}
+
+IOTHUB_MESSAGE_HANDLE IoTHubMessage_CreateFromString(const char *source)
+{
+    if (!source) {
+        return NULL;
+    }
+
+    return create_message((const unsigned char *)source, strlen(source));
+}
+
+void IoTHubMessage_Destroy(IOTHUB_MESSAGE_HANDLE iotHubMessageHandle)
+{
+    free(iotHubMessageHandle);
+}
+
+AZURE_SPHERE_PROV_RETURN_VALUE
+IoTHubDeviceClient_LL_CreateWithAzureSphereDeviceAuthProvisioning(
+    const char *idScope, unsigned int timeout,
+    IOTHUB_DEVICE_CLIENT_LL_HANDLE *handle)
+{
+    AZURE_SPHERE_PROV_RETURN_VALUE result = {
+        .result = AZURE_SPHERE_PROV_RESULT_OK,
+        .prov_device_error = PROV_DEVICE_RESULT_OK,
+        .iothub_client_error = IOTHUB_CLIENT_OK,
+    };
+    (void)timeout;
+
+    if (!idScope || !handle ||
+        strlen(idScope) >= sizeof((*handle)->idScope)) {
+        result.result = AZURE_SPHERE_PROV_RESULT_INVALID_PARAM;
+        return result;
+    }
+
+    if (!__atomic_load_n(&g_networkAvailable, __ATOMIC_RELAXED)) {
+        result.result = AZURE_SPHERE_PROV_RESULT_NETWORK_NOT_READY;
+        return result;
+    }
+
+    IOTHUB_DEVICE_CLIENT_LL_HANDLE const client = calloc(1, sizeof(*client));
+    if (!client) {
+        result.result = AZURE_SPHERE_PROV_RESULT_GENERIC_ERROR;
+        return result;
+    }
+
+    strcpy(client->idScope, idScope);
+    strcpy(client->deviceId, g_deviceId);
+    client->tail = &client->head;
+    *handle = client;
+
+    return result;
+}
+
+void IoTHubDeviceClient_LL_Destroy(IOTHUB_DEVICE_CLIENT_LL_HANDLE handle)
+{
+    if (!handle) {
+        return;
+    }
+
+    while (handle->head) {
+        struct Event *const event = handle->head;
+        handle->head = event->next;
+
+        if (event->callback) {
+            event->callback(IOTHUB_CLIENT_CONFIRMATION_BECAUSE_DESTROY,
+                            event->context);
+        }
+        IoTHubMessage_Destroy(event->message);
+        free(event);
+    }
+
+    free(handle);
+}
+
+IOTHUB_CLIENT_RESULT IoTHubDeviceClient_LL_SetRetryPolicy(
+    IOTHUB_DEVICE_CLIENT_LL_HANDLE handle,
+    IOTHUB_CLIENT_RETRY_POLICY retryPolicy, size_t retryTimeoutLimitInSeconds)
+{
+    (void)retryPolicy;
+    (void)retryTimeoutLimitInSeconds;
+
+    return handle ? IOTHUB_CLIENT_OK : IOTHUB_CLIENT_INVALID_ARG;
+}
+
+IOTHUB_CLIENT_RESULT IoTHubDeviceClient_LL_SetOption(
+    IOTHUB_DEVICE_CLIENT_LL_HANDLE handle, const char *optionName,
+    const void *value)
+{
+    return handle && optionName && value ?
+        IOTHUB_CLIENT_OK : IOTHUB_CLIENT_INVALID_ARG;
+}
+
+IOTHUB_CLIENT_RESULT IoTHubDeviceClient_LL_SetConnectionStatusCallback(
+    IOTHUB_DEVICE_CLIENT_LL_HANDLE handle,
+    IOTHUB_CLIENT_CONNECTION_STATUS_CALLBACK connectionStatusCallback,
+    void *userContextCallback)
+{
+    if (!handle) {
+        return IOTHUB_CLIENT_INVALID_ARG;
+    }
+
+    handle->connectionCallback = connectionStatusCallback;
+    handle->connectionContext = userContextCallback;
+
+    return IOTHUB_CLIENT_OK;
+}
+
+IOTHUB_CLIENT_RESULT IoTHubDeviceClient_LL_SendEventAsync(
+    IOTHUB_DEVICE_CLIENT_LL_HANDLE handle, IOTHUB_MESSAGE_HANDLE eventMessage,
+    IOTHUB_CLIENT_EVENT_CONFIRMATION_CALLBACK eventConfirmationCallback,
+    void *userContextCallback)
+{
+    if (!handle || !eventMessage) {
+        return IOTHUB_CLIENT_INVALID_ARG;
+    }
+
+    struct Event *const event = malloc(sizeof(*event));
+    if (!event) {
+        return IOTHUB_CLIENT_ERROR;
+    }
+
+    /*
+     * The client keeps its own copy of the message.
+     */
+    event->message = create_message(eventMessage->data, eventMessage->size);
+    if (!event->message) {
+        free(event);
+        return IOTHUB_CLIENT_ERROR;
+    }
+    event->callback = eventConfirmationCallback;
+    event->context = userContextCallback;
+    event->next = NULL;
+
+    *handle->tail = event;
+    handle->tail = &event->next;
+
+    return IOTHUB_CLIENT_OK;
+}
+
+void IoTHubDeviceClient_LL_DoWork(IOTHUB_DEVICE_CLIENT_LL_HANDLE handle)
+{
+    if (!handle) {
+        return;
+    }
+
+    const bool available =
+        __atomic_load_n(&g_networkAvailable, __ATOMIC_RELAXED);
+    if (available != handle->connected) {
+        handle->connected = available;
+
+        if (handle->connectionCallback) {
+            handle->connectionCallback(
+                available ? IOTHUB_CLIENT_CONNECTION_AUTHENTICATED :
+                    IOTHUB_CLIENT_CONNECTION_UNAUTHENTICATED,
+                available ? IOTHUB_CLIENT_CONNECTION_OK :
+                    IOTHUB_CLIENT_CONNECTION_NO_NETWORK,
+                handle->connectionContext);
+        }
+    }
+
+    if (!handle->connected) {
+        return;
+    }
+
+    /*
+     * Deliver the messages queued, including the ones queued by the
+     * confirmation callbacks, on the next processing.
+     */
+    struct Event *events = handle->head;
+    handle->head = NULL;
+    handle->tail = &handle->head;
+
+    while (events) {
+        struct Event *const event = events;
+        events = event->next;
+
+        bool delivered = true;
+        HostIot_Sink *const sink = g_sink.sink;
+        if (sink) {
+            delivered = sink(handle->idScope, handle->deviceId,
+                             event->message->data, event->message->size,
+                             g_sink.context);
+        }
+
+        if (event->callback) {
+            event->callback(delivered ? IOTHUB_CLIENT_CONFIRMATION_OK :
+                                IOTHUB_CLIENT_CONFIRMATION_ERROR,
+                            event->context);
+        }
+        IoTHubMessage_Destroy(event->message);
+        free(event);
+    }
+}
+
+const char *IOTHUB_CLIENT_CONFIRMATION_RESULTStrings(
+    IOTHUB_CLIENT_CONFIRMATION_RESULT value)
+{
+    switch (value) {
+        case IOTHUB_CLIENT_CONFIRMATION_OK:
+            return "IOTHUB_CLIENT_CONFIRMATION_OK";
+
+        case IOTHUB_CLIENT_CONFIRMATION_BECAUSE_DESTROY:
+            return "IOTHUB_CLIENT_CONFIRMATION_BECAUSE_DESTROY";
+
+        case IOTHUB_CLIENT_CONFIRMATION_MESSAGE_TIMEOUT:
+            return "IOTHUB_CLIENT_CONFIRMATION_MESSAGE_TIMEOUT";
+
+        case IOTHUB_CLIENT_CONFIRMATION_ERROR:
+            return "IOTHUB_CLIENT_CONFIRMATION_ERROR";
+
+        default:
+            return "Unknown";
+    }
+}
+
+void HostIot_SetSink(HostIot_Sink *sink, void *context)
+{
+    g_sink.sink = sink;
+    g_sink.context = context;
+}
+
+int HostIot_SetDeviceId(const char *deviceId)
+{
+    if (!deviceId) {
+        deviceId = "host";
+    }
+
+    if (strlen(deviceId) >= sizeof(g_deviceId)) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    strcpy(g_deviceId, deviceId);
+
+    return 0;
+}
+
+void HostIot_SetNetworkAvailable(bool available)
+{
+    __atomic_store_n(&g_networkAvailable, available, __ATOMIC_RELAXED);
+}
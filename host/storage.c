@@ -0,0 +1,50 @@
+/**
+ * @file storage.c
+ * @author Matthieu Bucchianeri
+ * @brief Host stand-in for the Azure Sphere mutable storage, backed by a file.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <applibs/storage.h>
+#include <host/storage.h>
+
+/*
+ * The file holding the mutable storage of the application simulated by each
+ * thread.
+ */
+static __thread char g_path[PATH_MAX] = "mutable_storage";
+
+int Storage_OpenMutableFile(void)
+{
+    return open(g_path, O_RDWR | O_CREAT | O_CLOEXEC, 0600);
+}
+
+int Storage_DeleteMutableFile(void)
+{
+    if (unlink(g_path) < 0 && errno != ENOENT) {
+        return -1;
+    }
+
+    return 0;
+}
+
+int HostStorage_SetPath(const char *path)
+{
+    if (!path) {
+        path = "mutable_storage";
+    }
+
+    if (strlen(path) >= sizeof(g_path)) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    strcpy(g_path, path);
+
+    return 0;
+}
@@ -0,0 +1,248 @@
+/**
+ * @file sysevent.c
+ * @author Matthieu Bucchianeri
+ * @brief Host stand-in for the Azure Sphere system events, with simulated
+ *        events.
+ */
+
+#include <sys/eventfd.h>
+#include <errno.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <applibs/eventloop.h>
+#include <applibs/sysevent.h>
+#include <host/sysevent.h>
+
+/*
+ * The number of events queued for a registration.
+ */
+#define HOST_SYSEVENT_QUEUE 8
+
+struct SysEvent_Info {
+    SysEvent_Info_UpdateData updateData;
+};
+
+/*
+ * An event queued for a registration.
+ */
+struct Notification {
+    SysEvent_Events event;
+    SysEvent_Status status;
+    struct SysEvent_Info info;
+};
+
+/*
+ * A registration to the system events. The events are posted from any thread,
+ * and delivered from the event loop through an event file descriptor.
+ */
+struct Registration {
+    EventLoop *el;
+    EventRegistration *reg;
+    int eventFd;
+    SysEvent_Events mask;
+    SysEventsCallback *callback;
+    void *context;
+    struct Notification queue[HOST_SYSEVENT_QUEUE];
+    unsigned int head;
+    unsigned int count;
+    struct Registration *next;
+};
+
+static pthread_mutex_t g_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static struct Registration *g_registrations;
+
+/*
+ * The deferral last requested for each event, indexed by the bit of the event.
+ */
+static uint32_t g_deferrals[32];
+
+static void dispatch(EventLoop *el, int fd, EventLoop_IoEvents events,
+                     void *context)
+{
+    struct Registration *const registration = context;
+
+    uint64_t value;
+    if (read(fd, &value, sizeof(value)) < 0) {
+        return;
+    }
+
+    for (;;) {
+        struct Notification notification;
+
+        pthread_mutex_lock(&g_lock);
+        const int pending = registration->count > 0;
+        if (pending) {
+            notification = registration->queue[registration->head];
+            registration->head =
+                (registration->head + 1) % HOST_SYSEVENT_QUEUE;
+            registration->count--;
+        }
+        pthread_mutex_unlock(&g_lock);
+
+        if (!pending) {
+            break;
+        }
+
+        registration->callback(notification.event, notification.status,
+                               &notification.info, registration->context);
+    }
+}
+
+EventRegistration *SysEvent_RegisterForEventNotifications(
+    EventLoop *el, SysEvent_Events eventBitmask,
+    SysEventsCallback callback_function, void *context)
+{
+    if (!el || !callback_function) {
+        errno = EINVAL;
+        return NULL;
+    }
+
+    struct Registration *const registration =
+        calloc(1, sizeof(*registration));
+    if (!registration) {
+        errno = ENOMEM;
+        return NULL;
+    }
+
+    registration->el = el;
+    registration->mask = eventBitmask;
+    registration->callback = callback_function;
+    registration->context = context;
+
+    registration->eventFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (registration->eventFd < 0) {
+        free(registration);
+        return NULL;
+    }
+
+    registration->reg = EventLoop_RegisterIo(el, registration->eventFd,
+                                             EventLoop_Input, dispatch,
+                                             registration);
+    if (!registration->reg) {
+        close(registration->eventFd);
+        free(registration);
+        return NULL;
+    }
+
+    pthread_mutex_lock(&g_lock);
+    registration->next = g_registrations;
+    g_registrations = registration;
+    pthread_mutex_unlock(&g_lock);
+
+    /*
+     * The application only knows the event registration, which is used to
+     * find the system event registration back.
+     */
+    return registration->reg;
+}
+
+int SysEvent_UnregisterForEventNotifications(EventRegistration *reg)
+{
+    pthread_mutex_lock(&g_lock);
+    struct Registration **link = &g_registrations;
+    while (*link && (*link)->reg != reg) {
+        link = &(*link)->next;
+    }
+    struct Registration *const registration = *link;
+    if (registration) {
+        *link = registration->next;
+    }
+    pthread_mutex_unlock(&g_lock);
+
+    if (!registration) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    const int result = EventLoop_UnregisterIo(registration->el, reg);
+    close(registration->eventFd);
+    free(registration);
+
+    return result;
+}
+
+int SysEvent_Info_GetUpdateData(const SysEvent_Info *info,
+                                SysEvent_Info_UpdateData *update_info)
+{
+    if (!info || !update_info) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    *update_info = info->updateData;
+
+    return 0;
+}
+
+int SysEvent_DeferEvent(SysEvent_Events event,
+                        uint32_t requested_defer_time_in_minutes)
+{
+    if (!event || (event & (event - 1))) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    __atomic_store_n(&g_deferrals[__builtin_ctz(event)],
+                     requested_defer_time_in_minutes, __ATOMIC_RELAXED);
+
+    return 0;
+}
+
+int SysEvent_ResumeEvent(SysEvent_Events event)
+{
+    return SysEvent_DeferEvent(event, 0);
+}
+
+int HostSysEvent_Post(SysEvent_Events event, SysEvent_Status status,
+                      const SysEvent_Info_UpdateData *updateData)
+{
+    int result = 0;
+
+    pthread_mutex_lock(&g_lock);
+    for (struct Registration *registration = g_registrations; registration;
+         registration = registration->next) {
+        if (!(registration->mask & event)) {
+            continue;
+        }
+
+        if (registration->count == HOST_SYSEVENT_QUEUE) {
+            errno = ENOBUFS;
+            result = -1;
+            continue;
+        }
+
+        struct Notification *const notification =
+            &registration->queue[(registration->head + registration->count) %
+                                 HOST_SYSEVENT_QUEUE];
+        notification->event = event;
+        notification->status = status;
+        if (updateData) {
+            notification->info.updateData = *updateData;
+        } else {
+            memset(&notification->info, 0, sizeof(notification->info));
+        }
+        registration->count++;
+
+        const uint64_t value = 1;
+        if (write(registration->eventFd, &value, sizeof(value)) < 0) {
+            result = -1;
+        }
+    }
+    pthread_mutex_unlock(&g_lock);
+
+    return result;
+}
+
+uint32_t HostSysEvent_GetDeferral(SysEvent_Events event)
+{
+    if (!event || (event & (event - 1))) {
+        return 0;
+    }
+
+    return __atomic_load_n(&g_deferrals[__builtin_ctz(event)],
+                           __ATOMIC_RELAXED);
+}
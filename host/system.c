@@ -0,0 +1,96 @@
+/**
+ * @file system.c
+ * @author Matthieu Bucchianeri
+ * @brief Host stand-in for the Azure Sphere logging, applications, networking
+ *        and power management APIs.
+ */
+
+#include <sys/resource.h>
+#include <errno.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <unistd.h>
+
+#include <applibs/applications.h>
+#include <applibs/log.h>
+#include <applibs/networking.h>
+#include <applibs/powermanagement.h>
+
+int Log_Debug(const char *fmt, ...)
+{
+    va_list args;
+
+    va_start(args, fmt);
+    const int written = vfprintf(stderr, fmt, args);
+    va_end(args);
+
+    return written;
+}
+
+size_t Applications_GetTotalMemoryUsageInKB(void)
+{
+    return Applications_GetUserModeMemoryUsageInKB();
+}
+
+size_t Applications_GetUserModeMemoryUsageInKB(void)
+{
+    /*
+     * The resident set size, from the second field of statm.
+     */
+    FILE *const statm = fopen("/proc/self/statm", "r");
+    if (!statm) {
+        return 0;
+    }
+
+    unsigned long size, resident;
+    const int fields = fscanf(statm, "%lu %lu", &size, &resident);
+    fclose(statm);
+
+    return fields == 2 ? resident * (sysconf(_SC_PAGESIZE) / 1024) : 0;
+}
+
+size_t Applications_GetPeakUserModeMemoryUsageInKB(void)
+{
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) < 0) {
+        return 0;
+    }
+
+    return usage.ru_maxrss;
+}
+
+int Networking_TimeSync_SetEnabled(bool enabled)
+{
+    (void)enabled;
+
+    return 0;
+}
+
+int PowerManagement_ForceSystemReboot(void)
+{
+    Log_Debug("Host: system reboot requested\n");
+
+    return 0;
+}
+
+int PowerManagement_ForceSystemPowerDown(
+    unsigned int maximum_residency_in_seconds)
+{
+    Log_Debug("Host: system power down requested for %u s\n",
+              maximum_residency_in_seconds);
+
+    return 0;
+}
+
+int PowerManagement_SetSystemPowerProfile(
+    PowerManagement_System_PowerProfile desired_profile)
+{
+    if (desired_profile > PowerManagement_HighPerformance) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    Log_Debug("Host: system power profile %u requested\n", desired_profile);
+
+    return 0;
+}
@@ -6,15 +6,99 @@
 
 #pragma once
 
+#include <sphereplusplus/dispatch.hh>
+#include <sphereplusplus/energy.hh>
+#include <sphereplusplus/load.hh>
+#include <sphereplusplus/profiler.hh>
+#include <sphereplusplus/record.hh>
+#include <sphereplusplus/stall.hh>
+#include <sphereplusplus/tracer.hh>
+
 #include <applibs/eventloop.h>
 
 namespace SpherePlusPlus {
 
 /**
- * @brief Get the application's event loop.
- * @return The event loop.
- * @note Requires the Application to be initialized.
+ * @brief Get the event loop of the calling thread: the event loop of the
+ *        application initialized on the thread, or of the EventLoopThread
+ *        running the thread.
+ * @return The event loop, or nullptr if none.
  */
 extern EventLoop *getEventLoop();
 
+class Timer;
+
+/**
+ * @brief Get the armed timers of an event loop, when it is the event loop of
+ *        the application initialized on the calling thread.
+ * @param[in] eventLoop The event loop.
+ * @return The head of the list of the armed timers, or nullptr if the event
+ *         loop is not the event loop of the application.
+ */
+extern Timer **getArmedTimers(const EventLoop *eventLoop);
+
+/**
+ * @brief Scope of a callback dispatched from the event loop, stamping the
+ *        instrumentation when the callback starts and returns.
+ */
+class DispatchScope
+{
+public:
+    /**
+     * @brief Constructor, marking the start of the callback.
+     * @param[in] kind The type of the callback.
+     * @param[in] callback The callback (delegate stub or static callback).
+     * @param[in] object The object passed to the callback.
+     */
+    DispatchScope(const DispatchKind kind, const void *const callback,
+                  const void *const object) :
+        m_kind(kind),
+        m_callback(callback),
+        m_object(object)
+    {
+        Tracer::begin(kind, callback, object);
+        StallDetector::enter(kind, callback, object);
+        CallbackProfiler::enter(m_profile, kind, callback, object);
+        LoadMonitor::enter();
+        m_energy = EnergyModel::enter(kind);
+    }
+
+    /**
+     * @brief Destructor, marking the end of the callback.
+     */
+    ~DispatchScope()
+    {
+        EnergyModel::leave(m_energy);
+        LoadMonitor::leave();
+        CallbackProfiler::leave(m_profile);
+        StallDetector::leave();
+        Tracer::end(m_kind, m_callback, m_object);
+    }
+
+    DispatchScope(const DispatchScope &other) = delete;
+    DispatchScope &operator =(const DispatchScope &other) = delete;
+
+private:
+    /**
+     * The callback.
+     * @{
+     */
+    const DispatchKind m_kind;
+    const void *const m_callback;
+    const void *const m_object;
+    /**
+     * @}
+     */
+
+    /**
+     * The state of the profiler.
+     */
+    CallbackProfiler::Frame m_profile;
+
+    /**
+     * The enclosing feature of the energy model.
+     */
+    EnergyModel::Feature *m_energy;
+};
+
 } /* namespace SpherePlusPlus */
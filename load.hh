@@ -0,0 +1,165 @@
+/**
+ * @file load.hh
+ * @author Matthieu Bucchianeri
+ * @brief Event loop load accounting.
+ *
+ * The callbacks dispatched from the event loop (see internal.hh) are timed when
+ * a load monitor is attached to the thread running the event loop. Only the
+ * outermost callbacks are timed: a callback dispatched from within another
+ * callback (such as an IoT callback invoked while pumping the IoT client) is
+ * already accounted to the outer callback. The busy time, compared with the
+ * time elapsed, gives the utilization of the event loop.
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+#include <sphereplusplus/abort.hh>
+#include <sphereplusplus/clock.hh>
+
+namespace SpherePlusPlus {
+
+/**
+ * @brief Event loop load accounting.
+ */
+class LoadMonitor
+{
+public:
+    /**
+     * @brief Constructor.
+     */
+    LoadMonitor() :
+        m_depth(0),
+        m_start_ns(0),
+        m_busy_ns(0),
+        m_callbacks(0)
+    {
+    }
+
+    /*
+     * The monitor is attached to a thread, and cannot be copied.
+     */
+    LoadMonitor(const LoadMonitor &other) = delete;
+    LoadMonitor &operator =(const LoadMonitor &other) = delete;
+
+    /**
+     * @brief Destructor.
+     */
+    virtual ~LoadMonitor()
+    {
+        if (g_current == this) {
+            destroy();
+        }
+    }
+
+    /**
+     * @brief Initialize the monitor, and attach it to the calling thread,
+     *        which must be the thread running the event loop.
+     * @return True on success.
+     */
+    virtual bool init()
+    {
+        AbortIf(g_current, false);
+
+        m_depth = 0;
+        m_busy_ns = 0;
+        m_callbacks = 0;
+        g_current = this;
+
+        return true;
+    }
+
+    /**
+     * @brief Destroy the monitor.
+     * @return True on success.
+     * @note Must be invoked from the thread running the event loop.
+     */
+    virtual bool destroy()
+    {
+        AbortIfNot(g_current == this, false);
+
+        g_current = nullptr;
+
+        return true;
+    }
+
+    /**
+     * @brief Get the time spent in callbacks since the initialization,
+     *        including the callback running.
+     * @return The time, in nanoseconds.
+     */
+    uint64_t busyTime() const
+    {
+        return m_busy_ns + (m_depth ? readClock() - m_start_ns : 0);
+    }
+
+    /**
+     * @brief Get the number of outermost callbacks dispatched since the
+     *        initialization.
+     * @return The number of callbacks.
+     */
+    uint64_t callbacks() const
+    {
+        return m_callbacks;
+    }
+
+    /**
+     * @brief Mark the start of a callback on the calling thread.
+     */
+    static void enter()
+    {
+        LoadMonitor *const monitor = g_current;
+        if (__builtin_expect(!monitor, 1)) {
+            return;
+        }
+
+        if (monitor->m_depth++ == 0) {
+            monitor->m_start_ns = readClock();
+            monitor->m_callbacks++;
+        }
+    }
+
+    /**
+     * @brief Mark the end of a callback on the calling thread.
+     */
+    static void leave()
+    {
+        LoadMonitor *const monitor = g_current;
+        if (__builtin_expect(!monitor, 1) || !monitor->m_depth) {
+            return;
+        }
+
+        if (--monitor->m_depth == 0) {
+            monitor->m_busy_ns += readClock() - monitor->m_start_ns;
+        }
+    }
+
+private:
+    /**
+     * The nesting of the callbacks running.
+     */
+    uint32_t m_depth;
+
+    /**
+     * The start of the outermost callback running, in nanoseconds.
+     */
+    uint64_t m_start_ns;
+
+    /**
+     * The time spent in the callbacks that returned, in nanoseconds.
+     */
+    uint64_t m_busy_ns;
+
+    /**
+     * The number of outermost callbacks.
+     */
+    uint64_t m_callbacks;
+
+    /**
+     * The monitor attached to the current thread.
+     */
+    static __thread LoadMonitor *g_current;
+};
+
+} /* namespace SpherePlusPlus */
@@ -0,0 +1,205 @@
+/**
+ * @file loop.hh
+ * @author Matthieu Bucchianeri
+ * @brief Event loop running on a dedicated thread.
+ *
+ * Work that must not be delayed by the application's event loop, such as a
+ * high-rate sampling timer, can run on an event loop of its own, on a
+ * dedicated thread:
+ *
+ * EventLoopThread sampling;
+ * sampling.init();
+ * timer.init(sampling.eventLoop());
+ * timer.startPeriodic(1000);
+ * sampling.start();
+ * ...
+ * sampling.stop();
+ * timer.destroy();
+ * sampling.destroy();
+ *
+ * The objects bound to the event loop must be initialized and destroyed while
+ * the thread is not running, or from the callbacks running on the thread. The
+ * callbacks may also initialize objects with the default event loop (see
+ * getEventLoop()), which is the event loop of the thread.
+ */
+
+#pragma once
+
+#include <errno.h>
+#include <pthread.h>
+
+#include <applibs/eventloop.h>
+
+#include <sphereplusplus/abort.hh>
+
+#include "internal.hh"
+
+namespace SpherePlusPlus {
+
+/**
+ * @brief Event loop running on a dedicated thread.
+ */
+class EventLoopThread
+{
+public:
+    /**
+     * @brief Constructor.
+     */
+    EventLoopThread() :
+        m_eventLoop(nullptr),
+        m_thread(),
+        m_running(false),
+        m_started(false)
+    {
+    }
+
+    /*
+     * The event loop is bound to a thread, and cannot be copied.
+     */
+    EventLoopThread(const EventLoopThread &other) = delete;
+    EventLoopThread &operator =(const EventLoopThread &other) = delete;
+
+    /**
+     * @brief Destructor.
+     */
+    virtual ~EventLoopThread()
+    {
+        if (m_eventLoop) {
+            destroy();
+        }
+    }
+
+    /**
+     * @brief Initialize the event loop, without running it yet.
+     * @return True on success.
+     */
+    virtual bool init()
+    {
+        AbortIf(m_eventLoop, false);
+
+        m_eventLoop = EventLoop_Create();
+        AbortErrnoPtr(m_eventLoop, false);
+
+        return true;
+    }
+
+    /**
+     * @brief Destroy the event loop, stopping its thread if needed.
+     * @return True on success.
+     * @note The objects bound to the event loop must be destroyed first.
+     */
+    virtual bool destroy()
+    {
+        AbortIfNot(m_eventLoop, false);
+
+        if (m_started) {
+            AbortIfNot(stop(), false);
+        }
+
+        EventLoop_Close(m_eventLoop);
+        m_eventLoop = nullptr;
+
+        return true;
+    }
+
+    /**
+     * @brief Start the thread running the event loop.
+     * @return True on success.
+     */
+    virtual bool start()
+    {
+        AbortIfNot(m_eventLoop, false);
+        AbortIf(m_started, false);
+
+        __atomic_store_n(&m_running, true, __ATOMIC_RELAXED);
+        AbortIfNeq(pthread_create(&m_thread, nullptr, main, this), 0, false);
+        m_started = true;
+
+        return true;
+    }
+
+    /**
+     * @brief Stop the event loop, and wait for its thread to exit.
+     * @return True on success.
+     * @note Must not be invoked from the thread running the event loop.
+     */
+    virtual bool stop()
+    {
+        AbortIfNot(m_started, false);
+
+        __atomic_store_n(&m_running, false, __ATOMIC_RELAXED);
+        AbortErrno(EventLoop_Stop(m_eventLoop), false);
+
+        AbortIfNeq(pthread_join(m_thread, nullptr), 0, false);
+        m_started = false;
+
+        return true;
+    }
+
+    /**
+     * @brief Get the event loop.
+     * @return The event loop, or nullptr if not initialized.
+     */
+    EventLoop *eventLoop() const
+    {
+        return m_eventLoop;
+    }
+
+private:
+    friend EventLoop *getEventLoop();
+
+    /**
+     * @brief Thread running the event loop.
+     * @param[in] context The EventLoopThread object.
+     * @return nullptr.
+     */
+    static void *main(void *const context)
+    {
+        EventLoopThread *const thread = static_cast<EventLoopThread *>(context);
+
+        g_current = thread;
+        while (__atomic_load_n(&thread->m_running, __ATOMIC_RELAXED)) {
+            Tracer::begin(DispatchKind::Loop, nullptr, thread->m_eventLoop);
+
+            const EventLoop_Run_Result status =
+                EventLoop_Run(thread->m_eventLoop, -1, true);
+            if (status == EventLoop_Run_Failed && errno != EINTR) {
+                AbortErrno(-1, nullptr);
+            }
+
+            Tracer::end(DispatchKind::Loop, nullptr, thread->m_eventLoop);
+            StallDetector::iterate();
+        }
+        g_current = nullptr;
+
+        return nullptr;
+    }
+
+    /**
+     * The event loop thread running the current thread, used to find the
+     * default event loop of the thread.
+     */
+    static __thread EventLoopThread *g_current;
+
+    /**
+     * The event loop.
+     */
+    EventLoop *m_eventLoop;
+
+    /**
+     * The thread running the event loop.
+     */
+    pthread_t m_thread;
+
+    /**
+     * Whether the event loop must keep running.
+     */
+    bool m_running;
+
+    /**
+     * Whether the thread was started.
+     */
+    bool m_started;
+};
+
+} /* namespace SpherePlusPlus */
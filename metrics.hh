@@ -0,0 +1,860 @@
+/**
+ * @file metrics.hh
+ * @author Matthieu Bucchianeri
+ * @brief Registry of counters, gauges and histograms.
+ *
+ * The metrics register themselves when constructed, typically as static
+ * objects of the module they instrument:
+ *
+ * static SpherePlusPlus::Counter g_bytesSent("net.bytes_sent");
+ *
+ * A histogram constructed without a name is not registered, for the private
+ * statistics of an object that may have many instances.
+ *
+ * The updates are lock-free, and can be made from any thread. The registry
+ * exports a snapshot of all the metrics in JSON or CBOR (RFC 8949).
+ */
+
+#pragma once
+
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <sphereplusplus/abort.hh>
+#include <sphereplusplus/spinlock.hh>
+
+namespace SpherePlusPlus {
+
+/**
+ * @brief Type of a metric.
+ */
+enum class MetricType : uint8_t
+{
+    /**
+     * A monotonic count of events.
+     */
+    Counter,
+
+    /**
+     * A value that goes up and down.
+     */
+    Gauge,
+
+    /**
+     * A distribution of values.
+     */
+    Histogram,
+};
+
+/**
+ * @brief Base class of the metrics, registering the metric.
+ */
+class Metric
+{
+public:
+    /*
+     * The metric is registered by address, and cannot be copied.
+     */
+    Metric(const Metric &other) = delete;
+    Metric &operator =(const Metric &other) = delete;
+
+    /**
+     * @brief Destructor, unregistering the metric.
+     */
+    virtual ~Metric()
+    {
+        if (!m_name) {
+            return;
+        }
+
+        g_lock.lock();
+        Metric **metric = &g_metrics;
+        while (*metric && *metric != this) {
+            metric = &(*metric)->m_next;
+        }
+        if (*metric) {
+            *metric = m_next;
+        }
+        g_lock.unlock();
+    }
+
+    /**
+     * @brief Get the name of the metric.
+     * @return The name.
+     */
+    const char *name() const
+    {
+        return m_name;
+    }
+
+    /**
+     * @brief Get the type of the metric.
+     * @return The type.
+     */
+    MetricType type() const
+    {
+        return m_type;
+    }
+
+protected:
+    /**
+     * @brief Constructor, registering the metric.
+     * @param[in] name The name of the metric, which must remain valid, or
+     *            nullptr to leave the metric unregistered.
+     * @param[in] type The type of the metric.
+     */
+    Metric(const char *const name, const MetricType type) :
+        m_name(name),
+        m_type(type),
+        m_next(nullptr)
+    {
+        if (!m_name) {
+            return;
+        }
+
+        g_lock.lock();
+        m_next = g_metrics;
+        g_metrics = this;
+        g_lock.unlock();
+    }
+
+private:
+    /**
+     * The name of the metric.
+     */
+    const char *const m_name;
+
+    /**
+     * The type of the metric.
+     */
+    const MetricType m_type;
+
+    /**
+     * The next registered metric.
+     */
+    Metric *m_next;
+
+    /**
+     * The registered metrics.
+     */
+    static Metric *g_metrics;
+
+    /**
+     * The lock protecting the registered metrics (but not their values).
+     */
+    static SpinLock g_lock;
+
+    friend class MetricRegistry;
+};
+
+/**
+ * @brief Monotonic count of events.
+ */
+class Counter : public Metric
+{
+public:
+    /**
+     * @brief Constructor.
+     * @param[in] name The name of the metric, which must remain valid.
+     */
+    explicit Counter(const char *const name) :
+        Metric(name, MetricType::Counter),
+        m_value(0)
+    {
+    }
+
+    /**
+     * @brief Count events.
+     * @param[in] count The number of events.
+     */
+    void add(const uint64_t count = 1)
+    {
+        __atomic_add_fetch(&m_value, count, __ATOMIC_RELAXED);
+    }
+
+    /**
+     * @brief Get the count.
+     * @return The number of events.
+     */
+    uint64_t value() const
+    {
+        return __atomic_load_n(&m_value, __ATOMIC_RELAXED);
+    }
+
+private:
+    /**
+     * The number of events.
+     */
+    uint64_t m_value;
+};
+
+/**
+ * @brief Value that goes up and down.
+ */
+class Gauge : public Metric
+{
+public:
+    /**
+     * @brief Constructor.
+     * @param[in] name The name of the metric, which must remain valid.
+     */
+    explicit Gauge(const char *const name) :
+        Metric(name, MetricType::Gauge),
+        m_value(0)
+    {
+    }
+
+    /**
+     * @brief Set the value.
+     * @param[in] value The value.
+     */
+    void set(const int64_t value)
+    {
+        __atomic_store_n(&m_value, value, __ATOMIC_RELAXED);
+    }
+
+    /**
+     * @brief Change the value.
+     * @param[in] delta The change.
+     */
+    void add(const int64_t delta)
+    {
+        __atomic_add_fetch(&m_value, delta, __ATOMIC_RELAXED);
+    }
+
+    /**
+     * @brief Get the value.
+     * @return The value.
+     */
+    int64_t value() const
+    {
+        return __atomic_load_n(&m_value, __ATOMIC_RELAXED);
+    }
+
+private:
+    /**
+     * The value.
+     */
+    int64_t m_value;
+};
+
+/**
+ * @brief Distribution of values, in log-linear buckets.
+ *
+ * Each power of 2 is split into k_subBuckets linear buckets, so the values are
+ * recorded with a relative error under 1 / k_subBuckets.
+ */
+class Histogram : public Metric
+{
+public:
+    /**
+     * The number of linear buckets per power of 2, as a power of 2.
+     */
+    static constexpr unsigned k_subBucketBits = 2;
+
+    /**
+     * The number of linear buckets per power of 2.
+     */
+    static constexpr unsigned k_subBuckets = 1u << k_subBucketBits;
+
+    /**
+     * The number of buckets, covering all 32-bit values.
+     */
+    static constexpr unsigned k_buckets =
+        (32 - k_subBucketBits + 1) * k_subBuckets;
+
+    /**
+     * @brief Constructor.
+     * @param[in] name The name of the metric, which must remain valid, or
+     *            nullptr for a histogram that is not registered.
+     */
+    explicit Histogram(const char *const name = nullptr) :
+        Metric(name, MetricType::Histogram),
+        m_count(0),
+        m_sum(0),
+        m_min(UINT32_MAX),
+        m_max(0),
+        m_buckets()
+    {
+    }
+
+    /**
+     * @brief Record a value.
+     * @param[in] value The value.
+     */
+    void record(const uint32_t value)
+    {
+        __atomic_add_fetch(&m_buckets[bucket(value)], 1, __ATOMIC_RELAXED);
+        __atomic_add_fetch(&m_count, 1, __ATOMIC_RELAXED);
+        __atomic_add_fetch(&m_sum, value, __ATOMIC_RELAXED);
+
+        uint32_t current = __atomic_load_n(&m_min, __ATOMIC_RELAXED);
+        while (value < current &&
+               !__atomic_compare_exchange_n(&m_min, &current, value, true,
+                                            __ATOMIC_RELAXED,
+                                            __ATOMIC_RELAXED)) {
+        }
+        current = __atomic_load_n(&m_max, __ATOMIC_RELAXED);
+        while (value > current &&
+               !__atomic_compare_exchange_n(&m_max, &current, value, true,
+                                            __ATOMIC_RELAXED,
+                                            __ATOMIC_RELAXED)) {
+        }
+    }
+
+    /**
+     * @brief Clear the recorded values.
+     * @note Values recorded concurrently may be lost.
+     */
+    void reset()
+    {
+        for (unsigned i = 0; i < k_buckets; i++) {
+            __atomic_store_n(&m_buckets[i], 0, __ATOMIC_RELAXED);
+        }
+        __atomic_store_n(&m_count, 0, __ATOMIC_RELAXED);
+        __atomic_store_n(&m_sum, 0, __ATOMIC_RELAXED);
+        __atomic_store_n(&m_min, UINT32_MAX, __ATOMIC_RELAXED);
+        __atomic_store_n(&m_max, 0, __ATOMIC_RELAXED);
+    }
+
+    /**
+     * @brief Get the number of values recorded.
+     * @return The number of values.
+     */
+    uint64_t count() const
+    {
+        return __atomic_load_n(&m_count, __ATOMIC_RELAXED);
+    }
+
+    /**
+     * @brief Get the sum of the values recorded.
+     * @return The sum.
+     */
+    uint64_t sum() const
+    {
+        return __atomic_load_n(&m_sum, __ATOMIC_RELAXED);
+    }
+
+    /**
+     * @brief Get the smallest value recorded.
+     * @return The smallest value, or 0 if no value was recorded.
+     */
+    uint32_t min() const
+    {
+        return count() ? __atomic_load_n(&m_min, __ATOMIC_RELAXED) : 0;
+    }
+
+    /**
+     * @brief Get the largest value recorded.
+     * @return The largest value.
+     */
+    uint32_t max() const
+    {
+        return __atomic_load_n(&m_max, __ATOMIC_RELAXED);
+    }
+
+    /**
+     * @brief Estimate a percentile of the values recorded.
+     * @param[in] percent The percentile, between 0 and 100.
+     * @return The upper bound of the bucket holding the percentile, or 0 if no
+     *         value was recorded.
+     */
+    uint32_t percentile(const uint32_t percent) const
+    {
+        uint64_t total = 0;
+        for (unsigned i = 0; i < k_buckets; i++) {
+            total += __atomic_load_n(&m_buckets[i], __ATOMIC_RELAXED);
+        }
+        if (!total) {
+            return 0;
+        }
+
+        const uint64_t rank = (total * percent + 99) / 100;
+        uint64_t seen = 0;
+        for (unsigned i = 0; i < k_buckets; i++) {
+            seen += __atomic_load_n(&m_buckets[i], __ATOMIC_RELAXED);
+            if (seen >= rank && seen) {
+                const uint32_t bound = upperBound(i);
+
+                return bound < max() ? bound : max();
+            }
+        }
+
+        return max();
+    }
+
+    /**
+     * @brief Get the bucket of a value.
+     * @param[in] value The value.
+     * @return The bucket.
+     */
+    static unsigned bucket(const uint32_t value)
+    {
+        if (value < k_subBuckets) {
+            return value;
+        }
+
+        const unsigned exponent = 31 - __builtin_clz(value);
+        const unsigned shift = exponent - k_subBucketBits;
+
+        return (shift + 1) * k_subBuckets +
+            ((value >> shift) & (k_subBuckets - 1));
+    }
+
+    /**
+     * @brief Get the largest value of a bucket.
+     * @param[in] bucket The bucket.
+     * @return The largest value.
+     */
+    static uint32_t upperBound(const unsigned bucket)
+    {
+        if (bucket < k_subBuckets) {
+            return bucket;
+        }
+
+        const unsigned shift = bucket / k_subBuckets - 1;
+        const uint64_t lower = static_cast<uint64_t>(
+            k_subBuckets + bucket % k_subBuckets) << shift;
+
+        return static_cast<uint32_t>(lower + (1ull << shift) - 1);
+    }
+
+private:
+    /**
+     * The number of values recorded.
+     */
+    uint64_t m_count;
+
+    /**
+     * The sum of the values recorded.
+     */
+    uint64_t m_sum;
+
+    /**
+     * The smallest and largest value recorded.
+     * @{
+     */
+    uint32_t m_min;
+    uint32_t m_max;
+    /**
+     * @}
+     */
+
+    /**
+     * The number of values recorded in each bucket.
+     */
+    uint32_t m_buckets[k_buckets];
+};
+
+/**
+ * @brief Export of the registered metrics.
+ *
+ * The snapshot lists the metrics by name. Counters and gauges are exported as
+ * their value, and histograms as an object with the number of values (n),
+ * their sum, min, max and the 50th, 90th and 99th percentiles:
+ *
+ * {"net.bytes_sent":1024,"loop.latency_us":{"n":10,"sum":250,"min":2,
+ *  "max":120,"p50":7,"p90":47,"p99":120}}
+ */
+class MetricRegistry
+{
+public:
+    /**
+     * @brief Serialize a snapshot of the metrics in JSON.
+     * @param[out] buffer The buffer to write to.
+     * @param[in] size The size of the buffer.
+     * @return The length of the serialized snapshot, or 0 if it does not fit.
+     */
+    static size_t serializeJson(char *const buffer, const size_t size)
+    {
+        size_t length = 0;
+        bool fits = append(buffer, size, length, "{");
+
+        /*
+         * The values are copied under the lock in batches, and formatted
+         * after releasing it.
+         */
+        Sample samples[k_batch];
+        const Metric *last = nullptr;
+        size_t count = k_batch;
+        for (bool first = true; fits && count == k_batch; first = false) {
+            count = copy(samples, last);
+
+            for (size_t i = 0; fits && i < count; i++) {
+                const Sample &sample = samples[i];
+                fits = append(buffer, size, length, "%s\"%s\":",
+                              first && i == 0 ? "" : ",", sample.name);
+
+                switch (sample.type) {
+                    case MetricType::Counter:
+                        fits = fits && append(
+                            buffer, size, length, "%llu",
+                            static_cast<unsigned long long>(sample.value));
+                        break;
+
+                    case MetricType::Gauge:
+                        fits = fits && append(
+                            buffer, size, length, "%lld",
+                            static_cast<long long>(sample.value));
+                        break;
+
+                    case MetricType::Histogram:
+                        fits = fits && append(
+                            buffer, size, length,
+                            "{\"n\":%llu,\"sum\":%llu,\"min\":%u,"
+                            "\"max\":%u,\"p50\":%u,\"p90\":%u,\"p99\":%u}",
+                            static_cast<unsigned long long>(sample.value),
+                            static_cast<unsigned long long>(sample.sum),
+                            sample.min, sample.max, sample.p50, sample.p90,
+                            sample.p99);
+                        break;
+                }
+            }
+        }
+
+        fits = fits && append(buffer, size, length, "}");
+        AbortIfNot(fits, 0);
+
+        return length;
+    }
+
+    /**
+     * @brief Serialize a snapshot of the metrics in CBOR.
+     * @param[out] buffer The buffer to write to.
+     * @param[in] size The size of the buffer.
+     * @return The length of the serialized snapshot, or 0 if it does not fit.
+     * @see serializeJson
+     */
+    static size_t serializeCbor(uint8_t *const buffer, const size_t size)
+    {
+        CborWriter writer(buffer, size);
+
+        Metric::g_lock.lock();
+        uint64_t count = 0;
+        for (const Metric *metric = Metric::g_metrics; metric;
+             metric = metric->m_next) {
+            count++;
+        }
+
+        writer.map(count);
+        for (const Metric *metric = Metric::g_metrics; metric;
+             metric = metric->m_next) {
+            writer.text(metric->name());
+
+            switch (metric->type()) {
+                case MetricType::Counter:
+                    writer.uint(static_cast<const Counter *>(metric)->value());
+                    break;
+
+                case MetricType::Gauge:
+                    writer.sint(static_cast<const Gauge *>(metric)->value());
+                    break;
+
+                case MetricType::Histogram:
+                {
+                    const Histogram *const histogram =
+                        static_cast<const Histogram *>(metric);
+
+                    writer.map(7);
+                    writer.text("n");
+                    writer.uint(histogram->count());
+                    writer.text("sum");
+                    writer.uint(histogram->sum());
+                    writer.text("min");
+                    writer.uint(histogram->min());
+                    writer.text("max");
+                    writer.uint(histogram->max());
+                    writer.text("p50");
+                    writer.uint(histogram->percentile(50));
+                    writer.text("p90");
+                    writer.uint(histogram->percentile(90));
+                    writer.text("p99");
+                    writer.uint(histogram->percentile(99));
+                    break;
+                }
+            }
+        }
+        Metric::g_lock.unlock();
+
+        AbortIfNot(writer.fits(), 0);
+
+        return writer.length();
+    }
+
+private:
+    /**
+     * The number of metrics copied at once by serializeJson().
+     */
+    static constexpr size_t k_batch = 8;
+
+    /**
+     * @brief Values of a metric copied for serialization.
+     */
+    struct Sample
+    {
+        const char *name;
+        MetricType type;
+
+        /**
+         * The value of a counter or of a gauge, or the number of values of a
+         * histogram.
+         */
+        uint64_t value;
+
+        /**
+         * The statistics of a histogram.
+         * @{
+         */
+        uint64_t sum;
+        uint32_t min;
+        uint32_t max;
+        uint32_t p50;
+        uint32_t p90;
+        uint32_t p99;
+        /**
+         * @}
+         */
+    };
+
+    /**
+     * @brief Copy the values of the next batch of metrics.
+     * @param[out] samples The values, for up to k_batch metrics.
+     * @param[in,out] last The last metric copied, or nullptr to start from
+     *                the first metric.
+     * @return The number of metrics copied.
+     * @note A metric registered meanwhile is left out, and the metrics
+     *       following the last one copied are left out when it was
+     *       unregistered meanwhile.
+     */
+    static size_t copy(Sample *const samples, const Metric *&last)
+    {
+        size_t count = 0;
+
+        Metric::g_lock.lock();
+        const Metric *metric = Metric::g_metrics;
+        if (last) {
+            while (metric && metric != last) {
+                metric = metric->m_next;
+            }
+            metric = metric ? metric->m_next : nullptr;
+        }
+
+        for (; metric && count < k_batch; metric = metric->m_next) {
+            Sample &sample = samples[count++];
+            sample.name = metric->name();
+            sample.type = metric->type();
+
+            switch (metric->type()) {
+                case MetricType::Counter:
+                    sample.value =
+                        static_cast<const Counter *>(metric)->value();
+                    break;
+
+                case MetricType::Gauge:
+                    sample.value = static_cast<uint64_t>(
+                        static_cast<const Gauge *>(metric)->value());
+                    break;
+
+                case MetricType::Histogram:
+                {
+                    const Histogram *const histogram =
+                        static_cast<const Histogram *>(metric);
+
+                    sample.value = histogram->count();
+                    sample.sum = histogram->sum();
+                    sample.min = histogram->min();
+                    sample.max = histogram->max();
+                    sample.p50 = histogram->percentile(50);
+                    sample.p90 = histogram->percentile(90);
+                    sample.p99 = histogram->percentile(99);
+                    break;
+                }
+            }
+
+            last = metric;
+        }
+        Metric::g_lock.unlock();
+
+        return count;
+    }
+
+    /**
+     * @brief Minimal CBOR encoder.
+     */
+    class CborWriter
+    {
+    public:
+        /**
+         * @brief Constructor.
+         * @param[out] buffer The buffer to write to.
+         * @param[in] size The size of the buffer.
+         */
+        CborWriter(uint8_t *const buffer, const size_t size) :
+            m_buffer(buffer),
+            m_size(size),
+            m_length(0),
+            m_fits(true)
+        {
+        }
+
+        /**
+         * @brief Write the header of a map.
+         * @param[in] count The number of pairs in the map.
+         */
+        void map(const uint64_t count)
+        {
+            head(5, count);
+        }
+
+        /**
+         * @brief Write a text string.
+         * @param[in] text The string.
+         */
+        void text(const char *const text)
+        {
+            const size_t length = strlen(text);
+
+            head(3, length);
+            bytes(text, length);
+        }
+
+        /**
+         * @brief Write an unsigned integer.
+         * @param[in] value The integer.
+         */
+        void uint(const uint64_t value)
+        {
+            head(0, value);
+        }
+
+        /**
+         * @brief Write a signed integer.
+         * @param[in] value The integer.
+         */
+        void sint(const int64_t value)
+        {
+            if (value < 0) {
+                head(1, static_cast<uint64_t>(-(value + 1)));
+            } else {
+                head(0, value);
+            }
+        }
+
+        /**
+         * @brief Whether everything written fits in the buffer.
+         * @return True if the buffer is large enough.
+         */
+        bool fits() const
+        {
+            return m_fits;
+        }
+
+        /**
+         * @brief Get the length written.
+         * @return The length, in bytes.
+         */
+        size_t length() const
+        {
+            return m_length;
+        }
+
+    private:
+        /**
+         * @brief Write the head of a data item.
+         * @param[in] major The major type.
+         * @param[in] argument The argument.
+         */
+        void head(const uint8_t major, const uint64_t argument)
+        {
+            uint8_t encoded[9];
+            size_t length;
+
+            if (argument < 24) {
+                encoded[0] = major << 5 | argument;
+                length = 1;
+            } else {
+                /*
+                 * Use the shortest of the 1, 2, 4 or 8 bytes encodings.
+                 */
+                unsigned bytes = argument <= UINT8_MAX ? 1 :
+                    argument <= UINT16_MAX ? 2 :
+                    argument <= UINT32_MAX ? 4 : 8;
+
+                encoded[0] = major << 5 | (24 + __builtin_ctz(bytes));
+                for (unsigned i = 0; i < bytes; i++) {
+                    encoded[1 + i] = argument >> (8 * (bytes - 1 - i));
+                }
+                length = 1 + bytes;
+            }
+
+            this->bytes(encoded, length);
+        }
+
+        /**
+         * @brief Write raw bytes.
+         * @param[in] data The bytes.
+         * @param[in] length The number of bytes.
+         */
+        void bytes(const void *const data, const size_t length)
+        {
+            if (m_length + length > m_size) {
+                m_fits = false;
+                return;
+            }
+
+            memcpy(m_buffer + m_length, data, length);
+            m_length += length;
+        }
+
+        /**
+         * The buffer to write to.
+         */
+        uint8_t *const m_buffer;
+
+        /**
+         * The size of the buffer.
+         */
+        const size_t m_size;
+
+        /**
+         * The length written.
+         */
+        size_t m_length;
+
+        /**
+         * Whether everything written fits in the buffer.
+         */
+        bool m_fits;
+    };
+
+    /**
+     * @brief Append formatted text to a buffer.
+     * @param[out] buffer The buffer.
+     * @param[in] size The size of the buffer.
+     * @param[in,out] length The length of the text in the buffer.
+     * @param[in] format The format.
+     * @return True if the text fits.
+     */
+    __attribute__((format(printf, 4, 5)))
+    static bool append(char *const buffer, const size_t size, size_t &length,
+                       const char *const format, ...)
+    {
+        va_list args;
+        va_start(args, format);
+        const int written =
+            vsnprintf(buffer + length, size - length, format, args);
+        va_end(args);
+
+        if (written < 0 || length + written >= size) {
+            return false;
+        }
+        length += written;
+
+        return true;
+    }
+};
+
+} /* namespace SpherePlusPlus */
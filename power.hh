@@ -0,0 +1,757 @@
+/**
+ * @file power.hh
+ * @author Matthieu Bucchianeri
+ * @brief Duty-cycle power scheduler, suspending the system while the
+ *        application is idle, and power profile governor, following the load
+ *        of the application.
+ *
+ * Whenever its event loop has no event left to process, the application asks
+ * the scheduler for the longest safe suspend: none while operations are
+ * pending (such as telemetry not yet confirmed, or a backlog reported by the
+ * application), otherwise until the next expiry of its timers, without
+ * waiting for the deferrable ones (see Timer::setDeferrable()). The
+ * application is then flushed (see ApplicationBase::flush()), and the system
+ * suspended, if the time saved pays for the time to resume.
+ *
+ * Each checkpoint saved before a suspend is a write to flash, which wears out:
+ * a device suspending every few minutes would write it thousands of times a
+ * day. The checkpoint is therefore saved before a suspend only when the one in
+ * storage is older than Policy::checkpointInterval_s, and is not written at
+ * all when the state did not change (see checkpoint.hh). Its age is taken from
+ * the time stored in the checkpoint itself, which survives the power down.
+ * The trade-off is the state changed in between: it is lost when the system
+ * powers down, and the application resumes from the older checkpoint. The
+ * application state persisted by ApplicationBase::persistState() is not
+ * rate-limited, and must be kept off the flash, or sparse, accordingly.
+ *
+ * A suspended system only wakes up when the suspend ends: the inputs that do
+ * not come from timers (GPIOs, cloud-to-device messages...) are missed. The
+ * application restarts after a suspend, and resumes its state from the
+ * checkpoint (see checkpoint.hh).
+ *
+ * While awake, the governor switches the system power profile with the load:
+ * the utilization of the event loop (see load.hh) and the work queued, such as
+ * a backlog of telemetry being replayed. It switches up as soon as a window
+ * exceeds the threshold of the next profile, and down one profile at a time,
+ * after several windows below the lower threshold of the current profile.
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+#include <applibs/eventloop.h>
+#include <applibs/powermanagement.h>
+
+#include <sphereplusplus/abort.hh>
+#include <sphereplusplus/clock.hh>
+#include <sphereplusplus/delegate.hh>
+#include <sphereplusplus/load.hh>
+#include <sphereplusplus/timer.hh>
+
+namespace SpherePlusPlus {
+
+/**
+ * @brief Duty-cycle power scheduler.
+ * @note Requires the "PowerControls" application capability to specify
+ *       "ForcePowerDown".
+ * @see ApplicationBase::setPowerScheduler
+ */
+class PowerScheduler
+{
+public:
+    /**
+     * @brief Parameters of the scheduler.
+     */
+    struct Policy
+    {
+        /**
+         * The shortest time saved by a suspend, beyond the time to resume,
+         * worth suspending for, in seconds.
+         */
+        uint32_t minPayoff_s;
+
+        /**
+         * The time for the system to resume and the application to restart
+         * after a suspend, in seconds. The suspend ends that much before the
+         * next expiry.
+         */
+        uint32_t resumeLatency_s;
+
+        /**
+         * The longest suspend, when no timer is armed, in seconds.
+         */
+        uint32_t maxSuspend_s;
+
+        /**
+         * The time to stay awake after the initialization of the scheduler or
+         * after a suspend request, in seconds.
+         */
+        uint32_t holdoff_s;
+
+        /**
+         * The shortest time between two checkpoints saved before a suspend,
+         * in seconds, or 0 to save the checkpoint before every suspend.
+         */
+        uint32_t checkpointInterval_s;
+    };
+
+    /**
+     * The default policy: suspend when it saves at least a minute, with 10
+     * seconds to resume, for at most an hour, stay awake 30 seconds after
+     * starting, and save the checkpoint before a suspend at most hourly.
+     */
+    static constexpr Policy k_defaultPolicy = {60, 10, 3600, 30, 3600};
+
+    /**
+     * @brief Constructor.
+     */
+    PowerScheduler() :
+        m_policy(k_defaultPolicy),
+        m_backlog(),
+        m_holdoff_ns(0),
+        m_suspends(0),
+        m_suspended_s(0),
+        m_initialized(false)
+    {
+    }
+
+    /**
+     * @brief Destructor.
+     */
+    virtual ~PowerScheduler()
+    {
+    }
+
+    /**
+     * @brief Initialize the scheduler.
+     * @param[in] policy The parameters of the scheduler.
+     * @return True on success.
+     */
+    virtual bool init(const Policy &policy = k_defaultPolicy)
+    {
+        AbortIf(m_initialized, false);
+        AbortIfNot(policy.maxSuspend_s > 0, false);
+
+        m_policy = policy;
+        m_holdoff_ns = VirtualClock::now() + m_policy.holdoff_s * 1000000000ull;
+        m_suspends = 0;
+        m_suspended_s = 0;
+        m_initialized = true;
+
+        return true;
+    }
+
+    /**
+     * @brief Destroy the scheduler.
+     * @return True on success.
+     */
+    virtual bool destroy()
+    {
+        AbortIfNot(m_initialized, false);
+
+        m_initialized = false;
+
+        return true;
+    }
+
+    /**
+     * @brief Connect a class method returning the backlog of the application.
+     * @tparam T The class type.
+     * @tparam TMethod The class method, returning the number of items queued.
+     * @param[in] instance The class instance.
+     */
+    template<class T, uint32_t (T::*TMethod)()>
+    void connect(T &instance)
+    {
+        m_backlog.connect<T, TMethod>(instance);
+    }
+
+    /**
+     * @brief Connect a static method returning the backlog of the application.
+     * @tparam TFunc The static method, returning the number of items queued.
+     */
+    template<uint32_t (*TFunc)()>
+    void connect()
+    {
+        m_backlog.connect<TFunc>();
+    }
+
+    /**
+     * @brief Connect a lambda returning the backlog of the application.
+     * @tparam LAMBDA The lambda type.
+     * @param[in] instance The closure for the lambda, returning the number of
+     *            items queued.
+     */
+    template <typename LAMBDA>
+    void connect(const LAMBDA &instance)
+    {
+        m_backlog.connect<LAMBDA>(instance);
+    }
+
+    /**
+     * @brief Compute the longest safe suspend.
+     * @param[in] eventLoop The event loop of the application, which has no
+     *            event left to process.
+     * @param[in] pending The number of operations pending in the application.
+     * @return The duration of the suspend, in seconds, or 0 when the system
+     *         must stay awake.
+     */
+    uint32_t suspendDuration(const EventLoop *const eventLoop,
+                             const uint32_t pending) const
+    {
+        if (!m_initialized || pending || VirtualClock::now() < m_holdoff_ns ||
+            (m_backlog && m_backlog())) {
+            return 0;
+        }
+
+        uint64_t sleep_s = m_policy.maxSuspend_s;
+        uint64_t delay_us;
+        if (Timer::nextExpiry(eventLoop, delay_us) &&
+            delay_us / 1000000 < sleep_s) {
+            sleep_s = delay_us / 1000000;
+        }
+
+        if (sleep_s < m_policy.resumeLatency_s + m_policy.minPayoff_s) {
+            return 0;
+        }
+
+        return static_cast<uint32_t>(sleep_s - m_policy.resumeLatency_s);
+    }
+
+    /**
+     * @brief Account for a suspend, and hold off the next one.
+     * @param[in] duration_s The duration of the suspend, in seconds.
+     * @param[in] checkpoint_s The time the checkpoint in storage was saved, in
+     *            seconds since the epoch, or 0 when there is none (see
+     *            Checkpoint::storedTime()).
+     * @return True when the checkpoint must be saved before the suspend.
+     */
+    bool suspended(const uint32_t duration_s, const uint32_t checkpoint_s)
+    {
+        m_suspends++;
+        m_suspended_s += duration_s;
+        m_holdoff_ns = VirtualClock::now() +
+            m_policy.holdoff_s * 1000000000ull;
+
+        /*
+         * A clock behind the checkpoint cannot tell its age: save it.
+         */
+        const uint64_t now_s = VirtualClock::wallTime() / 1000000000;
+
+        return !checkpoint_s || now_s < checkpoint_s ||
+            now_s - checkpoint_s >= m_policy.checkpointInterval_s;
+    }
+
+    /**
+     * @brief Get the number of suspends requested.
+     * @return The number of suspends.
+     */
+    uint32_t suspends() const
+    {
+        return m_suspends;
+    }
+
+    /**
+     * @brief Get the total duration of the suspends requested.
+     * @return The duration, in seconds.
+     */
+    uint64_t suspendedTime() const
+    {
+        return m_suspended_s;
+    }
+
+private:
+    /**
+     * The parameters of the scheduler.
+     */
+    Policy m_policy;
+
+    /**
+     * The callback returning the backlog of the application.
+     */
+    Delegate<uint32_t()> m_backlog;
+
+    /**
+     * The time before which the system stays awake, in nanoseconds.
+     */
+    uint64_t m_holdoff_ns;
+
+    /**
+     * The number of suspends requested.
+     */
+    uint32_t m_suspends;
+
+    /**
+     * The total duration of the suspends requested, in seconds.
+     */
+    uint64_t m_suspended_s;
+
+    /**
+     * Whether the scheduler is initialized.
+     */
+    bool m_initialized;
+};
+
+/**
+ * @brief System power profile.
+ */
+enum class PowerProfile : uint8_t
+{
+    /**
+     * Lowest power, reduced performance.
+     */
+    PowerSaver,
+
+    /**
+     * Trade-off between power and performance.
+     */
+    Balanced,
+
+    /**
+     * Full performance.
+     */
+    Performance,
+};
+
+/**
+ * @brief Power profile governor.
+ * @note Requires the "PowerControls" application capability to specify
+ *       "SetPowerProfile".
+ * @see ApplicationBase::setPowerGovernor
+ */
+class PowerGovernor
+{
+public:
+    /**
+     * @brief Parameters of the governor.
+     */
+    struct Policy
+    {
+        /**
+         * The duration of the windows over which the load is measured, in
+         * milliseconds.
+         */
+        uint32_t window_ms;
+
+        /**
+         * The utilization of the event loop switching up to the balanced
+         * profile, and the utilization under which it switches back down, in
+         * percent.
+         * @{
+         */
+        uint8_t balancedEnter_pct;
+        uint8_t balancedLeave_pct;
+        /**
+         * @}
+         */
+
+        /**
+         * The utilization of the event loop switching up to the performance
+         * profile, and the utilization under which it switches back down, in
+         * percent.
+         * @{
+         */
+        uint8_t performanceEnter_pct;
+        uint8_t performanceLeave_pct;
+        /**
+         * @}
+         */
+
+        /**
+         * The work queued switching up to the performance profile. Any work
+         * queued keeps at least the balanced profile.
+         */
+        uint32_t burstBacklog;
+
+        /**
+         * The number of consecutive windows below the lower threshold before
+         * switching down.
+         */
+        uint32_t holdWindows;
+    };
+
+    /**
+     * The default policy: one-second windows, balanced from 10% utilization
+     * down to 5%, performance from 50% down to 25% or with 32 items queued,
+     * and switching down after 5 seconds below the lower threshold.
+     */
+    static constexpr Policy k_defaultPolicy = {1000, 10, 5, 50, 25, 32, 5};
+
+    /**
+     * @brief Constructor.
+     */
+    PowerGovernor() :
+        m_policy(k_defaultPolicy),
+        m_backlog(),
+        m_pending(),
+        m_load(),
+        m_timer(),
+        m_profile(PowerProfile::Balanced),
+        m_below(0),
+        m_windowStart_ns(0),
+        m_windowBusy_ns(0),
+        m_utilization_pct(0),
+        m_switches(0),
+        m_initialized(false)
+    {
+    }
+
+    /*
+     * The governor holds a timer and a load monitor, and cannot be copied.
+     */
+    PowerGovernor(const PowerGovernor &other) = delete;
+    PowerGovernor &operator =(const PowerGovernor &other) = delete;
+
+    /**
+     * @brief Destructor.
+     */
+    virtual ~PowerGovernor()
+    {
+        if (m_initialized) {
+            destroy();
+        }
+    }
+
+    /**
+     * @brief Initialize the governor, and start measuring the load.
+     * @param[in] policy The parameters of the governor.
+     * @param[in] profile The initial power profile.
+     * @return True on success.
+     * @note Must be invoked from the thread running the event loop. No other
+     *       load monitor may be attached to the thread.
+     */
+    virtual bool init(const Policy &policy = k_defaultPolicy,
+                      const PowerProfile profile = PowerProfile::Balanced)
+    {
+        AbortIf(m_initialized, false);
+        AbortIfNot(policy.window_ms > 0, false);
+        AbortIfNot(policy.balancedLeave_pct <= policy.balancedEnter_pct,
+                   false);
+        AbortIfNot(policy.performanceLeave_pct <= policy.performanceEnter_pct,
+                   false);
+        AbortIfNot(policy.balancedEnter_pct <= policy.performanceEnter_pct,
+                   false);
+
+        m_policy = policy;
+        m_below = 0;
+        m_utilization_pct = 0;
+        m_switches = 0;
+        AbortIfNot(apply(profile), false);
+
+        AbortIfNot(m_load.init(), false);
+        m_windowStart_ns = readClock();
+        m_windowBusy_ns = m_load.busyTime();
+
+        /*
+         * The windows do not need to keep the system awake, the load is low
+         * while it could be suspended.
+         */
+        bool started = m_timer.init();
+        if (started) {
+            m_timer.setDeferrable(true);
+            m_timer.connect<PowerGovernor, &PowerGovernor::evaluate>(*this);
+            started = m_timer.startPeriodic(m_policy.window_ms * 1000ull);
+            if (!started) {
+                m_timer.destroy();
+            }
+        }
+
+        if (!started) {
+            m_load.destroy();
+        }
+        AbortIfNot(started, false);
+
+        m_initialized = true;
+
+        return true;
+    }
+
+    /**
+     * @brief Destroy the governor.
+     * @return True on success.
+     * @note The power profile is left unchanged.
+     */
+    virtual bool destroy()
+    {
+        AbortIfNot(m_initialized, false);
+
+        AbortIfNot(m_timer.destroy(), false);
+        AbortIfNot(m_load.destroy(), false);
+        m_initialized = false;
+
+        return true;
+    }
+
+    /**
+     * @brief Connect a class method returning the backlog of the application.
+     * @tparam T The class type.
+     * @tparam TMethod The class method, returning the number of items queued.
+     * @param[in] instance The class instance.
+     */
+    template<class T, uint32_t (T::*TMethod)()>
+    void connect(T &instance)
+    {
+        m_backlog.connect<T, TMethod>(instance);
+    }
+
+    /**
+     * @brief Connect a static method returning the backlog of the application.
+     * @tparam TFunc The static method, returning the number of items queued.
+     */
+    template<uint32_t (*TFunc)()>
+    void connect()
+    {
+        m_backlog.connect<TFunc>();
+    }
+
+    /**
+     * @brief Connect a lambda returning the backlog of the application.
+     * @tparam LAMBDA The lambda type.
+     * @param[in] instance The closure for the lambda, returning the number of
+     *            items queued.
+     */
+    template <typename LAMBDA>
+    void connect(const LAMBDA &instance)
+    {
+        m_backlog.connect<LAMBDA>(instance);
+    }
+
+    /**
+     * @brief Connect the operations pending in the application, counted as
+     *        work queued.
+     * @tparam T The application type.
+     * @tparam TMethod The class method, returning the number of operations.
+     * @param[in] instance The application.
+     * @note Invoked by ApplicationBase::setPowerGovernor().
+     */
+    template<class T, uint32_t (T::*TMethod)()>
+    void connectPending(T &instance)
+    {
+        m_pending.connect<T, TMethod>(instance);
+    }
+
+    /**
+     * @brief Disconnect the operations pending in the application.
+     */
+    void disconnectPending()
+    {
+        m_pending = Delegate<uint32_t()>();
+    }
+
+    /**
+     * @brief Get the current power profile.
+     * @return The profile.
+     */
+    PowerProfile profile() const
+    {
+        return m_profile;
+    }
+
+    /**
+     * @brief Get the utilization of the event loop over the last window.
+     * @return The utilization, in percent.
+     */
+    uint32_t utilization() const
+    {
+        return m_utilization_pct;
+    }
+
+    /**
+     * @brief Get the number of profile switches since the initialization.
+     * @return The number of switches.
+     */
+    uint32_t switches() const
+    {
+        return m_switches;
+    }
+
+    /**
+     * @brief Get the name of a power profile.
+     * @param[in] profile The profile.
+     * @return The name.
+     */
+    static const char *profileName(const PowerProfile profile)
+    {
+        switch (profile) {
+            case PowerProfile::PowerSaver:
+                return "power-saver";
+
+            case PowerProfile::Balanced:
+                return "balanced";
+
+            case PowerProfile::Performance:
+                return "performance";
+
+            default:
+                return "unknown";
+        }
+    }
+
+private:
+    /**
+     * @brief Window timer callback. Measures the load, and switches the
+     *        profile.
+     */
+    void evaluate()
+    {
+        /*
+         * The busy time is real time, even on a virtual clock.
+         */
+        const uint64_t now = readClock();
+        const uint64_t busy = m_load.busyTime();
+        const uint64_t elapsed = now - m_windowStart_ns;
+
+        m_utilization_pct = elapsed ? static_cast<uint32_t>(
+            (busy - m_windowBusy_ns) * 100 / elapsed) : 0;
+        if (m_utilization_pct > 100) {
+            m_utilization_pct = 100;
+        }
+        m_windowStart_ns = now;
+        m_windowBusy_ns = busy;
+
+        const uint32_t queued =
+            (m_backlog ? m_backlog() : 0) + (m_pending ? m_pending() : 0);
+        const PowerProfile target = this->target(m_utilization_pct, queued);
+
+        if (target > m_profile) {
+            m_below = 0;
+            apply(target);
+        } else if (target < m_profile) {
+            /*
+             * Only step down after several windows, one profile at a time.
+             */
+            if (++m_below >= m_policy.holdWindows) {
+                m_below = 0;
+                apply(static_cast<PowerProfile>(
+                    static_cast<uint8_t>(m_profile) - 1));
+            }
+        } else {
+            m_below = 0;
+        }
+    }
+
+    /**
+     * @brief Get the profile for a window, with the thresholds of the current
+     *        profile.
+     * @param[in] utilization_pct The utilization of the event loop.
+     * @param[in] queued The work queued.
+     * @return The profile.
+     */
+    PowerProfile target(const uint32_t utilization_pct,
+                        const uint32_t queued) const
+    {
+        const bool burst = m_policy.burstBacklog &&
+            queued >= m_policy.burstBacklog;
+
+        if (burst || utilization_pct >= m_policy.performanceEnter_pct ||
+            (m_profile == PowerProfile::Performance &&
+             utilization_pct >= m_policy.performanceLeave_pct)) {
+            return PowerProfile::Performance;
+        }
+
+        if (queued || utilization_pct >= m_policy.balancedEnter_pct ||
+            (m_profile >= PowerProfile::Balanced &&
+             utilization_pct >= m_policy.balancedLeave_pct)) {
+            return PowerProfile::Balanced;
+        }
+
+        return PowerProfile::PowerSaver;
+    }
+
+    /**
+     * @brief Switch the system power profile.
+     * @param[in] profile The profile.
+     * @return True on success.
+     */
+    bool apply(const PowerProfile profile)
+    {
+        PowerManagement_System_PowerProfile desired;
+        switch (profile) {
+            case PowerProfile::PowerSaver:
+                desired = PowerManagement_PowerSaver;
+                break;
+
+            case PowerProfile::Performance:
+                desired = PowerManagement_HighPerformance;
+                break;
+
+            default:
+                desired = PowerManagement_Balanced;
+                break;
+        }
+
+        AbortErrno(PowerManagement_SetSystemPowerProfile(desired), false);
+        if (m_initialized) {
+            m_switches++;
+            Log_Debug("Power profile %s (utilization %u%%)\n",
+                      profileName(profile), m_utilization_pct);
+        }
+        m_profile = profile;
+
+        return true;
+    }
+
+    /**
+     * The parameters of the governor.
+     */
+    Policy m_policy;
+
+    /**
+     * The callback returning the backlog of the application.
+     */
+    Delegate<uint32_t()> m_backlog;
+
+    /**
+     * The callback returning the operations pending in the application.
+     */
+    Delegate<uint32_t()> m_pending;
+
+    /**
+     * The load of the event loop.
+     */
+    LoadMonitor m_load;
+
+    /**
+     * The timer ending each window.
+     */
+    Timer m_timer;
+
+    /**
+     * The current power profile.
+     */
+    PowerProfile m_profile;
+
+    /**
+     * The number of consecutive windows below the lower threshold.
+     */
+    uint32_t m_below;
+
+    /**
+     * The start of the current window, in nanoseconds.
+     */
+    uint64_t m_windowStart_ns;
+
+    /**
+     * The busy time of the event loop at the start of the current window, in
+     * nanoseconds.
+     */
+    uint64_t m_windowBusy_ns;
+
+    /**
+     * The utilization of the event loop over the last window, in percent.
+     */
+    uint32_t m_utilization_pct;
+
+    /**
+     * The number of profile switches.
+     */
+    uint32_t m_switches;
+
+    /**
+     * Whether the governor is initialized.
+     */
+    bool m_initialized;
+};
+
+} /* namespace SpherePlusPlus */
@@ -0,0 +1,441 @@
+/**
+ * @file profiler.hh
+ * @author Matthieu Bucchianeri
+ * @brief Per-callback time accounting.
+ *
+ * The callbacks dispatched from the event loop (see internal.hh) are timed when
+ * a profiler is attached to the thread running the event loop. Each handler,
+ * identified by its callback and object, accumulates its number of calls, its
+ * wall time and its CPU time.
+ *
+ * To keep the profiler cheap enough to stay always on, only some of the calls
+ * are timed: the wall time once every k_wallSamplePeriod calls of a handler,
+ * and the CPU time, which is much costlier to read (it requires a system call),
+ * once every k_cpuSamplePeriod calls. The totals are extrapolated from the
+ * samples, and the histograms and the maximum CPU time only cover the samples.
+ * The maximum wall time covers every call: the calls not sampled are timed
+ * with the coarse monotonic clock, which only costs a memory read, and a spike
+ * longer than its resolution (a scheduler tick) raises the maximum to a lower
+ * bound of its duration.
+ *
+ * The times are inclusive: a callback dispatched from within another callback
+ * (such as an IoT callback invoked while pumping the IoT client) is also
+ * accounted to the outer callback.
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+
+#include <sphereplusplus/abort.hh>
+#include <sphereplusplus/clock.hh>
+#include <sphereplusplus/dispatch.hh>
+#include <sphereplusplus/ranking.hh>
+
+namespace SpherePlusPlus {
+
+/**
+ * @brief Per-callback time accounting.
+ */
+class CallbackProfiler
+{
+public:
+    /**
+     * The number of handlers recorded. The calls to the handlers that do not
+     * fit are recorded against the null handler.
+     */
+    static constexpr size_t k_maxHandlers = 32;
+
+    /**
+     * The number of buckets of the histograms. Bucket 0 counts the durations
+     * under 4 us, bucket i the durations between 2^(i+11) and 2^(i+12) ns, and
+     * the last bucket the durations over 67 ms.
+     */
+    static constexpr size_t k_histogramBuckets = 16;
+
+    /**
+     * The wall time of a handler is sampled once every k_wallSamplePeriod
+     * calls, and its CPU time once every k_cpuSamplePeriod calls.
+     * @{
+     */
+    static constexpr uint32_t k_wallSamplePeriod = 4;
+    static constexpr uint32_t k_cpuSamplePeriod = 64;
+    /**
+     * @}
+     */
+
+    /**
+     * @brief Time accounting of a handler.
+     */
+    struct Handler
+    {
+        /**
+         * The type of the callback.
+         */
+        DispatchKind kind;
+
+        /**
+         * The callback (delegate stub or static callback).
+         */
+        const void *callback;
+
+        /**
+         * The object passed to the callback.
+         */
+        const void *object;
+
+        /**
+         * The number of calls.
+         */
+        uint32_t calls;
+
+        /**
+         * The number of calls whose wall time was sampled.
+         */
+        uint32_t wallSamples;
+
+        /**
+         * The wall time of the sampled calls, in nanoseconds, and the maximum
+         * wall time of all the calls.
+         * @{
+         */
+        uint64_t wallTotal_ns;
+        uint64_t wallMax_ns;
+        uint32_t wallHistogram[k_histogramBuckets];
+        /**
+         * @}
+         */
+
+        /**
+         * The number of calls whose CPU time was sampled.
+         */
+        uint32_t cpuSamples;
+
+        /**
+         * The CPU time of the sampled calls, in nanoseconds.
+         * @{
+         */
+        uint64_t cpuTotal_ns;
+        uint64_t cpuMax_ns;
+        uint32_t cpuHistogram[k_histogramBuckets];
+        /**
+         * @}
+         */
+    };
+
+    /**
+     * @brief State of a callback being timed.
+     */
+    struct Frame
+    {
+        /**
+         * The handler, or nullptr if no profiler is attached.
+         */
+        Handler *handler;
+
+        /**
+         * The start of the callback, in nanoseconds, or 0 if not sampled.
+         * @{
+         */
+        uint64_t wallStart_ns;
+        uint64_t cpuStart_ns;
+        /**
+         * @}
+         */
+
+        /**
+         * The start of the callback on the coarse clock, plus the resolution
+         * of the clock, in nanoseconds.
+         */
+        uint64_t coarseStart_ns;
+    };
+
+    /**
+     * @brief Constructor.
+     */
+    CallbackProfiler() :
+        m_handlers(),
+        m_coarseResolution_ns(0)
+    {
+    }
+
+    /*
+     * The profiler is attached to a thread, and cannot be copied.
+     */
+    CallbackProfiler(const CallbackProfiler &other) = delete;
+    CallbackProfiler &operator =(const CallbackProfiler &other) = delete;
+
+    /**
+     * @brief Destructor.
+     */
+    virtual ~CallbackProfiler()
+    {
+        if (g_current == this) {
+            destroy();
+        }
+    }
+
+    /**
+     * @brief Initialize the profiler, and attach it to the calling thread,
+     *        which must be the thread running the event loop.
+     * @return True on success.
+     */
+    virtual bool init()
+    {
+        AbortIf(g_current, false);
+
+        struct timespec resolution;
+        AbortErrno(clock_getres(CLOCK_MONOTONIC_COARSE, &resolution), false);
+        m_coarseResolution_ns =
+            resolution.tv_sec * 1000000000ull + resolution.tv_nsec;
+
+        reset();
+        g_current = this;
+
+        return true;
+    }
+
+    /**
+     * @brief Destroy the profiler.
+     * @return True on success.
+     * @note Must be invoked from the thread running the event loop.
+     */
+    virtual bool destroy()
+    {
+        AbortIfNot(g_current == this, false);
+
+        g_current = nullptr;
+
+        return true;
+    }
+
+    /**
+     * @brief Clear the time accounting.
+     * @note Must not be invoked from a callback being timed.
+     */
+    void reset()
+    {
+        memset(m_handlers, 0, sizeof(m_handlers));
+    }
+
+    /**
+     * @brief Take a snapshot of the time accounting.
+     * @param[out] handlers The handlers, by decreasing estimated wall time.
+     * @param[in] max The maximum number of handlers to return.
+     * @return The number of handlers returned.
+     * @note Must be invoked from the thread running the event loop.
+     */
+    size_t snapshot(Handler *const handlers, const size_t max) const
+    {
+        size_t count = 0;
+
+        for (size_t i = 0; i < k_maxHandlers; i++) {
+            if (m_handlers[i].calls == 0) {
+                continue;
+            }
+
+            insertRanked(handlers, count, max, m_handlers[i],
+                         estimatedWallTime);
+        }
+
+        return count;
+    }
+
+    /**
+     * @brief Log the handlers, by decreasing estimated wall time.
+     * @param[in] max The maximum number of handlers to log.
+     * @note Must be invoked from the thread running the event loop.
+     */
+    void dump(const size_t max = k_maxHandlers) const
+    {
+        Handler handlers[k_maxHandlers];
+        const size_t count =
+            snapshot(handlers, max < k_maxHandlers ? max : k_maxHandlers);
+
+        Log_Debug("Callback profile (wall/cpu us: total, mean, max):\n");
+        for (size_t i = 0; i < count; i++) {
+            const Handler &handler = handlers[i];
+            typedef unsigned long long ull;
+
+            const ull wallMean = handler.wallSamples ?
+                handler.wallTotal_ns / handler.wallSamples : 0;
+            const ull cpuMean = handler.cpuSamples ?
+                handler.cpuTotal_ns / handler.cpuSamples : 0;
+
+            Log_Debug("%2u. %-8s %p (object %p): %u calls, "
+                      "wall %llu/%llu/%llu, cpu %llu/%llu/%llu\n",
+                      static_cast<uint32_t>(i + 1),
+                      dispatchKindName(handler.kind), handler.callback,
+                      handler.object, handler.calls,
+                      wallMean * handler.calls / 1000, wallMean / 1000,
+                      static_cast<ull>(handler.wallMax_ns / 1000),
+                      cpuMean * handler.calls / 1000, cpuMean / 1000,
+                      static_cast<ull>(handler.cpuMax_ns / 1000));
+        }
+    }
+
+    /**
+     * @brief Mark the start of a callback on the calling thread.
+     * @param[out] frame The state of the callback.
+     * @param[in] kind The type of the callback.
+     * @param[in] callback The callback.
+     * @param[in] object The object passed to the callback.
+     */
+    static void enter(Frame &frame, const DispatchKind kind,
+                      const void *const callback, const void *const object)
+    {
+        CallbackProfiler *const profiler = g_current;
+        if (__builtin_expect(!profiler, 1)) {
+            frame.handler = nullptr;
+            return;
+        }
+
+        Handler *const handler = profiler->lookup(kind, callback, object);
+        frame.handler = handler;
+        frame.cpuStart_ns = handler->calls % k_cpuSamplePeriod == 0 ?
+            readClock(CLOCK_THREAD_CPUTIME_ID) : 0;
+        frame.wallStart_ns = handler->calls % k_wallSamplePeriod == 0 ?
+            readClock(CLOCK_MONOTONIC) : 0;
+        frame.coarseStart_ns = frame.wallStart_ns ? 0 :
+            readClock(CLOCK_MONOTONIC_COARSE) + profiler->m_coarseResolution_ns;
+        handler->calls++;
+    }
+
+    /**
+     * @brief Mark the end of a callback on the calling thread.
+     * @param[in] frame The state of the callback.
+     */
+    static void leave(const Frame &frame)
+    {
+        Handler *const handler = frame.handler;
+        if (__builtin_expect(!handler, 1)) {
+            return;
+        }
+
+        if (frame.wallStart_ns) {
+            const uint64_t wall =
+                readClock(CLOCK_MONOTONIC) - frame.wallStart_ns;
+            account(wall, handler->wallTotal_ns, handler->wallMax_ns,
+                    handler->wallHistogram);
+            handler->wallSamples++;
+        } else {
+            const uint64_t end = readClock(CLOCK_MONOTONIC_COARSE);
+            if (end > frame.coarseStart_ns &&
+                end - frame.coarseStart_ns > handler->wallMax_ns) {
+                handler->wallMax_ns = end - frame.coarseStart_ns;
+            }
+        }
+
+        if (frame.cpuStart_ns) {
+            const uint64_t cpu =
+                readClock(CLOCK_THREAD_CPUTIME_ID) - frame.cpuStart_ns;
+            account(cpu, handler->cpuTotal_ns, handler->cpuMax_ns,
+                    handler->cpuHistogram);
+            handler->cpuSamples++;
+        }
+    }
+
+    /**
+     * @brief Estimate the total wall time of a handler from the samples.
+     * @param[in] handler The handler.
+     * @return The estimated wall time, in nanoseconds.
+     */
+    static uint64_t estimatedWallTime(const Handler &handler)
+    {
+        if (!handler.wallSamples) {
+            return 0;
+        }
+
+        return handler.wallTotal_ns / handler.wallSamples * handler.calls;
+    }
+
+    /**
+     * @brief Get the histogram bucket of a duration.
+     * @param[in] duration_ns The duration, in nanoseconds.
+     * @return The bucket.
+     */
+    static size_t bucket(const uint64_t duration_ns)
+    {
+        if (duration_ns < (1u << 12)) {
+            return 0;
+        }
+
+        const size_t bucket = 63 - __builtin_clzll(duration_ns) - 11;
+
+        return bucket < k_histogramBuckets ? bucket : k_histogramBuckets - 1;
+    }
+
+private:
+    /**
+     * @brief Accumulate a duration.
+     * @param[in] duration_ns The duration, in nanoseconds.
+     * @param[in,out] total_ns The total duration.
+     * @param[in,out] max_ns The maximum duration.
+     * @param[in,out] histogram The histogram of the durations.
+     */
+    static void account(const uint64_t duration_ns, uint64_t &total_ns,
+                        uint64_t &max_ns,
+                        uint32_t (&histogram)[k_histogramBuckets])
+    {
+        total_ns += duration_ns;
+        if (duration_ns > max_ns) {
+            max_ns = duration_ns;
+        }
+        histogram[bucket(duration_ns)]++;
+    }
+
+    /**
+     * @brief Find or insert a handler.
+     * @param[in] kind The type of the callback.
+     * @param[in] callback The callback.
+     * @param[in] object The object passed to the callback.
+     * @return The handler.
+     */
+    Handler *lookup(const DispatchKind kind, const void *const callback,
+                    const void *const object)
+    {
+        /*
+         * Open addressing, with the null handler (index 0) collecting the
+         * overflow.
+         */
+        const size_t hash = ((reinterpret_cast<uintptr_t>(callback) ^
+                              reinterpret_cast<uintptr_t>(object)) >> 2) *
+            2654435761u;
+        for (size_t i = 0; i < k_maxHandlers - 1; i++) {
+            Handler *const handler =
+                &m_handlers[1 + (hash + i) % (k_maxHandlers - 1)];
+
+            if (handler->callback == callback && handler->object == object) {
+                return handler;
+            }
+            if (!handler->callback) {
+                handler->kind = kind;
+                handler->callback = callback;
+                handler->object = object;
+                return handler;
+            }
+        }
+
+        return &m_handlers[0];
+    }
+
+    /**
+     * The handlers.
+     */
+    Handler m_handlers[k_maxHandlers];
+
+    /**
+     * The resolution of the coarse monotonic clock, in nanoseconds.
+     */
+    uint64_t m_coarseResolution_ns;
+
+    /**
+     * The profiler attached to the current thread.
+     */
+    static __thread CallbackProfiler *g_current;
+};
+
+} /* namespace SpherePlusPlus */
@@ -0,0 +1,46 @@
+/**
+ * @file ranking.hh
+ * @author Matthieu Bucchianeri
+ * @brief Ranking of the entries of the accounting tables.
+ *
+ * The snapshots of the accounting tables (profiler, energy model, heap
+ * profiler) return the top entries by decreasing rank. The tables are small,
+ * so the entries are ranked with an insertion sort, without allocation.
+ */
+
+#pragma once
+
+#include <stddef.h>
+
+namespace SpherePlusPlus {
+
+/**
+ * @brief Insert an entry into a ranking, by decreasing rank.
+ * @tparam T The type of the entries.
+ * @tparam RANK The type of the closure computing the rank of an entry.
+ * @param[in,out] ranking The entries ranked, by decreasing rank.
+ * @param[in,out] count The number of entries ranked, at most max.
+ * @param[in] max The maximum number of entries ranked.
+ * @param[in] entry The entry to insert. It is dropped when its rank is lower
+ *            than the rank of the max entries ranked.
+ * @param[in] rank The closure computing the rank of an entry.
+ */
+template <typename T, typename RANK>
+void insertRanked(T *const ranking, size_t &count, const size_t max,
+                  const T &entry, const RANK &rank)
+{
+    const auto entryRank = rank(entry);
+
+    size_t j = count < max ? count++ : max;
+    while (j > 0 && rank(ranking[j - 1]) < entryRank) {
+        if (j < max) {
+            ranking[j] = ranking[j - 1];
+        }
+        j--;
+    }
+    if (j < max) {
+        ranking[j] = entry;
+    }
+}
+
+} /* namespace SpherePlusPlus */
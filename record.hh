@@ -0,0 +1,366 @@
+/**
+ * @file record.hh
+ * @author Matthieu Bucchianeri
+ * @brief Recording of the inputs of the event loop.
+ *
+ * When a recorder is attached to the thread running the event loop, the inputs
+ * of the application are recorded with their time, relative to the start of
+ * the recording: the timer expiries, the process signals, the system event
+ * notifications and the Azure IoT connection changes and telemetry
+ * confirmations. The recording can be written as text, one input per line:
+ *
+ * <time in ns> <kind> <value> <value> <value> <value>
+ *
+ * and replayed on a host (see replay.hh), to run the same traffic against each
+ * build of the application. The timer expiries are not replayed, they follow
+ * from the other inputs, but they allow checking that a replay behaves as the
+ * recording. They are only recorded on request, since the periodic timers
+ * (such as the Azure IoT pump) expire many times per second.
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <sphereplusplus/abort.hh>
+#include <sphereplusplus/clock.hh>
+
+namespace SpherePlusPlus {
+
+/**
+ * @brief Type of the inputs of the event loop.
+ */
+enum class InputKind : uint8_t
+{
+    /**
+     * A timer expiry.
+     */
+    Timer,
+
+    /**
+     * A process signal: the signal number.
+     */
+    Signal,
+
+    /**
+     * A system event notification: the event, its status, the maximum
+     * deferral time in minutes and the type of update.
+     */
+    SysEvent,
+
+    /**
+     * An Azure IoT connection change: the status and the reason.
+     */
+    IotConnection,
+
+    /**
+     * An Azure IoT telemetry confirmation: the result.
+     */
+    IotConfirmation,
+};
+
+/**
+ * @brief Recording of the inputs of the event loop.
+ */
+class InputRecorder
+{
+public:
+    /**
+     * @brief Input of the event loop.
+     */
+    struct Input
+    {
+        /**
+         * The time of the input, since the start of the recording, in
+         * nanoseconds.
+         */
+        uint64_t time_ns;
+
+        /**
+         * The values of the input, depending on its type.
+         */
+        uint32_t values[4];
+
+        /**
+         * The type of the input.
+         */
+        InputKind kind;
+    };
+
+    /**
+     * @brief Constructor.
+     */
+    InputRecorder() :
+        m_inputs(nullptr),
+        m_capacity(0),
+        m_count(0),
+        m_dropped(0),
+        m_start_ns(0),
+        m_timers(false)
+    {
+    }
+
+    /*
+     * The recorder is attached to a thread, and cannot be copied.
+     */
+    InputRecorder(const InputRecorder &other) = delete;
+    InputRecorder &operator =(const InputRecorder &other) = delete;
+
+    /**
+     * @brief Destructor.
+     */
+    virtual ~InputRecorder()
+    {
+        if (g_current == this) {
+            destroy();
+        }
+    }
+
+    /**
+     * @brief Initialize the recorder, and attach it to the calling thread,
+     *        which must be the thread running the event loop.
+     * @param[in] inputs The buffer of inputs.
+     * @param[in] capacity The number of inputs in the buffer.
+     * @param[in] timers Whether to record the timer expiries.
+     * @return True on success.
+     * @note The recording stops once the buffer is full, the inputs after
+     *       that are only counted.
+     */
+    virtual bool init(Input *const inputs, const size_t capacity,
+                      const bool timers = false)
+    {
+        AbortIf(g_current, false);
+        AbortIfNot(inputs, false);
+        AbortIfNot(capacity, false);
+
+        m_inputs = inputs;
+        m_capacity = capacity;
+        m_timers = timers;
+        clear();
+
+        g_current = this;
+
+        return true;
+    }
+
+    /**
+     * @brief Initialize the recorder.
+     * @tparam CAPACITY The number of inputs in the buffer.
+     * @param[in] inputs The buffer of inputs.
+     * @param[in] timers Whether to record the timer expiries.
+     * @return True on success.
+     * @see init
+     */
+    template<size_t CAPACITY>
+    bool init(Input (&inputs)[CAPACITY], const bool timers = false)
+    {
+        return init(inputs, CAPACITY, timers);
+    }
+
+    /**
+     * @brief Destroy the recorder.
+     * @return True on success.
+     * @note Must be invoked from the thread running the event loop.
+     */
+    virtual bool destroy()
+    {
+        AbortIfNot(g_current == this, false);
+
+        g_current = nullptr;
+
+        return true;
+    }
+
+    /**
+     * @brief Discard the inputs recorded, and restart the recording.
+     */
+    void clear()
+    {
+        m_count = 0;
+        m_dropped = 0;
+        m_start_ns = VirtualClock::now();
+    }
+
+    /**
+     * @brief Get the inputs recorded.
+     * @return The inputs.
+     */
+    const Input *inputs() const
+    {
+        return m_inputs;
+    }
+
+    /**
+     * @brief Get the number of inputs recorded.
+     * @return The number of inputs.
+     */
+    size_t count() const
+    {
+        return m_count;
+    }
+
+    /**
+     * @brief Get the number of inputs not recorded, for lack of space.
+     * @return The number of inputs.
+     */
+    uint32_t dropped() const
+    {
+        return m_dropped;
+    }
+
+    /**
+     * @brief Write the inputs recorded as text.
+     * @param[in] fd The file descriptor to write to.
+     * @return True on success.
+     */
+    bool write(const int fd) const
+    {
+        AbortIfNot(m_inputs, false);
+
+        for (size_t i = 0; i < m_count; i++) {
+            const Input &input = m_inputs[i];
+
+            AbortErrno(dprintf(fd, "%llu %s %u %u %u %u\n",
+                               static_cast<unsigned long long>(input.time_ns),
+                               inputKindName(input.kind), input.values[0],
+                               input.values[1], input.values[2],
+                               input.values[3]),
+                       false);
+        }
+
+        return true;
+    }
+
+    /**
+     * @brief Parse an input written as text.
+     * @param[in] line The line of text.
+     * @param[out] input The input.
+     * @return True on success.
+     */
+    static bool parse(const char *const line, Input &input)
+    {
+        unsigned long long time_ns;
+        char kind[24];
+
+        AbortIfNeq(sscanf(line, "%llu %23s %u %u %u %u", &time_ns, kind,
+                          &input.values[0], &input.values[1],
+                          &input.values[2], &input.values[3]),
+                   6, false);
+
+        uint8_t i = 0;
+        while (i < k_inputKinds &&
+               strcmp(kind, inputKindName(static_cast<InputKind>(i)))) {
+            i++;
+        }
+        AbortIfNot(i < k_inputKinds, false);
+
+        input.time_ns = time_ns;
+        input.kind = static_cast<InputKind>(i);
+
+        return true;
+    }
+
+    /**
+     * @brief Get the name of a type of input.
+     * @param[in] kind The type of input.
+     * @return The name.
+     */
+    static const char *inputKindName(const InputKind kind)
+    {
+        switch (kind) {
+            case InputKind::Timer:
+                return "timer";
+
+            case InputKind::Signal:
+                return "signal";
+
+            case InputKind::SysEvent:
+                return "sysevent";
+
+            case InputKind::IotConnection:
+                return "iot_connection";
+
+            case InputKind::IotConfirmation:
+                return "iot_confirmation";
+
+            default:
+                return "unknown";
+        }
+    }
+
+    /**
+     * @brief Record an input on the calling thread.
+     * @param[in] kind The type of the input.
+     * @param[in] value0, value1, value2, value3 The values of the input.
+     */
+    static void record(const InputKind kind, const uint32_t value0 = 0,
+                       const uint32_t value1 = 0, const uint32_t value2 = 0,
+                       const uint32_t value3 = 0)
+    {
+        InputRecorder *const recorder = g_current;
+        if (__builtin_expect(!recorder, 1) ||
+            (kind == InputKind::Timer && !recorder->m_timers)) {
+            return;
+        }
+
+        if (recorder->m_count == recorder->m_capacity) {
+            recorder->m_dropped++;
+            return;
+        }
+
+        Input &input = recorder->m_inputs[recorder->m_count++];
+        input.time_ns = VirtualClock::now() - recorder->m_start_ns;
+        input.values[0] = value0;
+        input.values[1] = value1;
+        input.values[2] = value2;
+        input.values[3] = value3;
+        input.kind = kind;
+    }
+
+private:
+    /**
+     * The number of types of input.
+     */
+    static constexpr uint8_t k_inputKinds =
+        static_cast<uint8_t>(InputKind::IotConfirmation) + 1;
+
+    /**
+     * The buffer of inputs.
+     */
+    Input *m_inputs;
+
+    /**
+     * The number of inputs in the buffer.
+     */
+    size_t m_capacity;
+
+    /**
+     * The number of inputs recorded.
+     */
+    size_t m_count;
+
+    /**
+     * The number of inputs not recorded, for lack of space.
+     */
+    uint32_t m_dropped;
+
+    /**
+     * The start of the recording, in nanoseconds.
+     */
+    uint64_t m_start_ns;
+
+    /**
+     * Whether to record the timer expiries.
+     */
+    bool m_timers;
+
+    /**
+     * The recorder attached to the current thread.
+     */
+    static __thread InputRecorder *g_current;
+};
+
+} /* namespace SpherePlusPlus */
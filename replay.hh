@@ -0,0 +1,345 @@
+/**
+ * @file replay.hh
+ * @author Matthieu Bucchianeri
+ * @brief Replay of recorded inputs of the event loop, on the host build.
+ *
+ * The inputs recorded on a device (see record.hh) are fed back into an
+ * application running on a virtual clock (see clock.hh), at their recorded
+ * time, through the controls of the host stand-ins: the system events are
+ * posted, the connection to Azure IoT Central is taken down and up, the
+ * telemetry messages are confirmed or failed in the recorded order, and the
+ * signals are raised. A day of traffic then replays in seconds, against each
+ * build of the application, to compare their CPU time and their callback
+ * latencies (see profiler.hh).
+ *
+ * The timer expiries are not replayed, they follow from the other inputs.
+ * Recording the replay and comparing it with the original recording shows
+ * whether the application behaved the same.
+ */
+
+#pragma once
+
+#ifndef SPHERE_PLUS_PLUS_HOST
+#error "The replay requires the host build"
+#endif
+
+#include <pthread.h>
+#include <signal.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include <applibs/sysevent.h>
+
+#include <azureiot/iothub_client_core_common.h>
+
+#include <host/iot.h>
+#include <host/sysevent.h>
+
+#include <sphereplusplus/abort.hh>
+#include <sphereplusplus/clock.hh>
+#include <sphereplusplus/delegate.hh>
+#include <sphereplusplus/record.hh>
+
+namespace SpherePlusPlus {
+
+/**
+ * @brief Replay of recorded inputs of the event loop.
+ */
+class InputReplayer
+{
+public:
+    /**
+     * @brief Input of the event loop.
+     */
+    using Input = InputRecorder::Input;
+
+    /**
+     * @brief Constructor.
+     */
+    InputReplayer() :
+        m_finished(),
+        m_inputs(nullptr),
+        m_count(0),
+        m_next(0),
+        m_confirmation(0),
+        m_clock(nullptr),
+        m_alarm(),
+        m_start_ns(0)
+    {
+    }
+
+    /*
+     * The replayer is attached to the host stand-ins, and cannot be copied.
+     */
+    InputReplayer(const InputReplayer &other) = delete;
+    InputReplayer &operator =(const InputReplayer &other) = delete;
+
+    /**
+     * @brief Destructor.
+     */
+    virtual ~InputReplayer()
+    {
+        if (m_clock) {
+            destroy();
+        }
+    }
+
+    /**
+     * @brief Initialize the replayer, and start the replay.
+     * @param[in] inputs The inputs to replay, in chronological order. They must
+     *            remain valid until the replayer is destroyed.
+     * @param[in] count The number of inputs.
+     * @return True on success.
+     * @note A virtual clock must be attached to the calling thread, which must
+     *       be the thread running the event loop.
+     */
+    virtual bool init(const Input *const inputs, const size_t count)
+    {
+        AbortIf(m_clock, false);
+        AbortIfNot(inputs || !count, false);
+
+        m_clock = VirtualClock::current();
+        AbortIfNot(m_clock, false);
+
+        m_inputs = inputs;
+        m_count = count;
+        m_next = 0;
+        m_confirmation = 0;
+        m_start_ns = m_clock->time();
+        m_alarm.expire = expire;
+        m_alarm.context = this;
+
+        HostIot_SetSink(sink, this);
+        scheduleNext();
+
+        return true;
+    }
+
+    /**
+     * @brief Destroy the replayer.
+     * @return True on success.
+     */
+    virtual bool destroy()
+    {
+        AbortIfNot(m_clock, false);
+
+        m_clock->cancel(m_alarm);
+        m_clock = nullptr;
+        HostIot_SetSink(nullptr, nullptr);
+
+        return true;
+    }
+
+    /**
+     * @brief Connect a class method to the end of the replay.
+     * @tparam T The class type.
+     * @tparam TMethod The class method.
+     * @param[in] instance The class instance.
+     */
+    template<class T, void (T::*TMethod)()>
+    void connect(T &instance)
+    {
+        m_finished.connect<T, TMethod>(instance);
+    }
+
+    /**
+     * @brief Connect a static method to the end of the replay.
+     * @tparam TFunc The static method.
+     */
+    template<void (*TFunc)()>
+    void connect()
+    {
+        m_finished.connect<TFunc>();
+    }
+
+    /**
+     * @brief Connect a lambda to the end of the replay.
+     * @tparam LAMBDA The lambda type.
+     * @param[in] instance The closure for the lambda.
+     */
+    template <typename LAMBDA>
+    void connect(const LAMBDA &instance)
+    {
+        m_finished.connect<LAMBDA>(instance);
+    }
+
+    /**
+     * @brief Whether all the inputs were replayed.
+     * @return True when the replay is finished.
+     */
+    bool finished() const
+    {
+        return m_next == m_count;
+    }
+
+    /**
+     * @brief Load a recording written as text (see InputRecorder::write()).
+     * @param[in] file The file to read from.
+     * @param[out] inputs The inputs.
+     * @param[in] capacity The maximum number of inputs.
+     * @param[out] count The number of inputs loaded.
+     * @return True on success, false on a malformed recording, or when the
+     *         recording does not fit.
+     */
+    static bool load(FILE *const file, Input *const inputs,
+                     const size_t capacity, size_t &count)
+    {
+        char line[128];
+
+        count = 0;
+        while (fgets(line, sizeof(line), file)) {
+            AbortIf(count == capacity, false);
+            AbortIfNot(InputRecorder::parse(line, inputs[count]), false);
+            count++;
+        }
+
+        return true;
+    }
+
+private:
+    /**
+     * @brief Schedule the next input to inject, or the end of the replay.
+     */
+    void scheduleNext()
+    {
+        /*
+         * The timer expiries follow from the other inputs, and the
+         * confirmations are consumed by the sink as the messages are sent.
+         */
+        while (m_next < m_count &&
+               (m_inputs[m_next].kind == InputKind::Timer ||
+                m_inputs[m_next].kind == InputKind::IotConfirmation)) {
+            m_next++;
+        }
+
+        if (m_next < m_count) {
+            m_clock->schedule(m_alarm, m_start_ns + m_inputs[m_next].time_ns);
+        } else if (m_count) {
+            /*
+             * End after the timers expiring with the last input.
+             */
+            m_clock->schedule(m_alarm,
+                              m_start_ns + m_inputs[m_count - 1].time_ns + 1);
+        } else {
+            m_finished();
+        }
+    }
+
+    /**
+     * @brief Virtual clock alarm callback. Injects the next input.
+     * @param[in] context The InputReplayer object.
+     */
+    static void expire(void *const context)
+    {
+        InputReplayer *const replayer = static_cast<InputReplayer *>(context);
+
+        if (replayer->m_next == replayer->m_count) {
+            replayer->m_finished();
+            return;
+        }
+
+        replayer->inject(replayer->m_inputs[replayer->m_next++]);
+        replayer->scheduleNext();
+    }
+
+    /**
+     * @brief Inject an input through the host stand-ins.
+     * @param[in] input The input.
+     */
+    void inject(const Input &input)
+    {
+        switch (input.kind) {
+            case InputKind::Signal:
+                AbortIfNeq(pthread_kill(pthread_self(), input.values[0]), 0);
+                break;
+
+            case InputKind::SysEvent: {
+                SysEvent_Info_UpdateData update;
+                update.max_deferral_time_in_minutes = input.values[2];
+                update.update_type =
+                    static_cast<SysEvent_UpdateType>(input.values[3]);
+                AbortErrno(HostSysEvent_Post(
+                    static_cast<SysEvent_Events>(input.values[0]),
+                    static_cast<SysEvent_Status>(input.values[1]), &update));
+                break;
+            }
+
+            case InputKind::IotConnection:
+                HostIot_SetNetworkAvailable(
+                    input.values[0] == IOTHUB_CLIENT_CONNECTION_AUTHENTICATED);
+                break;
+
+            default:
+                break;
+        }
+    }
+
+    /**
+     * @brief Hub stand-in, confirming or failing the messages in the
+     *        recorded order.
+     */
+    static bool sink(const char *const idScope, const char *const deviceId,
+                     const unsigned char *const message, const size_t size,
+                     void *const context)
+    {
+        InputReplayer *const replayer = static_cast<InputReplayer *>(context);
+
+        /*
+         * Only the confirmations received from the hub are replayed, the
+         * other ones follow from the state of the client.
+         */
+        while (replayer->m_confirmation < replayer->m_count) {
+            const Input &input = replayer->m_inputs[replayer->m_confirmation++];
+            if (input.kind == InputKind::IotConfirmation &&
+                (input.values[0] == IOTHUB_CLIENT_CONFIRMATION_OK ||
+                 input.values[0] == IOTHUB_CLIENT_CONFIRMATION_ERROR)) {
+                return input.values[0] == IOTHUB_CLIENT_CONFIRMATION_OK;
+            }
+        }
+
+        return true;
+    }
+
+    /**
+     * The callback invoked at the end of the replay.
+     */
+    Delegate<void()> m_finished;
+
+    /**
+     * The inputs to replay.
+     */
+    const Input *m_inputs;
+
+    /**
+     * The number of inputs.
+     */
+    size_t m_count;
+
+    /**
+     * The next input to inject.
+     */
+    size_t m_next;
+
+    /**
+     * The next input to search for a confirmation.
+     */
+    size_t m_confirmation;
+
+    /**
+     * The virtual clock of the replay.
+     */
+    VirtualClock *m_clock;
+
+    /**
+     * The time of the next input on the virtual clock.
+     */
+    VirtualClock::Alarm m_alarm;
+
+    /**
+     * The start of the replay on the virtual clock, in nanoseconds.
+     */
+    uint64_t m_start_ns;
+};
+
+} /* namespace SpherePlusPlus */
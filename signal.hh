@@ -0,0 +1,256 @@
+/**
+ * @file signal.hh
+ * @author Matthieu Bucchianeri
+ * @brief Process signals delivered through the event loop.
+ */
+
+#pragma once
+
+#include <sys/signalfd.h>
+#include <errno.h>
+#include <pthread.h>
+#include <signal.h>
+#include <unistd.h>
+
+#include <applibs/eventloop.h>
+
+#include <sphereplusplus/abort.hh>
+#include <sphereplusplus/delegate.hh>
+
+#include "internal.hh"
+
+namespace SpherePlusPlus {
+
+/**
+ * @brief Process signal delivered through the event loop.
+ *
+ * The signal is blocked and read from a signalfd, so that its callback runs
+ * from the event loop as ordinary code, rather than in the asynchronous
+ * context of a signal handler.
+ *
+ * @note The signal is only blocked for the calling thread and the threads it
+ *       creates afterwards. The signal must be initialized before creating
+ *       other threads, otherwise it may be delivered to them instead.
+ */
+class Signal
+{
+public:
+    /**
+     * @brief Constructor.
+     */
+    Signal() :
+        m_callback(),
+        m_signo(0),
+        m_signalFd(-1),
+        m_eventLoop(nullptr),
+        m_event(nullptr),
+        m_wasBlocked(false)
+    {
+    }
+
+    /*
+     * Signals own a file descriptor and cannot be copied.
+     */
+    Signal(const Signal &other) = delete;
+    Signal &operator =(const Signal &other) = delete;
+
+    /**
+     * @brief Destructor.
+     */
+    virtual ~Signal()
+    {
+        if (m_signalFd >= 0) {
+            destroy();
+        }
+    }
+
+    /**
+     * @brief Initialize the signal, on the event loop of the calling thread.
+     * @param[in] signo The signal number.
+     * @return True on success.
+     */
+    virtual bool init(const int signo)
+    {
+        return init(signo, getEventLoop());
+    }
+
+    /**
+     * @brief Initialize the signal, on a given event loop.
+     * @param[in] signo The signal number.
+     * @param[in] eventLoop The event loop.
+     * @return True on success.
+     * @note The signal is blocked for the calling thread, which should be the
+     *       thread running the event loop.
+     */
+    virtual bool init(const int signo, EventLoop *const eventLoop)
+    {
+        AbortIf(m_signalFd >= 0, false);
+        AbortIfNot(eventLoop, false);
+
+        sigset_t mask;
+        AbortErrno(sigemptyset(&mask), false);
+        AbortErrno(sigaddset(&mask, signo), false);
+
+        sigset_t oldMask;
+        AbortIfNeq(pthread_sigmask(SIG_BLOCK, &mask, &oldMask), 0, false);
+        m_wasBlocked = sigismember(&oldMask, signo) == 1;
+
+        const int signalFd = signalfd(-1, &mask, SFD_NONBLOCK | SFD_CLOEXEC);
+        EventRegistration *event = nullptr;
+        if (signalFd >= 0) {
+            event = EventLoop_RegisterIo(eventLoop, signalFd, EventLoop_Input,
+                                         callback, this);
+            if (!event) {
+                close(signalFd);
+            }
+        }
+
+        if (!event && !m_wasBlocked) {
+            pthread_sigmask(SIG_UNBLOCK, &mask, nullptr);
+        }
+        AbortErrno(signalFd, false);
+        AbortErrnoPtr(event, false);
+
+        m_signalFd = signalFd;
+        m_signo = signo;
+        m_eventLoop = eventLoop;
+        m_event = event;
+
+        return true;
+    }
+
+    /**
+     * @brief Destroy the signal, and restore its default handling.
+     * @return True on success.
+     */
+    virtual bool destroy()
+    {
+        AbortIfNot(m_signalFd >= 0, false);
+
+        AbortErrno(EventLoop_UnregisterIo(m_eventLoop, m_event), false);
+        m_event = nullptr;
+        m_eventLoop = nullptr;
+
+        AbortErrno(close(m_signalFd), false);
+        m_signalFd = -1;
+
+        if (!m_wasBlocked) {
+            sigset_t mask;
+            AbortErrno(sigemptyset(&mask), false);
+            AbortErrno(sigaddset(&mask, m_signo), false);
+            AbortIfNeq(pthread_sigmask(SIG_UNBLOCK, &mask, nullptr), 0,
+                       false);
+        }
+
+        return true;
+    }
+
+    /**
+     * @brief Connect a class method to the signal.
+     * @tparam T The class type.
+     * @tparam TMethod The class method.
+     * @param[in] instance The class instance.
+     */
+    template<class T, void (T::*TMethod)()>
+    void connect(T &instance)
+    {
+        m_callback.connect<T, TMethod>(instance);
+    }
+
+    /**
+     * @brief Connect a static method to the signal.
+     * @tparam TFunc The static method.
+     */
+    template<void (*TFunc)()>
+    void connect()
+    {
+        m_callback.connect<TFunc>();
+    }
+
+    /**
+     * @brief Connect a lambda to the signal.
+     * @tparam LAMBDA The lambda type.
+     * @param[in] instance The closure for the lambda.
+     */
+    template <typename LAMBDA>
+    void connect(const LAMBDA &instance)
+    {
+        m_callback.connect<LAMBDA>(instance);
+    }
+
+    /**
+     * @brief Get the signal number.
+     * @return The signal number, or 0 if not initialized.
+     */
+    int signo() const
+    {
+        return m_signo;
+    }
+
+private:
+    /**
+     * @brief Signal callback. Invokes the user callback.
+     * @param[in] el The event loop.
+     * @param[in] fd The file descriptor that triggered the event.
+     * @param[in] events The type of the event.
+     * @param[in] context The Signal object.
+     */
+    static void callback(EventLoop *const el, const int fd,
+                         const EventLoop_IoEvents events, void *const context)
+    {
+        Assert(events == EventLoop_Input);
+
+        Signal *const signal = static_cast<Signal *>(context);
+        Assert(fd == signal->m_signalFd);
+
+        /*
+         * Pending instances of the same signal are merged by the kernel, a
+         * single read consumes them.
+         */
+        struct signalfd_siginfo info;
+        const ssize_t count = read(signal->m_signalFd, &info, sizeof(info));
+        if (count < 0 && errno == EAGAIN) {
+            return;
+        }
+        AbortIfNot(count == sizeof(info));
+
+        InputRecorder::record(InputKind::Signal, signal->m_signo);
+
+        DispatchScope scope(DispatchKind::Signal,
+                            signal->m_callback.callback(),
+                            signal->m_callback.object());
+        signal->m_callback();
+    }
+
+    /**
+     * The signal's user callback.
+     */
+    Delegate<void()> m_callback;
+
+    /**
+     * The signal number.
+     */
+    int m_signo;
+
+    /**
+     * The underlying file descriptor of the signal.
+     */
+    int m_signalFd;
+
+    /**
+     * The event loop the signal is registered with.
+     */
+    EventLoop *m_eventLoop;
+
+    /**
+     * The event handler.
+     */
+    EventRegistration *m_event;
+
+    /**
+     * Whether the signal was already blocked before initialization.
+     */
+    bool m_wasBlocked;
+};
+
+} /* namespace SpherePlusPlus */
@@ -5,16 +5,122 @@
  */
 
 #include <stddef.h>
+#include <stdint.h>
+#include <string.h>
 
 #include <sphereplusplus/abort.hh>
 #include <sphereplusplus/application.hh>
+#include <sphereplusplus/clock.hh>
+#include <sphereplusplus/energy.hh>
+#include <sphereplusplus/health.hh>
+#include <sphereplusplus/heap.hh>
+#include <sphereplusplus/load.hh>
+#include <sphereplusplus/loop.hh>
+#include <sphereplusplus/metrics.hh>
+#include <sphereplusplus/power.hh>
+#include <sphereplusplus/profiler.hh>
+#include <sphereplusplus/record.hh>
+#include <sphereplusplus/stall.hh>
+#include <sphereplusplus/timer.hh>
+#include <sphereplusplus/tracer.hh>
+#include <sphereplusplus/update.hh>
 
 #include <applibs/eventloop.h>
 
 #include "internal.hh"
 
+#ifdef SPHERE_PLUS_PLUS_HEAP_PROFILER
+
 /*
- * Define this symbol to keep the compiler happy with virtual destructors.
+ * Heap profiler hooks. The allocator functions are wrapped by the linker (see
+ * heap.hh), and operator new/delete are routed to the profiler too.
+ */
+extern "C" {
+
+void *__wrap_malloc(size_t size)
+{
+    return SpherePlusPlus::HeapProfiler::allocate(size,
+                                                  __builtin_return_address(0));
+}
+
+void *__wrap_calloc(size_t count, size_t size)
+{
+    if (size && count > SIZE_MAX / size) {
+        return nullptr;
+    }
+
+    void *const ptr = SpherePlusPlus::HeapProfiler::allocate(
+        count * size, __builtin_return_address(0));
+    if (ptr) {
+        memset(ptr, 0, count * size);
+    }
+
+    return ptr;
+}
+
+void *__wrap_realloc(void *ptr, size_t size)
+{
+    return SpherePlusPlus::HeapProfiler::reallocate(
+        ptr, size, __builtin_return_address(0));
+}
+
+void __wrap_free(void *ptr)
+{
+    SpherePlusPlus::HeapProfiler::release(ptr);
+}
+
+}
+
+void *operator new(size_t size)
+{
+    return SpherePlusPlus::HeapProfiler::allocate(size,
+                                                  __builtin_return_address(0));
+}
+
+void *operator new[](size_t size)
+{
+    return SpherePlusPlus::HeapProfiler::allocate(size,
+                                                  __builtin_return_address(0));
+}
+
+void operator delete(void *p) noexcept
+{
+    SpherePlusPlus::HeapProfiler::release(p);
+}
+
+void operator delete[](void *p) noexcept
+{
+    SpherePlusPlus::HeapProfiler::release(p);
+}
+
+void operator delete(void *p, size_t size) noexcept
+{
+    (void)size;
+
+    SpherePlusPlus::HeapProfiler::release(p);
+}
+
+void operator delete[](void *p, size_t size) noexcept
+{
+    (void)size;
+
+    SpherePlusPlus::HeapProfiler::release(p);
+}
+
+namespace SpherePlusPlus {
+
+HeapProfiler::Site HeapProfiler::g_sites[HeapProfiler::k_maxSites] = {};
+HeapProfiler::Block HeapProfiler::g_blocks[HeapProfiler::k_tableSize] = {};
+size_t HeapProfiler::g_blockCount = 0;
+SpinLock HeapProfiler::g_lock;
+
+} /* namespace SpherePlusPlus */
+
+#elif !defined(SPHERE_PLUS_PLUS_HOST)
+
+/*
+ * Define this symbol to keep the compiler happy with virtual destructors. The
+ * host build links the C++ runtime, which defines it.
  */
 void operator delete(void *p, size_t size)
 {
@@ -22,6 +128,8 @@ void operator delete(void *p, size_t size)
     (void)size;
 }
 
+#endif
+
 /*
  * This definition is somehow missing from the Azure IoT library on Sphere.
  */
@@ -141,11 +249,51 @@ namespace SpherePlusPlus {
 
 EventLoop *getEventLoop()
 {
-    AbortIfNot(Application::g_application, nullptr);
+    if (ApplicationBase::g_current) {
+        return ApplicationBase::g_current->m_eventLoop;
+    }
+
+    AbortIfNot(EventLoopThread::g_current, nullptr);
+
+    return EventLoopThread::g_current->m_eventLoop;
+}
+
+Timer **getArmedTimers(const EventLoop *const eventLoop)
+{
+    ApplicationBase *const application = ApplicationBase::g_current;
+    if (!application || application->m_eventLoop != eventLoop) {
+        return nullptr;
+    }
 
-    return Application::g_application->m_eventLoop;
+    return &application->m_timers;
 }
 
-Application *Application::g_application = nullptr;
+__thread ApplicationBase *ApplicationBase::g_current = nullptr;
+
+__thread EventLoopThread *EventLoopThread::g_current = nullptr;
+
+__thread StallDetector *StallDetector::g_current = nullptr;
+
+__thread CallbackProfiler *CallbackProfiler::g_current = nullptr;
+
+__thread LoadMonitor *LoadMonitor::g_current = nullptr;
+
+__thread EnergyModel *EnergyModel::g_current = nullptr;
+
+__thread Tracer *Tracer::g_current = nullptr;
+
+__thread InputRecorder *InputRecorder::g_current = nullptr;
+
+__thread VirtualClock *VirtualClock::g_current = nullptr;
+
+Metric *Metric::g_metrics = nullptr;
+
+SpinLock Metric::g_lock;
+
+constexpr HealthReporter::Policy HealthReporter::k_defaultPolicy;
+constexpr UpdatePolicy::Policy UpdatePolicy::k_defaultPolicy;
+constexpr PowerScheduler::Policy PowerScheduler::k_defaultPolicy;
+constexpr PowerGovernor::Policy PowerGovernor::k_defaultPolicy;
+constexpr EnergyModel::Coefficients EnergyModel::k_defaultCoefficients;
 
 } /* namespace SpherePlusPlus */
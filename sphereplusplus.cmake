@@ -0,0 +1,69 @@
+# @file sphereplusplus.cmake
+# @author Matthieu Bucchianeri
+# @brief CMake helpers for applications using the Sphere++ library.
+#
+# Include this file from the application's CMakeLists.txt:
+#
+#   include(sphereplusplus/sphereplusplus.cmake)
+
+set(SPHERE_PLUS_PLUS_DIR ${CMAKE_CURRENT_LIST_DIR})
+
+# sphereplusplus_footprint(<target> [BUDGET <header>])
+#
+# Add a <target>-footprint target, reporting the size of the library classes
+# and the flash and static RAM contribution of each feature, from the linker
+# map of <target>. When a budget header is given, it is checked at compile time
+# (see budget.hh) by both <target> and the report.
+function(sphereplusplus_footprint TARGET)
+    cmake_parse_arguments(FOOTPRINT "" "BUDGET" "" ${ARGN})
+
+    find_package(Python3 COMPONENTS Interpreter REQUIRED)
+
+    set(MAP_FILE ${CMAKE_CURRENT_BINARY_DIR}/${TARGET}.map)
+    set(SIZES_TARGET ${TARGET}-footprint-sizes)
+
+    target_compile_options(${TARGET} PRIVATE
+        -ffunction-sections -fdata-sections)
+    target_link_options(${TARGET} PRIVATE -Wl,-Map=${MAP_FILE})
+
+    # The class sizes come from an object that is never linked, built with the
+    # same options as the application.
+    add_library(${SIZES_TARGET} OBJECT
+        ${SPHERE_PLUS_PLUS_DIR}/tools/footprint.cc)
+    target_include_directories(${SIZES_TARGET} PRIVATE
+        $<TARGET_PROPERTY:${TARGET},INCLUDE_DIRECTORIES>)
+    target_compile_options(${SIZES_TARGET} PRIVATE
+        $<TARGET_PROPERTY:${TARGET},COMPILE_OPTIONS>)
+    target_compile_definitions(${SIZES_TARGET} PRIVATE
+        $<TARGET_PROPERTY:${TARGET},COMPILE_DEFINITIONS>)
+
+    if(FOOTPRINT_BUDGET)
+        get_filename_component(BUDGET ${FOOTPRINT_BUDGET} ABSOLUTE)
+        target_compile_definitions(${TARGET} PRIVATE
+            SPHERE_PLUS_PLUS_BUDGET_HEADER="${BUDGET}")
+        target_compile_definitions(${SIZES_TARGET} PRIVATE
+            SPHERE_PLUS_PLUS_BUDGET_HEADER="${BUDGET}")
+    endif()
+
+    add_custom_target(${TARGET}-footprint
+        COMMAND ${Python3_EXECUTABLE}
+            ${SPHERE_PLUS_PLUS_DIR}/tools/footprint.py
+            --nm ${CMAKE_NM}
+            --sizes $<TARGET_OBJECTS:${SIZES_TARGET}>
+            --map ${MAP_FILE}
+        DEPENDS ${TARGET} ${SIZES_TARGET}
+        COMMAND_EXPAND_LISTS
+        VERBATIM)
+endfunction()
+
+# sphereplusplus_heap_profiler(<target>)
+#
+# Build <target> with the heap profiler (see heap.hh): the library records the
+# heap usage of each call site, for allocations made with malloc() and friends,
+# or with operator new.
+function(sphereplusplus_heap_profiler TARGET)
+    target_compile_definitions(${TARGET} PRIVATE
+        SPHERE_PLUS_PLUS_HEAP_PROFILER)
+    target_link_options(${TARGET} PRIVATE
+        -Wl,--wrap=malloc,--wrap=free,--wrap=calloc,--wrap=realloc)
+endfunction()
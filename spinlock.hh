@@ -0,0 +1,61 @@
+/**
+ * @file spinlock.hh
+ * @author Matthieu Bucchianeri
+ * @brief Spinlock for short critical sections.
+ *
+ * The spinlock protects the process-wide tables (metrics registry, heap
+ * profiler) updated from any thread. It can be constant-initialized, so that
+ * it is usable before the static constructors run, such as from the
+ * allocator hooks of the heap profiler.
+ */
+
+#pragma once
+
+namespace SpherePlusPlus {
+
+/**
+ * @brief Spinlock for short critical sections.
+ * @note The critical sections must not block, nor invoke system calls.
+ */
+class SpinLock
+{
+public:
+    /**
+     * @brief Constructor.
+     */
+    constexpr SpinLock() :
+        m_locked(false)
+    {
+    }
+
+    /*
+     * The lock is shared by address, and cannot be copied.
+     */
+    SpinLock(const SpinLock &other) = delete;
+    SpinLock &operator =(const SpinLock &other) = delete;
+
+    /**
+     * @brief Acquire the lock.
+     */
+    void lock()
+    {
+        while (__atomic_test_and_set(&m_locked, __ATOMIC_ACQUIRE)) {
+        }
+    }
+
+    /**
+     * @brief Release the lock.
+     */
+    void unlock()
+    {
+        __atomic_clear(&m_locked, __ATOMIC_RELEASE);
+    }
+
+private:
+    /**
+     * Whether the lock is held.
+     */
+    bool m_locked;
+};
+
+} /* namespace SpherePlusPlus */
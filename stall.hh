@@ -0,0 +1,434 @@
+/**
+ * @file stall.hh
+ * @author Matthieu Bucchianeri
+ * @brief Event loop stall detector.
+ *
+ * The callbacks dispatched from the event loop (see internal.hh) stamp a
+ * sequence counter when they start and when they return. A monitor thread
+ * watches the counter, and reports the callbacks that hold the event loop for
+ * longer than a threshold, without needing a stack trace: the callback is
+ * identified by the address of its delegate stub (or static callback) and its
+ * object, which can be resolved with addr2line.
+ *
+ * A callback dispatched from within another callback (such as an IoT callback
+ * invoked while pumping the IoT client) is accounted to the outer callback.
+ */
+
+#pragma once
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <time.h>
+
+#include <sphereplusplus/abort.hh>
+#include <sphereplusplus/clock.hh>
+#include <sphereplusplus/delegate.hh>
+#include <sphereplusplus/dispatch.hh>
+
+namespace SpherePlusPlus {
+
+/**
+ * @brief Event loop stall detector.
+ */
+class StallDetector
+{
+public:
+    /**
+     * The default threshold, in milliseconds.
+     */
+    static constexpr uint32_t k_defaultThreshold = 100;
+
+    /**
+     * @brief A callback that held the event loop for too long.
+     */
+    struct Report
+    {
+        /**
+         * The type of the callback.
+         */
+        DispatchKind kind;
+
+        /**
+         * The callback (delegate stub or static callback).
+         */
+        const void *callback;
+
+        /**
+         * The object passed to the callback.
+         */
+        const void *object;
+
+        /**
+         * For how long the callback has been running, in milliseconds.
+         */
+        uint32_t duration_ms;
+
+        /**
+         * The event loop iteration.
+         */
+        uint32_t iteration;
+    };
+
+    /**
+     * @brief Constructor.
+     */
+    StallDetector() :
+        m_sequence(0),
+        m_depth(0),
+        m_iteration(0),
+        m_start_ns(0),
+        m_kind(DispatchKind::Timer),
+        m_callback(nullptr),
+        m_object(nullptr),
+        m_threshold_ns(k_defaultThreshold * 1000000ull),
+        m_reportedSequence(0),
+        m_report(),
+        m_monitor(),
+        m_monitorRunning(false),
+        m_lock(),
+        m_wakeup()
+    {
+    }
+
+    /*
+     * The detector runs a thread, and cannot be copied.
+     */
+    StallDetector(const StallDetector &other) = delete;
+    StallDetector &operator =(const StallDetector &other) = delete;
+
+    /**
+     * @brief Destructor.
+     */
+    virtual ~StallDetector()
+    {
+        if (m_monitorRunning) {
+            destroy();
+        }
+    }
+
+    /**
+     * @brief Initialize the detector, and attach it to the calling thread,
+     *        which must be the thread running the event loop.
+     * @param[in] threshold_ms The threshold, in milliseconds.
+     * @return True on success.
+     */
+    virtual bool init(const uint32_t threshold_ms = k_defaultThreshold)
+    {
+        AbortIf(m_monitorRunning, false);
+        AbortIf(g_current, false);
+        AbortIfNot(threshold_ms > 0, false);
+
+        m_threshold_ns = threshold_ms * 1000000ull;
+
+        pthread_condattr_t attr;
+        AbortIfNeq(pthread_condattr_init(&attr), 0, false);
+        int status = pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+        if (status == 0) {
+            status = pthread_cond_init(&m_wakeup, &attr);
+        }
+        pthread_condattr_destroy(&attr);
+        AbortIfNeq(status, 0, false);
+
+        status = pthread_mutex_init(&m_lock, nullptr);
+        if (status != 0) {
+            pthread_cond_destroy(&m_wakeup);
+        }
+        AbortIfNeq(status, 0, false);
+
+        /*
+         * The monitor thread waits for the lock, so it only sees the detector
+         * running once the thread is created.
+         */
+        pthread_mutex_lock(&m_lock);
+        status = pthread_create(&m_monitor, nullptr, monitor, this);
+        m_monitorRunning = status == 0;
+        pthread_mutex_unlock(&m_lock);
+
+        if (!m_monitorRunning) {
+            pthread_mutex_destroy(&m_lock);
+            pthread_cond_destroy(&m_wakeup);
+        }
+        AbortIfNeq(status, 0, false);
+
+        g_current = this;
+
+        return true;
+    }
+
+    /**
+     * @brief Destroy the detector.
+     * @return True on success.
+     * @note Must be invoked from the thread running the event loop.
+     */
+    virtual bool destroy()
+    {
+        AbortIfNot(m_monitorRunning, false);
+        AbortIfNot(g_current == this, false);
+
+        g_current = nullptr;
+
+        pthread_mutex_lock(&m_lock);
+        m_monitorRunning = false;
+        pthread_cond_signal(&m_wakeup);
+        pthread_mutex_unlock(&m_lock);
+
+        AbortIfNeq(pthread_join(m_monitor, nullptr), 0, false);
+        pthread_cond_destroy(&m_wakeup);
+        pthread_mutex_destroy(&m_lock);
+
+        return true;
+    }
+
+    /**
+     * @brief Connect a class method to the stall reports.
+     * @tparam T The class type.
+     * @tparam TMethod The class method.
+     * @param[in] instance The class instance.
+     *
+     * @note The callback is invoked from the monitor thread, while the event
+     *       loop is stalled. Without a callback, the reports are logged.
+     */
+    template<class T, void (T::*TMethod)(const Report &)>
+    void connect(T &instance)
+    {
+        m_report.connect<T, TMethod>(instance);
+    }
+
+    /**
+     * @brief Connect a static method to the stall reports.
+     * @tparam TFunc The static method.
+     * @see connect
+     */
+    template<void (*TFunc)(const Report &)>
+    void connect()
+    {
+        m_report.connect<TFunc>();
+    }
+
+    /**
+     * @brief Mark the start of a callback on the calling thread.
+     * @param[in] kind The type of the callback.
+     * @param[in] callback The callback.
+     * @param[in] object The object passed to the callback.
+     */
+    static void enter(const DispatchKind kind, const void *const callback,
+                      const void *const object)
+    {
+        StallDetector *const detector = g_current;
+        if (__builtin_expect(!detector, 1)) {
+            return;
+        }
+        if (detector->m_depth++) {
+            return;
+        }
+
+        __atomic_thread_fence(__ATOMIC_RELEASE);
+        __atomic_store_n(&detector->m_kind, kind, __ATOMIC_RELAXED);
+        __atomic_store_n(&detector->m_callback, callback, __ATOMIC_RELAXED);
+        __atomic_store_n(&detector->m_object, object, __ATOMIC_RELAXED);
+        __atomic_store_n(&detector->m_start_ns, readClock(), __ATOMIC_RELAXED);
+        __atomic_add_fetch(&detector->m_sequence, 1, __ATOMIC_RELEASE);
+    }
+
+    /**
+     * @brief Mark the end of a callback on the calling thread.
+     */
+    static void leave()
+    {
+        StallDetector *const detector = g_current;
+        if (__builtin_expect(!detector, 1)) {
+            return;
+        }
+        /*
+         * Ignore the end of a callback that started before the detector was
+         * attached.
+         */
+        if (!detector->m_depth || --detector->m_depth) {
+            return;
+        }
+
+        const uint32_t sequence =
+            __atomic_add_fetch(&detector->m_sequence, 1, __ATOMIC_RELEASE);
+
+        /*
+         * Log the total duration of a callback that was reported.
+         */
+        if (__atomic_load_n(&detector->m_reportedSequence,
+                            __ATOMIC_RELAXED) == sequence - 1) {
+            Log_Debug("Event loop stall ended after %u ms\n",
+                      static_cast<uint32_t>(
+                          (readClock() - detector->m_start_ns) / 1000000));
+        }
+    }
+
+    /**
+     * @brief Mark an iteration of the event loop on the calling thread.
+     */
+    static void iterate()
+    {
+        StallDetector *const detector = g_current;
+        if (__builtin_expect(!detector, 1)) {
+            return;
+        }
+
+        __atomic_add_fetch(&detector->m_iteration, 1, __ATOMIC_RELAXED);
+    }
+
+private:
+    /**
+     * @brief Check whether the event loop is stalled. Invoked from the monitor
+     *        thread.
+     */
+    void check()
+    {
+        /*
+         * The sequence is odd while a callback is running. Read the callback
+         * and validate it with the sequence, in case it returned meanwhile.
+         */
+        const uint32_t sequence =
+            __atomic_load_n(&m_sequence, __ATOMIC_ACQUIRE);
+        if (!(sequence & 1) || sequence == m_reportedSequence) {
+            return;
+        }
+
+        Report report;
+        report.kind = __atomic_load_n(&m_kind, __ATOMIC_RELAXED);
+        report.callback = __atomic_load_n(&m_callback, __ATOMIC_RELAXED);
+        report.object = __atomic_load_n(&m_object, __ATOMIC_RELAXED);
+        const uint64_t start = __atomic_load_n(&m_start_ns, __ATOMIC_RELAXED);
+        report.iteration = __atomic_load_n(&m_iteration, __ATOMIC_RELAXED);
+
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        if (__atomic_load_n(&m_sequence, __ATOMIC_RELAXED) != sequence) {
+            return;
+        }
+
+        const uint64_t duration = readClock() - start;
+        if (duration < m_threshold_ns) {
+            return;
+        }
+
+        report.duration_ms = static_cast<uint32_t>(duration / 1000000);
+        __atomic_store_n(&m_reportedSequence, sequence, __ATOMIC_RELAXED);
+
+        if (m_report) {
+            m_report(report);
+        } else {
+            Log_Debug("Event loop stalled for %u ms in %s callback %p "
+                      "(object %p, iteration %u)\n",
+                      report.duration_ms, dispatchKindName(report.kind),
+                      report.callback, report.object, report.iteration);
+        }
+    }
+
+    /**
+     * @brief Monitor thread.
+     * @param[in] context The StallDetector object.
+     * @return Unused.
+     */
+    static void *monitor(void *const context)
+    {
+        StallDetector *const detector = static_cast<StallDetector *>(context);
+
+        /*
+         * Poll twice per threshold, so stalls are reported at most 1.5 times
+         * the threshold after they started.
+         */
+        const uint64_t period = detector->m_threshold_ns / 2;
+
+        pthread_mutex_lock(&detector->m_lock);
+        while (detector->m_monitorRunning) {
+            struct timespec deadline;
+            clock_gettime(CLOCK_MONOTONIC, &deadline);
+            deadline.tv_sec += period / 1000000000;
+            deadline.tv_nsec += period % 1000000000;
+            if (deadline.tv_nsec >= 1000000000) {
+                deadline.tv_sec++;
+                deadline.tv_nsec -= 1000000000;
+            }
+
+            if (pthread_cond_timedwait(&detector->m_wakeup, &detector->m_lock,
+                                       &deadline) == ETIMEDOUT) {
+                detector->check();
+            }
+        }
+        pthread_mutex_unlock(&detector->m_lock);
+
+        return nullptr;
+    }
+
+    /**
+     * The sequence counter, odd while a callback is running.
+     */
+    uint32_t m_sequence;
+
+    /**
+     * The nesting depth of the running callbacks, only accessed from the
+     * thread running the event loop.
+     */
+    uint32_t m_depth;
+
+    /**
+     * The event loop iteration counter.
+     */
+    uint32_t m_iteration;
+
+    /**
+     * The start of the running callback, in nanoseconds.
+     */
+    uint64_t m_start_ns;
+
+    /**
+     * The running callback.
+     * @{
+     */
+    DispatchKind m_kind;
+    const void *m_callback;
+    const void *m_object;
+    /**
+     * @}
+     */
+
+    /**
+     * The threshold, in nanoseconds.
+     */
+    uint64_t m_threshold_ns;
+
+    /**
+     * The sequence of the last stall reported.
+     */
+    uint32_t m_reportedSequence;
+
+    /**
+     * The report callback.
+     */
+    Delegate<void(const Report &)> m_report;
+
+    /**
+     * The monitor thread.
+     */
+    pthread_t m_monitor;
+
+    /**
+     * Whether the monitor thread must keep running.
+     */
+    bool m_monitorRunning;
+
+    /**
+     * The lock and condition to wake up the monitor thread.
+     * @{
+     */
+    pthread_mutex_t m_lock;
+    pthread_cond_t m_wakeup;
+    /**
+     * @}
+     */
+
+    /**
+     * The detector attached to the current thread.
+     */
+    static __thread StallDetector *g_current;
+};
+
+} /* namespace SpherePlusPlus */
@@ -6,8 +6,53 @@
 
  #pragma once
 
+#include <stddef.h>
+
+/*
+ * The substitutions are only defined when the toolchain does not ship the
+ * standard headers, so that they do not collide with them (such as on the host
+ * build).
+ */
+#if defined(SPHERE_PLUS_PLUS_HOST)
+#define SPHERE_PLUS_PLUS_STD_HEADERS
+#elif defined(__has_include)
+#if __has_include(<new>) && __has_include(<type_traits>) && \
+    __has_include(<utility>) && __has_include(<array>)
+#define SPHERE_PLUS_PLUS_STD_HEADERS
+#endif
+#endif
+
+#ifdef SPHERE_PLUS_PLUS_STD_HEADERS
+
+#include <array>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+#if __cplusplus >= 201703L
+#include <optional>
+#endif
+
+#else
+
+/*
+ * Placement new.
+ *
+ * The toolchain does not ship the <new> header, this is the only form of
+ * operator new needed by the library.
+ */
+inline void *operator new(size_t size, void *ptr) noexcept
+{
+    (void)size;
+
+    return ptr;
+}
+
+#endif
+
 namespace std
 {
+#ifndef SPHERE_PLUS_PLUS_STD_HEADERS
     /*
      * std::enable_if
      *
@@ -25,4 +70,406 @@ namespace std
 
     template <bool B, typename T = void>
     using enable_if_t = typename enable_if<B, T>::type;
+
+    /*
+     * std::integral_constant
+     */
+    template <typename T, T v>
+    struct integral_constant {
+        static constexpr T value = v;
+        typedef T value_type;
+        typedef integral_constant type;
+
+        constexpr operator value_type() const noexcept { return value; }
+        constexpr value_type operator ()() const noexcept { return value; }
+    };
+
+    template <typename T, T v>
+    constexpr T integral_constant<T, v>::value;
+
+    template <bool B>
+    using bool_constant = integral_constant<bool, B>;
+
+    typedef bool_constant<true> true_type;
+    typedef bool_constant<false> false_type;
+
+    /*
+     * std::conditional
+     */
+    template <bool B, typename T, typename F>
+    struct conditional {
+        typedef T type;
+    };
+
+    template <typename T, typename F>
+    struct conditional<false, T, F> {
+        typedef F type;
+    };
+
+    template <bool B, typename T, typename F>
+    using conditional_t = typename conditional<B, T, F>::type;
+
+    /*
+     * std::is_same
+     */
+    template <typename T, typename U>
+    struct is_same : false_type
+    {};
+
+    template <typename T>
+    struct is_same<T, T> : true_type
+    {};
+
+    /*
+     * std::remove_reference, std::remove_const, std::remove_volatile and
+     * std::remove_cv
+     */
+    template <typename T>
+    struct remove_reference {
+        typedef T type;
+    };
+
+    template <typename T>
+    struct remove_reference<T &> {
+        typedef T type;
+    };
+
+    template <typename T>
+    struct remove_reference<T &&> {
+        typedef T type;
+    };
+
+    template <typename T>
+    using remove_reference_t = typename remove_reference<T>::type;
+
+    template <typename T>
+    struct remove_const {
+        typedef T type;
+    };
+
+    template <typename T>
+    struct remove_const<const T> {
+        typedef T type;
+    };
+
+    template <typename T>
+    struct remove_volatile {
+        typedef T type;
+    };
+
+    template <typename T>
+    struct remove_volatile<volatile T> {
+        typedef T type;
+    };
+
+    template <typename T>
+    struct remove_cv {
+        typedef typename remove_volatile<
+            typename remove_const<T>::type>::type type;
+    };
+
+    template <typename T>
+    using remove_cv_t = typename remove_cv<T>::type;
+
+    /*
+     * std::is_lvalue_reference
+     */
+    template <typename T>
+    struct is_lvalue_reference : false_type
+    {};
+
+    template <typename T>
+    struct is_lvalue_reference<T &> : true_type
+    {};
+
+    /*
+     * Type properties, implemented with the compiler intrinsics.
+     */
+    template <typename T>
+    struct is_trivially_copyable :
+        bool_constant<__is_trivially_copyable(T)>
+    {};
+
+    template <typename T>
+    struct is_trivially_destructible :
+        bool_constant<__has_trivial_destructor(T)>
+    {};
+
+    template <typename T>
+    struct is_enum : bool_constant<__is_enum(T)>
+    {};
+
+    template <typename T, typename ...ARGS>
+    struct is_constructible : bool_constant<__is_constructible(T, ARGS...)>
+    {};
+
+    template <typename T>
+    struct underlying_type {
+        typedef __underlying_type(T) type;
+    };
+
+    template <typename T>
+    using underlying_type_t = typename underlying_type<T>::type;
+
+    /*
+     * std::move and std::forward
+     */
+    template <typename T>
+    constexpr typename remove_reference<T>::type &&move(T &&t) noexcept
+    {
+        return static_cast<typename remove_reference<T>::type &&>(t);
+    }
+
+    template <typename T>
+    constexpr T &&forward(typename remove_reference<T>::type &t) noexcept
+    {
+        return static_cast<T &&>(t);
+    }
+
+    template <typename T>
+    constexpr T &&forward(typename remove_reference<T>::type &&t) noexcept
+    {
+        static_assert(!is_lvalue_reference<T>::value,
+                      "Cannot forward an rvalue as an lvalue");
+        return static_cast<T &&>(t);
+    }
+
+    /*
+     * std::swap
+     */
+    template <typename T>
+    void swap(T &a, T &b)
+    {
+        T tmp(move(a));
+        a = move(b);
+        b = move(tmp);
+    }
+
+    /*
+     * std::pair
+     */
+    template <typename T1, typename T2>
+    struct pair {
+        typedef T1 first_type;
+        typedef T2 second_type;
+
+        constexpr pair() :
+            first(),
+            second()
+        {
+        }
+
+        constexpr pair(const T1 &a, const T2 &b) :
+            first(a),
+            second(b)
+        {
+        }
+
+        template <typename U1, typename U2>
+        constexpr pair(U1 &&a, U2 &&b) :
+            first(forward<U1>(a)),
+            second(forward<U2>(b))
+        {
+        }
+
+        pair(const pair &other) = default;
+        pair(pair &&other) = default;
+        pair &operator =(const pair &other) = default;
+        pair &operator =(pair &&other) = default;
+
+        T1 first;
+        T2 second;
+    };
+
+    template <typename T1, typename T2>
+    constexpr pair<T1, T2> make_pair(T1 a, T2 b)
+    {
+        return pair<T1, T2>(move(a), move(b));
+    }
+
+    /*
+     * std::array
+     */
+    template <typename T, size_t N>
+    struct array {
+        typedef T value_type;
+        typedef size_t size_type;
+        typedef T *iterator;
+        typedef const T *const_iterator;
+
+        constexpr size_type size() const noexcept { return N; }
+        constexpr bool empty() const noexcept { return N == 0; }
+
+        T &operator [](const size_type i) { return m_elems[i]; }
+        constexpr const T &operator [](const size_type i) const
+        {
+            return m_elems[i];
+        }
+
+        T *data() noexcept { return m_elems; }
+        const T *data() const noexcept { return m_elems; }
+
+        iterator begin() noexcept { return m_elems; }
+        const_iterator begin() const noexcept { return m_elems; }
+        iterator end() noexcept { return m_elems + N; }
+        const_iterator end() const noexcept { return m_elems + N; }
+
+        void fill(const T &value)
+        {
+            for (size_type i = 0; i < N; i++) {
+                m_elems[i] = value;
+            }
+        }
+
+        /*
+         * Public to allow aggregate initialization.
+         */
+        T m_elems[N ? N : 1];
+    };
+
+#endif
+
+#if !defined(SPHERE_PLUS_PLUS_STD_HEADERS) || __cplusplus < 201703L
+    /*
+     * std::optional
+     *
+     * The storage is inline, so an optional object may be used to construct an
+     * object in place, at a time later than its enclosing object.
+     */
+    struct nullopt_t {
+        explicit constexpr nullopt_t(int)
+        {
+        }
+    };
+
+    constexpr nullopt_t nullopt{0};
+
+    template <typename T>
+    class optional {
+    public:
+        typedef T value_type;
+
+        constexpr optional() noexcept :
+            m_dummy(),
+            m_engaged(false)
+        {
+        }
+
+        constexpr optional(nullopt_t) noexcept :
+            m_dummy(),
+            m_engaged(false)
+        {
+        }
+
+        optional(const T &value) :
+            m_engaged(false)
+        {
+            emplace(value);
+        }
+
+        optional(T &&value) :
+            m_engaged(false)
+        {
+            emplace(move(value));
+        }
+
+        optional(const optional &other) :
+            m_engaged(false)
+        {
+            if (other.m_engaged) {
+                emplace(other.m_value);
+            }
+        }
+
+        optional(optional &&other) :
+            m_engaged(false)
+        {
+            if (other.m_engaged) {
+                emplace(move(other.m_value));
+            }
+        }
+
+        ~optional()
+        {
+            reset();
+        }
+
+        optional &operator =(nullopt_t) noexcept
+        {
+            reset();
+
+            return *this;
+        }
+
+        optional &operator =(const optional &other)
+        {
+            if (this != &other) {
+                reset();
+                if (other.m_engaged) {
+                    emplace(other.m_value);
+                }
+            }
+
+            return *this;
+        }
+
+        optional &operator =(optional &&other)
+        {
+            if (this != &other) {
+                reset();
+                if (other.m_engaged) {
+                    emplace(move(other.m_value));
+                }
+            }
+
+            return *this;
+        }
+
+        template <typename ...ARGS>
+        T &emplace(ARGS &&...args)
+        {
+            reset();
+            new (static_cast<void *>(&m_value)) T(forward<ARGS>(args)...);
+            m_engaged = true;
+
+            return m_value;
+        }
+
+        void reset() noexcept
+        {
+            if (m_engaged) {
+                m_value.~T();
+                m_engaged = false;
+            }
+        }
+
+        constexpr bool has_value() const noexcept { return m_engaged; }
+        constexpr explicit operator bool() const noexcept { return m_engaged; }
+
+        T &operator *() { return m_value; }
+        const T &operator *() const { return m_value; }
+        T *operator ->() { return &m_value; }
+        const T *operator ->() const { return &m_value; }
+
+        T &value() { return m_value; }
+        const T &value() const { return m_value; }
+
+        template <typename U>
+        T value_or(U &&fallback) const
+        {
+            return m_engaged ? m_value : static_cast<T>(forward<U>(fallback));
+        }
+
+    private:
+        struct empty_t {
+        };
+
+        union {
+            empty_t m_dummy;
+            T m_value;
+        };
+
+        bool m_engaged;
+    };
+#endif
 }
@@ -13,7 +13,9 @@
 #include <applibs/eventloop.h>
 
 #include <sphereplusplus/abort.hh>
+#include <sphereplusplus/clock.hh>
 #include <sphereplusplus/delegate.hh>
+#include <sphereplusplus/std.hh>
 
 #include "internal.hh"
 
@@ -21,6 +23,15 @@ namespace SpherePlusPlus {
 
 /**
  * @brief One shot or periodic timers.
+ *
+ * The timers run on the event loop they are initialized with, by default the
+ * event loop of the calling thread (see getEventLoop()). The timers
+ * initialized with the default event loop while a virtual clock is attached
+ * to the calling thread run on that clock (see clock.hh).
+ *
+ * The timers armed on the event loop of the application are kept in a list
+ * owned by the application, with their deadline, so that the next expiry is
+ * found without a system call (see nextExpiry()).
  */
 class Timer
 {
@@ -31,33 +42,123 @@ public:
     Timer() :
         m_callback(),
         m_timerFd(-1),
-        m_event(nullptr)
+        m_eventLoop(nullptr),
+        m_event(nullptr),
+        m_clock(nullptr),
+        m_alarm(),
+        m_period_ns(0),
+        m_deadline_ns(0),
+        m_armed(false),
+        m_deferrable(false),
+        m_timers(nullptr),
+        m_next(nullptr),
+        m_prev(nullptr)
     {
     }
 
+    /**
+     * @brief Move constructor.
+     * @param[in] other The instance to move from. It is left uninitialized.
+     *
+     * @note When the other timer is initialized, its file descriptor is
+     *       registered again with its event loop, so that its expiries (armed
+     *       or not) are delivered to this instance.
+     */
+    Timer(Timer &&other) :
+        m_callback(std::move(other.m_callback)),
+        m_timerFd(-1),
+        m_eventLoop(nullptr),
+        m_event(nullptr),
+        m_clock(nullptr),
+        m_alarm(),
+        m_period_ns(0),
+        m_deadline_ns(0),
+        m_armed(false),
+        m_deferrable(other.m_deferrable),
+        m_timers(nullptr),
+        m_next(nullptr),
+        m_prev(nullptr)
+    {
+        AbortIfNot(adopt(other));
+    }
+
+    /**
+     * @brief Move assignment operator.
+     * @param[in] other The instance to move from. It is left uninitialized.
+     * @return This instance.
+     */
+    Timer &operator =(Timer &&other)
+    {
+        if (this != &other) {
+            if (m_timerFd >= 0) {
+                destroy();
+            }
+
+            m_callback = std::move(other.m_callback);
+            m_deferrable = other.m_deferrable;
+            AbortIfNot(adopt(other), *this);
+        }
+
+        return *this;
+    }
+
+    /*
+     * Timers own a file descriptor and cannot be copied.
+     */
+    Timer(const Timer &other) = delete;
+    Timer &operator =(const Timer &other) = delete;
+
     /**
      * @brief Destructor.
      */
     virtual ~Timer()
     {
-        destroy();
+        if (m_timerFd >= 0) {
+            destroy();
+        }
     }
 
     /**
-     * @brief Initialize the timer.
+     * @brief Initialize the timer, on the event loop of the calling thread.
      * @return True on success.
      */
     virtual bool init()
+    {
+        EventLoop *const eventLoop = getEventLoop();
+        AbortIfNot(eventLoop, false);
+
+        AbortIfNot(init(eventLoop), false);
+        m_clock = VirtualClock::current();
+
+        return true;
+    }
+
+    /**
+     * @brief Initialize the timer, on a given event loop.
+     * @param[in] eventLoop The event loop.
+     * @return True on success.
+     * @note The timer runs in real time. It must be initialized, used and
+     *       destroyed from the thread running the event loop, or while the
+     *       event loop is not running.
+     */
+    virtual bool init(EventLoop *const eventLoop)
     {
         AbortIf(m_timerFd >= 0, false);
+        AbortIfNot(eventLoop, false);
 
         m_timerFd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK);
         AbortErrno(m_timerFd, false);
 
-        m_event = EventLoop_RegisterIo(getEventLoop(), m_timerFd,
+        m_eventLoop = eventLoop;
+        m_event = EventLoop_RegisterIo(m_eventLoop, m_timerFd,
                                        EventLoop_Input, callback, this);
         AbortErrnoPtr(m_event, false);
 
+        m_clock = nullptr;
+        m_alarm.expire = expire;
+        m_alarm.context = this;
+        m_timers = getArmedTimers(m_eventLoop);
+
         return true;
     }
 
@@ -69,8 +170,16 @@ public:
     {
         AbortIfNot(m_timerFd >= 0, false);
 
-        AbortErrno(EventLoop_UnregisterIo(getEventLoop(), m_event), false);
+        disarm();
+        m_timers = nullptr;
+        if (m_clock) {
+            m_clock->cancel(m_alarm);
+            m_clock = nullptr;
+        }
+
+        AbortErrno(EventLoop_UnregisterIo(m_eventLoop, m_event), false);
         m_event = nullptr;
+        m_eventLoop = nullptr;
 
         AbortErrno(close(m_timerFd), false);
         m_timerFd = -1;
@@ -132,12 +241,21 @@ public:
     {
         AbortIfNot(m_timerFd >= 0, false);
 
+        m_period_ns = 0;
+        if (m_clock) {
+            m_clock->schedule(m_alarm, m_clock->time() + delay_us * 1000);
+            arm();
+            return true;
+        }
+
         const struct itimerspec oneShot = {
             .it_interval = {},
             .it_value = makeTimespec(delay_us),
         };
 
+        m_deadline_ns = readClock() + delay_us * 1000;
         AbortErrno(timerfd_settime(m_timerFd, 0, &oneShot, nullptr), false);
+        arm();
 
         return true;
     }
@@ -151,13 +269,22 @@ public:
     {
         AbortIfNot(m_timerFd >= 0, false);
 
+        m_period_ns = period_us * 1000;
+        if (m_clock) {
+            m_clock->schedule(m_alarm, m_clock->time() + m_period_ns);
+            arm();
+            return true;
+        }
+
         const struct timespec period = makeTimespec(period_us);
         const struct itimerspec periodic = {
             .it_interval = period,
             .it_value = period,
         };
 
+        m_deadline_ns = readClock() + m_period_ns;
         AbortErrno(timerfd_settime(m_timerFd, 0, &periodic, nullptr), false);
+        arm();
 
         return true;
     }
@@ -175,12 +302,198 @@ public:
 
         AbortIfNot(m_timerFd >= 0, false);
 
+        disarm();
+        if (m_clock) {
+            m_clock->cancel(m_alarm);
+            return true;
+        }
+
         AbortErrno(timerfd_settime(m_timerFd, 0, &stop, nullptr), false);
 
         return true;
     }
 
+    /**
+     * @brief Get the time until the next expiry of the timer.
+     * @param[out] remaining_us The time, in microseconds.
+     * @return True when the timer is armed.
+     */
+    bool remaining(uint64_t &remaining_us) const
+    {
+        if (m_timerFd < 0 || !m_armed) {
+            return false;
+        }
+
+        remaining_us = untilExpiry(m_clock ? m_clock->time() : readClock());
+
+        return true;
+    }
+
+    /**
+     * @brief Mark the timer as deferrable, such as timers doing housekeeping.
+     *        Deferrable timers do not prevent the system from being suspended
+     *        (see PowerScheduler).
+     * @param[in] deferrable Whether the timer is deferrable.
+     */
+    void setDeferrable(const bool deferrable)
+    {
+        m_deferrable = deferrable;
+    }
+
+    /**
+     * @brief Get the time until the next expiry of the timers of the event
+     *        loop of the application, other than the deferrable ones.
+     * @param[in] eventLoop The event loop of the application.
+     * @param[out] delay_us The time, in microseconds.
+     * @return True when at least one timer is armed.
+     * @note Must be invoked from the thread running the event loop.
+     */
+    static bool nextExpiry(const EventLoop *const eventLoop, uint64_t &delay_us)
+    {
+        Timer *const *const timers = getArmedTimers(eventLoop);
+        bool armed = false;
+        uint64_t now = 0;
+
+        delay_us = 0;
+        for (const Timer *timer = timers ? *timers : nullptr; timer;
+             timer = timer->m_next) {
+            if (timer->m_deferrable) {
+                continue;
+            }
+
+            /*
+             * The real-time timers share one reading of the clock.
+             */
+            if (!timer->m_clock && !now) {
+                now = readClock();
+            }
+
+            const uint64_t remaining_us = timer->untilExpiry(
+                timer->m_clock ? timer->m_clock->time() : now);
+            if (!armed || remaining_us < delay_us) {
+                delay_us = remaining_us;
+                armed = true;
+            }
+        }
+
+        return armed;
+    }
+
+    /**
+     * @brief Detach the armed timers of an event loop being closed.
+     * @param[in,out] timers The armed timers. The list is left empty.
+     */
+    static void release(Timer *&timers)
+    {
+        while (timers) {
+            Timer *const timer = timers;
+            timer->disarm();
+            timer->m_timers = nullptr;
+        }
+    }
+
 private:
+    /**
+     * @brief Add the timer to the armed timers of its event loop.
+     */
+    void arm()
+    {
+        if (m_armed) {
+            return;
+        }
+
+        m_armed = true;
+        if (!m_timers) {
+            return;
+        }
+
+        m_next = *m_timers;
+        if (m_next) {
+            m_next->m_prev = &m_next;
+        }
+        m_prev = m_timers;
+        *m_timers = this;
+    }
+
+    /**
+     * @brief Remove the timer from the armed timers of its event loop.
+     */
+    void disarm()
+    {
+        if (!m_armed) {
+            return;
+        }
+
+        m_armed = false;
+        if (!m_prev) {
+            return;
+        }
+
+        *m_prev = m_next;
+        if (m_next) {
+            m_next->m_prev = m_prev;
+        }
+        m_next = nullptr;
+        m_prev = nullptr;
+    }
+
+    /**
+     * @brief Get the time until the next expiry of the armed timer.
+     * @param[in] now The time on the clock of the timer, in nanoseconds.
+     * @return The time, in microseconds, or 0 when the expiry is pending.
+     */
+    uint64_t untilExpiry(const uint64_t now) const
+    {
+        const uint64_t deadline_ns = m_clock ? m_alarm.deadline_ns :
+            m_deadline_ns;
+
+        return deadline_ns > now ? (deadline_ns - now) / 1000 : 0;
+    }
+
+    /**
+     * @brief Take over the file descriptor of another timer.
+     * @param[in] other The timer to take over. It is left uninitialized.
+     * @return True on success.
+     */
+    bool adopt(Timer &other)
+    {
+        if (other.m_timerFd < 0) {
+            return true;
+        }
+
+        AbortErrno(EventLoop_UnregisterIo(other.m_eventLoop, other.m_event),
+                   false);
+        other.m_event = nullptr;
+        const bool armed = other.m_armed;
+        other.disarm();
+        m_timers = other.m_timers;
+        other.m_timers = nullptr;
+
+        m_timerFd = other.m_timerFd;
+        other.m_timerFd = -1;
+        m_eventLoop = other.m_eventLoop;
+        other.m_eventLoop = nullptr;
+
+        m_event = EventLoop_RegisterIo(m_eventLoop, m_timerFd,
+                                       EventLoop_Input, callback, this);
+        AbortErrnoPtr(m_event, false);
+
+        m_clock = other.m_clock;
+        m_alarm.expire = expire;
+        m_alarm.context = this;
+        m_period_ns = other.m_period_ns;
+        m_deadline_ns = other.m_deadline_ns;
+        if (m_clock && other.m_alarm.scheduled) {
+            m_clock->schedule(m_alarm, other.m_alarm.deadline_ns);
+            m_clock->cancel(other.m_alarm);
+        }
+        other.m_clock = nullptr;
+        if (armed) {
+            arm();
+        }
+
+        return true;
+    }
 
     /**
      * @brief Helper function to make a timespec from a given time.
@@ -219,7 +532,47 @@ private:
         const ssize_t count = read(timer->m_timerFd, &payload, sizeof(payload));
         AbortIfNot(count == sizeof(payload));
 
-        timer->m_callback();
+        /*
+         * The payload is the number of expiries.
+         */
+        if (timer->m_period_ns) {
+            timer->m_deadline_ns += payload * timer->m_period_ns;
+        } else {
+            timer->disarm();
+        }
+
+        timer->dispatch();
+    }
+
+    /**
+     * @brief Virtual clock alarm callback. Invokes the user callback.
+     * @param[in] context The Timer object.
+     */
+    static void expire(void *const context)
+    {
+        Timer *const timer = static_cast<Timer *>(context);
+
+        if (timer->m_period_ns) {
+            timer->m_clock->schedule(timer->m_alarm,
+                                     timer->m_alarm.deadline_ns +
+                                     timer->m_period_ns);
+        } else {
+            timer->disarm();
+        }
+
+        timer->dispatch();
+    }
+
+    /**
+     * @brief Invoke the user callback.
+     */
+    void dispatch()
+    {
+        InputRecorder::record(InputKind::Timer);
+
+        DispatchScope scope(DispatchKind::Timer, m_callback.callback(),
+                            m_callback.object());
+        m_callback();
     }
 
     /**
@@ -232,10 +585,62 @@ private:
      */
     int m_timerFd;
 
+    /**
+     * The event loop the timer is registered with.
+     */
+    EventLoop *m_eventLoop;
+
     /**
      * The event handler.
      */
     EventRegistration *m_event;
+
+    /**
+     * The virtual clock the timer runs on, or nullptr for real time.
+     */
+    VirtualClock *m_clock;
+
+    /**
+     * The deadline of the timer on the virtual clock.
+     */
+    VirtualClock::Alarm m_alarm;
+
+    /**
+     * The period of the timer, in nanoseconds, or 0 in one-shot mode.
+     */
+    uint64_t m_period_ns;
+
+    /**
+     * The next expiry of the timer in real time, in nanoseconds.
+     */
+    uint64_t m_deadline_ns;
+
+    /**
+     * Whether the timer is armed.
+     */
+    bool m_armed;
+
+    /**
+     * Whether the timer is deferrable.
+     */
+    bool m_deferrable;
+
+    /**
+     * The armed timers of the event loop, or nullptr when the event loop is
+     * not the event loop of the application.
+     */
+    Timer **m_timers;
+
+    /**
+     * The next armed timer.
+     */
+    Timer *m_next;
+
+    /**
+     * The link to the timer, in the previous armed timer or the head of the
+     * armed timers.
+     */
+    Timer **m_prev;
 };
 
 } /* namespace SpherePlusPlus */
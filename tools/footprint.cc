@@ -0,0 +1,56 @@
+/**
+ * @file footprint.cc
+ * @author Matthieu Bucchianeri
+ * @brief Size of the library classes, for the footprint report.
+ *
+ * This file is compiled (but never linked) with the same options as the
+ * application. Each class is represented by a symbol of the size of one of its
+ * instances, so that the report can be produced with the toolchain's nm,
+ * without running any code on the target. The budget assertions are checked
+ * along the way.
+ *
+ * @see footprint.py
+ */
+
+#include <sphereplusplus/application.hh>
+#include <sphereplusplus/budget.hh>
+#include <sphereplusplus/delegate.hh>
+#include <sphereplusplus/gpio.hh>
+#include <sphereplusplus/timer.hh>
+
+using namespace SpherePlusPlus;
+
+/**
+ * Declare a symbol with the size of an instance of a type.
+ *
+ * @param[in] name The name of the symbol, appended to "footprint_".
+ * @param[in] ... The type.
+ */
+#define Footprint(name, ...)                                            \
+    extern "C" {                                                        \
+        __attribute__((used)) char footprint_##name[sizeof(__VA_ARGS__)]; \
+    }
+
+Footprint(Delegate, Delegate<void()>)
+Footprint(Timer, Timer)
+Footprint(Gpio, Gpio)
+Footprint(GpioIn, GpioIn)
+Footprint(GpioOut, GpioOut)
+Footprint(ApplicationBase, ApplicationBase)
+Footprint(Application, Application)
+
+/*
+ * The RAM contribution of each feature is the difference with the application
+ * without any features.
+ */
+Footprint(Application_None, BasicApplication<ApplicationFeatures::None>)
+Footprint(Application_UpdateNotification,
+          BasicApplication<ApplicationFeatures::UpdateNotification>)
+Footprint(Application_TimeSync,
+          BasicApplication<ApplicationFeatures::TimeSync>)
+Footprint(Application_Watchdog,
+          BasicApplication<ApplicationFeatures::Watchdog>)
+Footprint(Application_IoTCentral,
+          BasicApplication<ApplicationFeatures::IoTCentral>)
+Footprint(Application_Checkpoint,
+          BasicApplication<ApplicationFeatures::Checkpoint>)
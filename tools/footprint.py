@@ -0,0 +1,181 @@
+#!/usr/bin/env python3
+#
+# @file footprint.py
+# @author Matthieu Bucchianeri
+# @brief Memory footprint report.
+#
+# Report the size of the library classes (from the object built out of
+# footprint.cc) and the flash and static RAM contribution of each feature (from
+# the linker map of the application).
+#
+# The application must be built with -ffunction-sections and -fdata-sections,
+# so that the map has one input section per symbol. The sphereplusplus.cmake
+# module sets this up.
+
+import argparse
+import json
+import re
+import subprocess
+import sys
+
+# Attribution of the symbols to the features, first match wins. The patterns
+# are matched against the (mangled) section names, and against the archive or
+# object that provided the section.
+FEATURES = [
+    ('IoTCentral', re.compile(r'Iot|IoTHub|iothub|IOTHUB|azure|Azure|PROV_|'
+                              r'prov_|mqtt|uamqp|Keepalive')),
+    ('Watchdog', re.compile(r'Watchdog|watchdog')),
+    ('Checkpoint', re.compile(r'Checkpoint|checkpoint|Storage_')),
+    ('UpdateNotification', re.compile(r'UpdateNotification|sysevent|SysEvent|'
+                                      r'UpdatePending|UpdateCompleted')),
+    ('TimeSync', re.compile(r'TimeSync')),
+    ('Timer', re.compile(r'5Timer|timerfd')),
+    ('Gpio', re.compile(r'Gpio|GPIO')),
+    ('Delegate', re.compile(r'Delegate')),
+    ('Core', re.compile(r'SpherePlusPlus|sphereplusplus')),
+]
+
+# Output sections, by memory.
+FLASH_SECTIONS = ('.text', '.rodata', '.data', '.init_array', '.fini_array',
+                  '.ARM.exidx', '.ARM.extab', '.eh_frame')
+RAM_SECTIONS = ('.data', '.bss')
+
+FOOTPRINT_PREFIX = 'footprint_'
+
+
+def class_sizes(nm, objects):
+    """Read the class sizes from the footprint object(s)."""
+    sizes = {}
+    for obj in objects:
+        output = subprocess.run([nm, '-S', '--defined-only', obj],
+                                check=True, capture_output=True,
+                                text=True).stdout
+        for line in output.splitlines():
+            fields = line.split()
+            if len(fields) == 4 and fields[3].startswith(FOOTPRINT_PREFIX):
+                sizes[fields[3][len(FOOTPRINT_PREFIX):]] = int(fields[1], 16)
+    return sizes
+
+
+def classify(name):
+    """Attribute an input section to a feature."""
+    for feature, pattern in FEATURES:
+        if pattern.search(name):
+            return feature
+    return 'Application'
+
+
+def parse_map(path):
+    """Parse a GNU ld map file into (output section, input section, size,
+    origin) tuples."""
+    entries = []
+    output_section = None
+    pending = None
+    in_memory_map = False
+
+    entry = re.compile(r'^\s+0x([0-9a-f]+)\s+0x([0-9a-f]+)\s+(\S.*)$')
+    with open(path) as f:
+        for line in f:
+            line = line.rstrip('\n')
+            if line.startswith('Linker script and memory map'):
+                in_memory_map = True
+                continue
+            if not in_memory_map or not line:
+                continue
+
+            # Output section, e.g. ".text  0x00001000  0x2345".
+            if not line.startswith(' '):
+                output_section = line.split()[0]
+                pending = None
+                continue
+
+            # Input section, with its address/size/origin on the same line or
+            # on the next one when the name is too long.
+            fields = line.split()
+            if line.startswith(' .') or line.startswith(' COMMON'):
+                name = fields[0]
+                if len(fields) >= 4 and fields[1].startswith('0x'):
+                    entries.append((output_section, name, int(fields[2], 16),
+                                    ' '.join(fields[3:])))
+                    pending = None
+                else:
+                    pending = name
+                continue
+
+            match = entry.match(line)
+            if match and pending:
+                entries.append((output_section, pending,
+                                int(match.group(2), 16), match.group(3)))
+                pending = None
+
+    return entries
+
+
+def section_footprint(entries):
+    """Accumulate the flash and RAM footprint of each feature."""
+    footprint = {}
+    for output_section, name, size, origin in entries:
+        if not output_section or size == 0:
+            continue
+        flash = output_section.startswith(FLASH_SECTIONS)
+        ram = output_section.startswith(RAM_SECTIONS)
+        if not flash and not ram:
+            continue
+
+        feature = classify(name)
+        if feature == 'Application':
+            feature = classify(origin)
+        totals = footprint.setdefault(feature, {'flash': 0, 'ram': 0})
+        if flash:
+            totals['flash'] += size
+        if ram:
+            totals['ram'] += size
+    return footprint
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__)
+    parser.add_argument('--sizes', nargs='+', default=[],
+                        help='object(s) built from footprint.cc')
+    parser.add_argument('--map', help='linker map of the application')
+    parser.add_argument('--nm', default='nm', help='nm of the toolchain')
+    parser.add_argument('--json', action='store_true',
+                        help='output a JSON report')
+    args = parser.parse_args()
+
+    report = {}
+    if args.sizes:
+        report['classes'] = class_sizes(args.nm, args.sizes)
+        none = report['classes'].get('Application_None')
+        if none is not None:
+            report['features_ram'] = {
+                name[len('Application_'):]: size - none
+                for name, size in report['classes'].items()
+                if name.startswith('Application_') and name != 'Application_None'
+            }
+    if args.map:
+        report['sections'] = section_footprint(parse_map(args.map))
+
+    if args.json:
+        json.dump(report, sys.stdout, indent=2, sort_keys=True)
+        print()
+        return 0
+
+    if 'classes' in report:
+        print('Instance sizes (bytes):')
+        for name, size in sorted(report['classes'].items()):
+            print('  %-36s %8d' % (name, size))
+    if 'features_ram' in report:
+        print('Application RAM per feature (bytes):')
+        for name, size in sorted(report['features_ram'].items()):
+            print('  %-36s %8d' % (name, size))
+    if 'sections' in report:
+        print('Static footprint per feature (bytes):')
+        print('  %-36s %8s %8s' % ('', 'flash', 'ram'))
+        for name, totals in sorted(report['sections'].items()):
+            print('  %-36s %8d %8d' % (name, totals['flash'], totals['ram']))
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
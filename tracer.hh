@@ -0,0 +1,295 @@
+/**
+ * @file tracer.hh
+ * @author Matthieu Bucchianeri
+ * @brief Timeline of the event loop activity.
+ *
+ * When a tracer is attached to the thread running the event loop, the
+ * iterations of the event loop and the callbacks dispatched from it (see
+ * internal.hh) record begin and end events into a ring of binary events, the
+ * oldest events being overwritten. The ring can then be exported in the Chrome
+ * trace-event format, for viewing in Perfetto (https://ui.perfetto.dev) or
+ * chrome://tracing.
+ *
+ * The callbacks are named after their type and the address of their callback,
+ * relative to the start of the executable, so they can be resolved with
+ * addr2line.
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include <sphereplusplus/abort.hh>
+#include <sphereplusplus/clock.hh>
+#include <sphereplusplus/dispatch.hh>
+
+extern "C" {
+/*
+ * Start of the executable, provided by the default linker script.
+ */
+extern const char __executable_start;
+}
+
+namespace SpherePlusPlus {
+
+/**
+ * @brief Timeline of the event loop activity.
+ */
+class Tracer
+{
+public:
+    /**
+     * @brief Binary trace event.
+     */
+    struct Event
+    {
+        /**
+         * The time of the event, in nanoseconds.
+         */
+        uint64_t timestamp_ns;
+
+        /**
+         * The callback (delegate stub or static callback), or nullptr for an
+         * event loop iteration.
+         */
+        const void *callback;
+
+        /**
+         * The object passed to the callback.
+         */
+        const void *object;
+
+        /**
+         * The type of the callback.
+         */
+        DispatchKind kind;
+
+        /**
+         * Whether the event is the beginning (or the end) of the callback.
+         */
+        bool begin;
+    };
+
+    /**
+     * @brief Constructor.
+     */
+    Tracer() :
+        m_events(nullptr),
+        m_mask(0),
+        m_head(0)
+    {
+    }
+
+    /*
+     * The tracer is attached to a thread, and cannot be copied.
+     */
+    Tracer(const Tracer &other) = delete;
+    Tracer &operator =(const Tracer &other) = delete;
+
+    /**
+     * @brief Destructor.
+     */
+    virtual ~Tracer()
+    {
+        if (g_current == this) {
+            destroy();
+        }
+    }
+
+    /**
+     * @brief Initialize the tracer, and attach it to the calling thread, which
+     *        must be the thread running the event loop.
+     * @param[in] events The ring of events.
+     * @param[in] capacity The number of events in the ring, a power of 2.
+     * @return True on success.
+     */
+    virtual bool init(Event *const events, const size_t capacity)
+    {
+        AbortIf(g_current, false);
+        AbortIfNot(events, false);
+        AbortIfNot(capacity && !(capacity & (capacity - 1)), false);
+
+        m_events = events;
+        m_mask = capacity - 1;
+        m_head = 0;
+
+        g_current = this;
+
+        return true;
+    }
+
+    /**
+     * @brief Initialize the tracer.
+     * @tparam CAPACITY The number of events in the ring, a power of 2.
+     * @param[in] events The ring of events.
+     * @return True on success.
+     * @see init
+     */
+    template<size_t CAPACITY>
+    bool init(Event (&events)[CAPACITY])
+    {
+        return init(events, CAPACITY);
+    }
+
+    /**
+     * @brief Destroy the tracer.
+     * @return True on success.
+     * @note Must be invoked from the thread running the event loop.
+     */
+    virtual bool destroy()
+    {
+        AbortIfNot(g_current == this, false);
+
+        g_current = nullptr;
+
+        return true;
+    }
+
+    /**
+     * @brief Discard the events recorded.
+     */
+    void clear()
+    {
+        m_head = 0;
+    }
+
+    /**
+     * @brief Export the events recorded in the Chrome trace-event format.
+     * @param[in] fd The file descriptor to write to.
+     * @return True on success.
+     * @note Must be invoked from the thread running the event loop. The
+     *       callback invoking the export appears as not finished.
+     */
+    bool write(const int fd) const
+    {
+        AbortIfNot(m_events, false);
+
+        const uint32_t count = m_head < m_mask + 1 ? m_head : m_mask + 1;
+
+        AbortErrno(dprintf(fd, "{\"displayTimeUnit\":\"ms\","
+                           "\"traceEvents\":[\n"), false);
+
+        /*
+         * The oldest events may end callbacks whose beginning was
+         * overwritten, skip them so the timeline stays balanced.
+         */
+        uint32_t depth = 0;
+        bool first = true;
+        for (uint32_t i = m_head - count; i != m_head; i++) {
+            const Event &event = m_events[i & m_mask];
+
+            if (!event.begin && depth == 0) {
+                continue;
+            }
+            depth += event.begin ? 1 : -1;
+
+            char name[32];
+            if (event.callback) {
+                snprintf(name, sizeof(name), "%s 0x%lx",
+                         dispatchKindName(event.kind),
+                         static_cast<unsigned long>(
+                             reinterpret_cast<uintptr_t>(event.callback) -
+                             reinterpret_cast<uintptr_t>(
+                                 &__executable_start)));
+            } else {
+                snprintf(name, sizeof(name), "%s",
+                         dispatchKindName(event.kind));
+            }
+
+            AbortErrno(dprintf(fd, "%s{\"ph\":\"%c\",\"ts\":%llu.%03u,"
+                               "\"pid\":1,\"tid\":1,\"cat\":\"%s\","
+                               "\"name\":\"%s\","
+                               "\"args\":{\"object\":\"%p\"}}",
+                               first ? "" : ",\n", event.begin ? 'B' : 'E',
+                               static_cast<unsigned long long>(
+                                   event.timestamp_ns / 1000),
+                               static_cast<uint32_t>(
+                                   event.timestamp_ns % 1000),
+                               dispatchKindName(event.kind), name,
+                               event.object),
+                       false);
+            first = false;
+        }
+
+        AbortErrno(dprintf(fd, "\n]}\n"), false);
+
+        return true;
+    }
+
+    /**
+     * @brief Record the beginning of a callback on the calling thread.
+     * @param[in] kind The type of the callback.
+     * @param[in] callback The callback.
+     * @param[in] object The object passed to the callback.
+     */
+    static void begin(const DispatchKind kind, const void *const callback,
+                      const void *const object)
+    {
+        Tracer *const tracer = g_current;
+        if (__builtin_expect(!tracer, 1)) {
+            return;
+        }
+
+        tracer->record(kind, callback, object, true);
+    }
+
+    /**
+     * @brief Record the end of a callback on the calling thread.
+     * @param[in] kind The type of the callback.
+     * @param[in] callback The callback.
+     * @param[in] object The object passed to the callback.
+     */
+    static void end(const DispatchKind kind, const void *const callback,
+                    const void *const object)
+    {
+        Tracer *const tracer = g_current;
+        if (__builtin_expect(!tracer, 1)) {
+            return;
+        }
+
+        tracer->record(kind, callback, object, false);
+    }
+
+private:
+    /**
+     * @brief Record an event.
+     * @param[in] kind The type of the callback.
+     * @param[in] callback The callback.
+     * @param[in] object The object passed to the callback.
+     * @param[in] begin Whether the event is the beginning of the callback.
+     */
+    void record(const DispatchKind kind, const void *const callback,
+                const void *const object, const bool begin)
+    {
+        Event &event = m_events[m_head++ & m_mask];
+        event.timestamp_ns = readClock();
+        event.callback = callback;
+        event.object = object;
+        event.kind = kind;
+        event.begin = begin;
+    }
+
+    /**
+     * The ring of events.
+     */
+    Event *m_events;
+
+    /**
+     * The number of events in the ring, minus 1.
+     */
+    uint32_t m_mask;
+
+    /**
+     * The number of events recorded.
+     */
+    uint32_t m_head;
+
+    /**
+     * The tracer attached to the current thread.
+     */
+    static __thread Tracer *g_current;
+};
+
+} /* namespace SpherePlusPlus */
@@ -0,0 +1,516 @@
+/**
+ * @file update.hh
+ * @author Matthieu Bucchianeri
+ * @brief Policy deferring the installation of updates around the workload of
+ *        the application.
+ *
+ * The workload is busy while a critical section is open (such as an active
+ * control cycle or a batch being processed), or while the backlog reported by
+ * the application is above a threshold. The policy samples the workload every
+ * minute, and learns how busy each 15 minutes window of the day usually is.
+ *
+ * When an update is pending, it is installed right away if the workload is
+ * idle and is predicted to stay idle. Otherwise, it is deferred until the
+ * next window predicted idle, and installed as soon as the workload is idle
+ * in a window predicted idle, or when the workload becomes idle at the end of
+ * a critical section. The update is never deferred beyond the maximum
+ * deferral time given by the system.
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+
+#include <applibs/sysevent.h>
+
+#include <sphereplusplus/abort.hh>
+#include <sphereplusplus/clock.hh>
+#include <sphereplusplus/delegate.hh>
+#include <sphereplusplus/timer.hh>
+
+namespace SpherePlusPlus {
+
+/**
+ * @brief Policy deferring the installation of updates around the workload of
+ *        the application.
+ * @note Requires the "SoftwareUpdateDeferral" application capability.
+ * @see ApplicationBase::setUpdatePolicy
+ */
+class UpdatePolicy
+{
+public:
+    /**
+     * @brief Parameters of the policy.
+     */
+    struct Policy
+    {
+        /**
+         * The backlog from which the workload is busy.
+         */
+        uint32_t backlogThreshold;
+
+        /**
+         * The percentage of busy samples below which a window of the day is
+         * predicted idle.
+         */
+        uint8_t idleThreshold_pct;
+
+        /**
+         * The deferral when the workload is still busy once the update is due,
+         * in minutes.
+         */
+        uint32_t retry_m;
+    };
+
+    /**
+     * The default policy: busy with 64 items queued, idle windows below 10%
+     * busy samples, and retry every 5 minutes.
+     */
+    static constexpr Policy k_defaultPolicy = {64, 10, 5};
+
+    /**
+     * The number of windows of the day.
+     */
+    static constexpr uint32_t k_windows = 96;
+
+    /**
+     * The duration of the windows of the day, in seconds.
+     */
+    static constexpr uint32_t k_windowDuration = 86400 / k_windows;
+
+    /**
+     * The period of the samples of the workload, in seconds.
+     */
+    static constexpr uint32_t k_samplePeriod = 60;
+
+    /**
+     * The level of a window of the day always busy: 255, in fixed point with
+     * 8 fractional bits.
+     */
+    static constexpr int k_busyLevel = 255 << 8;
+
+    /**
+     * The version of the saved workload profile, to register its checkpoint
+     * component with (see CheckpointComponent::init()). Bumped whenever the
+     * format of the profile changes.
+     */
+    static constexpr uint16_t k_stateVersion = 1;
+
+    /**
+     * @brief Constructor.
+     */
+    UpdatePolicy() :
+        m_policy(k_defaultPolicy),
+        m_backlog(),
+        m_sampleTimer(),
+        m_critical(0),
+        m_deadline_ns(0),
+        m_install_ns(0),
+        m_profile(),
+        m_initialized(false)
+    {
+    }
+
+    /*
+     * The policy holds timers, and cannot be copied.
+     */
+    UpdatePolicy(const UpdatePolicy &other) = delete;
+    UpdatePolicy &operator =(const UpdatePolicy &other) = delete;
+
+    /**
+     * @brief Destructor.
+     */
+    virtual ~UpdatePolicy()
+    {
+        if (m_initialized) {
+            destroy();
+        }
+    }
+
+    /**
+     * @brief Initialize the policy, and start sampling the workload.
+     * @param[in] policy The parameters of the policy.
+     * @return True on success.
+     * @note Must be invoked from the thread running the event loop.
+     */
+    virtual bool init(const Policy &policy = k_defaultPolicy)
+    {
+        AbortIf(m_initialized, false);
+        AbortIfNot(policy.idleThreshold_pct <= 100, false);
+        AbortIfNot(policy.retry_m > 0, false);
+
+        m_policy = policy;
+        m_critical = 0;
+        m_deadline_ns = 0;
+        m_install_ns = 0;
+
+        AbortIfNot(m_sampleTimer.init(), false);
+        m_sampleTimer.setDeferrable(true);
+        m_sampleTimer.connect<UpdatePolicy, &UpdatePolicy::sample>(*this);
+        AbortIfNot(m_sampleTimer.startPeriodic(k_samplePeriod * 1000000ull),
+                   false);
+
+        m_initialized = true;
+
+        return true;
+    }
+
+    /**
+     * @brief Destroy the policy.
+     * @return True on success.
+     * @note An update still deferred is installed when its deferral ends.
+     */
+    virtual bool destroy()
+    {
+        AbortIfNot(m_initialized, false);
+
+        AbortIfNot(m_sampleTimer.destroy(), false);
+        m_initialized = false;
+
+        return true;
+    }
+
+    /**
+     * @brief Connect a class method returning the backlog of the application.
+     * @tparam T The class type.
+     * @tparam TMethod The class method, returning the number of items queued.
+     * @param[in] instance The class instance.
+     */
+    template<class T, uint32_t (T::*TMethod)()>
+    void connect(T &instance)
+    {
+        m_backlog.connect<T, TMethod>(instance);
+    }
+
+    /**
+     * @brief Connect a static method returning the backlog of the application.
+     * @tparam TFunc The static method, returning the number of items queued.
+     */
+    template<uint32_t (*TFunc)()>
+    void connect()
+    {
+        m_backlog.connect<TFunc>();
+    }
+
+    /**
+     * @brief Connect a lambda returning the backlog of the application.
+     * @tparam LAMBDA The lambda type.
+     * @param[in] instance The closure for the lambda, returning the number of
+     *            items queued.
+     */
+    template <typename LAMBDA>
+    void connect(const LAMBDA &instance)
+    {
+        m_backlog.connect<LAMBDA>(instance);
+    }
+
+    /**
+     * @brief Enter a critical section, during which updates are deferred.
+     * @note Critical sections may be nested.
+     */
+    void beginCritical()
+    {
+        m_critical++;
+    }
+
+    /**
+     * @brief Leave a critical section. When the update is deferred and the
+     *        workload becomes idle in a window predicted idle, the update is
+     *        installed.
+     */
+    void endCritical()
+    {
+        Assert(m_critical > 0);
+
+        m_critical--;
+        if (m_install_ns && !busy() && predictedIdle(window(0))) {
+            AbortIfNot(install());
+        }
+    }
+
+    /**
+     * @brief Whether the workload is busy.
+     * @return True within a critical section, or when the backlog is above the
+     *         threshold.
+     */
+    bool busy() const
+    {
+        return m_critical ||
+            (m_backlog && m_backlog() >= m_policy.backlogThreshold);
+    }
+
+    /**
+     * @brief Decide when to install a pending update. Invoked upon the
+     *        notifications of a pending update, which the system repeats when
+     *        a deferral ends.
+     * @param[in] max_deferral_m The maximum deferral, in minutes.
+     * @return True on success.
+     */
+    bool pending(const uint32_t max_deferral_m)
+    {
+        AbortIfNot(m_initialized, false);
+
+        /*
+         * Keep the deadline of the first notification.
+         */
+        const uint64_t now = VirtualClock::now();
+        const uint64_t deadline = now + max_deferral_m * 60000000000ull;
+        if (!m_deadline_ns || deadline < m_deadline_ns) {
+            m_deadline_ns = deadline;
+        }
+
+        /*
+         * The deferral ended: install the update, unless the workload is still
+         * busy, in which case the update is deferred again, up to the
+         * deadline.
+         */
+        if (m_install_ns) {
+            m_install_ns = 0;
+            if (busy()) {
+                return defer(now + m_policy.retry_m * 60000000000ull);
+            }
+
+            return install();
+        }
+
+        if (!busy() && predictedIdle(window(0))) {
+            return install();
+        }
+
+        return defer(nextIdleWindow(now));
+    }
+
+    /**
+     * @brief Get the time the pending update is deferred to.
+     * @return The time, in nanoseconds (see VirtualClock::now()), or 0 when no
+     *         update is deferred.
+     */
+    uint64_t installTime() const
+    {
+        return m_install_ns;
+    }
+
+    /**
+     * @brief Save the learned workload profile, for example into a checkpoint
+     *        (see checkpoint.hh).
+     * @param[out] buffer The buffer.
+     * @param[in] size The size of the buffer, in bytes.
+     * @return The size of the profile, or 0 when it does not fit.
+     */
+    size_t save(uint8_t *const buffer, const size_t size)
+    {
+        if (size < sizeof(m_profile)) {
+            return 0;
+        }
+
+        memcpy(buffer, m_profile, sizeof(m_profile));
+
+        return sizeof(m_profile);
+    }
+
+    /**
+     * @brief Restore the learned workload profile.
+     * @param[in] buffer The buffer.
+     * @param[in] size The size of the buffer, in bytes.
+     * @return True on success.
+     */
+    bool restore(const uint8_t *const buffer, const size_t size)
+    {
+        AbortIfNot(size == sizeof(m_profile), false);
+
+        memcpy(m_profile, buffer, sizeof(m_profile));
+
+        return true;
+    }
+
+private:
+    /**
+     * @brief Get a window of the day.
+     * @param[in] offset_ns The offset from now, in nanoseconds.
+     * @return The index of the window.
+     */
+    static uint32_t window(const uint64_t offset_ns)
+    {
+        return (timeOfDay() + offset_ns) / 1000000000ull / k_windowDuration %
+            k_windows;
+    }
+
+    /**
+     * @brief Get the time of the day, or of the virtual day when a virtual
+     *        clock is attached.
+     * @return The time, in nanoseconds.
+     */
+    static uint64_t timeOfDay()
+    {
+        if (VirtualClock::current()) {
+            return VirtualClock::now() % 86400000000000ull;
+        }
+
+        return readClock(CLOCK_REALTIME) % 86400000000000ull;
+    }
+
+    /**
+     * @brief Whether a window of the day is predicted idle.
+     * @param[in] window The index of the window.
+     * @return True when the window was idle lately.
+     */
+    bool predictedIdle(const uint32_t window) const
+    {
+        return m_profile[window] * 100u <
+            m_policy.idleThreshold_pct * static_cast<uint32_t>(k_busyLevel);
+    }
+
+    /**
+     * @brief Find the next window predicted idle, or the least busy window,
+     *        before the deadline.
+     * @param[in] now The current time, in nanoseconds.
+     * @return The start of the window, in nanoseconds.
+     */
+    uint64_t nextIdleWindow(const uint64_t now) const
+    {
+        const uint64_t duration_ns = k_windowDuration * 1000000000ull;
+        const uint64_t start_ns = duration_ns - timeOfDay() % duration_ns;
+
+        uint64_t best = m_deadline_ns;
+        uint16_t bestLevel = UINT16_MAX;
+        for (uint64_t offset = start_ns; now + offset < m_deadline_ns;
+             offset += duration_ns) {
+            const uint32_t next = window(offset);
+            if (predictedIdle(next)) {
+                return now + offset;
+            }
+
+            if (m_profile[next] < bestLevel) {
+                best = now + offset;
+                bestLevel = m_profile[next];
+            }
+        }
+
+        return best;
+    }
+
+    /**
+     * @brief Defer the pending update.
+     * @param[in] time The time to install the update, in nanoseconds.
+     * @return True on success.
+     */
+    bool defer(const uint64_t time)
+    {
+        const uint64_t now = VirtualClock::now();
+
+        /*
+         * Round the deferral up, without exceeding the deadline.
+         */
+        const uint64_t remaining_m =
+            m_deadline_ns > now ? (m_deadline_ns - now) / 60000000000ull : 0;
+        uint64_t deferral_m = (time - now + 59999999999ull) / 60000000000ull;
+        if (deferral_m > remaining_m) {
+            deferral_m = remaining_m;
+        }
+
+        if (!deferral_m) {
+            return install();
+        }
+
+        AbortErrno(SysEvent_DeferEvent(SysEvent_Events_UpdateReadyForInstall,
+                                       deferral_m),
+                   false);
+        m_install_ns = now + deferral_m * 60000000000ull;
+
+        Log_Debug("Update deferred by %u minute(s)\n",
+                  static_cast<uint32_t>(deferral_m));
+
+        return true;
+    }
+
+    /**
+     * @brief Install the pending update.
+     * @return True on success.
+     */
+    bool install()
+    {
+        if (m_install_ns) {
+            AbortErrno(SysEvent_ResumeEvent(
+                        SysEvent_Events_UpdateReadyForInstall),
+                       false);
+            m_install_ns = 0;
+        }
+        m_deadline_ns = 0;
+
+        Log_Debug("Update allowed\n");
+
+        return true;
+    }
+
+    /**
+     * @brief Sampling timer callback. Learns the workload profile, and
+     *        installs the deferred update when the workload is idle in a
+     *        window predicted idle.
+     */
+    void sample()
+    {
+        const bool isBusy = busy();
+        const uint32_t current = window(0);
+
+        /*
+         * Exponential moving average, over about 16 samples. The division
+         * truncates, which leaves the level at most 15/256 away from the
+         * bounds thanks to the fractional part.
+         */
+        const int level = m_profile[current];
+        m_profile[current] = static_cast<uint16_t>(
+            level + ((isBusy ? k_busyLevel : 0) - level) / 16);
+
+        if (m_install_ns && !isBusy && predictedIdle(current)) {
+            AbortIfNot(install());
+        }
+    }
+
+    /**
+     * The parameters of the policy.
+     */
+    Policy m_policy;
+
+    /**
+     * The callback returning the backlog of the application.
+     */
+    Delegate<uint32_t()> m_backlog;
+
+    /**
+     * The timer sampling the workload.
+     */
+    Timer m_sampleTimer;
+
+    /**
+     * The depth of the critical sections.
+     */
+    uint32_t m_critical;
+
+    /**
+     * The deadline to install the pending update, in nanoseconds, or 0 when no
+     * update is pending.
+     */
+    uint64_t m_deadline_ns;
+
+    /**
+     * The time the pending update is deferred to, in nanoseconds, or 0 when no
+     * update is deferred.
+     */
+    uint64_t m_install_ns;
+
+    /**
+     * How busy each window of the day was lately, from 0 (always idle) to
+     * k_busyLevel (always busy).
+     */
+    uint16_t m_profile[k_windows];
+
+    /**
+     * Whether the policy is initialized.
+     */
+    bool m_initialized;
+};
+
+} /* namespace SpherePlusPlus */
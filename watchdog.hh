@@ -0,0 +1,662 @@
+/**
+ * @file watchdog.hh
+ * @author Matthieu Bucchianeri
+ * @brief Software watchdog, supervising components with their own heartbeat.
+ */
+
+#pragma once
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <time.h>
+
+#include <sphereplusplus/abort.hh>
+#include <sphereplusplus/clock.hh>
+#include <sphereplusplus/delegate.hh>
+#include <sphereplusplus/energy.hh>
+#include <sphereplusplus/timer.hh>
+
+#include <applibs/powermanagement.h>
+
+namespace SpherePlusPlus {
+
+class Watchdog;
+
+/**
+ * @brief A component supervised by the watchdog.
+ *
+ * The component must be petted at least once per period. When it is not, its
+ * restart callback is invoked from the event loop, and the watchdog escalates
+ * to its expiry callback (by default, a reboot) when the component cannot be
+ * restarted.
+ */
+class WatchdogComponent
+{
+public:
+    /**
+     * @brief Constructor.
+     * @param[in] name The name of the component, for diagnostics.
+     */
+    WatchdogComponent(const char *const name) :
+        m_name(name),
+        m_watchdog(nullptr),
+        m_next(nullptr),
+        m_period_ns(0),
+        m_lastPet_ns(0),
+        m_lastSeen_ns(0),
+        m_restart(),
+        m_restarts(0),
+        m_consecutiveRestarts(0),
+        m_nearMisses(0)
+    {
+    }
+
+    /*
+     * Components are linked into the watchdog, and cannot be copied.
+     */
+    WatchdogComponent(const WatchdogComponent &other) = delete;
+    WatchdogComponent &operator =(const WatchdogComponent &other) = delete;
+
+    /**
+     * @brief Destructor.
+     */
+    virtual ~WatchdogComponent()
+    {
+        if (m_watchdog) {
+            destroy();
+        }
+    }
+
+    /**
+     * @brief Register the component with the watchdog.
+     * @param[in] watchdog The watchdog.
+     * @param[in] period_ms The heartbeat period, in milliseconds.
+     * @return True on success.
+     */
+    inline bool init(Watchdog &watchdog, uint32_t period_ms);
+
+    /**
+     * @brief Unregister the component from the watchdog.
+     * @return True on success.
+     */
+    inline bool destroy();
+
+    /**
+     * @brief Connect a class method to restart the component.
+     * @tparam T The class type.
+     * @tparam TMethod The class method, returning true on success.
+     * @param[in] instance The class instance.
+     */
+    template<class T, bool (T::*TMethod)()>
+    void connect(T &instance)
+    {
+        m_restart.connect<T, TMethod>(instance);
+    }
+
+    /**
+     * @brief Connect a static method to restart the component.
+     * @tparam TFunc The static method, returning true on success.
+     */
+    template<bool (*TFunc)()>
+    void connect()
+    {
+        m_restart.connect<TFunc>();
+    }
+
+    /**
+     * @brief Connect a lambda to restart the component.
+     * @tparam LAMBDA The lambda type.
+     * @param[in] instance The closure for the lambda, returning true on
+     *            success.
+     */
+    template <typename LAMBDA>
+    void connect(const LAMBDA &instance)
+    {
+        m_restart.connect<LAMBDA>(instance);
+    }
+
+    /**
+     * @brief Pet the component.
+     * @return True on success.
+     * @note May be invoked from any thread.
+     */
+    bool pet()
+    {
+        AbortIfNot(m_watchdog, false);
+
+        const uint64_t now = readClock();
+        const uint64_t lastPet =
+            __atomic_exchange_n(&m_lastPet_ns, now, __ATOMIC_RELAXED);
+
+        /*
+         * Count the heartbeats that came close to missing the period.
+         */
+        const uint64_t period = __atomic_load_n(&m_period_ns, __ATOMIC_RELAXED);
+        if (lastPet && now - lastPet > period / 4 * 3) {
+            __atomic_add_fetch(&m_nearMisses, 1, __ATOMIC_RELAXED);
+        }
+
+        return true;
+    }
+
+    /**
+     * @brief Change the heartbeat period.
+     * @param[in] period_ms The heartbeat period, in milliseconds.
+     * @return True on success.
+     */
+    bool setPeriod(const uint32_t period_ms)
+    {
+        AbortIfNot(period_ms > 0, false);
+
+        __atomic_store_n(&m_period_ns, period_ms * 1000000ull,
+                         __ATOMIC_RELAXED);
+
+        return true;
+    }
+
+    /**
+     * @brief Get the name of the component.
+     * @return The name of the component.
+     */
+    const char *name() const
+    {
+        return m_name;
+    }
+
+    /**
+     * @brief Get the number of times the component was restarted.
+     * @return The number of restarts.
+     */
+    uint32_t restarts() const
+    {
+        return m_restarts;
+    }
+
+    /**
+     * @brief Get the number of heartbeats that came after more than 3/4 of the
+     *        period.
+     * @return The number of near misses.
+     */
+    uint32_t nearMisses() const
+    {
+        return __atomic_load_n(&m_nearMisses, __ATOMIC_RELAXED);
+    }
+
+private:
+    /**
+     * The name of the component.
+     */
+    const char *const m_name;
+
+    /**
+     * The watchdog supervising the component.
+     */
+    Watchdog *m_watchdog;
+
+    /**
+     * The next component supervised by the watchdog.
+     */
+    WatchdogComponent *m_next;
+
+    /**
+     * The heartbeat period, in nanoseconds.
+     */
+    uint64_t m_period_ns;
+
+    /**
+     * The time of the last heartbeat, in nanoseconds.
+     */
+    uint64_t m_lastPet_ns;
+
+    /**
+     * The time of the last heartbeat seen by the watchdog, in nanoseconds.
+     */
+    uint64_t m_lastSeen_ns;
+
+    /**
+     * The restart callback.
+     */
+    Delegate<bool()> m_restart;
+
+    /**
+     * The number of times the component was restarted.
+     */
+    uint32_t m_restarts;
+
+    /**
+     * The number of restarts since the last heartbeat.
+     */
+    uint32_t m_consecutiveRestarts;
+
+    /**
+     * The number of heartbeats that came after more than 3/4 of the period.
+     */
+    uint32_t m_nearMisses;
+
+    friend class Watchdog;
+};
+
+/**
+ * @brief Software watchdog.
+ *
+ * The components are checked from a timer on the event loop, where they may be
+ * restarted. An independent monitor thread verifies that the event loop itself
+ * keeps checking the components, and expires the watchdog when it does not.
+ */
+class Watchdog
+{
+public:
+    /**
+     * The default period of the checks, in milliseconds.
+     */
+    static constexpr uint32_t k_defaultCheckPeriod = 1000;
+
+    /**
+     * The default time without checks after which the event loop is
+     * considered hung, in milliseconds.
+     */
+    static constexpr uint32_t k_defaultLoopTimeout = 60000;
+
+    /**
+     * The default number of restarts of a component without a heartbeat,
+     * after which the watchdog expires.
+     */
+    static constexpr uint32_t k_defaultMaxRestarts = 3;
+
+    /**
+     * @brief Constructor.
+     */
+    Watchdog() :
+        m_components(nullptr),
+        m_checkTimer(),
+        m_expired(),
+        m_checkPeriod_ms(k_defaultCheckPeriod),
+        m_loopTimeout_ns(k_defaultLoopTimeout * 1000000ull),
+        m_maxRestarts(k_defaultMaxRestarts),
+        m_lastCheck_ns(0),
+        m_monitor(),
+        m_monitorRunning(false),
+        m_lock(),
+        m_wakeup()
+    {
+    }
+
+    /*
+     * The watchdog runs a thread, and cannot be copied.
+     */
+    Watchdog(const Watchdog &other) = delete;
+    Watchdog &operator =(const Watchdog &other) = delete;
+
+    /**
+     * @brief Destructor.
+     */
+    virtual ~Watchdog()
+    {
+        if (m_monitorRunning) {
+            destroy();
+        }
+    }
+
+    /**
+     * @brief Initialize the watchdog.
+     * @param[in] loop_timeout_ms The time without checks after which the event
+     *            loop is considered hung, in milliseconds.
+     * @return True on success.
+     */
+    virtual bool init(const uint32_t loop_timeout_ms = k_defaultLoopTimeout)
+    {
+        AbortIf(m_monitorRunning, false);
+        AbortIfNot(setLoopTimeout(loop_timeout_ms), false);
+        __atomic_store_n(&m_lastCheck_ns, readClock(),
+                         __ATOMIC_RELAXED);
+
+        pthread_condattr_t attr;
+        AbortIfNeq(pthread_condattr_init(&attr), 0, false);
+        int status = pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+        if (status == 0) {
+            status = pthread_cond_init(&m_wakeup, &attr);
+        }
+        pthread_condattr_destroy(&attr);
+        AbortIfNeq(status, 0, false);
+
+        status = pthread_mutex_init(&m_lock, nullptr);
+        if (status != 0) {
+            pthread_cond_destroy(&m_wakeup);
+        }
+        AbortIfNeq(status, 0, false);
+
+        bool started = m_checkTimer.init();
+        if (started) {
+            m_checkTimer.setDeferrable(true);
+            m_checkTimer.connect<Watchdog, &Watchdog::check>(*this);
+            started = m_checkTimer.startPeriodic(m_checkPeriod_ms * 1000ull);
+            if (!started) {
+                m_checkTimer.destroy();
+            }
+        }
+
+        if (started) {
+            /*
+             * The monitor thread waits for the lock, so it only sees the
+             * watchdog running once the thread is created.
+             */
+            pthread_mutex_lock(&m_lock);
+            status = pthread_create(&m_monitor, nullptr, monitor, this);
+            m_monitorRunning = status == 0;
+            pthread_mutex_unlock(&m_lock);
+
+            if (!m_monitorRunning) {
+                m_checkTimer.destroy();
+                started = false;
+            }
+        }
+
+        if (!started) {
+            pthread_mutex_destroy(&m_lock);
+            pthread_cond_destroy(&m_wakeup);
+        }
+        AbortIfNot(started, false);
+
+        return true;
+    }
+
+    /**
+     * @brief Destroy the watchdog.
+     * @return True on success.
+     */
+    virtual bool destroy()
+    {
+        AbortIfNot(m_monitorRunning, false);
+
+        pthread_mutex_lock(&m_lock);
+        m_monitorRunning = false;
+        pthread_cond_signal(&m_wakeup);
+        pthread_mutex_unlock(&m_lock);
+
+        AbortIfNeq(pthread_join(m_monitor, nullptr), 0, false);
+        pthread_cond_destroy(&m_wakeup);
+        pthread_mutex_destroy(&m_lock);
+
+        AbortIfNot(m_checkTimer.destroy(), false);
+
+        return true;
+    }
+
+    /**
+     * @brief Connect a class method to the expiry of the watchdog.
+     * @tparam T The class type.
+     * @tparam TMethod The class method. Its parameter is the component that
+     *         expired, or nullptr when the event loop is hung.
+     * @param[in] instance The class instance.
+     *
+     * @note When the event loop is hung, the callback is invoked from the
+     *       monitor thread. Without a callback, the system is rebooted.
+     */
+    template<class T, void (T::*TMethod)(const WatchdogComponent *)>
+    void connect(T &instance)
+    {
+        m_expired.connect<T, TMethod>(instance);
+    }
+
+    /**
+     * @brief Connect a static method to the expiry of the watchdog.
+     * @tparam TFunc The static method.
+     * @see connect
+     */
+    template<void (*TFunc)(const WatchdogComponent *)>
+    void connect()
+    {
+        m_expired.connect<TFunc>();
+    }
+
+    /**
+     * @brief Get the number of near misses of all the components.
+     * @return The number of near misses.
+     * @see WatchdogComponent::nearMisses
+     */
+    uint32_t nearMisses() const
+    {
+        uint32_t nearMisses = 0;
+        for (const WatchdogComponent *component = m_components; component;
+             component = component->m_next) {
+            nearMisses += component->nearMisses();
+        }
+
+        return nearMisses;
+    }
+
+    /**
+     * @brief Change the time without checks after which the event loop is
+     *        considered hung.
+     * @param[in] loop_timeout_ms The timeout, in milliseconds.
+     * @return True on success.
+     */
+    bool setLoopTimeout(const uint32_t loop_timeout_ms)
+    {
+        AbortIfNot(loop_timeout_ms > m_checkPeriod_ms, false);
+
+        __atomic_store_n(&m_loopTimeout_ns, loop_timeout_ms * 1000000ull,
+                         __ATOMIC_RELAXED);
+
+        return true;
+    }
+
+    /**
+     * @brief Change the number of restarts of a component without a
+     *        heartbeat, after which the watchdog expires.
+     * @param[in] max_restarts The maximum number of restarts.
+     */
+    void setMaxRestarts(const uint32_t max_restarts)
+    {
+        m_maxRestarts = max_restarts;
+    }
+
+private:
+    /**
+     * @brief Check the components. Invoked periodically from the event loop.
+     */
+    void check()
+    {
+        EnergyModel::Scope scope("watchdog");
+        const uint64_t now = readClock();
+        __atomic_store_n(&m_lastCheck_ns, now, __ATOMIC_RELAXED);
+
+        for (WatchdogComponent *component = m_components; component;
+             component = component->m_next) {
+            const uint64_t lastPet =
+                __atomic_load_n(&component->m_lastPet_ns, __ATOMIC_RELAXED);
+            const uint64_t period =
+                __atomic_load_n(&component->m_period_ns, __ATOMIC_RELAXED);
+
+            if (lastPet != component->m_lastSeen_ns) {
+                component->m_lastSeen_ns = lastPet;
+                component->m_consecutiveRestarts = 0;
+            }
+
+            if (now - component->m_lastSeen_ns <= period) {
+                continue;
+            }
+
+            Log_Debug("Watchdog: component %s missed its heartbeat\n",
+                      component->m_name);
+
+            /*
+             * Try restarting the component, and give it another period to
+             * recover.
+             */
+            if (component->m_restart &&
+                component->m_consecutiveRestarts < m_maxRestarts &&
+                component->m_restart()) {
+                component->m_restarts++;
+                component->m_consecutiveRestarts++;
+                component->m_lastSeen_ns = now;
+                continue;
+            }
+
+            expire(component);
+        }
+    }
+
+    /**
+     * @brief Expire the watchdog.
+     * @param[in] component The component that expired, or nullptr when the
+     *            event loop is hung.
+     */
+    void expire(const WatchdogComponent *const component)
+    {
+        if (m_expired) {
+            m_expired(component);
+            return;
+        }
+
+        Log_Debug("Watchdog timeout (%s), rebooting...\n",
+                  component ? component->m_name : "event loop");
+        PowerManagement_ForceSystemReboot();
+    }
+
+    /**
+     * @brief Monitor thread, verifying that the event loop is running the
+     *        checks.
+     * @param[in] context The Watchdog object.
+     * @return Unused.
+     */
+    static void *monitor(void *const context)
+    {
+        Watchdog *const watchdog = static_cast<Watchdog *>(context);
+
+        pthread_mutex_lock(&watchdog->m_lock);
+        while (watchdog->m_monitorRunning) {
+            struct timespec deadline;
+            clock_gettime(CLOCK_MONOTONIC, &deadline);
+            deadline.tv_sec += watchdog->m_checkPeriod_ms / 1000;
+            deadline.tv_nsec += (watchdog->m_checkPeriod_ms % 1000) * 1000000;
+            if (deadline.tv_nsec >= 1000000000) {
+                deadline.tv_sec++;
+                deadline.tv_nsec -= 1000000000;
+            }
+
+            const int status = pthread_cond_timedwait(
+                &watchdog->m_wakeup, &watchdog->m_lock, &deadline);
+            if (status != ETIMEDOUT) {
+                continue;
+            }
+
+            const uint64_t lastCheck =
+                __atomic_load_n(&watchdog->m_lastCheck_ns, __ATOMIC_RELAXED);
+            const uint64_t timeout = __atomic_load_n(
+                &watchdog->m_loopTimeout_ns, __ATOMIC_RELAXED);
+            if (readClock() - lastCheck > timeout) {
+                pthread_mutex_unlock(&watchdog->m_lock);
+                watchdog->expire(nullptr);
+                pthread_mutex_lock(&watchdog->m_lock);
+
+                /*
+                 * Do not expire again until the next timeout.
+                 */
+                __atomic_store_n(&watchdog->m_lastCheck_ns,
+                                 readClock(), __ATOMIC_RELAXED);
+            }
+        }
+        pthread_mutex_unlock(&watchdog->m_lock);
+
+        return nullptr;
+    }
+
+    /**
+     * The supervised components.
+     */
+    WatchdogComponent *m_components;
+
+    /**
+     * The timer running the checks on the event loop.
+     */
+    Timer m_checkTimer;
+
+    /**
+     * The expiry callback.
+     */
+    Delegate<void(const WatchdogComponent *)> m_expired;
+
+    /**
+     * The period of the checks, in milliseconds.
+     */
+    uint32_t m_checkPeriod_ms;
+
+    /**
+     * The time without checks after which the event loop is considered hung,
+     * in nanoseconds.
+     */
+    uint64_t m_loopTimeout_ns;
+
+    /**
+     * The number of restarts of a component without a heartbeat, after which
+     * the watchdog expires.
+     */
+    uint32_t m_maxRestarts;
+
+    /**
+     * The time of the last check, in nanoseconds.
+     */
+    uint64_t m_lastCheck_ns;
+
+    /**
+     * The monitor thread.
+     */
+    pthread_t m_monitor;
+
+    /**
+     * Whether the monitor thread must keep running.
+     */
+    bool m_monitorRunning;
+
+    /**
+     * The lock and condition to wake up the monitor thread.
+     * @{
+     */
+    pthread_mutex_t m_lock;
+    pthread_cond_t m_wakeup;
+    /**
+     * @}
+     */
+
+    friend class WatchdogComponent;
+};
+
+bool WatchdogComponent::init(Watchdog &watchdog, const uint32_t period_ms)
+{
+    AbortIf(m_watchdog, false);
+    AbortIfNot(setPeriod(period_ms), false);
+
+    m_watchdog = &watchdog;
+    m_next = watchdog.m_components;
+    watchdog.m_components = this;
+
+    m_restarts = 0;
+    m_consecutiveRestarts = 0;
+    m_nearMisses = 0;
+    m_lastPet_ns = 0;
+    AbortIfNot(pet(), false);
+
+    return true;
+}
+
+bool WatchdogComponent::destroy()
+{
+    AbortIfNot(m_watchdog, false);
+
+    for (WatchdogComponent **component = &m_watchdog->m_components;
+         *component; component = &(*component)->m_next) {
+        if (*component == this) {
+            *component = m_next;
+            break;
+        }
+    }
+
+    m_watchdog = nullptr;
+    m_next = nullptr;
+
+    return true;
+}
+
+} /* namespace SpherePlusPlus */